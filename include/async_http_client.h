@@ -0,0 +1,87 @@
+#ifndef ASYNC_HTTP_CLIENT_H
+#define ASYNC_HTTP_CLIENT_H
+
+#include <Arduino.h>
+#include <functional>
+#include "config.h"
+#include "http_client.h"
+
+typedef uint32_t HTTPRequestId;
+// response is the first ASYNC_HTTP_RESPONSE_MAX bytes of the body
+typedef std::function<void(int httpCode, const char* response)> HTTPResponseCallback;
+
+// Non-blocking front end for HTTPClientManager.
+//
+// Requests are queued in a bounded table and executed one at a time by a
+// dedicated worker task, which owns the HTTPClientManager (and its
+// keep-alive connections). Completion callbacks are delivered from handle(),
+// i.e. on the caller's loop, so callers never block on network I/O and
+// never run user code on the worker task. Payloads and responses live in
+// fixed buffers in the request slots, so requests do not allocate.
+class AsyncHTTPClient {
+public:
+    // httpCode passed to callbacks when a request is cancelled
+    static const int REQUEST_CANCELLED = -100;
+    // httpCode passed to callbacks when the deadline passed before sending
+    static const int REQUEST_EXPIRED = -101;
+
+    AsyncHTTPClient(HTTPClientManager& client);
+
+    // Start the worker task
+    bool begin();
+
+    // Queue a request; returns 0 if the queue is full or the payload is
+    // longer than ASYNC_HTTP_PAYLOAD_MAX. timeoutMs is the overall
+    // deadline including time spent waiting in the queue: the connect and
+    // the wait for the response together get what is left of it, and
+    // reading the body stops when it passes.
+    HTTPRequestId get(const char* url, HTTPResponseCallback callback,
+                      unsigned long timeoutMs = HTTP_TIMEOUT);
+    HTTPRequestId post(const char* url, const char* jsonPayload, HTTPResponseCallback callback,
+                       unsigned long timeoutMs = HTTP_TIMEOUT);
+
+    // Cancel a queued or running request; its callback will not be called.
+    // A running request stops at its next read of the response body.
+    bool cancel(HTTPRequestId id);
+
+    // Deliver completed requests to their callbacks (call in loop)
+    void handle();
+
+    // Number of requests queued, running or awaiting delivery
+    size_t pending();
+
+private:
+    enum RequestState {
+        REQUEST_FREE,
+        REQUEST_QUEUED,
+        REQUEST_RUNNING,
+        REQUEST_DONE
+    };
+
+    struct Request {
+        HTTPRequestId id;
+        RequestState state;
+        volatile bool cancelled;  // Also read by the worker while running
+        bool post;
+        char url[ASYNC_HTTP_URL_MAX];
+        char payload[ASYNC_HTTP_PAYLOAD_MAX + 1];
+        char response[ASYNC_HTTP_RESPONSE_MAX + 1];
+        int httpCode;
+        unsigned long deadline;
+        HTTPResponseCallback callback;
+    };
+
+    HTTPClientManager& _client;
+    Request _requests[ASYNC_HTTP_QUEUE_SIZE];
+    SemaphoreHandle_t _lock;
+    QueueHandle_t _queue;
+    TaskHandle_t _task;
+    HTTPRequestId _nextId;
+
+    HTTPRequestId submit(bool post, const char* url, const char* payload,
+                         HTTPResponseCallback callback, unsigned long timeoutMs);
+    void process(uint8_t index);
+    static void workerTask(void* parameter);
+};
+
+#endif // ASYNC_HTTP_CLIENT_H
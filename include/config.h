@@ -4,27 +4,142 @@
 // WiFi Configuration
 #define WIFI_SSID_MAX_LENGTH 32
 #define WIFI_PASSWORD_MAX_LENGTH 64
-#define WIFI_RECONNECT_INTERVAL 5000  // ms
-#define WIFI_MAX_RETRY 20
+#define WIFI_RECONNECT_INTERVAL 5000  // ms before the first retry, doubled per failure
+#define WIFI_RECONNECT_MAX_INTERVAL 300000  // ms, cap for the retry backoff
+#define WIFI_NETWORK_ATTEMPTS 2       // Failed attempts before failing over to the next network
+#define WIFI_MAX_NETWORKS 4           // Configured network plus backups
+#define WIFI_BACKUP_SSID ""           // Optional lower-ranked network, "" for none
+#define WIFI_BACKUP_PASSWORD ""
+#define WIFI_CONNECT_TIMEOUT 10000    // ms for a full connect (scan + DHCP)
+#define WIFI_FAST_CONNECT_TIMEOUT 3000  // ms for a cached BSSID/channel connect
+#define WIFI_REUSE_LEASE true         // Fast connect with the cached IP instead of DHCP
+#define WIFI_AP_SSID DEFAULT_DEVICE_NAME  // Setup access point
+#define WIFI_AP_PASSWORD ""           // 8+ characters, or "" for an open AP
+#define WIFI_AP_FALLBACK_TIMEOUT 120000  // ms offline before the setup AP starts (0 = never)
 
 // Web Server Configuration
 #define WEBSERVER_PORT 80
+#define WEB_ASSET_CACHE_CONTROL "public, max-age=86400"  // Non-HTML static files
+#define WEB_ASSETS_EMBEDDED true      // Serve data/ from firmware flash instead of SPIFFS
+#define CONFIG_JSON_MAX 256           // /api/config response buffer
+#define STATUS_REFRESH_INTERVAL 30000 // ms before uptime/heap/RSSI in /api/status refresh
+#define STATUS_BUFFER_SIZE 512        // Serialized /api/status snapshot
+#define STATUS_SNAPSHOTS 3            // Snapshot buffers; a response being sent pins one
+#define STATUS_PUSH_INTERVAL 1000     // ms between checks for status changes to push
+#ifndef STATUS_PUSH_MAX_CLIENTS
+#define STATUS_PUSH_MAX_CLIENTS 4     // Concurrent /api/events subscribers; builds may override it
+#endif
+#define STATUS_PUSH_MAX_QUEUED 4      // Unsent events before pushes to a subscriber wait
+#define STATUS_PUSH_RETRY 5000        // ms browsers wait before reconnecting
+#define JOB_QUEUE_SIZE 8              // Deferred jobs queued or kept for polling
+#define RESTART_DELAY 1000            // ms between answering /api/restart and restarting
+#define WEB_MAX_CONCURRENT 8          // Requests in flight before new ones get 503
+#define WEB_RATE_LIMIT 5              // Requests per second per client IP, sustained
+#define WEB_RATE_BURST 10             // Requests per client IP back to back
+#define WEB_RATE_CLIENTS 8            // Client IPs tracked; least recently seen is evicted
+#define WEB_SHED_FREE_HEAP 32768      // Free heap below which requests get 503
+#define WEB_SHED_LARGEST_BLOCK 8192   // Largest free block below which requests get 503
 
 // OTA Configuration
 #define OTA_HOSTNAME "esp32-device"
 #define OTA_PASSWORD "admin"
+#define OTA_MANIFEST_URL ""           // Pull updates from this manifest (https:// only), "" to disable
+// PEM root CA the update server's certificate must chain to. The manifest
+// carries the image's SHA-256, so pull updates are refused without it.
+#ifndef OTA_CA_CERT
+#define OTA_CA_CERT ""
+#endif
+#define OTA_PULL_INTERVAL 21600000UL  // ms between manifest checks (6 h)
+#define OTA_PULL_FIRST_DELAY 60000    // ms after boot before the first check
+#define OTA_URL_MAX 160
+#define OTA_CHUNK_SIZE 4096           // Download/flash buffer size; two are used
+#define OTA_RESUME_RETRIES 5          // Range resumes without progress before giving up
+#define OTA_TASK_STACK_SIZE 8192       // Download task (TLS needs the room)
+#define OTA_WRITER_STACK_SIZE 3072
+#define OTA_TASK_PRIORITY 1
+#define OTA_TASK_CORE 0               // Download task; the flash writer uses the other core
 
 // HTTP Client Configuration
 #define HTTP_TIMEOUT 5000  // ms
+#define HTTP_KEEP_ALIVE true          // Reuse connections between requests
+#define HTTP_POOL_SIZE 2              // Hosts kept connected at once
+#define HTTP_IDLE_TIMEOUT 30000       // ms before an idle connection is closed
+#define HTTP_HOST_MAX_LENGTH 64
+#define HTTP_STREAM_CHUNK_SIZE 512    // Bytes handed to a body sink at a time
+#define ASYNC_HTTP_QUEUE_SIZE 4       // Outstanding async requests
+#define ASYNC_HTTP_URL_MAX 128
+#define ASYNC_HTTP_PAYLOAD_MAX TELEMETRY_PAYLOAD_MAX  // Largest POST body
+#define ASYNC_HTTP_RESPONSE_MAX 256   // Response bytes kept for the callback, the rest is dropped
+#define ASYNC_HTTP_TASK_STACK_SIZE 8192
+#define ASYNC_HTTP_TASK_PRIORITY 1
+#define ASYNC_HTTP_TASK_CORE 0
+
+// Telemetry Configuration
+#define TELEMETRY_ENDPOINT ""               // e.g. "http://your-server.com/api/data"
+#define TELEMETRY_QUEUE_CAPACITY 32         // Samples buffered in RAM
+#define TELEMETRY_BATCH_SIZE 10             // Samples per upload
+#define TELEMETRY_MAX_AGE 600000            // ms before a partial batch is sent
+#define TELEMETRY_SPILL_FILE "/telemetry.bin"
+#define TELEMETRY_SPILL_MAX_BYTES 65536     // Cap on samples kept while offline
+#define TELEMETRY_PAYLOAD_MAX 1024
+#define TELEMETRY_RETRY_INTERVAL 5000       // ms before retrying a failed upload, doubled per failure
+#define TELEMETRY_RETRY_MAX 300000          // Longest wait between retries
+
+// Sensor Configuration
+#define SENSOR_SAMPLE_INTERVAL 60000  // ms between samples
+#define SENSOR_QUEUE_SIZE 8           // Samples waiting for the main loop (power of two)
+#define SENSOR_TASK_STACK_SIZE 3072
+#define SENSOR_TASK_PRIORITY 2
+#define SENSOR_TASK_CORE 1            // Core 0 runs WiFi, HTTP and log tasks
+
+// Scheduler Configuration
+#ifndef SCHEDULER_MAX_TASKS
+#define SCHEDULER_MAX_TASKS 16        // Task table size; builds may override it
+#endif
+#define SCHEDULER_MAX_WAIT 1000       // ms the main loop sleeps at most
+#define LOOP_POLL_INTERVAL 20         // ms between OTA/WiFi/HTTP result polls
+#define LOOP_HOUSEKEEPING_INTERVAL 100  // ms between web push, telemetry and config polls
+
+// Power Management
+#define POWER_SAVE_ENABLED true       // Frequency scaling, light sleep and modem sleep
+#define POWER_CPU_MAX_MHZ 240
+#define POWER_CPU_MIN_MHZ 80          // Keep >= 80 so the APB/UART clock is stable
+#define POWER_IDLE_POLL_INTERVAL 250  // ms between OTA/WiFi/HTTP polls while not busy
+
+// Heap Monitoring
+#define HEAP_REPORT_INTERVAL 600000   // ms between heap fragmentation log lines
 
 // Serial Configuration
 #define SERIAL_BAUD_RATE 115200
 
+// Logger Configuration
+#define LOG_ASYNC_ENABLED true        // Drain log lines from a background task
+#define LOG_RING_SLOTS 32             // Lines buffered before dropping
+#define LOG_LINE_MAX 160              // Bytes per line, including prefix
+#define LOG_TASK_STACK_SIZE 3072
+#define LOG_TASK_PRIORITY 1
+#define LOG_TASK_CORE 0
+#define LOG_DRAIN_IDLE_MS 100         // Drain wake-up interval when idle
+#define LOG_BINARY_ENABLED false      // Compact binary records (tools/log_decode.py)
+#define LOG_FORMAT_TABLE_SIZE 128     // Distinct format strings in binary mode
+#define LOG_MAX_SINKS 2               // Extra log destinations besides Serial
+
+// Persistent Log Configuration
+#define LOG_PERSIST_ENABLED true
+#define LOG_PERSIST_FILE "/logs.bin"
+#define LOG_PERSIST_PAGE_SIZE 256     // Matches the SPIFFS page size
+#define LOG_PERSIST_PAGES 64          // 16 KB circular log on SPIFFS
+
 // SPIFFS Configuration
 #define FORMAT_SPIFFS_IF_FAILED true
 
 // Application Settings
 #define CONFIG_FILE "/config.json"
+#define FIRMWARE_VERSION "1.0.0"      // Compared with the OTA manifest
+#define CONFIG_VERSION 1              // Config schema version (JSON file and NVS record)
+#define CONFIG_BACKEND_NVS true       // Binary record in NVS instead of CONFIG_FILE
+#define CONFIG_NVS_NAMESPACE "config"
+#define CONFIG_SAVE_DELAY 2000        // ms without changes before config is written
 #define DEFAULT_DEVICE_NAME "ESP32-Device"
 
 #endif // CONFIG_H
@@ -0,0 +1,103 @@
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <Preferences.h>
+#include "config.h"
+
+// Config schema, the single definition the struct, binary record, JSON
+// import/export and checksum are generated from. Each entry is a string
+// field and its maximum length. Append new fields at the end: older
+// binary records are then read as a prefix and the new fields start out
+// empty. Bump CONFIG_VERSION when the schema changes.
+#define DEVICE_CONFIG_FIELDS(FIELD) \
+    FIELD(ssid, WIFI_SSID_MAX_LENGTH) \
+    FIELD(password, WIFI_PASSWORD_MAX_LENGTH)
+
+// Typed device configuration
+struct DeviceConfig {
+#define DEVICE_CONFIG_MEMBER(name, maxLength) char name[(maxLength) + 1];
+    DEVICE_CONFIG_FIELDS(DEVICE_CONFIG_MEMBER)
+#undef DEVICE_CONFIG_MEMBER
+};
+
+// Single owner of the persisted configuration.
+//
+// The config is held in RAM and every read is served from there. Changes
+// are written behind: set() only marks the config dirty, and handle()
+// writes it once no further change has arrived for CONFIG_SAVE_DELAY, so
+// a burst of updates costs one flash write.
+//
+// With CONFIG_BACKEND_NVS the config is one fixed-layout binary record in
+// NVS (versioned, CRC-checked; NVS writes are atomic). A config.json left
+// by older firmware is imported on first boot and then removed.
+//
+// Otherwise it is stored as JSON on SPIFFS: each write goes to a temp file
+// that is renamed over the old one, and the version and CRC in the file
+// let a torn or half-renamed file be detected at boot.
+class ConfigStore {
+public:
+    ConfigStore();
+
+    // Load the config; fs must already be mounted
+    bool begin(fs::FS& fs, const char* path);
+
+    // Copy of the current config
+    DeviceConfig get();
+
+    // Replace the config and schedule a write
+    void set(const DeviceConfig& config);
+    bool setWiFi(const char* ssid, const char* password);
+
+    // True once WiFi credentials are set
+    bool isConfigured();
+
+    // Current config as JSON, as served by /api/config
+    size_t toJSON(char* buffer, size_t size);
+
+    // Write pending changes after CONFIG_SAVE_DELAY (call in loop)
+    void handle();
+
+    // Write pending changes now
+    bool flush();
+
+    // Number of config file writes since boot
+    uint32_t getWriteCount() const;
+
+private:
+    fs::FS* _fs;
+    const char* _path;
+    char _tempPath[40];
+    SemaphoreHandle_t _lock;
+    DeviceConfig _config;
+    bool _dirty;
+    unsigned long _changedAt;
+    uint32_t _writeCount;
+
+    // Binary record stored in NVS
+    struct Record {
+        uint16_t magic;
+        uint8_t version;
+        uint8_t reserved;
+        uint16_t length;  // sizeof(DeviceConfig) when written
+        uint16_t reserved2;
+        uint32_t crc;
+        DeviceConfig config;
+    };
+
+    Preferences _prefs;
+    bool _nvsOpen;
+
+    bool loadFile(const char* path, DeviceConfig& config);
+    bool writeFile(const DeviceConfig& config);
+    bool loadRecord(DeviceConfig& config, bool& outdated);
+    bool writeRecord(const DeviceConfig& config);
+    bool write(const DeviceConfig& config);
+    static void normalize(DeviceConfig& config);
+    static bool equals(const DeviceConfig& a, const DeviceConfig& b);
+    static uint32_t checksum(const DeviceConfig& config);
+    static uint32_t crc32(const uint8_t* data, size_t length, uint32_t crc = 0);
+};
+
+#endif // CONFIG_STORE_H
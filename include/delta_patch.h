@@ -0,0 +1,90 @@
+#ifndef DELTA_PATCH_H
+#define DELTA_PATCH_H
+
+#include <Arduino.h>
+
+// Streaming decoder for binary delta patches made by tools/ota_delta.py.
+// The new image is rebuilt from the running one (the source, memory
+// mapped) and the patch as it arrives, in bounded RAM: the decoder holds
+// a few counters and the patch header, never a whole block.
+//
+// Patch layout, integers little-endian, varints LEB128:
+//   header  "ESPD" u8 version, 3 reserved bytes, u32 source size,
+//           u32 target size, SHA-256 of the source (48 bytes)
+//   ops     ADD     0x01 zigzag(source seek) varint(length), followed by
+//                   runs of varint(same) varint(count) count bytes until
+//                   length is covered. The next length source bytes
+//                   are copied, the first "same" of each run unchanged,
+//                   the following "count" with the patch bytes added
+//                   (mod 256). Moved code where only addresses changed
+//                   costs a few bytes per difference.
+//           INSERT  0x02 varint(length) followed by length new bytes
+//           END     0x00
+// The source position starts at 0, moves by the seek of each ADD and
+// advances past the bytes it copies.
+class DeltaPatch {
+public:
+    static const size_t HEADER_SIZE = 48;
+    static const uint8_t VERSION = 1;
+
+    DeltaPatch();
+
+    // Source image the patch applies to, mapped into memory
+    void begin(const uint8_t* source, size_t sourceSize);
+
+    // Decode into out until it is full, the patch ends or in runs dry.
+    // Returns the number of image bytes produced; state is kept between
+    // calls, so a broken download continues with a new stream positioned
+    // at getConsumed().
+    size_t decode(Stream& in, uint8_t* out, size_t size);
+
+    // Patch bytes read so far
+    size_t getConsumed() const;
+
+    // Image size from the header, 0 until the header has been read
+    size_t getTargetSize() const;
+
+    // Whole image produced
+    bool finished() const;
+
+    // Bad header, wrong source image or corrupt op stream
+    bool failed() const;
+
+private:
+    enum State {
+        STATE_HEADER,
+        STATE_OP,
+        STATE_ADD_SEEK,
+        STATE_ADD_LENGTH,
+        STATE_RUN_SAME,
+        STATE_COPY,
+        STATE_RUN_COUNT,
+        STATE_DIFF,
+        STATE_INSERT_LENGTH,
+        STATE_INSERT,
+        STATE_DONE,
+        STATE_FAILED
+    };
+
+    const uint8_t* _source;
+    size_t _sourceSize;
+    size_t _targetSize;
+    State _state;
+    uint8_t _header[HEADER_SIZE];
+    size_t _headerLength;
+    uint32_t _varint;
+    uint8_t _varintShift;
+    int32_t _seek;
+    size_t _sourcePos;
+    size_t _opRemaining;   // Bytes left in the current ADD or INSERT
+    size_t _runRemaining;  // Bytes left in the current same/count run
+    size_t _produced;
+    size_t _consumed;
+
+    int readByte(Stream& in);
+    int readVarint(Stream& in);
+    bool checkHeader();
+    void fail(const char* reason);
+};
+
+#endif // DELTA_PATCH_H
@@ -0,0 +1,98 @@
+#ifndef FIXED_STRING_H
+#define FIXED_STRING_H
+
+#include <ArduinoJson.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// String with its storage inline, for text that lives long or is built on
+// hot paths (credentials, status fields). Unlike Arduino String it never
+// touches the heap, so it cannot fragment it; text beyond Capacity is
+// cut off and isTruncated() reports it.
+template <size_t Capacity>
+class FixedString {
+public:
+    FixedString() : _length(0), _truncated(false) {
+        _data[0] = '\0';
+    }
+
+    FixedString(const char* text) : FixedString() {
+        append(text);
+    }
+
+    FixedString& operator=(const char* text) {
+        clear();
+        append(text);
+        return *this;
+    }
+
+    // Returns false if text had to be cut off
+    bool append(const char* text) {
+        if (text == nullptr) {
+            return true;
+        }
+        size_t length = strlen(text);
+        size_t room = Capacity - _length;
+        if (length > room) {
+            length = room;
+            _truncated = true;
+        }
+        memcpy(_data + _length, text, length);
+        _length += length;
+        _data[_length] = '\0';
+        return !_truncated;
+    }
+
+    bool appendf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(_data + _length, Capacity + 1 - _length, format, args);
+        va_end(args);
+        if (written < 0) {
+            _data[_length] = '\0';
+            return false;
+        }
+        if ((size_t)written > Capacity - _length) {
+            _length = Capacity;
+            _truncated = true;
+        } else {
+            _length += written;
+        }
+        return !_truncated;
+    }
+
+    void clear() {
+        _length = 0;
+        _truncated = false;
+        _data[0] = '\0';
+    }
+
+    const char* c_str() const { return _data; }
+    size_t length() const { return _length; }
+    bool isEmpty() const { return _length == 0; }
+    bool isTruncated() const { return _truncated; }
+    static constexpr size_t capacity() { return Capacity; }
+
+    bool operator==(const char* text) const {
+        return text != nullptr && strcmp(_data, text) == 0;
+    }
+    bool operator!=(const char* text) const {
+        return !(*this == text);
+    }
+
+private:
+    char _data[Capacity + 1];
+    size_t _length;
+    bool _truncated;
+};
+
+// Lets a FixedString be assigned to a JsonDocument. The text is copied
+// into the document (ArduinoJson copies char* but would keep a const
+// char* by reference), so temporaries are safe.
+template <size_t Capacity>
+bool convertToJson(const FixedString<Capacity>& src, JsonVariant dst) {
+    return dst.set(const_cast<char*>(src.c_str()));
+}
+
+#endif // FIXED_STRING_H
@@ -0,0 +1,60 @@
+#ifndef HTTP_BODY_STREAM_H
+#define HTTP_BODY_STREAM_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <functional>
+
+// Returns true when the caller gives up on the request in progress
+typedef std::function<bool()> HTTPAbortCheck;
+
+// Read-only view of one HTTP response body, read straight off the
+// connection. Chunked transfer framing is removed on the fly, so the body
+// can be consumed piece by piece (or handed to deserializeJson) without
+// ever being held in memory as a whole.
+class HTTPBodyStream : public Stream {
+public:
+    // contentLength < 0 means chunked, or delimited by the server closing
+    HTTPBodyStream(WiFiClient& client, int contentLength, bool chunked, unsigned long timeoutMs);
+
+    // Copy up to maxLen body bytes into buffer; returns 0 at the end of
+    // the body or when the connection stalls for longer than the timeout
+    size_t readChunk(uint8_t* buffer, size_t maxLen);
+
+    // Read and drop the rest of the body
+    bool skipRemaining();
+
+    // Polled while waiting for data; once it returns true reads fail
+    void setAbortCheck(const HTTPAbortCheck& check);
+
+    // Whole body consumed; the connection is at the next response, unless
+    // the body was delimited by the close
+    bool finished() const;
+
+    // Connection timed out or closed in the middle of the body
+    bool failed() const;
+
+    // Stream interface; read() blocks up to the timeout
+    int available() override;
+    int read() override;
+    int peek() override;
+    void flush() override;
+    size_t write(uint8_t data) override;
+
+private:
+    WiFiClient& _client;
+    bool _chunked;
+    bool _inChunk;
+    bool _finished;
+    bool _failed;
+    int32_t _remaining;  // Bytes left in the body or current chunk, -1 until close
+    unsigned long _timeout;
+    int _peeked;
+    HTTPAbortCheck _abortCheck;
+
+    bool nextChunk();
+    bool readLine(char* line, size_t size);
+    size_t readRaw(uint8_t* buffer, size_t length);
+};
+
+#endif // HTTP_BODY_STREAM_H
@@ -2,12 +2,21 @@
 #define HTTP_CLIENT_H
 
 #include <HTTPClient.h>
+#include <WiFiClientSecure.h>
 #include <Arduino.h>
 #include <ArduinoJson.h>
+#include <functional>
+#include "config.h"
+#include "http_body_stream.h"
+
+// Receives a response body in pieces of at most HTTP_STREAM_CHUNK_SIZE
+// bytes; return false to stop reading
+typedef std::function<bool(const uint8_t* data, size_t length)> HTTPBodySink;
 
 class HTTPClientManager {
 public:
     HTTPClientManager();
+    ~HTTPClientManager();
     
     // Send GET request
     int sendGET(const char* url, String& response);
@@ -15,13 +24,72 @@ public:
     // Send POST request with JSON payload
     int sendPOST(const char* url, const char* jsonPayload, String& response);
     
+    // Same, streaming the response body to sink instead of a String
+    int sendGET(const char* url, HTTPBodySink sink);
+    int sendPOST(const char* url, const char* jsonPayload, HTTPBodySink sink);
+    
+    // GET a JSON response, keeping only the fields set in filter
+    int getJSON(const char* url, JsonDocument& doc, const JsonDocument& filter);
+    
     // Send sensor data (example)
     bool sendSensorData(const char* url, float temperature, float humidity);
+    
+    // Keep connections open between requests (per host, up to HTTP_POOL_SIZE)
+    void setKeepAlive(bool enabled);
+    
+    // Close connections idle for longer than HTTP_IDLE_TIMEOUT (call in loop)
+    void handle();
+    
+    // Number of TCP/TLS connections opened since boot
+    uint32_t getConnectionsOpened() const;
+    
+    // Response timeout for subsequent requests (default HTTP_TIMEOUT)
+    void setTimeout(uint16_t timeoutMs);
+    
+    // Connect timeout for subsequent requests (default HTTP_TIMEOUT)
+    void setConnectTimeout(uint16_t timeoutMs);
+    
+    // Finish requests by this millis(): the connect and response timeouts
+    // are cut to what is left of it, the connect's time coming off the
+    // wait for the response. Until clearDeadline().
+    void setDeadline(unsigned long deadline);
+    void clearDeadline();
+    
+    // Give up on a request once check returns true: polled while the body
+    // is read and before a retry. nullptr to clear.
+    void setAbortCheck(HTTPAbortCheck check);
 
 private:
-    HTTPClient _http;
+    // Consumes the response body; returns false if it could not
+    typedef std::function<bool(HTTPBodyStream& body)> BodyHandler;
+    
+    // One kept-alive connection to a scheme/host/port
+    struct Connection {
+        char host[HTTP_HOST_MAX_LENGTH];
+        uint16_t port;
+        bool secure;
+        WiFiClient* client;
+        HTTPClient http;
+        unsigned long lastUsed;
+    };
+    
+    Connection _connections[HTTP_POOL_SIZE];
+    bool _keepAlive;
+    uint16_t _timeout;
+    uint16_t _connectTimeout;
+    bool _hasDeadline;
+    unsigned long _deadline;
+    HTTPAbortCheck _abortCheck;
+    uint32_t _connectionsOpened;
     
+    uint16_t timeLeft(uint16_t timeoutMs) const;
+    int sendRequest(const char* method, const char* url, const char* payload, const BodyHandler& handler);
+    int sendRequest(const char* method, const char* url, const char* payload, String& response);
+    int sendRequest(const char* method, const char* url, const char* payload, HTTPBodySink& sink);
+    Connection* acquire(const char* url);
+    void close(Connection& connection);
     bool isValidURL(const char* url);
+    static bool parseOrigin(const char* url, char* host, size_t hostSize, uint16_t& port, bool& secure);
 };
 
 #endif // HTTP_CLIENT_H
@@ -0,0 +1,64 @@
+#ifndef JOB_QUEUE_H
+#define JOB_QUEUE_H
+
+#include <Arduino.h>
+#include <functional>
+#include "config.h"
+
+typedef uint32_t JobId;
+typedef std::function<bool()> Job;
+
+// Work handed off by the web server callbacks, which run on the AsyncTCP
+// task and must not block it (flash writes, reconnecting, restarting).
+//
+// Handlers submit() a job and answer 202 with its id right away; handle()
+// runs queued jobs in submission order on the main loop. Finished jobs
+// keep their slot, so their outcome can be polled, until the slot is
+// needed for a new job. Safe to submit from any task.
+class JobQueue {
+public:
+    enum JobState {
+        JOB_UNKNOWN,  // Never submitted, or finished long enough ago to be forgotten
+        JOB_QUEUED,
+        JOB_RUNNING,
+        JOB_DONE,
+        JOB_FAILED
+    };
+
+    JobQueue();
+
+    bool begin();
+
+    // Queue job to run no earlier than delayMs from now; type names it in
+    // logs and status and must be a string literal. Returns 0 if every
+    // slot holds a job that has not finished yet.
+    JobId submit(const char* type, Job job, unsigned long delayMs = 0);
+
+    // State and type of a job; JOB_UNKNOWN if it is not in the table
+    JobState getState(JobId id, const char** type = nullptr);
+
+    // Run due jobs (call in loop)
+    void handle();
+
+    // Jobs queued or running
+    size_t pending();
+
+    static const char* stateName(JobState state);
+
+private:
+    struct Entry {
+        JobId id;
+        JobState state;
+        const char* type;
+        unsigned long notBefore;
+        Job job;
+    };
+
+    Entry _entries[JOB_QUEUE_SIZE];
+    SemaphoreHandle_t _lock;
+    JobId _nextId;
+
+    int nextDue();
+};
+
+#endif // JOB_QUEUE_H
@@ -0,0 +1,74 @@
+#ifndef LOG_BINARY_H
+#define LOG_BINARY_H
+
+#include <atomic>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+// Compact binary log encoding, decoded on the host by tools/log_decode.py.
+//
+// Every record is framed as [0xA5][payload length][payload][checksum] so the
+// decoder can resynchronise on a noisy serial line and pass any plain text
+// between frames (boot ROM output, drop notices) straight through.
+//
+// Payload layouts (first byte is record type << 4 | level):
+//   LINE    varint(millis) varint(format id) packed arguments
+//   TEXT    varint(millis) raw message bytes
+//   FORMAT  varint(format id) format string bytes
+//
+// Arguments are packed by walking the printf conversion specifiers: signed
+// integers as zigzag varints, unsigned integers and pointers as varints,
+// floating point as little-endian float32 and strings as varint length
+// followed by the bytes.
+class LogBinary {
+public:
+    static const uint8_t FRAME_SYNC = 0xA5;
+    static const size_t FRAME_OVERHEAD = 3;
+
+    enum RecordType {
+        RECORD_LINE = 1,
+        RECORD_TEXT = 2,
+        RECORD_FORMAT = 3
+    };
+
+    // Each encoder returns the frame length, or 0 if it does not fit in size
+    static size_t encodeLine(uint8_t* buffer, size_t size, uint8_t level, uint32_t timestamp,
+                             uint16_t formatId, const char* format, va_list args);
+    static size_t encodeText(uint8_t* buffer, size_t size, uint8_t level, uint32_t timestamp,
+                             const char* text, size_t length);
+    static size_t encodeFormat(uint8_t* buffer, size_t size, uint16_t formatId, const char* format);
+
+    // Format id of a LINE or FORMAT frame, with its type; -1 for anything else
+    static int formatIdOf(const uint8_t* frame, size_t length, RecordType& type);
+
+private:
+    static bool putVarint(uint8_t* buffer, size_t size, size_t& pos, uint64_t value);
+    static bool putBytes(uint8_t* buffer, size_t size, size_t& pos, const void* data, size_t length);
+    static bool packArguments(uint8_t* buffer, size_t size, size_t& pos, const char* format, va_list args);
+    static size_t finishFrame(uint8_t* buffer, size_t size, size_t pos);
+};
+
+// Lock-free table that interns format string pointers into small ids.
+// Formats are identified by address, so only string literals should be
+// interned. Ids are stable for the lifetime of the firmware.
+class LogFormatTable {
+public:
+    LogFormatTable();
+
+    // Returns the id for format, or -1 if the table is full
+    int intern(const char* format);
+
+    bool isAnnounced(int id) const;
+    void markAnnounced(int id);
+
+    // Format string interned as id, nullptr if none
+    const char* lookup(int id) const;
+
+private:
+    std::atomic<const char*> _formats[LOG_FORMAT_TABLE_SIZE];
+    std::atomic<bool> _announced[LOG_FORMAT_TABLE_SIZE];
+};
+
+#endif // LOG_BINARY_H
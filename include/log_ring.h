@@ -0,0 +1,54 @@
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+// Bounded lock-free multi-producer / single-consumer ring of log lines.
+//
+// All slots are allocated once in begin(). Producers claim a slot, format
+// the line directly into it and publish it; the single consumer (the log
+// drain task) reads lines back in claim order. A line always lives in one
+// slot, so concurrent producers can never interleave (tear) each other's
+// output. When the ring is full the line is dropped and counted instead
+// of blocking the caller.
+class LogRing {
+public:
+    LogRing();
+    ~LogRing();
+
+    // Allocate the ring; slotCount is rounded up to a power of two
+    bool begin(size_t slotCount);
+
+    // Producer side: claim a slot of LOG_LINE_MAX bytes, or nullptr if full
+    char* claim(uint32_t& ticket);
+
+    // Producer side: make a claimed slot visible to the consumer
+    void publish(uint32_t ticket, size_t length);
+
+    // Consumer side: peek at the oldest published line, nullptr if empty
+    const char* peek(size_t& length);
+
+    // Consumer side: release the line returned by peek()
+    void release();
+
+    uint32_t getDroppedCount() const;
+    bool isEmpty() const;
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> sequence;
+        uint16_t length;
+        char data[LOG_LINE_MAX];
+    };
+
+    Slot* _slots;
+    uint32_t _mask;
+    std::atomic<uint32_t> _head;
+    std::atomic<uint32_t> _dropped;
+    std::atomic<uint32_t> _tail;
+};
+
+#endif // LOG_RING_H
@@ -2,6 +2,15 @@
 #define LOGGER_H
 
 #include <Arduino.h>
+#include <stdarg.h>
+#include "log_ring.h"
+#include "log_binary.h"
+
+// Highest level compiled into the firmware (0 = ERROR ... 3 = DEBUG).
+// Override with a build flag, e.g. -D LOG_COMPILE_LEVEL=2 to strip debug calls.
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL 3
+#endif
 
 // Log levels
 enum LogLevel {
@@ -11,11 +20,47 @@ enum LogLevel {
     LOG_DEBUG = 3
 };
 
+// Output encodings
+enum LogFormat {
+    LOG_FORMAT_TEXT = 0,    // "[timestamp] [LEVEL] message" lines
+    LOG_FORMAT_BINARY = 1   // Framed binary records, see log_binary.h
+};
+
+// Additional destination for log records besides Serial. write() is called
+// with complete records from the drain task (or the caller in synchronous
+// mode), so implementations must not log themselves.
+class LogSink {
+public:
+    virtual ~LogSink() {}
+    virtual void write(const char* data, size_t length) = 0;
+};
+
 class Logger {
 public:
     static void begin(unsigned long baudRate);
     static void setLogLevel(LogLevel level);
     
+    // Select the output encoding; binary output is decoded on the host with
+    // tools/log_decode.py
+    static void setFormat(LogFormat format);
+    
+    // Switch to asynchronous mode: lines are queued in a lock-free ring and
+    // written to Serial by a background task instead of the caller
+    static bool beginAsync(size_t slots);
+    
+    // Block until all queued lines have been written (e.g. before restart)
+    static void flush(unsigned long timeoutMs = 1000);
+    
+    // Number of lines dropped because the ring was full
+    static uint32_t getDroppedCount();
+    
+    // Register an extra destination for every record (up to LOG_MAX_SINKS)
+    static bool addSink(LogSink* sink);
+    
+    // Format string behind a binary format id, for sinks that announce
+    // formats again; nullptr if the id is unused
+    static const char* formatString(int id);
+    
     static void error(const char* message);
     static void warn(const char* message);
     static void info(const char* message);
@@ -25,11 +70,69 @@ public:
     static void warn(const String& message);
     static void info(const String& message);
     static void debug(const String& message);
+    
+    // printf-style logging: the line is formatted straight into the ring slot
+    // (or a stack buffer in synchronous mode) without any heap allocation
+    static void errorf(const char* format, ...) __attribute__((format(printf, 1, 2)));
+    static void warnf(const char* format, ...) __attribute__((format(printf, 1, 2)));
+    static void infof(const char* format, ...) __attribute__((format(printf, 1, 2)));
+    static void debugf(const char* format, ...) __attribute__((format(printf, 1, 2)));
+    
+    static bool isEnabled(LogLevel level) { return level <= _logLevel; }
 
 private:
     static LogLevel _logLevel;
+    static LogFormat _format;
+    static LogFormatTable _formats;
+    static LogRing _ring;
+    static TaskHandle_t _drainTask;
+    static uint32_t _reportedDrops;
+    static LogSink* _sinks[LOG_MAX_SINKS];
+    static size_t _sinkCount;
+    
     static void log(LogLevel level, const char* message);
+    static void logf(LogLevel level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+    static void vlog(LogLevel level, const char* format, va_list args);
+    static char* beginRecord(uint32_t& ticket, char* stackBuffer);
+    static void commitRecord(uint32_t ticket, const char* buffer, size_t length);
+    static void writeOut(const char* data, size_t length);
+    static int announceFormat(const char* format);
+    static size_t encodeBinary(char* buffer, size_t size, LogLevel level, int formatId,
+                               const char* format, va_list args);
+    static size_t formatLine(char* buffer, size_t size, LogLevel level, const char* format, va_list args);
+    static void drain();
+    static void drainTask(void* parameter);
     static const char* levelToString(LogLevel level);
 };
 
+// Logging macros: arguments are not evaluated at all when the level is
+// disabled at runtime, and the whole call is compiled out above
+// LOG_COMPILE_LEVEL.
+#define LOG_AT_LEVEL(level, fn, ...) \
+    do { if (Logger::isEnabled(level)) Logger::fn(__VA_ARGS__); } while (0)
+
+#if LOG_COMPILE_LEVEL >= 0
+#define LOG_ERRORF(...) LOG_AT_LEVEL(LOG_ERROR, errorf, __VA_ARGS__)
+#else
+#define LOG_ERRORF(...) do {} while (0)
+#endif
+
+#if LOG_COMPILE_LEVEL >= 1
+#define LOG_WARNF(...) LOG_AT_LEVEL(LOG_WARN, warnf, __VA_ARGS__)
+#else
+#define LOG_WARNF(...) do {} while (0)
+#endif
+
+#if LOG_COMPILE_LEVEL >= 2
+#define LOG_INFOF(...) LOG_AT_LEVEL(LOG_INFO, infof, __VA_ARGS__)
+#else
+#define LOG_INFOF(...) do {} while (0)
+#endif
+
+#if LOG_COMPILE_LEVEL >= 3
+#define LOG_DEBUGF(...) LOG_AT_LEVEL(LOG_DEBUG, debugf, __VA_ARGS__)
+#else
+#define LOG_DEBUGF(...) do {} while (0)
+#endif
+
 #endif // LOGGER_H
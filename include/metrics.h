@@ -0,0 +1,108 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Lightweight metrics, exported at /api/metrics in Prometheus text format.
+//
+// Metrics are normally file-level statics in the module they measure. Each
+// one links itself into a global list when constructed (static
+// initialization, before any task runs), so nothing is allocated and no
+// registration call is needed. Updates are relaxed 32-bit atomic adds (plus
+// a few-instruction critical section for a histogram's 64-bit sum) and can
+// be made from any task or core; a scrape may see a histogram's count
+// and buckets from slightly different moments.
+class Metric {
+public:
+    // Write every registered metric
+    static void writeAll(Print& out);
+
+protected:
+    Metric(const char* name, const char* help, const char* type);
+
+    virtual void writeValues(Print& out) const = 0;
+
+    const char* _name;
+
+private:
+    const char* _help;
+    const char* _type;
+    Metric* _next;
+
+    static Metric* _first;
+};
+
+// Monotonic event count; exported as <name>, use a _total suffix
+class Counter : public Metric {
+public:
+    Counter(const char* name, const char* help);
+
+    void add(uint32_t value = 1) {
+        _value.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    uint32_t get() const {
+        return _value.load(std::memory_order_relaxed);
+    }
+
+protected:
+    void writeValues(Print& out) const override;
+
+private:
+    std::atomic<uint32_t> _value;
+};
+
+// Value read at scrape time from a function, e.g. free heap. Pass type
+// "counter" for monotonic counts another module already keeps.
+class Gauge : public Metric {
+public:
+    typedef double (*Reader)();
+
+    Gauge(const char* name, const char* help, Reader reader, const char* type = "gauge");
+
+protected:
+    void writeValues(Print& out) const override;
+
+private:
+    Reader _reader;
+};
+
+// Latency distribution over fixed buckets from 100us to 5s, recorded in
+// microseconds and exported in seconds
+class Histogram : public Metric {
+public:
+    static const size_t BUCKETS = 10;  // Including +Inf
+
+    Histogram(const char* name, const char* help);
+
+    void record(uint32_t micros);
+
+protected:
+    void writeValues(Print& out) const override;
+
+private:
+    std::atomic<uint32_t> _buckets[BUCKETS];  // Not cumulative
+    // Microseconds. 64 bits, so it does not wrap after ~71 min of recorded
+    // time; the ESP32 has no 64-bit atomics, hence the lock.
+    uint64_t _sum;
+    mutable portMUX_TYPE _sumLock = portMUX_INITIALIZER_UNLOCKED;
+};
+
+// Records the lifetime of the scope into a histogram
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Histogram& histogram)
+        : _histogram(histogram), _start(micros()) {
+    }
+
+    ~ScopedTimer() {
+        _histogram.record(micros() - _start);
+    }
+
+private:
+    Histogram& _histogram;
+    uint32_t _start;
+};
+
+#endif // METRICS_H
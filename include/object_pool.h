@@ -0,0 +1,65 @@
+#ifndef OBJECT_POOL_H
+#define OBJECT_POOL_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed set of preallocated objects, handed out and returned without
+// touching the heap. For short-lived, request-scoped data that would
+// otherwise be allocated per request and leave holes in the heap.
+//
+// Lock-free: a bit per slot in one atomic word, claimed with a CAS, so any
+// task (or the AsyncTCP callbacks) may acquire and release. Objects are not
+// constructed or reset between uses; the caller fills them in.
+template <typename T, size_t Capacity>
+class ObjectPool {
+    static_assert(Capacity >= 1 && Capacity <= 32, "ObjectPool holds 1 to 32 objects");
+
+public:
+    ObjectPool() : _used(0), _exhausted(0) {
+    }
+
+    // nullptr when every object is in use
+    T* acquire() {
+        uint32_t used = _used.load(std::memory_order_relaxed);
+        for (;;) {
+            uint32_t free = ~used & FULL;
+            if (free == 0) {
+                _exhausted.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            uint32_t bit = free & -free;
+            if (_used.compare_exchange_weak(used, used | bit, std::memory_order_acquire,
+                                            std::memory_order_relaxed)) {
+                return &_items[__builtin_ctz(bit)];
+            }
+        }
+    }
+
+    void release(T* item) {
+        if (item < _items || item >= _items + Capacity) {
+            return;
+        }
+        size_t index = item - _items;
+        _used.fetch_and(~(1u << index), std::memory_order_release);
+    }
+
+    size_t available() const {
+        return Capacity - __builtin_popcount(_used.load(std::memory_order_relaxed));
+    }
+
+    // Times acquire() found the pool empty
+    uint32_t getExhaustedCount() const {
+        return _exhausted.load(std::memory_order_relaxed);
+    }
+
+private:
+    static const uint32_t FULL = (Capacity == 32) ? 0xFFFFFFFFu : ((1u << Capacity) - 1);
+
+    T _items[Capacity];
+    std::atomic<uint32_t> _used;
+    std::atomic<uint32_t> _exhausted;
+};
+
+#endif // OBJECT_POOL_H
@@ -3,7 +3,33 @@
 
 #include <ArduinoOTA.h>
 #include <Arduino.h>
+#include "config.h"
 
+class DeltaPatch;
+
+// Firmware updates, pushed over the LAN with ArduinoOTA or pulled over
+// HTTPS from a manifest (server certificate verified against OTA_CA_CERT;
+// plain HTTP is refused):
+//
+//   {"version": "1.1.0", "url": "https://.../firmware.bin",
+//    "size": 912384, "sha256": "<64 hex digits>"}
+//
+// A pull runs in its own task. The download and the flash writes overlap:
+// the network side fills one of two OTA_CHUNK_SIZE buffers while a writer
+// task on the other core flashes the previous one. The image is hashed as
+// it streams by and only marked bootable if the SHA-256 matches. A broken
+// connection is resumed with a Range request from the last byte received.
+//
+// The manifest may also list delta patches (tools/ota_delta.py), each made
+// against the image of an older version:
+//
+//   "patches": [{"from": "1.0.0", "url": "https://.../1.0.0-1.1.0.patch",
+//                "size": 48211}]
+//
+// A patch whose "from" is FIRMWARE_VERSION is downloaded instead of the
+// image and applied against the running partition on the fly (see
+// DeltaPatch). The result is checked against the same SHA-256; if
+// anything goes wrong the full image is downloaded instead.
 class OTAManager {
 public:
     OTAManager();
@@ -16,11 +42,55 @@ public:
     
     // Check if OTA update is in progress
     bool isUpdating();
+    
+    // Fetch the manifest and install the image if its version differs
+    // from FIRMWARE_VERSION. Runs in the background; false if a check or
+    // update is already running.
+    bool checkForUpdate(const char* manifestUrl);
+    
+    // Percent of the current pull update written, -1 if none is running
+    int getProgress();
+    
+    // A pulled image was verified; restart to boot into it
+    bool isRestartPending();
 
 private:
-    bool _updating;
+    volatile bool _updating;
+    volatile bool _restartPending;
+    volatile size_t _written;
+    size_t _imageSize;
+    TaskHandle_t _pullTask;
+    char _manifestUrl[OTA_URL_MAX];
+    
+    // Download/flash pipeline. Buffer indices circulate between the two
+    // queues: empty buffers go to the download task, filled ones to the
+    // writer. OTA_NO_BUFFER tells the writer to stop.
+    uint8_t* _buffers[2];
+    size_t _lengths[2];
+    QueueHandle_t _freeBuffers;
+    QueueHandle_t _fullBuffers;
+    SemaphoreHandle_t _writerDone;
+    volatile bool _writeFailed;
+    
+    struct Manifest {
+        char version[32];
+        char url[OTA_URL_MAX];
+        size_t size;
+        char sha256[65];
+        char patchUrl[OTA_URL_MAX];  // "" if no patch from FIRMWARE_VERSION
+        size_t patchSize;
+    };
     
     void setupCallbacks();
+    void pull();
+    bool fetchManifest(Manifest& manifest);
+    bool installPatch(const Manifest& manifest);
+    bool install(const char* url, size_t downloadSize, const Manifest& manifest, DeltaPatch* patch);
+    bool download(const char* url, size_t size, const Manifest& manifest, DeltaPatch* patch);
+    bool startPipeline();
+    void stopPipeline();
+    static void pullTask(void* parameter);
+    static void writerTask(void* parameter);
 };
 
 #endif // OTA_MANAGER_H
@@ -0,0 +1,68 @@
+#ifndef PERSISTENT_LOG_H
+#define PERSISTENT_LOG_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "config.h"
+#include "log_binary.h"
+#include "logger.h"
+
+// Crash-surviving log store, registered with Logger::addSink().
+//
+// Records are collected in a page buffer that lives in RTC memory, so the
+// most recent lines survive a soft reset or panic, and are written to a
+// fixed-size circular file on SPIFFS one whole page at a time. Pages are
+// overwritten round-robin (oldest first), which spreads erases evenly over
+// the file and avoids the append/truncate churn of a growing log file.
+//
+// Binary records (LOG_FORMAT_BINARY) refer to format strings that Logger
+// announces once per boot, and the page holding an announcement is soon
+// overwritten. So each page announces the formats its lines use itself,
+// ahead of the first such line, and the log decodes from any page on.
+class PersistentLog : public LogSink {
+public:
+    // Position of a reader walking the log from oldest to newest record
+    struct Cursor {
+        Cursor() : started(false), startPage(0), pagesRead(0), offset(0) {}
+        bool started;
+        uint16_t startPage;
+        uint16_t pagesRead;
+        uint16_t offset;
+    };
+
+    PersistentLog();
+
+    // Open (or create) the circular log file; fs must already be mounted
+    bool begin(fs::FS& fs, const char* path);
+
+    // LogSink: buffer a record and write out every completed page
+    void write(const char* data, size_t length) override;
+
+    // Copy the next part of the log into buffer; returns 0 at the end
+    size_t read(Cursor& cursor, uint8_t* buffer, size_t maxLen);
+
+    // Number of page writes issued to flash since boot
+    uint32_t getPageWrites() const;
+
+private:
+    struct PageHeader {
+        uint32_t sequence;
+        uint16_t length;
+        uint16_t reserved;
+    };
+
+    File _file;
+    SemaphoreHandle_t _lock;
+    uint16_t _writePage;
+    uint32_t _sequence;
+    uint32_t _pageWrites;
+    uint32_t _pageFormats[(LOG_FORMAT_TABLE_SIZE + 31) / 32];  // Announced in the page being filled
+
+    bool openFile(fs::FS& fs, const char* path);
+    void findWritePosition();
+    void announce(int formatId);
+    void append(const char* data, size_t length);
+    void writePage();
+};
+
+#endif // PERSISTENT_LOG_H
@@ -0,0 +1,50 @@
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <Arduino.h>
+#include <esp_pm.h>
+#include "config.h"
+
+// Power policy for the time between scheduled work.
+//
+// With POWER_SAVE_ENABLED the CPU clock scales down to POWER_CPU_MIN_MHZ
+// when idle and the chip enters light sleep whenever every task is
+// blocked: the main loop sleeping until the scheduler's next deadline
+// (wake on timer) and the network tasks waiting for traffic (wake on
+// network, the radio keeps the association in modem sleep and wakes for
+// beacons). Light sleep needs an SDK built with tickless idle; without it
+// only frequency scaling and modem sleep are used, and with no power
+// management in the SDK at all only modem sleep.
+//
+// While busy (OTA update, HTTP requests in flight) the CPU is held at full
+// speed, light sleep is blocked and WiFi power save is off for throughput.
+class PowerManager {
+public:
+    PowerManager();
+
+    // Apply the power configuration; call after WiFi is started
+    void begin();
+
+    // Stay fully awake while busy
+    void setBusy(bool busy);
+    bool isBusy() const;
+
+    // Sleep until the next deadline (use instead of delay() in loop)
+    void idle(unsigned long ms);
+
+    // Share of time since boot that loop() spent awake, 0..1
+    float getDutyCycle() const;
+
+    bool isLightSleepEnabled() const;
+
+private:
+    bool _enabled;
+    bool _scaling;     // PM configured and its locks created
+    bool _busy;
+    bool _lightSleep;
+    esp_pm_lock_handle_t _cpuLock;
+    esp_pm_lock_handle_t _sleepLock;
+    unsigned long _idleTime;
+};
+
+#endif // POWER_MANAGER_H
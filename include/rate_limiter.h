@@ -0,0 +1,35 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Per-client token buckets: each client may make burst requests back to
+// back, then ratePerSecond sustained. Clients are keyed by IPv4 address in
+// a fixed table of WEB_RATE_CLIENTS; a new client takes the slot of the one
+// seen least recently, starting with a full bucket.
+//
+// Not locked: only the AsyncTCP task calls allow().
+class RateLimiter {
+public:
+    RateLimiter(uint32_t ratePerSecond, uint32_t burst);
+
+    // Take a token for client. Returns false, with the ms until the next
+    // token in retryAfterMs, when its bucket is empty.
+    bool allow(uint32_t client, uint32_t& retryAfterMs);
+
+private:
+    struct Bucket {
+        uint32_t client;       // 0 = free slot
+        uint32_t tokens;       // In thousandths of a request
+        unsigned long updatedAt;
+    };
+
+    Bucket _buckets[WEB_RATE_CLIENTS];
+    uint32_t _rate;
+    uint32_t _capacity;        // burst, in thousandths
+
+    Bucket& find(uint32_t client, unsigned long now);
+};
+
+#endif // RATE_LIMITER_H
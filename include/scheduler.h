@@ -0,0 +1,68 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Cooperative scheduler for the main loop.
+//
+// Subsystems register periodic or one-shot tasks; run() calls the ones
+// that are due and returns how long the loop may sleep until the next
+// deadline. Tasks live in a fixed table (SCHEDULER_MAX_TASKS) ordered by
+// a binary min-heap of deadlines, so nothing is allocated after startup
+// and finding the next task is O(1), adding or removing one O(log n).
+//
+// Not thread-safe: register, cancel and run from the loop task only.
+class Scheduler {
+public:
+    typedef void (*Callback)();
+    typedef unsigned long (*Clock)();
+
+    static const int INVALID_TASK = -1;
+
+    // clock is millis() on the device; tests can pass a fake one
+    explicit Scheduler(Clock clock = millis);
+
+    // Call callback every interval ms, the first time after firstDelay
+    int every(unsigned long interval, Callback callback, unsigned long firstDelay = 0);
+
+    // Call callback once, delay ms from now
+    int after(unsigned long delay, Callback callback);
+
+    // Remove a task; also works from inside its own callback
+    bool cancel(int id);
+
+    // Change the interval of a periodic task; a shorter interval takes
+    // effect right away, a longer one after the next run
+    bool setInterval(int id, unsigned long interval);
+
+    // Run all due tasks; returns ms until the next deadline, at most
+    // SCHEDULER_MAX_WAIT
+    unsigned long run();
+
+    // Number of registered tasks
+    int size() const;
+
+private:
+    struct Task {
+        Callback callback;
+        unsigned long deadline;
+        unsigned long interval;  // 0 for one-shot tasks
+        int heapIndex;           // -1 while the slot is free
+    };
+
+    Clock _clock;
+    Task _tasks[SCHEDULER_MAX_TASKS];
+    int _heap[SCHEDULER_MAX_TASKS];  // Task slots, earliest deadline first
+    int _heapSize;
+
+    int add(unsigned long delay, unsigned long interval, Callback callback);
+    void push(int slot);
+    void remove(int heapIndex);
+    void siftUp(int heapIndex);
+    void siftDown(int heapIndex);
+    void swap(int a, int b);
+    bool before(int a, int b) const;
+};
+
+#endif // SCHEDULER_H
@@ -0,0 +1,43 @@
+#ifndef SENSOR_TASK_H
+#define SENSOR_TASK_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "spsc_queue.h"
+#include "telemetry_queue.h"
+
+// Sensor acquisition on its own task, pinned to SENSOR_TASK_CORE.
+//
+// The task samples every SENSOR_SAMPLE_INTERVAL on a fixed tick grid, so
+// slow network or flash work in the main loop never delays or skews a
+// reading. Samples are handed to the main loop through a lock-free SPSC
+// queue; read() is the consumer side. When the loop falls behind and the
+// queue is full, new samples are dropped and counted.
+class SensorTask {
+public:
+    typedef TelemetryQueue::Sample Sample;
+
+    // Fills in one reading; false if the sensor did not answer
+    typedef bool (*Reader)(float& temperature, float& humidity);
+
+    SensorTask();
+
+    // Start the task
+    bool begin(Reader reader);
+
+    // Consumer side: next sample, false if none is waiting
+    bool read(Sample& sample);
+
+    uint32_t getSampleCount() const;
+    uint32_t getDroppedCount() const;
+
+private:
+    Reader _reader;
+    TaskHandle_t _task;
+    SpscQueue<Sample, SENSOR_QUEUE_SIZE> _queue;
+    volatile uint32_t _sampleCount;
+
+    static void sensorTask(void* parameter);
+};
+
+#endif // SENSOR_TASK_H
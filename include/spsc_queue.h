@@ -0,0 +1,64 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bounded lock-free single-producer / single-consumer queue.
+//
+// Hands values from one task to another, typically across cores, without
+// a mutex: the producer only writes _head, the consumer only writes _tail,
+// and the acquire/release pair on those indices orders the slot accesses.
+// Storage is part of the object; Capacity must be a power of two. push()
+// fails instead of blocking when the queue is full.
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "SpscQueue capacity must be a power of two");
+
+public:
+    SpscQueue() : _head(0), _tail(0), _dropped(0) {
+    }
+
+    // Producer side
+    bool push(const T& value) {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) == Capacity) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        _items[head & (Capacity - 1)] = value;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side
+    bool pop(T& value) {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if (_head.load(std::memory_order_acquire) == tail) {
+            return false;
+        }
+        value = _items[tail & (Capacity - 1)];
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Approximate when called while the other side is active
+    size_t size() const {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+
+    uint32_t getDroppedCount() const {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    T _items[Capacity];
+    // Written by different cores; kept apart from each other
+    alignas(32) std::atomic<uint32_t> _head;
+    alignas(32) std::atomic<uint32_t> _tail;
+    std::atomic<uint32_t> _dropped;
+};
+
+#endif // SPSC_QUEUE_H
@@ -0,0 +1,64 @@
+#ifndef STATUS_CACHE_H
+#define STATUS_CACHE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <functional>
+#include "config.h"
+
+// Serialized /api/status snapshot with an ETag.
+//
+// The snapshot is rebuilt only when the fingerprint (a hash of the fields
+// that must show up immediately, e.g. WiFi state and IP) changes, or when
+// STATUS_REFRESH_INTERVAL has passed for slowly drifting values such as
+// uptime and free heap. Unchanged polls are answered from the buffer, or
+// with a 304 when the client already has it. Safe to use from the web
+// server callbacks and the main loop at the same time.
+//
+// A response sends its snapshot after the handler returned, for as long as
+// the client takes, so readers pin the snapshot they use. Rebuilds only go
+// into unpinned buffers; with all of them pinned the current one is kept
+// and the rebuild waits for the next acquire().
+class StatusCache {
+public:
+    typedef std::function<void(JsonDocument& doc)> Builder;
+    typedef std::function<uint32_t()> Fingerprint;
+
+    struct Snapshot {
+        char body[STATUS_BUFFER_SIZE];
+        size_t length;
+        char etag[12];  // "xxxxxxxx" including quotes
+        uint8_t pins;
+    };
+
+    StatusCache();
+
+    void begin(Builder builder, Fingerprint fingerprint);
+
+    // Force a rebuild on the next get()
+    void invalidate();
+
+    // Current snapshot, rebuilt first if stale. It stays unchanged until
+    // it is given back with release(). Never nullptr.
+    const Snapshot* acquire();
+    void release(const Snapshot* snapshot);
+
+    // Number of times the snapshot was rebuilt since boot
+    uint32_t getRebuildCount() const;
+
+private:
+    Snapshot _snapshots[STATUS_SNAPSHOTS];
+    SemaphoreHandle_t _lock;
+    uint8_t _current;
+    bool _valid;
+    volatile bool _invalidated;
+    uint32_t _fingerprint;
+    unsigned long _builtAt;
+    uint32_t _rebuilds;
+    Builder _builder;
+    Fingerprint _fingerprintCallback;
+
+    void rebuild(uint32_t fingerprint);
+};
+
+#endif // STATUS_CACHE_H
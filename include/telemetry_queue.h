@@ -0,0 +1,86 @@
+#ifndef TELEMETRY_QUEUE_H
+#define TELEMETRY_QUEUE_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "config.h"
+#include "async_http_client.h"
+
+// Batched telemetry uplink.
+//
+// Samples are collected in a fixed-capacity RAM queue and uploaded as one
+// columnar JSON payload once TELEMETRY_BATCH_SIZE samples are waiting or the
+// oldest one is TELEMETRY_MAX_AGE old. While the uplink is down a full queue
+// is spilled to a SPIFFS file, which is drained (oldest first) once the
+// connection is back, so samples survive outages and reboots. Uploads go
+// through AsyncHTTPClient, one batch in flight at a time, so handle() never
+// blocks on the network. After a failed upload the next attempt waits
+// TELEMETRY_RETRY_INTERVAL, doubling per failure up to TELEMETRY_RETRY_MAX,
+// so a down server is not hammered; a success resets the wait.
+//
+// Payload example (timestamps are deltas from t0):
+//   {"device":"ESP32-Device","t0":120000,"dt":[0,60000,120000],
+//    "temperature":[22.51,22.48,22.60],"humidity":[55.20,55.10,54.90]}
+class TelemetryQueue {
+public:
+    struct Sample {
+        uint32_t timestamp;
+        float temperature;
+        float humidity;
+    };
+
+    TelemetryQueue();
+
+    // Set the upload endpoint and the filesystem used for spilling
+    void begin(AsyncHTTPClient& client, fs::FS& fs, const char* url);
+
+    // Queue a sample; never blocks on the network
+    void add(float temperature, float humidity);
+    void add(const Sample& sample);  // Keeps the sample's own timestamp
+
+    // Upload or spill as needed (call in loop); online = uplink usable
+    void handle(bool online);
+
+    uint32_t getSamplesSent() const;
+    uint32_t getRequestsSent() const;
+    uint32_t getBytesSent() const;
+    uint32_t getSamplesDropped() const;
+    uint32_t getUploadsFailed() const;
+
+private:
+    Sample _samples[TELEMETRY_QUEUE_CAPACITY];
+    size_t _head;
+    size_t _count;
+
+    AsyncHTTPClient* _client;
+    fs::FS* _fs;
+    const char* _url;
+    char _payload[TELEMETRY_PAYLOAD_MAX];
+
+    uint32_t _samplesSent;
+    uint32_t _requestsSent;
+    uint32_t _bytesSent;
+    uint32_t _samplesDropped;
+
+    // Batch currently being uploaded
+    bool _inFlight;
+    bool _inFlightSpilled;
+    size_t _inFlightCount;
+
+    // Backoff after failed uploads; 0 when the last one succeeded
+    uint32_t _uploadsFailed;
+    unsigned long _retryDelay;
+    unsigned long _failedAt;
+
+    void uploadSpilled();
+    void uploadQueued();
+    bool upload(const Sample* samples, size_t count, bool spilled);
+    void onUploadComplete(int httpCode);
+    void commitSpilled(size_t count);
+    size_t buildPayload(const Sample* samples, size_t count);
+    bool appendValue(size_t& pos, size_t index, float value);
+    bool append(size_t& pos, const char* format, ...) __attribute__((format(printf, 3, 4)));
+    void spill();
+};
+
+#endif // TELEMETRY_QUEUE_H
@@ -0,0 +1,23 @@
+#ifndef WEB_ASSETS_H
+#define WEB_ASSETS_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Web UI file compiled into the firmware image (WEB_ASSETS_EMBEDDED).
+// The data is a const array, so it stays in memory-mapped flash and is
+// sent from there without touching SPIFFS.
+struct WebAsset {
+    const char* path;
+    const char* contentType;
+    const uint8_t* data;
+    size_t length;
+    const char* etag;
+    bool gzipped;
+};
+
+// Embedded asset for a request path, or nullptr (always nullptr when
+// WEB_ASSETS_EMBEDDED is false)
+const WebAsset* findWebAsset(const char* path);
+
+#endif // WEB_ASSETS_H
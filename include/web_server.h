@@ -4,6 +4,13 @@
 #include <ESPAsyncWebServer.h>
 #include <SPIFFS.h>
 #include <ArduinoJson.h>
+#include "persistent_log.h"
+#include "status_cache.h"
+#include "config_store.h"
+#include "job_queue.h"
+#include "object_pool.h"
+#include "rate_limiter.h"
+#include "config.h"
 
 class WebServerManager {
 public:
@@ -12,23 +19,78 @@ public:
     // Initialize web server
     void begin();
     
-    // Handle web server
+    // Handle web server; pushes status changes to /api/events subscribers
     void handle();
     
     // Set callbacks
     void onConfigUpdate(std::function<void(const char*, const char*)> callback);
-    void onGetStatus(std::function<String()> callback);
+    void onGetStatus(StatusCache::Builder builder, StatusCache::Fingerprint fingerprint);
+    
+    // Rebuild the cached /api/status response on its next request
+    void invalidateStatus();
+    
+    // Expose a persistent log for download at /api/logs
+    void setPersistentLog(PersistentLog* log);
+    
+    // Config served by /api/config and updated by saving the form
+    void setConfigStore(ConfigStore* store);
+    
+    // Queue for work that must not run on the AsyncTCP task: saving the
+    // config (and the update callback) and restarting
+    void setJobQueue(JobQueue* jobs);
 
 private:
+    friend class AdmissionHandler;
+    
+    enum RejectReason {
+        REJECT_BUSY,           // WEB_MAX_CONCURRENT requests in flight
+        REJECT_LOW_HEAP,       // Below WEB_SHED_FREE_HEAP/WEB_SHED_LARGEST_BLOCK
+        REJECT_RATE_LIMITED    // Client out of tokens
+    };
+    
+    // Why a request was turned away. Kept with the request itself until it
+    // is answered, since other requests are decided in between.
+    struct Rejection {
+        RejectReason reason;
+        uint32_t retryAfterMs;     // For REJECT_RATE_LIMITED
+    };
+    
+    // An /api/events subscriber and the snapshot it was sent last
+    struct EventClient {
+        AsyncEventSourceClient* client;   // nullptr: free slot
+        char etag[12];
+    };
+    
     AsyncWebServer* _server;
+    AsyncEventSource* _events;
+    EventClient _eventClients[STATUS_PUSH_MAX_CLIENTS];
+    SemaphoreHandle_t _eventClientsLock;   // Slots change on the AsyncTCP task
+    char _pushedEtag[12];
+    uint32_t _eventId;
+    unsigned long _lastPushCheck;
     std::function<void(const char*, const char*)> _configUpdateCallback;
-    std::function<String()> _statusCallback;
+    StatusCache _statusCache;
+    PersistentLog* _persistentLog;
+    ConfigStore* _configStore;
+    JobQueue* _jobs;
+    ObjectPool<DeviceConfig, JOB_QUEUE_SIZE> _pendingConfigs;  // Configs waiting for their job
+    RateLimiter _rateLimiter;
     
     void setupRoutes();
+    bool admit(AsyncWebServerRequest* request, Rejection& rejection);
+    void sendRejected(AsyncWebServerRequest* request, const Rejection* rejection);
     void handleRoot(AsyncWebServerRequest* request);
+    bool serveAsset(AsyncWebServerRequest* request);
     void handleConfig(AsyncWebServerRequest* request);
     void handleStatus(AsyncWebServerRequest* request);
     void handleSaveConfig(AsyncWebServerRequest* request);
+    void handleJob(AsyncWebServerRequest* request);
+    void handleRestart(AsyncWebServerRequest* request);
+    void sendAccepted(AsyncWebServerRequest* request, JobId id);
+    void handleLogs(AsyncWebServerRequest* request);
+    void handleMetrics(AsyncWebServerRequest* request);
+    void handleEventsConnect(AsyncEventSourceClient* client);
+    void handleEventsDisconnect(AsyncEventSourceClient* client);
     void handleNotFound(AsyncWebServerRequest* request);
 };
 
@@ -3,40 +3,102 @@
 
 #include <WiFi.h>
 #include <Arduino.h>
+#include "config.h"
+#include "fixed_string.h"
 
+// Non-blocking WiFi station connection.
+//
+// connect() only records the credentials; handle() drives the connection
+// from the main loop and never waits on the radio. After a successful
+// connection the AP's BSSID and channel and the IP lease are cached in RTC
+// memory, so a reconnect (link loss, soft reset, deep sleep wake) first
+// tries to join that AP directly with the cached address, skipping the
+// scan and DHCP. If that fails within WIFI_FAST_CONNECT_TIMEOUT the cache
+// is dropped and a regular scan + DHCP connect follows, after a random
+// delay of up to WIFI_FAST_CONNECT_TIMEOUT.
+//
+// Failed attempts are retried with capped exponential backoff and random
+// jitter, so devices that lost the same AP do not retry in lockstep. Known
+// networks are tried in rank order, moving on after WIFI_NETWORK_ATTEMPTS
+// failures. After WIFI_AP_FALLBACK_TIMEOUT offline the setup access point
+// is started next to the station; it stops again once the station is
+// connected.
 class WiFiManager {
 public:
+    enum State {
+        STATE_IDLE,             // No credentials
+        STATE_PENDING,          // Next attempt starts after _pendingDelay
+        STATE_FAST_CONNECTING,  // Cached BSSID/channel/lease
+        STATE_CONNECTING,       // Full scan + DHCP
+        STATE_CONNECTED
+    };
+
     WiFiManager();
     
     // Initialize WiFi manager
     void begin();
     
-    // Connect to WiFi with stored credentials
-    bool connect(const char* ssid, const char* password);
+    // Make this the top-ranked network and start connecting after delayMs
+    // (returns at once; progress happens in handle())
+    bool connect(const char* ssid, const char* password, unsigned long delayMs = 0);
+    
+    // Add a lower-ranked network to fail over to
+    bool addNetwork(const char* ssid, const char* password);
     
-    // Handle WiFi reconnection
-    void handleReconnect();
+    // Drive connection and reconnection (call in loop)
+    void handle();
     
     // Check if WiFi is connected
     bool isConnected();
     
-    // Get current SSID
-    String getSSID();
+    State getState() const;
+    
+    // Time from the start of the last connection to having an IP (ms)
+    unsigned long getConnectDuration() const;
+    
+    // Setup access point, served next to the station
+    void startAccessPoint();
+    void stopAccessPoint();
+    bool isAccessPointActive() const;
+    
+    // SSID of the network in use (or being tried)
+    FixedString<WIFI_SSID_MAX_LENGTH> getSSID();
     
     // Get IP address
-    String getIPAddress();
+    FixedString<15> getIPAddress();
     
     // Disconnect from WiFi
     void disconnect();
     
-    // Set credentials
+    // Set credentials of the top-ranked network without connecting
     void setCredentials(const char* ssid, const char* password);
 
 private:
-    String _ssid;
-    String _password;
-    unsigned long _lastReconnectAttempt;
+    struct Network {
+        FixedString<WIFI_SSID_MAX_LENGTH> ssid;
+        FixedString<WIFI_PASSWORD_MAX_LENGTH> password;
+    };
+    
+    Network _networks[WIFI_MAX_NETWORKS];  // [0] is set by connect()
+    int _network;
+    State _state;
+    unsigned long _pendingSince;
+    unsigned long _pendingDelay;
+    unsigned long _attemptStartedAt;
+    unsigned long _connectStartedAt;
+    unsigned long _connectDuration;
+    unsigned long _offlineSince;
     int _retryCount;
+    int _networkFailures;
+    bool _apActive;
+    
+    void schedule(unsigned long delayMs);
+    void startAttempt();
+    void attemptFailed();
+    bool selectNextNetwork();
+    unsigned long backoffDelay();
+    void saveCache();
+    bool cacheValid();
     
     void logStatus();
 };
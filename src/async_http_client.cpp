@@ -0,0 +1,241 @@
+#include "async_http_client.h"
+#include "logger.h"
+
+AsyncHTTPClient::AsyncHTTPClient(HTTPClientManager& client)
+    : _client(client), _lock(nullptr), _queue(nullptr), _task(nullptr), _nextId(1) {
+    for (size_t i = 0; i < ASYNC_HTTP_QUEUE_SIZE; i++) {
+        _requests[i].id = 0;
+        _requests[i].state = REQUEST_FREE;
+        _requests[i].cancelled = false;
+        _requests[i].post = false;
+        _requests[i].url[0] = '\0';
+        _requests[i].payload[0] = '\0';
+        _requests[i].response[0] = '\0';
+        _requests[i].httpCode = 0;
+        _requests[i].deadline = 0;
+    }
+}
+
+bool AsyncHTTPClient::begin() {
+    if (_task != nullptr) {
+        return true;
+    }
+
+    _lock = xSemaphoreCreateMutex();
+    _queue = xQueueCreate(ASYNC_HTTP_QUEUE_SIZE, sizeof(uint8_t));
+    if (_lock == nullptr || _queue == nullptr) {
+        Logger::error("Async HTTP: failed to allocate queue");
+        return false;
+    }
+
+    BaseType_t created = xTaskCreatePinnedToCore(
+        workerTask, "http_worker", ASYNC_HTTP_TASK_STACK_SIZE, this,
+        ASYNC_HTTP_TASK_PRIORITY, &_task, ASYNC_HTTP_TASK_CORE);
+
+    if (created != pdPASS) {
+        _task = nullptr;
+        Logger::error("Async HTTP: failed to start worker task");
+        return false;
+    }
+
+    return true;
+}
+
+HTTPRequestId AsyncHTTPClient::get(const char* url, HTTPResponseCallback callback,
+                                   unsigned long timeoutMs) {
+    return submit(false, url, nullptr, callback, timeoutMs);
+}
+
+HTTPRequestId AsyncHTTPClient::post(const char* url, const char* jsonPayload,
+                                    HTTPResponseCallback callback, unsigned long timeoutMs) {
+    return submit(true, url, jsonPayload, callback, timeoutMs);
+}
+
+bool AsyncHTTPClient::cancel(HTTPRequestId id) {
+    if (_lock == nullptr || id == 0) {
+        return false;
+    }
+
+    bool found = false;
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    for (size_t i = 0; i < ASYNC_HTTP_QUEUE_SIZE; i++) {
+        if (_requests[i].state != REQUEST_FREE && _requests[i].id == id) {
+            _requests[i].cancelled = true;
+            found = true;
+            break;
+        }
+    }
+    xSemaphoreGive(_lock);
+
+    return found;
+}
+
+void AsyncHTTPClient::handle() {
+    if (_lock == nullptr) {
+        return;
+    }
+
+    for (size_t i = 0; i < ASYNC_HTTP_QUEUE_SIZE; i++) {
+        Request& request = _requests[i];
+
+        xSemaphoreTake(_lock, portMAX_DELAY);
+        if (request.state != REQUEST_DONE) {
+            xSemaphoreGive(_lock);
+            continue;
+        }
+
+        // Take the results out so the slot can be reused by the callback
+        HTTPResponseCallback callback = request.callback;
+        char response[ASYNC_HTTP_RESPONSE_MAX + 1];
+        memcpy(response, request.response, sizeof(response));
+        int httpCode = request.httpCode;
+        bool cancelled = request.cancelled;
+
+        request.callback = nullptr;
+        request.state = REQUEST_FREE;
+        xSemaphoreGive(_lock);
+
+        if (!cancelled && callback) {
+            callback(httpCode, response);
+        }
+    }
+}
+
+size_t AsyncHTTPClient::pending() {
+    if (_lock == nullptr) {
+        return 0;
+    }
+
+    size_t count = 0;
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    for (size_t i = 0; i < ASYNC_HTTP_QUEUE_SIZE; i++) {
+        if (_requests[i].state != REQUEST_FREE) {
+            count++;
+        }
+    }
+    xSemaphoreGive(_lock);
+
+    return count;
+}
+
+HTTPRequestId AsyncHTTPClient::submit(bool post, const char* url, const char* payload,
+                                      HTTPResponseCallback callback, unsigned long timeoutMs) {
+    if (_task == nullptr || url == nullptr || strlen(url) >= ASYNC_HTTP_URL_MAX) {
+        Logger::error("Async HTTP: client not started or URL too long");
+        return 0;
+    }
+    if (payload != nullptr && strlen(payload) > ASYNC_HTTP_PAYLOAD_MAX) {
+        Logger::error("Async HTTP: payload too long");
+        return 0;
+    }
+
+    xSemaphoreTake(_lock, portMAX_DELAY);
+
+    int index = -1;
+    for (size_t i = 0; i < ASYNC_HTTP_QUEUE_SIZE; i++) {
+        if (_requests[i].state == REQUEST_FREE) {
+            index = i;
+            break;
+        }
+    }
+
+    if (index < 0) {
+        xSemaphoreGive(_lock);
+        LOG_WARNF("Async HTTP: queue full, rejecting request to %s", url);
+        return 0;
+    }
+
+    Request& request = _requests[index];
+    request.id = _nextId++;
+    if (_nextId == 0) {
+        _nextId = 1;
+    }
+    request.state = REQUEST_QUEUED;
+    request.cancelled = false;
+    request.post = post;
+    strncpy(request.url, url, sizeof(request.url));
+    strcpy(request.payload, (payload != nullptr) ? payload : "");
+    request.response[0] = '\0';
+    request.httpCode = 0;
+    request.deadline = millis() + timeoutMs;
+    request.callback = callback;
+    HTTPRequestId id = request.id;
+
+    xSemaphoreGive(_lock);
+
+    // Cannot fail: the queue has one entry per request slot
+    uint8_t slot = index;
+    xQueueSend(_queue, &slot, 0);
+    return id;
+}
+
+void AsyncHTTPClient::process(uint8_t index) {
+    Request& request = _requests[index];
+
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    long remaining = (long)(request.deadline - millis());
+    bool cancelled = request.cancelled;
+    if (!cancelled && remaining > 0) {
+        request.state = REQUEST_RUNNING;
+    }
+    xSemaphoreGive(_lock);
+
+    int httpCode;
+
+    if (cancelled) {
+        httpCode = REQUEST_CANCELLED;
+    } else if (remaining <= 0) {
+        httpCode = REQUEST_EXPIRED;
+    } else {
+        // Only the worker touches the buffers of a running request. The
+        // body is read to the end so the connection can be kept alive;
+        // what does not fit is dropped.
+        size_t length = 0;
+        HTTPBodySink sink = [&request, &length](const uint8_t* data, size_t size) {
+            size_t room = ASYNC_HTTP_RESPONSE_MAX - length;
+            size_t copied = size < room ? size : room;
+            memcpy(request.response + length, data, copied);
+            length += copied;
+            return true;
+        };
+
+        // The connect and the wait for the response share the rest of the
+        // deadline; body reads give up at the deadline or on cancel()
+        _client.setDeadline(request.deadline);
+        _client.setAbortCheck([&request]() {
+            return request.cancelled || (long)(millis() - request.deadline) >= 0;
+        });
+        if (request.post) {
+            httpCode = _client.sendPOST(request.url, request.payload, sink);
+        } else {
+            httpCode = _client.sendGET(request.url, sink);
+        }
+        _client.setAbortCheck(nullptr);
+        _client.clearDeadline();
+        request.response[length] = '\0';
+
+        if (request.cancelled) {
+            httpCode = REQUEST_CANCELLED;
+        }
+    }
+
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    request.httpCode = httpCode;
+    request.state = REQUEST_DONE;
+    xSemaphoreGive(_lock);
+}
+
+void AsyncHTTPClient::workerTask(void* parameter) {
+    AsyncHTTPClient* self = static_cast<AsyncHTTPClient*>(parameter);
+
+    for (;;) {
+        uint8_t index;
+        if (xQueueReceive(self->_queue, &index, pdMS_TO_TICKS(1000)) == pdTRUE) {
+            self->process(index);
+        }
+
+        // Close keep-alive connections that timed out, also while other
+        // hosts keep the queue busy
+        self->_client.handle();
+    }
+}
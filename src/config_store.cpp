@@ -0,0 +1,329 @@
+#include "config_store.h"
+#include <ArduinoJson.h>
+#include "logger.h"
+
+static const uint16_t RECORD_MAGIC = 0xC0F1;
+static const char* RECORD_KEY = "record";
+
+ConfigStore::ConfigStore()
+    : _fs(nullptr), _path(nullptr), _lock(nullptr), _dirty(false), _changedAt(0), _writeCount(0),
+      _nvsOpen(false) {
+    _tempPath[0] = '\0';
+    memset(&_config, 0, sizeof(_config));
+}
+
+bool ConfigStore::begin(fs::FS& fs, const char* path) {
+    if (_lock == nullptr) {
+        _lock = xSemaphoreCreateMutex();
+    }
+
+    _fs = &fs;
+    _path = path;
+    snprintf(_tempPath, sizeof(_tempPath), "%s.tmp", path);
+
+    DeviceConfig config;
+
+    if (CONFIG_BACKEND_NVS) {
+        _nvsOpen = _prefs.begin(CONFIG_NVS_NAMESPACE, false);
+        if (!_nvsOpen) {
+            Logger::error("Config: failed to open NVS, using SPIFFS");
+        }
+
+        bool outdated = false;
+        if (_nvsOpen && loadRecord(config, outdated)) {
+            _config = config;
+            _dirty = outdated;  // Rewrite in the current layout
+            return true;
+        }
+    }
+
+    // A complete temp file is newer than the config file: the previous
+    // save was interrupted before the rename
+    bool interrupted = loadFile(_tempPath, config);
+    bool loaded = interrupted;
+    if (interrupted) {
+        Logger::warn("Config: completing interrupted save");
+    } else {
+        if (_fs->exists(_tempPath)) {
+            _fs->remove(_tempPath);
+        }
+        loaded = loadFile(_path, config);
+        if (!loaded && _fs->exists(_path)) {
+            Logger::error("Config: file corrupt, using defaults");
+        }
+    }
+
+    if (!loaded) {
+        return false;
+    }
+    _config = config;
+
+    if (_nvsOpen) {
+        // One-time import; the JSON file goes once the record is stored
+        if (writeRecord(config)) {
+            _fs->remove(_tempPath);
+            _fs->remove(_path);
+            Logger::info("Config: migrated JSON config to NVS");
+        } else {
+            _dirty = true;
+        }
+    } else {
+        _dirty = interrupted;
+    }
+    return true;
+}
+
+DeviceConfig ConfigStore::get() {
+    if (_lock == nullptr) {
+        return _config;
+    }
+
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    DeviceConfig config = _config;
+    xSemaphoreGive(_lock);
+    return config;
+}
+
+void ConfigStore::set(const DeviceConfig& config) {
+    if (_lock == nullptr) {
+        return;
+    }
+
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    if (!equals(_config, config)) {
+        _config = config;
+        normalize(_config);
+        _dirty = true;
+        _changedAt = millis();
+    }
+    xSemaphoreGive(_lock);
+}
+
+bool ConfigStore::setWiFi(const char* ssid, const char* password) {
+    if (strlen(ssid) > WIFI_SSID_MAX_LENGTH || strlen(password) > WIFI_PASSWORD_MAX_LENGTH) {
+        return false;
+    }
+
+    DeviceConfig config = get();
+    strncpy(config.ssid, ssid, sizeof(config.ssid));
+    strncpy(config.password, password, sizeof(config.password));
+    set(config);
+    return true;
+}
+
+bool ConfigStore::isConfigured() {
+    return get().ssid[0] != '\0';
+}
+
+size_t ConfigStore::toJSON(char* buffer, size_t size) {
+    DeviceConfig config = get();
+
+    StaticJsonDocument<256> doc;
+#define DEVICE_CONFIG_TO_JSON(name, maxLength) doc[#name] = config.name;
+    DEVICE_CONFIG_FIELDS(DEVICE_CONFIG_TO_JSON)
+#undef DEVICE_CONFIG_TO_JSON
+    return serializeJson(doc, buffer, size);
+}
+
+void ConfigStore::handle() {
+    if (_lock == nullptr || !_dirty || millis() - _changedAt < CONFIG_SAVE_DELAY) {
+        return;
+    }
+    flush();
+}
+
+bool ConfigStore::flush() {
+    if (_lock == nullptr) {
+        return false;
+    }
+
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    bool ok = true;
+    if (_dirty) {
+        ok = write(_config);
+        if (ok) {
+            _dirty = false;
+        } else {
+            _changedAt = millis();  // Retry after another CONFIG_SAVE_DELAY
+        }
+    }
+    xSemaphoreGive(_lock);
+    return ok;
+}
+
+uint32_t ConfigStore::getWriteCount() const {
+    return _writeCount;
+}
+
+bool ConfigStore::write(const DeviceConfig& config) {
+    bool ok = _nvsOpen ? writeRecord(config) : writeFile(config);
+    if (ok) {
+        _writeCount++;
+    }
+    return ok;
+}
+
+bool ConfigStore::loadFile(const char* path, DeviceConfig& config) {
+    File file = _fs->open(path, FILE_READ);
+    if (!file) {
+        return false;
+    }
+
+    StaticJsonDocument<256> doc;
+    DeserializationError error = deserializeJson(doc, file);
+    file.close();
+    if (error) {
+        return false;  // Torn write
+    }
+
+    memset(&config, 0, sizeof(config));
+#define DEVICE_CONFIG_FROM_JSON(name, maxLength) strncpy(config.name, doc[#name] | "", maxLength);
+    DEVICE_CONFIG_FIELDS(DEVICE_CONFIG_FROM_JSON)
+#undef DEVICE_CONFIG_FROM_JSON
+
+    // Files written before versioning have no version or CRC; trust them
+    if (doc["version"].isNull()) {
+        return true;
+    }
+    if (doc["version"].as<int>() != CONFIG_VERSION) {
+        LOG_WARNF("Config: unsupported version in %s", path);
+        return false;
+    }
+    return doc["crc"].as<uint32_t>() == checksum(config);
+}
+
+bool ConfigStore::writeFile(const DeviceConfig& config) {
+    StaticJsonDocument<256> doc;
+    doc["version"] = CONFIG_VERSION;
+#define DEVICE_CONFIG_TO_JSON(name, maxLength) doc[#name] = config.name;
+    DEVICE_CONFIG_FIELDS(DEVICE_CONFIG_TO_JSON)
+#undef DEVICE_CONFIG_TO_JSON
+    doc["crc"] = checksum(config);
+
+    File file = _fs->open(_tempPath, FILE_WRITE);
+    if (!file) {
+        Logger::error("Config: failed to open temp file");
+        return false;
+    }
+    size_t written = serializeJson(doc, file);
+    file.close();
+
+    if (written == 0) {
+        _fs->remove(_tempPath);
+        Logger::error("Config: failed to write temp file");
+        return false;
+    }
+
+    // SPIFFS cannot rename over an existing file; begin() finishes the
+    // job if power fails between these two steps
+    _fs->remove(_path);
+    if (!_fs->rename(_tempPath, _path)) {
+        Logger::error("Config: failed to replace config file");
+        return false;
+    }
+
+    Logger::info("Configuration saved to SPIFFS");
+    return true;
+}
+
+bool ConfigStore::loadRecord(DeviceConfig& config, bool& outdated) {
+    size_t size = _prefs.getBytesLength(RECORD_KEY);
+    if (size == 0) {
+        return false;  // Nothing stored yet
+    }
+
+    Record record;
+    const size_t headerSize = offsetof(Record, config);
+    if (size < headerSize || size > sizeof(record) ||
+        _prefs.getBytes(RECORD_KEY, &record, size) != size) {
+        Logger::error("Config: NVS record has an unexpected size");
+        return false;
+    }
+
+    // Records written with the struct's tail padding are longer than
+    // header + length; the extra bytes are ignored
+    if (record.magic != RECORD_MAGIC || record.version > CONFIG_VERSION ||
+        record.length > sizeof(record.config) || size < headerSize + record.length ||
+        record.crc != crc32((const uint8_t*)&record.config, record.length)) {
+        Logger::error("Config: NVS record invalid");
+        return false;
+    }
+
+    // Older layouts are a prefix of the current one, since fields are only
+    // ever appended; fields they lack start out empty
+    memset(&config, 0, sizeof(config));
+    memcpy(&config, &record.config, record.length);
+    normalize(config);
+
+    outdated = record.version != CONFIG_VERSION || size != headerSize + record.length;
+    if (record.version != CONFIG_VERSION) {
+        LOG_INFOF("Config: upgrading NVS record from version %u", record.version);
+    }
+    return true;
+}
+
+bool ConfigStore::writeRecord(const DeviceConfig& config) {
+    Record record;
+    memset(&record, 0, sizeof(record));
+    record.magic = RECORD_MAGIC;
+    record.version = CONFIG_VERSION;
+    record.length = sizeof(record.config);
+    record.config = config;
+    normalize(record.config);
+    record.crc = crc32((const uint8_t*)&record.config, sizeof(record.config));
+
+    // Exactly header + config: sizeof(record) includes tail padding, which
+    // loadRecord() would have to tell apart from a newer, longer config.
+    // NVS replaces the entry atomically, so no temp copy is needed
+    size_t size = offsetof(Record, config) + record.length;
+    if (_prefs.putBytes(RECORD_KEY, &record, size) != size) {
+        Logger::error("Config: failed to write NVS record");
+        return false;
+    }
+
+    Logger::info("Configuration saved to NVS");
+    return true;
+}
+
+void ConfigStore::normalize(DeviceConfig& config) {
+    // Terminate every field and zero what follows, so the stored record
+    // depends only on the field values
+#define DEVICE_CONFIG_NORMALIZE(name, maxLength) \
+    config.name[maxLength] = '\0'; \
+    memset(config.name + strlen(config.name), 0, sizeof(config.name) - strlen(config.name));
+    DEVICE_CONFIG_FIELDS(DEVICE_CONFIG_NORMALIZE)
+#undef DEVICE_CONFIG_NORMALIZE
+}
+
+bool ConfigStore::equals(const DeviceConfig& a, const DeviceConfig& b) {
+#define DEVICE_CONFIG_EQUALS(name, maxLength) \
+    if (strncmp(a.name, b.name, sizeof(a.name)) != 0) { \
+        return false; \
+    }
+    DEVICE_CONFIG_FIELDS(DEVICE_CONFIG_EQUALS)
+#undef DEVICE_CONFIG_EQUALS
+    return true;
+}
+
+uint32_t ConfigStore::checksum(const DeviceConfig& config) {
+    // Over each field including its terminator, so bytes after the
+    // terminator do not matter
+    uint32_t crc = 0;
+#define DEVICE_CONFIG_CHECKSUM(name, maxLength) \
+    crc = crc32((const uint8_t*)config.name, strnlen(config.name, maxLength) + 1, crc);
+    DEVICE_CONFIG_FIELDS(DEVICE_CONFIG_CHECKSUM)
+#undef DEVICE_CONFIG_CHECKSUM
+    return crc;
+}
+
+uint32_t ConfigStore::crc32(const uint8_t* data, size_t length, uint32_t crc) {
+    // CRC-32 (IEEE); pass the previous result to continue over more data
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
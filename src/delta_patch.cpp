@@ -0,0 +1,260 @@
+#include "delta_patch.h"
+#include <mbedtls/sha256.h>
+#include "logger.h"
+
+static const uint8_t OP_END = 0x00;
+static const uint8_t OP_ADD = 0x01;
+static const uint8_t OP_INSERT = 0x02;
+
+static uint32_t readLE32(const uint8_t* data) {
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+           ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+DeltaPatch::DeltaPatch()
+    : _source(nullptr), _sourceSize(0), _targetSize(0), _state(STATE_HEADER), _headerLength(0),
+      _varint(0), _varintShift(0), _seek(0), _sourcePos(0), _opRemaining(0), _runRemaining(0),
+      _produced(0), _consumed(0) {
+}
+
+void DeltaPatch::begin(const uint8_t* source, size_t sourceSize) {
+    _source = source;
+    _sourceSize = sourceSize;
+    _targetSize = 0;
+    _state = STATE_HEADER;
+    _headerLength = 0;
+    _varint = 0;
+    _varintShift = 0;
+    _sourcePos = 0;
+    _produced = 0;
+    _consumed = 0;
+}
+
+size_t DeltaPatch::decode(Stream& in, uint8_t* out, size_t size) {
+    size_t pos = 0;
+    
+    while (pos < size) {
+        switch (_state) {
+        case STATE_HEADER: {
+            int c = readByte(in);
+            if (c < 0) {
+                return pos;
+            }
+            _header[_headerLength++] = (uint8_t)c;
+            if (_headerLength == HEADER_SIZE && checkHeader()) {
+                _state = STATE_OP;
+            }
+            break;
+        }
+            
+        case STATE_OP: {
+            int op = readByte(in);
+            if (op < 0) {
+                return pos;
+            }
+            if (op == OP_ADD) {
+                _state = STATE_ADD_SEEK;
+            } else if (op == OP_INSERT) {
+                _state = STATE_INSERT_LENGTH;
+            } else if (op == OP_END && _produced == _targetSize) {
+                _state = STATE_DONE;
+            } else {
+                fail(op == OP_END ? "patch ends early" : "unknown op");
+            }
+            break;
+        }
+            
+        case STATE_ADD_SEEK: {
+            int result = readVarint(in);
+            if (result <= 0) {
+                return pos;
+            }
+            _seek = (int32_t)(_varint >> 1) ^ -(int32_t)(_varint & 1);
+            _state = STATE_ADD_LENGTH;
+            break;
+        }
+            
+        case STATE_ADD_LENGTH: {
+            int result = readVarint(in);
+            if (result <= 0) {
+                return pos;
+            }
+            // Both checked against the source: the seek may go backwards
+            int64_t start = (int64_t)_sourcePos + _seek;
+            if (start < 0 || start + _varint > (int64_t)_sourceSize ||
+                _produced + _varint > _targetSize) {
+                fail("ADD out of range");
+                return pos;
+            }
+            _sourcePos = (size_t)start;
+            _opRemaining = _varint;
+            _state = STATE_RUN_SAME;
+            break;
+        }
+            
+        case STATE_RUN_SAME:
+        case STATE_RUN_COUNT: {
+            int result = readVarint(in);
+            if (result <= 0) {
+                return pos;
+            }
+            if (_varint > _opRemaining) {
+                fail("run longer than ADD");
+                return pos;
+            }
+            _runRemaining = _varint;
+            _opRemaining -= _varint;
+            _state = (_state == STATE_RUN_SAME) ? STATE_COPY : STATE_DIFF;
+            break;
+        }
+            
+        case STATE_COPY: {
+            size_t length = min(_runRemaining, size - pos);
+            memcpy(out + pos, _source + _sourcePos, length);
+            pos += length;
+            _sourcePos += length;
+            _produced += length;
+            _runRemaining -= length;
+            if (_runRemaining == 0) {
+                _state = STATE_RUN_COUNT;
+            }
+            break;
+        }
+            
+        case STATE_DIFF:
+            while (_runRemaining > 0 && pos < size) {
+                int c = readByte(in);
+                if (c < 0) {
+                    return pos;
+                }
+                out[pos++] = _source[_sourcePos++] + (uint8_t)c;
+                _produced++;
+                _runRemaining--;
+            }
+            if (_runRemaining == 0) {
+                _state = (_opRemaining > 0) ? STATE_RUN_SAME : STATE_OP;
+            }
+            break;
+            
+        case STATE_INSERT_LENGTH: {
+            int result = readVarint(in);
+            if (result <= 0) {
+                return pos;
+            }
+            if (_produced + _varint > _targetSize) {
+                fail("INSERT out of range");
+                return pos;
+            }
+            _opRemaining = _varint;
+            _state = STATE_INSERT;
+            break;
+        }
+            
+        case STATE_INSERT:
+            while (_opRemaining > 0 && pos < size) {
+                int c = readByte(in);
+                if (c < 0) {
+                    return pos;
+                }
+                out[pos++] = (uint8_t)c;
+                _produced++;
+                _opRemaining--;
+            }
+            if (_opRemaining == 0) {
+                _state = STATE_OP;
+            }
+            break;
+            
+        case STATE_DONE:
+        case STATE_FAILED:
+            return pos;
+        }
+    }
+    
+    return pos;
+}
+
+size_t DeltaPatch::getConsumed() const {
+    return _consumed;
+}
+
+size_t DeltaPatch::getTargetSize() const {
+    return _targetSize;
+}
+
+bool DeltaPatch::finished() const {
+    return _state == STATE_DONE;
+}
+
+bool DeltaPatch::failed() const {
+    return _state == STATE_FAILED;
+}
+
+int DeltaPatch::readByte(Stream& in) {
+    int c = in.read();
+    if (c >= 0) {
+        _consumed++;
+    }
+    return c;
+}
+
+int DeltaPatch::readVarint(Stream& in) {
+    // Returns 1 once complete, 0 if the stream ran dry part way (the
+    // partial value is kept), -1 if the value does not fit in 32 bits
+    for (;;) {
+        int c = readByte(in);
+        if (c < 0) {
+            return 0;
+        }
+        if (_varintShift == 0) {
+            _varint = 0;
+        }
+        if (_varintShift > 28) {
+            fail("varint too long");
+            return -1;
+        }
+        _varint |= (uint32_t)(c & 0x7F) << _varintShift;
+        if ((c & 0x80) == 0) {
+            _varintShift = 0;
+            return 1;
+        }
+        _varintShift += 7;
+    }
+}
+
+bool DeltaPatch::checkHeader() {
+    if (memcmp(_header, "ESPD", 4) != 0 || _header[4] != VERSION) {
+        fail("not a version 1 delta patch");
+        return false;
+    }
+    
+    uint32_t sourceSize = readLE32(_header + 8);
+    if (sourceSize > _sourceSize) {
+        fail("patch is for a larger image");
+        return false;
+    }
+    
+    // The running partition is larger than the image; only the part the
+    // patch was made from is compared
+    uint8_t digest[32];
+    mbedtls_sha256_context hash;
+    mbedtls_sha256_init(&hash);
+    mbedtls_sha256_starts(&hash, 0);
+    mbedtls_sha256_update(&hash, _source, sourceSize);
+    mbedtls_sha256_finish(&hash, digest);
+    mbedtls_sha256_free(&hash);
+    
+    if (memcmp(digest, _header + 16, sizeof(digest)) != 0) {
+        fail("patch is for a different image");
+        return false;
+    }
+    
+    _sourceSize = sourceSize;
+    _targetSize = readLE32(_header + 12);
+    return true;
+}
+
+void DeltaPatch::fail(const char* reason) {
+    LOG_ERRORF("Delta patch: %s", reason);
+    _state = STATE_FAILED;
+}
@@ -0,0 +1,186 @@
+#include "http_body_stream.h"
+
+HTTPBodyStream::HTTPBodyStream(WiFiClient& client, int contentLength, bool chunked, unsigned long timeoutMs)
+    : _client(client), _chunked(chunked), _inChunk(false), _finished(false), _failed(false),
+      _remaining(chunked ? 0 : contentLength), _timeout(timeoutMs), _peeked(-1) {
+    if (!chunked && contentLength == 0) {
+        _finished = true;
+    }
+}
+
+size_t HTTPBodyStream::readChunk(uint8_t* buffer, size_t maxLen) {
+    if (maxLen == 0) {
+        return 0;
+    }
+
+    if (_peeked >= 0) {
+        buffer[0] = (uint8_t)_peeked;
+        _peeked = -1;
+        return 1;
+    }
+
+    if (_finished || _failed) {
+        return 0;
+    }
+
+    if (_chunked && _remaining == 0 && !nextChunk()) {
+        return 0;
+    }
+
+    size_t want = maxLen;
+    if (_remaining >= 0 && (size_t)_remaining < want) {
+        want = _remaining;
+    }
+
+    size_t got = readRaw(buffer, want);
+
+    if (_remaining < 0) {
+        // Body ends when the server closes the connection; a stall with
+        // the connection still open is a timeout, not the end
+        if (got == 0) {
+            if (_client.connected()) {
+                _failed = true;
+            } else {
+                _finished = true;
+            }
+        }
+        return got;
+    }
+
+    if (got == 0) {
+        _failed = true;
+        return 0;
+    }
+
+    _remaining -= got;
+    if (!_chunked && _remaining == 0) {
+        _finished = true;
+    }
+    return got;
+}
+
+bool HTTPBodyStream::skipRemaining() {
+    uint8_t scratch[64];
+    while (readChunk(scratch, sizeof(scratch)) > 0) {
+    }
+    return _finished;
+}
+
+void HTTPBodyStream::setAbortCheck(const HTTPAbortCheck& check) {
+    _abortCheck = check;
+}
+
+bool HTTPBodyStream::finished() const {
+    return _finished && _peeked < 0;
+}
+
+bool HTTPBodyStream::failed() const {
+    return _failed;
+}
+
+int HTTPBodyStream::available() {
+    if (_peeked >= 0) {
+        return 1;
+    }
+    if (_finished || _failed) {
+        return 0;
+    }
+
+    int buffered = _client.available();
+    if (_remaining >= 0 && buffered > _remaining) {
+        buffered = _remaining;
+    }
+    return buffered;
+}
+
+int HTTPBodyStream::read() {
+    uint8_t data;
+    return (readChunk(&data, 1) == 1) ? data : -1;
+}
+
+int HTTPBodyStream::peek() {
+    if (_peeked < 0) {
+        _peeked = read();
+    }
+    return _peeked;
+}
+
+void HTTPBodyStream::flush() {
+}
+
+size_t HTTPBodyStream::write(uint8_t data) {
+    return 0;
+}
+
+bool HTTPBodyStream::nextChunk() {
+    char line[24];
+
+    // Each chunk's data is followed by CRLF
+    if (_inChunk && !readLine(line, sizeof(line))) {
+        _failed = true;
+        return false;
+    }
+
+    // Chunk size in hex, optionally followed by ";extensions"
+    if (!readLine(line, sizeof(line))) {
+        _failed = true;
+        return false;
+    }
+
+    char* end;
+    unsigned long size = strtoul(line, &end, 16);
+    if (end == line) {
+        _failed = true;
+        return false;
+    }
+
+    if (size == 0) {
+        // Last chunk: skip any trailer fields up to the empty line
+        while (readLine(line, sizeof(line))) {
+            if (line[0] == '\0') {
+                _finished = true;
+                return false;
+            }
+        }
+        _failed = true;
+        return false;
+    }
+
+    _inChunk = true;
+    _remaining = size;
+    return true;
+}
+
+bool HTTPBodyStream::readLine(char* line, size_t size) {
+    size_t length = 0;
+    uint8_t c;
+
+    while (readRaw(&c, 1) == 1) {
+        if (c == '\n') {
+            line[length] = '\0';
+            return true;
+        }
+        // Over-long lines are truncated; only the leading size field matters
+        if (c != '\r' && length < size - 1) {
+            line[length++] = c;
+        }
+    }
+    return false;
+}
+
+size_t HTTPBodyStream::readRaw(uint8_t* buffer, size_t length) {
+    unsigned long start = millis();
+
+    for (;;) {
+        if (_client.available() > 0) {
+            int got = _client.read(buffer, length);
+            if (got > 0) {
+                return got;
+            }
+        }
+        if (!_client.connected() || millis() - start >= _timeout || (_abortCheck && _abortCheck())) {
+            return 0;
+        }
+        delay(1);
+    }
+}
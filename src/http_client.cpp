@@ -1,53 +1,292 @@
 #include "http_client.h"
 #include "config.h"
 #include "logger.h"
+#include "metrics.h"
 
-HTTPClientManager::HTTPClientManager() {
+static Histogram requestDuration("esp32_http_client_request_duration_seconds",
+                                 "Outgoing HTTP request latency, including reading the body");
+static Counter requestErrors("esp32_http_client_errors_total",
+                             "Outgoing HTTP requests without a valid response");
+
+HTTPClientManager::HTTPClientManager()
+    : _keepAlive(HTTP_KEEP_ALIVE), _timeout(HTTP_TIMEOUT), _connectTimeout(HTTP_TIMEOUT), _hasDeadline(false),
+      _deadline(0), _connectionsOpened(0) {
+    for (size_t i = 0; i < HTTP_POOL_SIZE; i++) {
+        _connections[i].host[0] = '\0';
+        _connections[i].port = 0;
+        _connections[i].secure = false;
+        _connections[i].client = nullptr;
+        _connections[i].lastUsed = 0;
+        
+        // Needed to tell chunked bodies apart when streaming
+        const char* headers[] = { "Transfer-Encoding" };
+        _connections[i].http.collectHeaders(headers, 1);
+    }
+}
+
+HTTPClientManager::~HTTPClientManager() {
+    for (size_t i = 0; i < HTTP_POOL_SIZE; i++) {
+        close(_connections[i]);
+    }
 }
 
 int HTTPClientManager::sendGET(const char* url, String& response) {
+    return sendRequest("GET", url, nullptr, response);
+}
+
+int HTTPClientManager::sendPOST(const char* url, const char* jsonPayload, String& response) {
+    return sendRequest("POST", url, jsonPayload, response);
+}
+
+int HTTPClientManager::sendGET(const char* url, HTTPBodySink sink) {
+    return sendRequest("GET", url, nullptr, sink);
+}
+
+int HTTPClientManager::sendPOST(const char* url, const char* jsonPayload, HTTPBodySink sink) {
+    return sendRequest("POST", url, jsonPayload, sink);
+}
+
+int HTTPClientManager::getJSON(const char* url, JsonDocument& doc, const JsonDocument& filter) {
+    return sendRequest("GET", url, nullptr, [&doc, &filter](HTTPBodyStream& body) {
+        // Parses straight off the connection; only filtered fields are stored
+        DeserializationError error = deserializeJson(doc, body, DeserializationOption::Filter(filter));
+        if (error) {
+            LOG_ERRORF("HTTP JSON parse failed: %s", error.c_str());
+            return false;
+        }
+        return body.skipRemaining();
+    });
+}
+
+void HTTPClientManager::setKeepAlive(bool enabled) {
+    _keepAlive = enabled;
+    if (!enabled) {
+        for (size_t i = 0; i < HTTP_POOL_SIZE; i++) {
+            close(_connections[i]);
+        }
+    }
+}
+
+void HTTPClientManager::handle() {
+    unsigned long now = millis();
+    
+    for (size_t i = 0; i < HTTP_POOL_SIZE; i++) {
+        Connection& connection = _connections[i];
+        if (connection.client != nullptr && connection.client->connected() &&
+            now - connection.lastUsed >= HTTP_IDLE_TIMEOUT) {
+            LOG_DEBUGF("HTTP closing idle connection to %s", connection.host);
+            connection.client->stop();
+        }
+    }
+}
+
+uint32_t HTTPClientManager::getConnectionsOpened() const {
+    return _connectionsOpened;
+}
+
+void HTTPClientManager::setTimeout(uint16_t timeoutMs) {
+    _timeout = timeoutMs;
+}
+
+void HTTPClientManager::setConnectTimeout(uint16_t timeoutMs) {
+    _connectTimeout = timeoutMs;
+}
+
+void HTTPClientManager::setDeadline(unsigned long deadline) {
+    _deadline = deadline;
+    _hasDeadline = true;
+}
+
+void HTTPClientManager::clearDeadline() {
+    _hasDeadline = false;
+}
+
+void HTTPClientManager::setAbortCheck(HTTPAbortCheck check) {
+    _abortCheck = check;
+}
+
+uint16_t HTTPClientManager::timeLeft(uint16_t timeoutMs) const {
+    if (!_hasDeadline) {
+        return timeoutMs;
+    }
+    // At least 1 ms, the clients take 0 as no timeout at all
+    long left = (long)(_deadline - millis());
+    return left < 1 ? 1 : (left < timeoutMs ? left : timeoutMs);
+}
+
+int HTTPClientManager::sendRequest(const char* method, const char* url, const char* payload, String& response) {
+    response = "";
+    return sendRequest(method, url, payload, [&response](HTTPBodyStream& body) {
+        char buffer[HTTP_STREAM_CHUNK_SIZE + 1];
+        size_t length;
+        while ((length = body.readChunk((uint8_t*)buffer, HTTP_STREAM_CHUNK_SIZE)) > 0) {
+            buffer[length] = '\0';
+            response += buffer;
+        }
+        return body.finished();
+    });
+}
+
+int HTTPClientManager::sendRequest(const char* method, const char* url, const char* payload, HTTPBodySink& sink) {
+    return sendRequest(method, url, payload, [&sink](HTTPBodyStream& body) {
+        uint8_t buffer[HTTP_STREAM_CHUNK_SIZE];
+        size_t length;
+        while ((length = body.readChunk(buffer, sizeof(buffer))) > 0) {
+            if (!sink(buffer, length)) {
+                return false;
+            }
+        }
+        return body.finished();
+    });
+}
+
+int HTTPClientManager::sendRequest(const char* method, const char* url, const char* payload, const BodyHandler& handler) {
     if (!isValidURL(url)) {
         Logger::error("Invalid URL");
         return -1;
     }
     
-    _http.begin(url);
-    _http.setTimeout(HTTP_TIMEOUT);
+    ScopedTimer timer(requestDuration);
+    Connection* connection = acquire(url);
+    if (connection == nullptr) {
+        Logger::error("HTTP: failed to allocate connection");
+        return -1;
+    }
     
-    int httpCode = _http.GET();
+    int httpCode = -1;
     
-    if (httpCode > 0) {
-        response = _http.getString();
-        Logger::info("HTTP GET Response: " + String(httpCode));
-    } else {
-        Logger::error("HTTP GET Failed: " + String(_http.errorToString(httpCode).c_str()));
+    // A kept-alive connection may have been closed by the server in the
+    // meantime; in that case reconnect once and resend transparently. A
+    // POST is only resent if the request never went out, since the server
+    // may have acted on it before the connection dropped.
+    bool idempotent = (strcmp(method, "GET") == 0);
+    for (int attempt = 0; attempt < 2; attempt++) {
+        bool reused = connection->client->connected();
+        bool connected = reused;
+        if (!reused) {
+            _connectionsOpened++;
+            // Here rather than inside GET()/POST(), so that with a deadline
+            // the wait for the response only gets what the connect left
+            connected = connection->client->connect(connection->host, connection->port,
+                                                    timeLeft(_connectTimeout));
+        }
+        uint16_t timeout = timeLeft(_timeout);
+        
+        HTTPClient& http = connection->http;
+        http.begin(*connection->client, url);
+        http.setReuse(_keepAlive);
+        http.setTimeout(timeout);
+        http.setConnectTimeout(_connectTimeout);
+        
+        if (!connected) {
+            httpCode = HTTPC_ERROR_CONNECTION_REFUSED;
+        } else if (payload != nullptr) {
+            http.addHeader("Content-Type", "application/json");
+            httpCode = http.POST(payload);
+        } else {
+            httpCode = http.GET();
+        }
+        
+        bool responded = (httpCode > 0);
+        if (responded) {
+            LOG_INFOF("HTTP %s Response: %d%s", method, httpCode, reused ? " (reused)" : "");
+            
+            // Read the body straight off the connection instead of
+            // buffering it whole with getString()
+            bool chunked = http.header("Transfer-Encoding").equalsIgnoreCase("chunked");
+            int length = (httpCode == 204 || httpCode == 304) ? 0 : http.getSize();
+            HTTPBodyStream body(*connection->client, length, chunked, timeout);
+            body.setAbortCheck(_abortCheck);
+            
+            if (!handler(body)) {
+                httpCode = body.failed() ? HTTPC_ERROR_READ_TIMEOUT : HTTPC_ERROR_STREAM_WRITE;
+            }
+            
+            // The rest of an unread body would corrupt the next response,
+            // and a body that ends with the close leaves nothing to reuse
+            if (!body.finished() || (length < 0 && !chunked)) {
+                connection->client->stop();
+            }
+        }
+        
+        http.end();
+        
+        bool unsent = (httpCode == HTTPC_ERROR_CONNECTION_REFUSED ||
+                       httpCode == HTTPC_ERROR_SEND_HEADER_FAILED ||
+                       httpCode == HTTPC_ERROR_NOT_CONNECTED);
+        if (responded || !reused || (!idempotent && !unsent) || (_abortCheck && _abortCheck())) {
+            break;
+        }
+        
+        LOG_DEBUGF("HTTP %s on reused connection failed, reconnecting", method);
+        connection->client->stop();
+    }
+    
+    if (httpCode <= 0) {
+        requestErrors.add();
+        LOG_ERRORF("HTTP %s Failed: %s", method, HTTPClient::errorToString(httpCode).c_str());
+        connection->client->stop();
+    } else if (!_keepAlive) {
+        connection->client->stop();
     }
     
-    _http.end();
+    connection->lastUsed = millis();
     return httpCode;
 }
 
-int HTTPClientManager::sendPOST(const char* url, const char* jsonPayload, String& response) {
-    if (!isValidURL(url)) {
-        Logger::error("Invalid URL");
-        return -1;
+HTTPClientManager::Connection* HTTPClientManager::acquire(const char* url) {
+    char host[HTTP_HOST_MAX_LENGTH];
+    uint16_t port;
+    bool secure;
+    
+    if (!parseOrigin(url, host, sizeof(host), port, secure)) {
+        return nullptr;
     }
     
-    _http.begin(url);
-    _http.setTimeout(HTTP_TIMEOUT);
-    _http.addHeader("Content-Type", "application/json");
+    // Prefer an existing connection to the same origin, else the least
+    // recently used slot
+    Connection* target = &_connections[0];
+    for (size_t i = 0; i < HTTP_POOL_SIZE; i++) {
+        Connection& connection = _connections[i];
+        if (connection.client != nullptr && connection.port == port &&
+            connection.secure == secure && strcmp(connection.host, host) == 0) {
+            return &connection;
+        }
+        if (connection.client == nullptr ||
+            (target->client != nullptr && connection.lastUsed < target->lastUsed)) {
+            target = &connection;
+        }
+    }
     
-    int httpCode = _http.POST(jsonPayload);
+    close(*target);
     
-    if (httpCode > 0) {
-        response = _http.getString();
-        Logger::info("HTTP POST Response: " + String(httpCode));
+    if (secure) {
+        WiFiClientSecure* tls = new WiFiClientSecure();
+        if (tls != nullptr) {
+            tls->setInsecure();  // Same certificate policy as HTTPClient::begin(url)
+        }
+        target->client = tls;
     } else {
-        Logger::error("HTTP POST Failed: " + String(_http.errorToString(httpCode).c_str()));
+        target->client = new WiFiClient();
     }
     
-    _http.end();
-    return httpCode;
+    if (target->client == nullptr) {
+        return nullptr;
+    }
+    
+    strncpy(target->host, host, sizeof(target->host));
+    target->port = port;
+    target->secure = secure;
+    return target;
+}
+
+void HTTPClientManager::close(Connection& connection) {
+    if (connection.client != nullptr) {
+        connection.client->stop();
+        delete connection.client;
+        connection.client = nullptr;
+    }
+    connection.host[0] = '\0';
 }
 
 bool HTTPClientManager::sendSensorData(const char* url, float temperature, float humidity) {
@@ -56,13 +295,15 @@ bool HTTPClientManager::sendSensorData(const char* url, float temperature, float
     doc["humidity"] = humidity;
     doc["timestamp"] = millis();
     
-    String jsonString;
-    serializeJson(doc, jsonString);
+    char payload[128];
+    serializeJson(doc, payload, sizeof(payload));
     
-    Logger::debug("Sending sensor data: " + jsonString);
+    LOG_DEBUGF("Sending sensor data: %s", payload);
     
-    String response;
-    int httpCode = sendPOST(url, jsonString.c_str(), response);
+    // Only the status code matters; the body is read and dropped
+    int httpCode = sendPOST(url, payload, [](const uint8_t* data, size_t length) {
+        return true;
+    });
     
     return (httpCode >= 200 && httpCode < 300);
 }
@@ -72,6 +313,29 @@ bool HTTPClientManager::isValidURL(const char* url) {
         return false;
     }
     
-    String urlStr = String(url);
-    return (urlStr.startsWith("http://") || urlStr.startsWith("https://"));
+    return (strncmp(url, "http://", 7) == 0 || strncmp(url, "https://", 8) == 0);
+}
+
+bool HTTPClientManager::parseOrigin(const char* url, char* host, size_t hostSize, uint16_t& port, bool& secure) {
+    secure = (strncmp(url, "https://", 8) == 0);
+    const char* start = url + (secure ? 8 : 7);
+    
+    // Skip optional credentials
+    const char* end = start + strcspn(start, "/?#");
+    const char* at = (const char*)memchr(start, '@', end - start);
+    if (at != nullptr) {
+        start = at + 1;
+    }
+    
+    const char* colon = (const char*)memchr(start, ':', end - start);
+    const char* hostEnd = (colon != nullptr) ? colon : end;
+    size_t length = hostEnd - start;
+    if (length == 0 || length >= hostSize) {
+        return false;
+    }
+    
+    memcpy(host, start, length);
+    host[length] = '\0';
+    port = (colon != nullptr) ? (uint16_t)atoi(colon + 1) : (secure ? 443 : 80);
+    return true;
 }
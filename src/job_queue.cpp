@@ -0,0 +1,168 @@
+#include "job_queue.h"
+#include "logger.h"
+
+JobQueue::JobQueue() : _lock(nullptr), _nextId(1) {
+    for (size_t i = 0; i < JOB_QUEUE_SIZE; i++) {
+        _entries[i].id = 0;
+        _entries[i].state = JOB_UNKNOWN;
+        _entries[i].type = "";
+        _entries[i].notBefore = 0;
+    }
+}
+
+bool JobQueue::begin() {
+    if (_lock == nullptr) {
+        _lock = xSemaphoreCreateMutex();
+    }
+    return _lock != nullptr;
+}
+
+JobId JobQueue::submit(const char* type, Job job, unsigned long delayMs) {
+    if (_lock == nullptr) {
+        return 0;
+    }
+    
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    
+    // A free slot, otherwise the one finished longest ago
+    int index = -1;
+    for (size_t i = 0; i < JOB_QUEUE_SIZE; i++) {
+        JobState state = _entries[i].state;
+        if (state == JOB_UNKNOWN) {
+            index = i;
+            break;
+        }
+        if ((state == JOB_DONE || state == JOB_FAILED) &&
+            (index < 0 || _entries[i].id < _entries[index].id)) {
+            index = i;
+        }
+    }
+    
+    if (index < 0) {
+        xSemaphoreGive(_lock);
+        LOG_WARNF("Jobs: queue full, rejecting %s", type);
+        return 0;
+    }
+    
+    Entry& entry = _entries[index];
+    entry.id = _nextId++;
+    if (_nextId == 0) {
+        _nextId = 1;
+    }
+    entry.state = JOB_QUEUED;
+    entry.type = type;
+    entry.notBefore = millis() + delayMs;
+    entry.job = job;
+    JobId id = entry.id;
+    
+    xSemaphoreGive(_lock);
+    
+    LOG_DEBUGF("Jobs: queued %s #%u", type, (unsigned)id);
+    return id;
+}
+
+JobQueue::JobState JobQueue::getState(JobId id, const char** type) {
+    if (_lock == nullptr || id == 0) {
+        return JOB_UNKNOWN;
+    }
+    
+    JobState state = JOB_UNKNOWN;
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    for (size_t i = 0; i < JOB_QUEUE_SIZE; i++) {
+        if (_entries[i].state != JOB_UNKNOWN && _entries[i].id == id) {
+            state = _entries[i].state;
+            if (type != nullptr) {
+                *type = _entries[i].type;
+            }
+            break;
+        }
+    }
+    xSemaphoreGive(_lock);
+    
+    return state;
+}
+
+void JobQueue::handle() {
+    if (_lock == nullptr) {
+        return;
+    }
+    
+    for (;;) {
+        xSemaphoreTake(_lock, portMAX_DELAY);
+        int index = nextDue();
+        if (index < 0) {
+            xSemaphoreGive(_lock);
+            return;
+        }
+        
+        // Run without the lock, so handlers can submit and poll meanwhile
+        Entry& entry = _entries[index];
+        entry.state = JOB_RUNNING;
+        Job job = entry.job;
+        entry.job = nullptr;
+        const char* type = entry.type;
+        JobId id = entry.id;
+        xSemaphoreGive(_lock);
+        
+        unsigned long startedAt = millis();
+        bool ok = job();
+        LOG_DEBUGF("Jobs: %s #%u %s in %lu ms", type, (unsigned)id,
+                   ok ? "done" : "failed", millis() - startedAt);
+        if (!ok) {
+            LOG_WARNF("Jobs: %s #%u failed", type, (unsigned)id);
+        }
+        
+        // Slots are only reused once finished, so index still holds id
+        xSemaphoreTake(_lock, portMAX_DELAY);
+        entry.state = ok ? JOB_DONE : JOB_FAILED;
+        xSemaphoreGive(_lock);
+    }
+}
+
+size_t JobQueue::pending() {
+    if (_lock == nullptr) {
+        return 0;
+    }
+    
+    size_t count = 0;
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    for (size_t i = 0; i < JOB_QUEUE_SIZE; i++) {
+        if (_entries[i].state == JOB_QUEUED || _entries[i].state == JOB_RUNNING) {
+            count++;
+        }
+    }
+    xSemaphoreGive(_lock);
+    
+    return count;
+}
+
+const char* JobQueue::stateName(JobState state) {
+    switch (state) {
+    case JOB_QUEUED:
+        return "queued";
+    case JOB_RUNNING:
+        return "running";
+    case JOB_DONE:
+        return "done";
+    case JOB_FAILED:
+        return "failed";
+    default:
+        return "unknown";
+    }
+}
+
+int JobQueue::nextDue() {
+    // Oldest queued job whose delay has passed; called with the lock held
+    unsigned long now = millis();
+    int index = -1;
+    for (size_t i = 0; i < JOB_QUEUE_SIZE; i++) {
+        const Entry& entry = _entries[i];
+        if (entry.state != JOB_QUEUED || (long)(now - entry.notBefore) < 0) {
+            continue;
+        }
+        if (index < 0 || entry.id < _entries[index].id) {
+            index = i;
+        }
+    }
+    return index;
+}
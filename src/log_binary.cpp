@@ -0,0 +1,291 @@
+#include "log_binary.h"
+#include <string.h>
+
+size_t LogBinary::encodeLine(uint8_t* buffer, size_t size, uint8_t level, uint32_t timestamp,
+                             uint16_t formatId, const char* format, va_list args) {
+    size_t pos = 2;  // Sync byte and length are filled in by finishFrame()
+    if (size < FRAME_OVERHEAD + 1) {
+        return 0;
+    }
+
+    buffer[pos++] = (RECORD_LINE << 4) | (level & 0x0F);
+    if (!putVarint(buffer, size, pos, timestamp) ||
+        !putVarint(buffer, size, pos, formatId) ||
+        !packArguments(buffer, size, pos, format, args)) {
+        return 0;
+    }
+
+    return finishFrame(buffer, size, pos);
+}
+
+size_t LogBinary::encodeText(uint8_t* buffer, size_t size, uint8_t level, uint32_t timestamp,
+                             const char* text, size_t length) {
+    size_t pos = 2;
+    if (size < FRAME_OVERHEAD + 1) {
+        return 0;
+    }
+
+    buffer[pos++] = (RECORD_TEXT << 4) | (level & 0x0F);
+    if (!putVarint(buffer, size, pos, timestamp)) {
+        return 0;
+    }
+
+    // Text records are the fallback path, so truncate rather than fail
+    size_t room = size - pos - 1;
+    if (room > 255 - (pos - 2)) {
+        room = 255 - (pos - 2);
+    }
+    if (length > room) {
+        length = room;
+    }
+    putBytes(buffer, size, pos, text, length);
+
+    return finishFrame(buffer, size, pos);
+}
+
+size_t LogBinary::encodeFormat(uint8_t* buffer, size_t size, uint16_t formatId, const char* format) {
+    size_t pos = 2;
+    if (size < FRAME_OVERHEAD + 1) {
+        return 0;
+    }
+
+    buffer[pos++] = (RECORD_FORMAT << 4);
+    if (!putVarint(buffer, size, pos, formatId) ||
+        !putBytes(buffer, size, pos, format, strlen(format))) {
+        return 0;
+    }
+
+    return finishFrame(buffer, size, pos);
+}
+
+int LogBinary::formatIdOf(const uint8_t* frame, size_t length, RecordType& type) {
+    if (length < FRAME_OVERHEAD + 2 || frame[0] != FRAME_SYNC || (size_t)frame[1] + FRAME_OVERHEAD != length) {
+        return -1;
+    }
+
+    type = (RecordType)(frame[2] >> 4);
+    size_t pos = 3;
+    size_t end = length - 1;
+    uint64_t value = 0;
+    int fields = (type == RECORD_LINE) ? 2 : (type == RECORD_FORMAT) ? 1 : 0;
+    for (int field = 0; field < fields; field++) {
+        value = 0;
+        for (int shift = 0;; shift += 7) {
+            if (pos >= end || shift > 28) {
+                return -1;
+            }
+            uint8_t byte = frame[pos++];
+            value |= (uint64_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                break;
+            }
+        }
+    }
+
+    return (fields > 0 && value < LOG_FORMAT_TABLE_SIZE) ? (int)value : -1;
+}
+
+bool LogBinary::putVarint(uint8_t* buffer, size_t size, size_t& pos, uint64_t value) {
+    do {
+        if (pos >= size) {
+            return false;
+        }
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        buffer[pos++] = byte | (value ? 0x80 : 0);
+    } while (value);
+
+    return true;
+}
+
+bool LogBinary::putBytes(uint8_t* buffer, size_t size, size_t& pos, const void* data, size_t length) {
+    if (pos + length > size) {
+        return false;
+    }
+
+    memcpy(buffer + pos, data, length);
+    pos += length;
+    return true;
+}
+
+bool LogBinary::packArguments(uint8_t* buffer, size_t size, size_t& pos, const char* format, va_list args) {
+    for (const char* p = format; *p; p++) {
+        if (*p != '%') {
+            continue;
+        }
+        p++;
+        if (*p == '%') {
+            continue;
+        }
+
+        // Flags
+        while (*p && strchr("-+ #0", *p)) {
+            p++;
+        }
+
+        // Width and precision; '*' consumes an int argument
+        for (int field = 0; field < 2; field++) {
+            if (*p == '*') {
+                int value = va_arg(args, int);
+                if (!putVarint(buffer, size, pos, ((uint64_t)value << 1) ^ (uint64_t)(value >> 31))) {
+                    return false;
+                }
+                p++;
+            } else {
+                while (*p >= '0' && *p <= '9') {
+                    p++;
+                }
+            }
+            if (field == 0 && *p == '.') {
+                p++;
+            } else {
+                break;
+            }
+        }
+
+        // Length modifier
+        int longs = 0;
+        while (*p && strchr("hljztL", *p)) {
+            if (*p == 'l' || *p == 'j') {
+                longs++;
+            } else if (*p == 'z' || *p == 't') {
+                longs = (sizeof(size_t) > sizeof(int)) ? 1 : 0;
+            }
+            p++;
+        }
+
+        bool ok = true;
+        switch (*p) {
+            case 'd':
+            case 'i': {
+                int64_t value;
+                if (longs >= 2) {
+                    value = va_arg(args, long long);
+                } else if (longs == 1) {
+                    value = va_arg(args, long);
+                } else {
+                    value = va_arg(args, int);
+                }
+                ok = putVarint(buffer, size, pos, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+                break;
+            }
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o':
+            case 'c': {
+                uint64_t value;
+                if (longs >= 2) {
+                    value = va_arg(args, unsigned long long);
+                } else if (longs == 1) {
+                    value = va_arg(args, unsigned long);
+                } else {
+                    value = va_arg(args, unsigned int);
+                }
+                ok = putVarint(buffer, size, pos, value);
+                break;
+            }
+            case 'p':
+                ok = putVarint(buffer, size, pos, (uintptr_t)va_arg(args, void*));
+                break;
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A': {
+                float value = (float)va_arg(args, double);
+                uint32_t bits;
+                memcpy(&bits, &value, sizeof(bits));
+                uint8_t bytes[4] = {
+                    (uint8_t)bits, (uint8_t)(bits >> 8), (uint8_t)(bits >> 16), (uint8_t)(bits >> 24)
+                };
+                ok = putBytes(buffer, size, pos, bytes, sizeof(bytes));
+                break;
+            }
+            case 's': {
+                const char* value = va_arg(args, const char*);
+                if (value == nullptr) {
+                    value = "(null)";
+                }
+                size_t length = strlen(value);
+                ok = putVarint(buffer, size, pos, length) && putBytes(buffer, size, pos, value, length);
+                break;
+            }
+            case 'n':
+                va_arg(args, void*);
+                break;
+            default:
+                // Unknown conversion: bail out so the caller falls back to text
+                return false;
+        }
+
+        if (!ok) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+size_t LogBinary::finishFrame(uint8_t* buffer, size_t size, size_t pos) {
+    size_t payloadLength = pos - 2;
+    if (payloadLength > 255 || pos >= size) {
+        return 0;
+    }
+
+    uint8_t checksum = 0;
+    for (size_t i = 2; i < pos; i++) {
+        checksum += buffer[i];
+    }
+
+    buffer[0] = FRAME_SYNC;
+    buffer[1] = (uint8_t)payloadLength;
+    buffer[pos++] = checksum;
+    return pos;
+}
+
+LogFormatTable::LogFormatTable() {
+    for (size_t i = 0; i < LOG_FORMAT_TABLE_SIZE; i++) {
+        _formats[i].store(nullptr, std::memory_order_relaxed);
+        _announced[i].store(false, std::memory_order_relaxed);
+    }
+}
+
+int LogFormatTable::intern(const char* format) {
+    size_t start = ((uintptr_t)format >> 2) % LOG_FORMAT_TABLE_SIZE;
+
+    for (size_t probe = 0; probe < LOG_FORMAT_TABLE_SIZE; probe++) {
+        size_t index = (start + probe) % LOG_FORMAT_TABLE_SIZE;
+        const char* current = _formats[index].load(std::memory_order_acquire);
+
+        if (current == format) {
+            return index;
+        }
+        if (current == nullptr) {
+            if (_formats[index].compare_exchange_strong(current, format, std::memory_order_acq_rel) ||
+                current == format) {
+                return index;
+            }
+        }
+    }
+
+    return -1;
+}
+
+bool LogFormatTable::isAnnounced(int id) const {
+    return _announced[id].load(std::memory_order_acquire);
+}
+
+void LogFormatTable::markAnnounced(int id) {
+    _announced[id].store(true, std::memory_order_release);
+}
+
+const char* LogFormatTable::lookup(int id) const {
+    if (id < 0 || id >= LOG_FORMAT_TABLE_SIZE) {
+        return nullptr;
+    }
+    return _formats[id].load(std::memory_order_acquire);
+}
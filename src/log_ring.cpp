@@ -0,0 +1,102 @@
+#include "log_ring.h"
+#include <new>
+
+LogRing::LogRing()
+    : _slots(nullptr), _mask(0), _head(0), _dropped(0), _tail(0) {
+}
+
+LogRing::~LogRing() {
+    delete[] _slots;
+}
+
+bool LogRing::begin(size_t slotCount) {
+    if (_slots != nullptr) {
+        return true;
+    }
+
+    size_t capacity = 2;
+    while (capacity < slotCount) {
+        capacity <<= 1;
+    }
+
+    _slots = new (std::nothrow) Slot[capacity];
+    if (_slots == nullptr) {
+        return false;
+    }
+
+    // Slot i is free for the producer holding ticket i
+    for (size_t i = 0; i < capacity; i++) {
+        _slots[i].sequence.store(i, std::memory_order_relaxed);
+        _slots[i].length = 0;
+    }
+
+    _mask = capacity - 1;
+    _head.store(0, std::memory_order_relaxed);
+    _tail.store(0, std::memory_order_relaxed);
+    return true;
+}
+
+char* LogRing::claim(uint32_t& ticket) {
+    if (_slots == nullptr) {
+        return nullptr;
+    }
+
+    uint32_t pos = _head.load(std::memory_order_relaxed);
+    for (;;) {
+        Slot& slot = _slots[pos & _mask];
+        uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+        int32_t diff = (int32_t)(sequence - pos);
+
+        if (diff == 0) {
+            // Slot is free for this position, try to take it
+            if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                ticket = pos;
+                return slot.data;
+            }
+        } else if (diff < 0) {
+            // Consumer has not released this slot yet: ring is full
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        } else {
+            pos = _head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void LogRing::publish(uint32_t ticket, size_t length) {
+    Slot& slot = _slots[ticket & _mask];
+    slot.length = (length < LOG_LINE_MAX) ? length : LOG_LINE_MAX;
+    slot.sequence.store(ticket + 1, std::memory_order_release);
+}
+
+const char* LogRing::peek(size_t& length) {
+    if (_slots == nullptr) {
+        return nullptr;
+    }
+
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    Slot& slot = _slots[tail & _mask];
+    if (slot.sequence.load(std::memory_order_acquire) != tail + 1) {
+        return nullptr;
+    }
+
+    length = slot.length;
+    return slot.data;
+}
+
+void LogRing::release() {
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    Slot& slot = _slots[tail & _mask];
+
+    // Hand the slot back to the producer one lap ahead
+    slot.sequence.store(tail + _mask + 1, std::memory_order_release);
+    _tail.store(tail + 1, std::memory_order_relaxed);
+}
+
+uint32_t LogRing::getDroppedCount() const {
+    return _dropped.load(std::memory_order_relaxed);
+}
+
+bool LogRing::isEmpty() const {
+    return _head.load(std::memory_order_relaxed) == _tail.load(std::memory_order_relaxed);
+}
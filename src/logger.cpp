@@ -1,6 +1,14 @@
 #include "logger.h"
+#include "config.h"
 
 LogLevel Logger::_logLevel = LOG_INFO;
+LogFormat Logger::_format = LOG_FORMAT_TEXT;
+LogFormatTable Logger::_formats;
+LogRing Logger::_ring;
+TaskHandle_t Logger::_drainTask = nullptr;
+uint32_t Logger::_reportedDrops = 0;
+LogSink* Logger::_sinks[LOG_MAX_SINKS] = {};
+size_t Logger::_sinkCount = 0;
 
 void Logger::begin(unsigned long baudRate) {
     Serial.begin(baudRate);
@@ -16,6 +24,64 @@ void Logger::setLogLevel(LogLevel level) {
     _logLevel = level;
 }
 
+void Logger::setFormat(LogFormat format) {
+    _format = format;
+}
+
+bool Logger::beginAsync(size_t slots) {
+    if (_drainTask != nullptr) {
+        return true;
+    }
+    
+    if (!_ring.begin(slots)) {
+        Serial.println("Logger: failed to allocate log ring, staying synchronous");
+        return false;
+    }
+    
+    BaseType_t created = xTaskCreatePinnedToCore(
+        drainTask, "log_drain", LOG_TASK_STACK_SIZE, nullptr,
+        LOG_TASK_PRIORITY, &_drainTask, LOG_TASK_CORE);
+    
+    if (created != pdPASS) {
+        _drainTask = nullptr;
+        Serial.println("Logger: failed to start drain task, staying synchronous");
+        return false;
+    }
+    
+    return true;
+}
+
+void Logger::flush(unsigned long timeoutMs) {
+    if (_drainTask == nullptr) {
+        Serial.flush();
+        return;
+    }
+    
+    unsigned long start = millis();
+    while (!_ring.isEmpty() && millis() - start < timeoutMs) {
+        xTaskNotifyGive(_drainTask);
+        delay(1);
+    }
+    Serial.flush();
+}
+
+uint32_t Logger::getDroppedCount() {
+    return _ring.getDroppedCount();
+}
+
+bool Logger::addSink(LogSink* sink) {
+    if (sink == nullptr || _sinkCount >= LOG_MAX_SINKS) {
+        return false;
+    }
+    
+    _sinks[_sinkCount++] = sink;
+    return true;
+}
+
+const char* Logger::formatString(int id) {
+    return _formats.lookup(id);
+}
+
 void Logger::error(const char* message) {
     log(LOG_ERROR, message);
 }
@@ -48,19 +114,192 @@ void Logger::debug(const String& message) {
     log(LOG_DEBUG, message.c_str());
 }
 
+void Logger::errorf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vlog(LOG_ERROR, format, args);
+    va_end(args);
+}
+
+void Logger::warnf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vlog(LOG_WARN, format, args);
+    va_end(args);
+}
+
+void Logger::infof(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vlog(LOG_INFO, format, args);
+    va_end(args);
+}
+
+void Logger::debugf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vlog(LOG_DEBUG, format, args);
+    va_end(args);
+}
+
 void Logger::log(LogLevel level, const char* message) {
+    logf(level, "%s", message);
+}
+
+void Logger::logf(LogLevel level, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vlog(level, format, args);
+    va_end(args);
+}
+
+void Logger::vlog(LogLevel level, const char* format, va_list args) {
+    // Filtered levels return before any argument is formatted
     if (level > _logLevel) {
         return;
     }
     
-    char timestamp[32];
-    snprintf(timestamp, sizeof(timestamp), "[%10lu] ", millis());
+    int formatId = -1;
+    if (_format == LOG_FORMAT_BINARY) {
+        formatId = announceFormat(format);
+    }
+    
+    char line[LOG_LINE_MAX];
+    uint32_t ticket = 0;
+    char* buffer = beginRecord(ticket, line);
+    if (buffer == nullptr) {
+        return;  // Ring full, counted as dropped
+    }
+    
+    size_t length;
+    if (_format == LOG_FORMAT_BINARY) {
+        length = encodeBinary(buffer, LOG_LINE_MAX, level, formatId, format, args);
+    } else {
+        length = formatLine(buffer, LOG_LINE_MAX, level, format, args);
+    }
+    
+    commitRecord(ticket, buffer, length);
+}
+
+char* Logger::beginRecord(uint32_t& ticket, char* stackBuffer) {
+    if (_drainTask != nullptr) {
+        // Format straight into a ring slot; the drain task does the UART I/O
+        return _ring.claim(ticket);
+    }
+    
+    // Synchronous mode: format on the stack and issue a single write
+    return stackBuffer;
+}
+
+void Logger::commitRecord(uint32_t ticket, const char* buffer, size_t length) {
+    if (_drainTask != nullptr) {
+        _ring.publish(ticket, length);
+        xTaskNotifyGive(_drainTask);
+        return;
+    }
+    
+    writeOut(buffer, length);
+}
+
+void Logger::writeOut(const char* data, size_t length) {
+    Serial.write(data, length);
+    
+    for (size_t i = 0; i < _sinkCount; i++) {
+        _sinks[i]->write(data, length);
+    }
+}
+
+int Logger::announceFormat(const char* format) {
+    // Formats that cannot fit in one frame are always sent as text
+    if (strlen(format) + LogBinary::FRAME_OVERHEAD + 4 > LOG_LINE_MAX) {
+        return -1;
+    }
+    
+    int id = _formats.intern(format);
+    if (id < 0 || _formats.isAnnounced(id)) {
+        return id;
+    }
+    
+    char record[LOG_LINE_MAX];
+    uint32_t ticket = 0;
+    char* buffer = beginRecord(ticket, record);
+    if (buffer == nullptr) {
+        return -1;  // Retry the announcement on the next use
+    }
+    
+    size_t length = LogBinary::encodeFormat((uint8_t*)buffer, LOG_LINE_MAX, id, format);
+    commitRecord(ticket, buffer, length);
+    if (length == 0) {
+        return -1;
+    }
+    
+    _formats.markAnnounced(id);
+    return id;
+}
+
+size_t Logger::encodeBinary(char* buffer, size_t size, LogLevel level, int formatId,
+                            const char* format, va_list args) {
+    uint32_t timestamp = millis();
     
-    Serial.print(timestamp);
-    Serial.print("[");
-    Serial.print(levelToString(level));
-    Serial.print("] ");
-    Serial.println(message);
+    if (formatId >= 0) {
+        va_list copy;
+        va_copy(copy, args);
+        size_t length = LogBinary::encodeLine((uint8_t*)buffer, size, level, timestamp,
+                                              formatId, format, copy);
+        va_end(copy);
+        if (length > 0) {
+            return length;
+        }
+    }
+    
+    // Unknown format or arguments too large: send the formatted text instead
+    char text[LOG_LINE_MAX];
+    int written = vsnprintf(text, sizeof(text), format, args);
+    size_t length = (written < 0) ? 0 : ((size_t)written < sizeof(text) ? (size_t)written : sizeof(text) - 1);
+    return LogBinary::encodeText((uint8_t*)buffer, size, level, timestamp, text, length);
+}
+
+size_t Logger::formatLine(char* buffer, size_t size, LogLevel level, const char* format, va_list args) {
+    int prefix = snprintf(buffer, size, "[%10lu] [%s] ", millis(), levelToString(level));
+    size_t length = (prefix > 0) ? (size_t)prefix : 0;
+    
+    // Always keep room for the line terminator so lines never run together
+    size_t room = size - length - 2;
+    int body = vsnprintf(buffer + length, room, format, args);
+    if (body > 0) {
+        length += ((size_t)body < room) ? (size_t)body : room - 1;
+    }
+    
+    buffer[length++] = '\r';
+    buffer[length++] = '\n';
+    buffer[length] = '\0';
+    return length;
+}
+
+void Logger::drain() {
+    size_t length;
+    const char* line;
+    
+    while ((line = _ring.peek(length)) != nullptr) {
+        writeOut(line, length);
+        _ring.release();
+    }
+    
+    uint32_t dropped = _ring.getDroppedCount();
+    if (dropped != _reportedDrops) {
+        char notice[64];
+        snprintf(notice, sizeof(notice), "[%10lu] [WARN ] Logger dropped %lu lines\r\n",
+                 millis(), (unsigned long)(dropped - _reportedDrops));
+        writeOut(notice, strlen(notice));
+        _reportedDrops = dropped;
+    }
+}
+
+void Logger::drainTask(void* parameter) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LOG_DRAIN_IDLE_MS));
+        drain();
+    }
 }
 
 const char* Logger::levelToString(LogLevel level) {
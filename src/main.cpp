@@ -1,102 +1,241 @@
 #include <Arduino.h>
 #include <SPIFFS.h>
 #include <ArduinoJson.h>
+#include <esp_heap_caps.h>
 #include "config.h"
 #include "logger.h"
 #include "wifi_manager.h"
 #include "web_server.h"
 #include "ota_manager.h"
 #include "http_client.h"
+#include "async_http_client.h"
+#include "persistent_log.h"
+#include "telemetry_queue.h"
+#include "config_store.h"
+#include "scheduler.h"
+#include "sensor_task.h"
+#include "power_manager.h"
+#include "job_queue.h"
+#include "metrics.h"
 
 // Global objects
 WiFiManager wifiManager;
 WebServerManager webServer;
 OTAManager otaManager;
 HTTPClientManager httpClient;
+AsyncHTTPClient asyncHttp(httpClient);
+PersistentLog persistentLog;
+TelemetryQueue telemetry;
+ConfigStore configStore;
+Scheduler scheduler;
+SensorTask sensors;
+PowerManager power;
+JobQueue jobs;
+
+// Heap report state, read by the metrics below
+uint32_t minLargestBlock = UINT32_MAX;
+float heapFragmentation();
+
+// Metrics served at /api/metrics
+Histogram loopDuration("esp32_loop_duration_seconds", "Time loop() is awake per iteration");
+Gauge uptimeGauge("esp32_uptime_seconds", "Time since boot",
+    []() -> double { return millis() / 1000.0; });
+Gauge freeHeapGauge("esp32_heap_free_bytes", "Free heap",
+    []() -> double { return ESP.getFreeHeap(); });
+Gauge minFreeHeapGauge("esp32_heap_min_free_bytes", "Lowest free heap since boot",
+    []() -> double { return ESP.getMinFreeHeap(); });
+Gauge largestBlockGauge("esp32_heap_largest_free_block_bytes", "Largest allocatable heap block",
+    []() -> double { return ESP.getMaxAllocHeap(); });
+Gauge fragmentationGauge("esp32_heap_fragmentation_ratio", "1 - largest free block / free heap",
+    []() -> double { return heapFragmentation(); });
+Gauge minLargestBlockGauge("esp32_heap_min_largest_free_block_bytes",
+    "Smallest largest-free-block seen by the heap report",
+    []() -> double { return minLargestBlock; });
+Counter allocFailures("esp32_heap_alloc_failures_total", "Heap allocations that failed");
+Gauge dutyCycleGauge("esp32_loop_duty_ratio", "Share of time loop() was awake",
+    []() -> double { return power.getDutyCycle(); });
+Gauge rssiGauge("esp32_wifi_rssi_dbm", "WiFi signal strength, 0 while disconnected",
+    []() -> double { return wifiManager.isConnected() ? WiFi.RSSI() : 0; });
+Gauge logDropsGauge("esp32_log_dropped_total", "Log lines dropped because the ring was full",
+    []() -> double { return Logger::getDroppedCount(); }, "counter");
+Gauge sensorDropsGauge("esp32_sensor_dropped_total", "Samples dropped because the loop fell behind",
+    []() -> double { return sensors.getDroppedCount(); }, "counter");
+Gauge samplesSentGauge("esp32_telemetry_samples_sent_total", "Telemetry samples accepted by the server",
+    []() -> double { return telemetry.getSamplesSent(); }, "counter");
+Gauge samplesDroppedGauge("esp32_telemetry_samples_dropped_total", "Telemetry samples lost to a full queue",
+    []() -> double { return telemetry.getSamplesDropped(); }, "counter");
+Gauge uploadsFailedGauge("esp32_telemetry_uploads_failed_total", "Telemetry uploads the server did not accept",
+    []() -> double { return telemetry.getUploadsFailed(); }, "counter");
+Gauge configWritesGauge("esp32_config_writes_total", "Config writes to flash",
+    []() -> double { return configStore.getWriteCount(); }, "counter");
 
 // Application state
 bool isConfigured = false;
-unsigned long lastDataSend = 0;
-const unsigned long DATA_SEND_INTERVAL = 60000; // Send data every 60 seconds
+bool otaStarted = false;
+int networkTask = Scheduler::INVALID_TASK;
+int httpTask = Scheduler::INVALID_TASK;
 
 // Function prototypes
 void loadConfiguration();
-void saveConfiguration(const char* ssid, const char* password);
-String getStatusJSON();
-void sendExampleData();
+void handleNetwork();
+void updatePowerState();
+unsigned long pollInterval();
+void buildStatus(JsonDocument& doc);
+uint32_t statusFingerprint();
+bool readExampleSensor(float& temperature, float& humidity);
+void forwardSamples();
+void reportHeap();
+void onAllocFailed(size_t size, uint32_t caps, const char* function);
 
 void setup() {
     // Initialize logger
     Logger::begin(SERIAL_BAUD_RATE);
     Logger::setLogLevel(LOG_INFO);
+    if (LOG_ASYNC_ENABLED) {
+        Logger::beginAsync(LOG_RING_SLOTS);
+    }
+    if (LOG_BINARY_ENABLED) {
+        Logger::setFormat(LOG_FORMAT_BINARY);
+    }
+    
+    // Keep a copy of the log in flash so it survives reboots
+    if (LOG_PERSIST_ENABLED && SPIFFS.begin(FORMAT_SPIFFS_IF_FAILED)) {
+        if (persistentLog.begin(SPIFFS, LOG_PERSIST_FILE)) {
+            Logger::addSink(&persistentLog);
+            webServer.setPersistentLog(&persistentLog);
+        } else {
+            Logger::warn("Persistent log unavailable");
+        }
+    }
     
     Logger::info("===========================================");
     Logger::info("ESP32 Template Project");
     Logger::info("===========================================");
     Logger::info("Starting system initialization...");
+    LOG_INFOF("Main loop on core %d of %d", (int)xPortGetCoreID(), (int)ESP.getChipCores());
+    heap_caps_register_failed_alloc_callback(onAllocFailed);
     
     // Initialize WiFi Manager
     wifiManager.begin();
+    wifiManager.addNetwork(WIFI_BACKUP_SSID, WIFI_BACKUP_PASSWORD);
     
-    // Load configuration from SPIFFS
+    // Light/modem sleep between scheduled work
+    power.begin();
+    
+    // Load configuration from SPIFFS; kept in RAM from here on
     loadConfiguration();
     
-    // Initialize Web Server
+    // Initialize Web Server; slow work from its handlers runs as jobs on
+    // the main loop
+    jobs.begin();
+    webServer.setJobQueue(&jobs);
     webServer.begin();
     
-    // Setup web server callbacks
+    // Setup web server callbacks; the config update runs as a job
     webServer.onConfigUpdate([](const char* ssid, const char* password) {
         Logger::info("Configuration updated via web interface");
-        saveConfiguration(ssid, password);
+        isConfigured = true;
         
-        // Reconnect with new credentials
-        delay(1000);
-        wifiManager.connect(ssid, password);
+        // Reconnect with new credentials after a moment, so the browser
+        // can still see the job finish
+        wifiManager.connect(ssid, password, 1000);
+        webServer.invalidateStatus();
     });
     
-    webServer.onGetStatus([]() {
-        return getStatusJSON();
-    });
+    webServer.onGetStatus(buildStatus, statusFingerprint);
     
-    // Initialize OTA (only if WiFi is connected)
-    if (wifiManager.isConnected()) {
-        otaManager.begin(OTA_HOSTNAME, OTA_PASSWORD);
+    // Network requests run on a worker task so loop() never blocks on them
+    asyncHttp.begin();
+    
+    // Batched telemetry uplink, spilling to SPIFFS while offline
+    telemetry.begin(asyncHttp, SPIFFS, TELEMETRY_ENDPOINT);
+    
+    // Periodic work, run from loop()
+    networkTask = scheduler.every(pollInterval(), handleNetwork);
+    httpTask = scheduler.every(pollInterval(), []() { asyncHttp.handle(); });
+    scheduler.every(LOOP_HOUSEKEEPING_INTERVAL, updatePowerState);
+    scheduler.every(LOOP_HOUSEKEEPING_INTERVAL, []() { webServer.handle(); });
+    scheduler.every(LOOP_HOUSEKEEPING_INTERVAL, []() {
+        telemetry.handle(wifiManager.isConnected() && !otaManager.isUpdating());
+    });
+    scheduler.every(LOOP_HOUSEKEEPING_INTERVAL, []() { configStore.handle(); });
+    scheduler.every(LOOP_HOUSEKEEPING_INTERVAL, []() { jobs.handle(); });
+    scheduler.every(HEAP_REPORT_INTERVAL, reportHeap);
+    
+    // Pull firmware updates from the manifest server; a check that falls
+    // while offline is skipped until the next interval
+    if (strlen(OTA_MANIFEST_URL) > 0) {
+        scheduler.every(OTA_PULL_INTERVAL, []() {
+            if (wifiManager.isConnected()) {
+                otaManager.checkForUpdate(OTA_MANIFEST_URL);
+            }
+        }, OTA_PULL_FIRST_DELAY);
     }
     
+    // Sensors are sampled on their own task; the loop forwards the samples
+    // to the telemetry queue, which keeps them while offline and uploads
+    // them in batches once WiFi is back
+    sensors.begin(readExampleSensor);
+    scheduler.every(LOOP_HOUSEKEEPING_INTERVAL, forwardSamples);
+    
     Logger::info("System initialization completed!");
     Logger::info("===========================================\n");
     
     if (!isConfigured) {
         Logger::warn("WiFi not configured. Please connect to the device and configure WiFi.");
-        Logger::info("Access the web interface at: http://" + WiFi.softAPIP().toString());
+        wifiManager.startAccessPoint();
+        LOG_INFOF("Access the web interface at: http://%s", WiFi.softAPIP().toString().c_str());
     }
 }
 
 void loop() {
-    // Handle WiFi reconnection
-    if (isConfigured) {
-        wifiManager.handleReconnect();
+    // Run due tasks, then sleep until the next one
+    uint32_t start = micros();
+    unsigned long wait = scheduler.run();
+    loopDuration.record(micros() - start);
+    power.idle(wait);
+}
+
+void updatePowerState() {
+    // Full speed and fast polling only while there is work in flight
+    bool busy = otaManager.isUpdating() || asyncHttp.pending() > 0;
+    if (busy == power.isBusy()) {
+        return;
     }
     
-    // Handle OTA updates (only if WiFi is connected)
-    if (wifiManager.isConnected()) {
-        otaManager.handle();
+    power.setBusy(busy);
+    scheduler.setInterval(networkTask, pollInterval());
+    scheduler.setInterval(httpTask, pollInterval());
+}
+
+unsigned long pollInterval() {
+    if (POWER_SAVE_ENABLED && !power.isBusy()) {
+        return POWER_IDLE_POLL_INTERVAL;
     }
+    return LOOP_POLL_INTERVAL;
+}
+
+void handleNetwork() {
+    // Drive the WiFi connection; never blocks
+    wifiManager.handle();
     
-    // Handle web server
-    webServer.handle();
-    
-    // Send example data periodically (only if WiFi is connected and not updating)
-    if (wifiManager.isConnected() && !otaManager.isUpdating()) {
-        unsigned long currentMillis = millis();
-        if (currentMillis - lastDataSend >= DATA_SEND_INTERVAL) {
-            lastDataSend = currentMillis;
-            sendExampleData();
+    // Handle OTA updates (only if WiFi is connected); started on the
+    // first connection since connecting no longer happens in setup()
+    if (wifiManager.isConnected()) {
+        if (!otaStarted) {
+            otaManager.begin(OTA_HOSTNAME, OTA_PASSWORD);
+            otaStarted = true;
         }
+        otaManager.handle();
     }
     
-    // Small delay to prevent watchdog issues
-    delay(10);
+    // A pulled image was verified and marked bootable
+    if (otaManager.isRestartPending()) {
+        Logger::info("Restarting into the new firmware");
+        configStore.flush();
+        Logger::flush();
+        ESP.restart();
+    }
 }
 
 void loadConfiguration() {
@@ -106,41 +245,13 @@ void loadConfiguration() {
         return;
     }
     
-    // Try to load configuration
-    File file = SPIFFS.open(CONFIG_FILE, "r");
-    if (!file) {
+    if (!configStore.begin(SPIFFS, CONFIG_FILE)) {
         Logger::warn("Configuration file not found. Using default AP mode.");
-        
-        // Create default config file
-        StaticJsonDocument<256> doc;
-        doc["ssid"] = "";
-        doc["password"] = "";
-        
-        File newFile = SPIFFS.open(CONFIG_FILE, "w");
-        if (newFile) {
-            serializeJson(doc, newFile);
-            newFile.close();
-        }
-        
-        isConfigured = false;
-        return;
     }
+    webServer.setConfigStore(&configStore);
     
-    // Parse configuration
-    StaticJsonDocument<256> doc;
-    DeserializationError error = deserializeJson(doc, file);
-    file.close();
-    
-    if (error) {
-        Logger::error("Failed to parse configuration file");
-        isConfigured = false;
-        return;
-    }
-    
-    const char* ssid = doc["ssid"];
-    const char* password = doc["password"];
-    
-    if (ssid == nullptr || strlen(ssid) == 0) {
+    DeviceConfig config = configStore.get();
+    if (config.ssid[0] == '\0') {
         Logger::warn("No WiFi credentials found in configuration");
         isConfigured = false;
         return;
@@ -148,37 +259,13 @@ void loadConfiguration() {
     
     Logger::info("Configuration loaded successfully");
     
-    // Connect to WiFi
-    if (wifiManager.connect(ssid, password)) {
-        isConfigured = true;
-    } else {
-        Logger::warn("Failed to connect with stored credentials");
-        isConfigured = false;
-    }
-}
-
-void saveConfiguration(const char* ssid, const char* password) {
-    StaticJsonDocument<256> doc;
-    doc["ssid"] = ssid;
-    doc["password"] = password;
-    
-    File file = SPIFFS.open(CONFIG_FILE, "w");
-    if (!file) {
-        Logger::error("Failed to save configuration");
-        return;
-    }
-    
-    serializeJson(doc, file);
-    file.close();
-    
-    Logger::info("Configuration saved to SPIFFS");
-    isConfigured = true;
+    // Connect to WiFi in the background; loop() keeps running meanwhile
+    isConfigured = wifiManager.connect(config.ssid, config.password);
 }
 
-String getStatusJSON() {
-    StaticJsonDocument<512> doc;
-    
+void buildStatus(JsonDocument& doc) {
     doc["device_name"] = DEFAULT_DEVICE_NAME;
+    doc["firmware_version"] = FIRMWARE_VERSION;
     doc["uptime"] = millis();
     doc["wifi_connected"] = wifiManager.isConnected();
     
@@ -186,6 +273,7 @@ String getStatusJSON() {
         doc["ssid"] = wifiManager.getSSID();
         doc["ip_address"] = wifiManager.getIPAddress();
         doc["signal_strength"] = WiFi.RSSI();
+        doc["wifi_connect_time"] = wifiManager.getConnectDuration();
     } else {
         doc["ssid"] = "Not connected";
         doc["ip_address"] = "N/A";
@@ -193,33 +281,72 @@ String getStatusJSON() {
     }
     
     doc["free_heap"] = ESP.getFreeHeap();
+    doc["largest_free_block"] = ESP.getMaxAllocHeap();
     doc["chip_model"] = ESP.getChipModel();
     doc["chip_cores"] = ESP.getChipCores();
     doc["sdk_version"] = ESP.getSdkVersion();
     
-    String output;
-    serializeJson(doc, output);
-    
-    return output;
+    int otaProgress = otaManager.getProgress();
+    if (otaProgress >= 0) {
+        doc["ota_progress"] = otaProgress;
+    }
 }
 
-void sendExampleData() {
-    // Example: Send simulated sensor data
-    float temperature = 22.5 + (random(-50, 50) / 10.0); // Simulated temperature
-    float humidity = 55.0 + (random(-100, 100) / 10.0);   // Simulated humidity
-    
-    Logger::debug("Preparing to send sensor data...");
-    
-    // Replace this URL with your actual endpoint
-    const char* endpoint = "http://your-server.com/api/data";
-    
-    // Uncomment to actually send data
-    // bool success = httpClient.sendSensorData(endpoint, temperature, humidity);
-    // if (success) {
-    //     Logger::info("Data sent successfully");
-    // } else {
-    //     Logger::warn("Failed to send data");
-    // }
-    
-    Logger::debug("Temperature: " + String(temperature) + "°C, Humidity: " + String(humidity) + "%");
+uint32_t statusFingerprint() {
+    // Status fields that should reach the dashboard without waiting for
+    // STATUS_REFRESH_INTERVAL: connection state and OTA progress. RSSI,
+    // uptime and heap drift all the time and wait for the refresh.
+    uint32_t hash = 2166136261u;
+    auto mix = [&hash](uint32_t value) {
+        hash = (hash ^ value) * 16777619u;
+    };
+    
+    bool connected = wifiManager.isConnected();
+    mix(connected);
+    if (connected) {
+        mix((uint32_t)WiFi.localIP());
+        mix((uint32_t)wifiManager.getConnectDuration());
+    }
+    mix((uint32_t)otaManager.getProgress());
+    return hash;
+}
+
+bool readExampleSensor(float& temperature, float& humidity) {
+    // Example: simulated sensor, runs on the sensor task
+    temperature = 22.5 + (random(-50, 50) / 10.0);
+    humidity = 55.0 + (random(-100, 100) / 10.0);
+    return true;
+}
+
+void forwardSamples() {
+    // Queued and uploaded in batches; set TELEMETRY_ENDPOINT in config.h
+    // to your server to actually send data
+    SensorTask::Sample sample;
+    while (sensors.read(sample)) {
+        telemetry.add(sample);
+        LOG_DEBUGF("Temperature: %.2f°C, Humidity: %.2f%%", sample.temperature, sample.humidity);
+    }
+}
+
+float heapFragmentation() {
+    // 0 while all free memory is one block, towards 1 as it splinters
+    uint32_t free = ESP.getFreeHeap();
+    return free > 0 ? 1.0f - (float)ESP.getMaxAllocHeap() / free : 0.0f;
+}
+
+void reportHeap() {
+    // Largest block vs. free heap over time; a shrinking largest block
+    // with steady free heap means fragmentation, not a leak
+    uint32_t largest = ESP.getMaxAllocHeap();
+    if (largest < minLargestBlock) {
+        minLargestBlock = largest;
+    }
+    LOG_INFOF("Heap: %u free, %u largest block (%d%% fragmented), %u min free, %u min largest, %u failed allocs",
+              (unsigned)ESP.getFreeHeap(), (unsigned)largest, (int)(heapFragmentation() * 100),
+              (unsigned)ESP.getMinFreeHeap(), (unsigned)minLargestBlock, (unsigned)allocFailures.get());
+}
+
+void onAllocFailed(size_t size, uint32_t caps, const char* function) {
+    // Runs inside the failing allocation; only count it
+    allocFailures.add();
 }
@@ -0,0 +1,75 @@
+#include "metrics.h"
+
+// Upper bounds of the histogram buckets in microseconds; the last bucket
+// (+Inf) catches everything above
+static const uint32_t BUCKET_BOUNDS[Histogram::BUCKETS - 1] = {
+    100, 1000, 5000, 10000, 50000, 100000, 500000, 1000000, 5000000
+};
+
+// Zero-initialized before any constructor runs
+Metric* Metric::_first = nullptr;
+
+Metric::Metric(const char* name, const char* help, const char* type)
+    : _name(name), _help(help), _type(type), _next(_first) {
+    _first = this;
+}
+
+void Metric::writeAll(Print& out) {
+    for (Metric* metric = _first; metric != nullptr; metric = metric->_next) {
+        out.printf("# HELP %s %s\n# TYPE %s %s\n", metric->_name, metric->_help,
+                   metric->_name, metric->_type);
+        metric->writeValues(out);
+    }
+}
+
+Counter::Counter(const char* name, const char* help)
+    : Metric(name, help, "counter"), _value(0) {
+}
+
+void Counter::writeValues(Print& out) const {
+    out.printf("%s %lu\n", _name, (unsigned long)get());
+}
+
+Gauge::Gauge(const char* name, const char* help, Reader reader, const char* type)
+    : Metric(name, help, type), _reader(reader) {
+}
+
+void Gauge::writeValues(Print& out) const {
+    out.printf("%s %.10g\n", _name, _reader());
+}
+
+Histogram::Histogram(const char* name, const char* help)
+    : Metric(name, help, "histogram"), _sum(0) {
+    for (size_t i = 0; i < BUCKETS; i++) {
+        _buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void Histogram::record(uint32_t micros) {
+    size_t bucket = 0;
+    while (bucket < BUCKETS - 1 && micros > BUCKET_BOUNDS[bucket]) {
+        bucket++;
+    }
+
+    // Count and cumulative buckets are derived when exported
+    _buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    portENTER_CRITICAL(&_sumLock);
+    _sum += micros;
+    portEXIT_CRITICAL(&_sumLock);
+}
+
+void Histogram::writeValues(Print& out) const {
+    uint32_t cumulative = 0;
+    for (size_t i = 0; i < BUCKETS - 1; i++) {
+        cumulative += _buckets[i].load(std::memory_order_relaxed);
+        out.printf("%s_bucket{le=\"%g\"} %lu\n", _name, BUCKET_BOUNDS[i] / 1e6,
+                   (unsigned long)cumulative);
+    }
+    cumulative += _buckets[BUCKETS - 1].load(std::memory_order_relaxed);
+    out.printf("%s_bucket{le=\"+Inf\"} %lu\n", _name, (unsigned long)cumulative);
+    portENTER_CRITICAL(&_sumLock);
+    uint64_t sum = _sum;
+    portEXIT_CRITICAL(&_sumLock);
+    out.printf("%s_sum %.6f\n", _name, sum / 1e6);
+    out.printf("%s_count %lu\n", _name, (unsigned long)cumulative);
+}
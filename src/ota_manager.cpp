@@ -1,8 +1,40 @@
 #include "ota_manager.h"
-#include "config.h"
+#include <memory>
+#include <ArduinoJson.h>
+#include <HTTPClient.h>
+#include <Update.h>
+#include <WiFiClientSecure.h>
+#include <esp_ota_ops.h>
+#include <mbedtls/sha256.h>
+#include "delta_patch.h"
+#include "http_body_stream.h"
 #include "logger.h"
 
-OTAManager::OTAManager() : _updating(false) {
+static const uint8_t OTA_NO_BUFFER = 0xFF;
+
+// The SHA-256 check is only as good as the manifest it comes from, so
+// every pull request must be HTTPS verified against OTA_CA_CERT
+static bool isTrustedUrl(const char* url) {
+    return strncmp(url, "https://", 8) == 0 && strlen(OTA_CA_CERT) > 0;
+}
+
+// Verifying TLS client for url, nullptr if url cannot be trusted
+static WiFiClient* createClient(const char* url) {
+    if (!isTrustedUrl(url)) {
+        LOG_ERRORF("OTA: refusing %s (https:// and OTA_CA_CERT required)", url);
+        return nullptr;
+    }
+    WiFiClientSecure* tls = new WiFiClientSecure();
+    tls->setCACert(OTA_CA_CERT);
+    return tls;
+}
+
+OTAManager::OTAManager()
+    : _updating(false), _restartPending(false), _written(0), _imageSize(0), _pullTask(nullptr),
+      _freeBuffers(nullptr), _fullBuffers(nullptr), _writerDone(nullptr), _writeFailed(false) {
+    _manifestUrl[0] = '\0';
+    _buffers[0] = _buffers[1] = nullptr;
+    _lengths[0] = _lengths[1] = 0;
 }
 
 void OTAManager::begin(const char* hostname, const char* password) {
@@ -15,27 +47,67 @@ void OTAManager::begin(const char* hostname, const char* password) {
     setupCallbacks();
     
     ArduinoOTA.begin();
-    Logger::info("OTA initialized. Hostname: " + String(hostname));
+    LOG_INFOF("OTA initialized. Hostname: %s", hostname);
 }
 
 void OTAManager::handle() {
-    ArduinoOTA.handle();
+    // A pushed update would fight the pull for the Update instance
+    if (_pullTask == nullptr) {
+        ArduinoOTA.handle();
+    }
 }
 
 bool OTAManager::isUpdating() {
     return _updating;
 }
 
+bool OTAManager::checkForUpdate(const char* manifestUrl) {
+    if (_pullTask != nullptr || _updating || _restartPending) {
+        return false;
+    }
+    if (manifestUrl == nullptr || strlen(manifestUrl) >= sizeof(_manifestUrl)) {
+        Logger::error("OTA: invalid manifest URL");
+        return false;
+    }
+    if (!isTrustedUrl(manifestUrl)) {
+        Logger::error("OTA: pull updates need an https:// manifest URL and OTA_CA_CERT");
+        return false;
+    }
+    strcpy(_manifestUrl, manifestUrl);
+    
+    BaseType_t created = xTaskCreatePinnedToCore(
+        pullTask, "ota_pull", OTA_TASK_STACK_SIZE, this,
+        OTA_TASK_PRIORITY, &_pullTask, OTA_TASK_CORE);
+    
+    if (created != pdPASS) {
+        _pullTask = nullptr;
+        Logger::error("OTA: failed to start pull task");
+        return false;
+    }
+    return true;
+}
+
+int OTAManager::getProgress() {
+    if (_pullTask == nullptr || !_updating || _imageSize == 0) {
+        return -1;
+    }
+    return (int)((uint64_t)_written * 100 / _imageSize);
+}
+
+bool OTAManager::isRestartPending() {
+    return _restartPending;
+}
+
 void OTAManager::setupCallbacks() {
     ArduinoOTA.onStart([this]() {
         _updating = true;
-        String type;
+        const char* type;
         if (ArduinoOTA.getCommand() == U_FLASH) {
             type = "sketch";
         } else {  // U_SPIFFS
             type = "filesystem";
         }
-        Logger::info("OTA Update Started: " + type);
+        LOG_INFOF("OTA Update Started: %s", type);
     });
     
     ArduinoOTA.onEnd([this]() {
@@ -49,27 +121,399 @@ void OTAManager::setupCallbacks() {
         
         // Only log every 10%
         if (currentProgress >= lastProgress + 10) {
-            Logger::info("OTA Progress: " + String(currentProgress) + "%");
+            LOG_INFOF("OTA Progress: %u%%", currentProgress);
             lastProgress = currentProgress;
         }
     });
     
     ArduinoOTA.onError([this](ota_error_t error) {
         _updating = false;
-        String errorMsg = "OTA Error[" + String(error) + "]: ";
+        const char* reason = "";
         
         if (error == OTA_AUTH_ERROR) {
-            errorMsg += "Auth Failed";
+            reason = "Auth Failed";
         } else if (error == OTA_BEGIN_ERROR) {
-            errorMsg += "Begin Failed";
+            reason = "Begin Failed";
         } else if (error == OTA_CONNECT_ERROR) {
-            errorMsg += "Connect Failed";
+            reason = "Connect Failed";
         } else if (error == OTA_RECEIVE_ERROR) {
-            errorMsg += "Receive Failed";
+            reason = "Receive Failed";
         } else if (error == OTA_END_ERROR) {
-            errorMsg += "End Failed";
+            reason = "End Failed";
         }
         
-        Logger::error(errorMsg);
+        LOG_ERRORF("OTA Error[%d]: %s", (int)error, reason);
     });
 }
+
+void OTAManager::pull() {
+    Manifest manifest;
+    if (!fetchManifest(manifest)) {
+        return;
+    }
+    
+    if (strcmp(manifest.version, FIRMWARE_VERSION) == 0) {
+        LOG_INFOF("OTA: firmware %s is up to date", FIRMWARE_VERSION);
+        return;
+    }
+    
+    LOG_INFOF("OTA: updating %s -> %s (%u bytes)", FIRMWARE_VERSION, manifest.version,
+              (unsigned)manifest.size);
+    
+    _updating = true;
+    bool ok = false;
+    
+    // A patch against the running image is much smaller than the image;
+    // any problem with it falls back to the full download
+    if (manifest.patchUrl[0] != '\0') {
+        ok = installPatch(manifest);
+        if (!ok) {
+            Logger::warn("OTA: delta update failed, downloading the full image");
+        }
+    }
+    if (!ok) {
+        ok = install(manifest.url, manifest.size, manifest, nullptr);
+    }
+    
+    _restartPending = ok;
+    _updating = false;
+}
+
+bool OTAManager::installPatch(const Manifest& manifest) {
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    const void* source = nullptr;
+    spi_flash_mmap_handle_t handle;
+    
+    if (running == nullptr ||
+        esp_partition_mmap(running, 0, running->size, SPI_FLASH_MMAP_DATA, &source, &handle) != ESP_OK) {
+        Logger::error("OTA: cannot map the running image");
+        return false;
+    }
+    
+    LOG_INFOF("OTA: applying %u byte delta patch", (unsigned)manifest.patchSize);
+    DeltaPatch patch;
+    patch.begin(static_cast<const uint8_t*>(source), running->size);
+    bool ok = install(manifest.patchUrl, manifest.patchSize, manifest, &patch);
+    
+    spi_flash_munmap(handle);
+    return ok;
+}
+
+bool OTAManager::install(const char* url, size_t downloadSize, const Manifest& manifest,
+                         DeltaPatch* patch) {
+    if (!Update.begin(manifest.size, U_FLASH)) {
+        LOG_ERRORF("OTA: cannot start update: %s", Update.errorString());
+        return false;
+    }
+    
+    _written = 0;
+    _imageSize = manifest.size;
+    
+    unsigned long startedAt = millis();
+    bool ok = download(url, downloadSize, manifest, patch);
+    
+    if (ok && Update.end(true)) {
+        unsigned long elapsed = millis() - startedAt;
+        LOG_INFOF("OTA: %u bytes in %lu ms (%lu KB/s), restart to apply", (unsigned)downloadSize,
+                  elapsed, (unsigned long)((uint64_t)downloadSize * 1000 / 1024 / (elapsed > 0 ? elapsed : 1)));
+        return true;
+    }
+    
+    if (ok) {
+        LOG_ERRORF("OTA: finishing update failed: %s", Update.errorString());
+    }
+    Update.abort();
+    return false;
+}
+
+bool OTAManager::fetchManifest(Manifest& manifest) {
+    std::unique_ptr<WiFiClient> client(createClient(_manifestUrl));
+    if (!client) {
+        return false;
+    }
+    HTTPClient http;
+    const char* headers[] = { "Transfer-Encoding" };
+    http.collectHeaders(headers, 1);
+    http.begin(*client, _manifestUrl);
+    http.setTimeout(HTTP_TIMEOUT);
+    
+    int httpCode = http.GET();
+    if (httpCode != 200) {
+        LOG_ERRORF("OTA: manifest request failed: %d", httpCode);
+        http.end();
+        return false;
+    }
+    
+    // Parsed straight off the connection, never held as a String
+    bool chunked = http.header("Transfer-Encoding").equalsIgnoreCase("chunked");
+    HTTPBodyStream body(*client, http.getSize(), chunked, HTTP_TIMEOUT);
+    StaticJsonDocument<1024> doc;
+    DeserializationError error = deserializeJson(doc, body);
+    http.end();
+    
+    if (error) {
+        LOG_ERRORF("OTA: invalid manifest: %s", error.c_str());
+        return false;
+    }
+    
+    const char* url = doc["url"] | "";
+    const char* version = doc["version"] | "";
+    const char* sha256 = doc["sha256"] | "";
+    manifest.size = doc["size"] | 0;
+    
+    if (strlen(url) == 0 || strlen(url) >= sizeof(manifest.url) ||
+        strlen(version) == 0 || strlen(version) >= sizeof(manifest.version) ||
+        strlen(sha256) != 64 || manifest.size == 0) {
+        Logger::error("OTA: manifest is missing url, version, size or sha256");
+        return false;
+    }
+    
+    strlcpy(manifest.url, url, sizeof(manifest.url));
+    strlcpy(manifest.version, version, sizeof(manifest.version));
+    strlcpy(manifest.sha256, sha256, sizeof(manifest.sha256));
+    
+    // Optional patches, each against the image of one older version
+    manifest.patchUrl[0] = '\0';
+    manifest.patchSize = 0;
+    for (JsonObject patch : doc["patches"].as<JsonArray>()) {
+        const char* from = patch["from"] | "";
+        const char* patchUrl = patch["url"] | "";
+        if (strcmp(from, FIRMWARE_VERSION) == 0 && strlen(patchUrl) < sizeof(manifest.patchUrl)) {
+            strlcpy(manifest.patchUrl, patchUrl, sizeof(manifest.patchUrl));
+            manifest.patchSize = patch["size"] | 0;
+            break;
+        }
+    }
+    return true;
+}
+
+bool OTAManager::download(const char* url, size_t size, const Manifest& manifest, DeltaPatch* patch) {
+    if (!startPipeline()) {
+        return false;
+    }
+    
+    mbedtls_sha256_context hash;
+    mbedtls_sha256_init(&hash);
+    mbedtls_sha256_starts(&hash, 0);
+    
+    // Bytes of the download received so far, where a resumed request
+    // continues, and bytes of the image produced from them. The same
+    // unless a patch is being applied.
+    size_t received = 0;
+    size_t produced = 0;
+    int retries = 0;
+    
+    auto complete = [&]() {
+        return patch != nullptr ? patch->finished() || patch->failed() : received >= size;
+    };
+    
+    while (!complete() && !_writeFailed && retries <= OTA_RESUME_RETRIES) {
+        if (received > 0) {
+            LOG_WARNF("OTA: resuming download at %u bytes", (unsigned)received);
+            vTaskDelay(pdMS_TO_TICKS(1000));
+        }
+        
+        std::unique_ptr<WiFiClient> client(createClient(url));
+        if (!client) {
+            break;
+        }
+        HTTPClient http;
+        const char* headers[] = { "Transfer-Encoding" };
+        http.collectHeaders(headers, 1);
+        http.begin(*client, url);
+        http.setTimeout(HTTP_TIMEOUT);
+        if (received > 0) {
+            char range[32];
+            snprintf(range, sizeof(range), "bytes=%u-", (unsigned)received);
+            http.addHeader("Range", range);
+        }
+        
+        int httpCode = http.GET();
+        
+        // A server without Range support sends everything again
+        size_t skip = 0;
+        if (httpCode == 200) {
+            skip = received;
+        } else if (httpCode != 206 || received == 0) {
+            LOG_ERRORF("OTA: image request failed: %d", httpCode);
+            http.end();
+            retries++;
+            continue;
+        }
+        
+        bool chunked = http.header("Transfer-Encoding").equalsIgnoreCase("chunked");
+        HTTPBodyStream body(*client, http.getSize(), chunked, HTTP_TIMEOUT);
+        size_t progress = received;
+        
+        while (skip > 0) {
+            uint8_t index;
+            xQueueReceive(_freeBuffers, &index, portMAX_DELAY);
+            size_t length = body.readChunk(_buffers[index], skip < OTA_CHUNK_SIZE ? skip : OTA_CHUNK_SIZE);
+            xQueueSend(_freeBuffers, &index, portMAX_DELAY);
+            if (length == 0) {
+                break;
+            }
+            skip -= length;
+        }
+        
+        while (skip == 0 && !complete() && !_writeFailed) {
+            uint8_t index;
+            xQueueReceive(_freeBuffers, &index, portMAX_DELAY);
+            
+            // While the writer flashes the other buffer
+            size_t length;
+            if (patch != nullptr) {
+                length = patch->decode(body, _buffers[index], OTA_CHUNK_SIZE);
+                received = patch->getConsumed();
+            } else {
+                size_t wanted = size - received;
+                length = body.readChunk(_buffers[index], wanted < OTA_CHUNK_SIZE ? wanted : OTA_CHUNK_SIZE);
+                received += length;
+            }
+            
+            if (length == 0) {
+                xQueueSend(_freeBuffers, &index, portMAX_DELAY);
+                break;
+            }
+            
+            mbedtls_sha256_update(&hash, _buffers[index], length);
+            _lengths[index] = length;
+            produced += length;
+            xQueueSend(_fullBuffers, &index, portMAX_DELAY);
+        }
+        
+        http.end();
+        
+        if (patch != nullptr && patch->failed()) {
+            break;
+        }
+        if (received > progress) {
+            retries = 0;
+        } else {
+            retries++;
+        }
+    }
+    
+    stopPipeline();
+    
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&hash, digest);
+    mbedtls_sha256_free(&hash);
+    
+    if (_writeFailed) {
+        LOG_ERRORF("OTA: flash write failed: %s", Update.errorString());
+        return false;
+    }
+    if ((patch != nullptr && !patch->finished()) || produced != manifest.size) {
+        LOG_ERRORF("OTA: download failed at %u of %u bytes", (unsigned)received, (unsigned)size);
+        return false;
+    }
+    
+    char hex[65];
+    for (int i = 0; i < 32; i++) {
+        snprintf(hex + i * 2, 3, "%02x", digest[i]);
+    }
+    if (strcasecmp(hex, manifest.sha256) != 0) {
+        LOG_ERRORF("OTA: SHA-256 mismatch, got %s", hex);
+        return false;
+    }
+    
+    Logger::info("OTA: image verified");
+    return true;
+}
+
+bool OTAManager::startPipeline() {
+    _writeFailed = false;
+    _buffers[0] = (uint8_t*)malloc(OTA_CHUNK_SIZE);
+    _buffers[1] = (uint8_t*)malloc(OTA_CHUNK_SIZE);
+    _freeBuffers = xQueueCreate(2, sizeof(uint8_t));
+    _fullBuffers = xQueueCreate(3, sizeof(uint8_t));  // Two buffers plus OTA_NO_BUFFER
+    _writerDone = xSemaphoreCreateBinary();
+    
+    if (_buffers[0] == nullptr || _buffers[1] == nullptr || _freeBuffers == nullptr ||
+        _fullBuffers == nullptr || _writerDone == nullptr) {
+        Logger::error("OTA: failed to allocate download buffers");
+        if (_writerDone != nullptr) {
+            vSemaphoreDelete(_writerDone);
+            _writerDone = nullptr;
+        }
+        stopPipeline();
+        return false;
+    }
+    
+    for (uint8_t i = 0; i < 2; i++) {
+        xQueueSend(_freeBuffers, &i, 0);
+    }
+    
+    // Single-core chips only have core 0
+    BaseType_t core = (portNUM_PROCESSORS > 1) ? (OTA_TASK_CORE ^ 1) : 0;
+    BaseType_t created = xTaskCreatePinnedToCore(
+        writerTask, "ota_write", OTA_WRITER_STACK_SIZE, this,
+        OTA_TASK_PRIORITY, nullptr, core);
+    
+    if (created != pdPASS) {
+        Logger::error("OTA: failed to start writer task");
+        vSemaphoreDelete(_writerDone);
+        _writerDone = nullptr;
+        stopPipeline();
+        return false;
+    }
+    return true;
+}
+
+void OTAManager::stopPipeline() {
+    // Let the writer drain what is queued, then free everything
+    if (_writerDone != nullptr) {
+        uint8_t stop = OTA_NO_BUFFER;
+        xQueueSend(_fullBuffers, &stop, portMAX_DELAY);
+        xSemaphoreTake(_writerDone, portMAX_DELAY);
+        vSemaphoreDelete(_writerDone);
+        _writerDone = nullptr;
+    }
+    if (_freeBuffers != nullptr) {
+        vQueueDelete(_freeBuffers);
+        _freeBuffers = nullptr;
+    }
+    if (_fullBuffers != nullptr) {
+        vQueueDelete(_fullBuffers);
+        _fullBuffers = nullptr;
+    }
+    for (int i = 0; i < 2; i++) {
+        free(_buffers[i]);
+        _buffers[i] = nullptr;
+    }
+}
+
+void OTAManager::pullTask(void* parameter) {
+    OTAManager* self = static_cast<OTAManager*>(parameter);
+    self->pull();
+    self->_pullTask = nullptr;
+    vTaskDelete(nullptr);
+}
+
+void OTAManager::writerTask(void* parameter) {
+    OTAManager* self = static_cast<OTAManager*>(parameter);
+    
+    for (;;) {
+        uint8_t index;
+        xQueueReceive(self->_fullBuffers, &index, portMAX_DELAY);
+        if (index == OTA_NO_BUFFER) {
+            break;
+        }
+        
+        // After a failure buffers keep circulating so the download side
+        // never blocks; it sees _writeFailed and stops
+        if (!self->_writeFailed) {
+            size_t length = self->_lengths[index];
+            if (Update.write(self->_buffers[index], length) == length) {
+                self->_written += length;
+            } else {
+                self->_writeFailed = true;
+            }
+        }
+        xQueueSend(self->_freeBuffers, &index, portMAX_DELAY);
+    }
+    
+    xSemaphoreGive(self->_writerDone);
+    vTaskDelete(nullptr);
+}
@@ -0,0 +1,239 @@
+#include "persistent_log.h"
+#include <esp_system.h>
+
+static const uint32_t RTC_TAIL_MAGIC = 0x4C4F4754;  // "LOGT"
+static const size_t PAGE_DATA_SIZE = LOG_PERSIST_PAGE_SIZE - 8;  // Minus PageHeader
+
+// Pending (not yet written) page. RTC slow memory is not cleared by a soft
+// reset, panic or watchdog reset, so these lines survive the reboot.
+struct RtcTail {
+    uint32_t magic;
+    uint32_t length;
+    char data[PAGE_DATA_SIZE];
+};
+
+RTC_NOINIT_ATTR static RtcTail rtcTail;
+
+PersistentLog::PersistentLog()
+    : _lock(nullptr), _writePage(0), _sequence(1), _pageWrites(0) {
+    memset(_pageFormats, 0, sizeof(_pageFormats));
+}
+
+bool PersistentLog::begin(fs::FS& fs, const char* path) {
+    if (_lock == nullptr) {
+        _lock = xSemaphoreCreateMutex();
+    }
+
+    esp_reset_reason_t reason = esp_reset_reason();
+    bool recovered = (rtcTail.magic == RTC_TAIL_MAGIC &&
+                      rtcTail.length <= PAGE_DATA_SIZE &&
+                      reason != ESP_RST_POWERON);
+    if (!recovered) {
+        rtcTail.magic = RTC_TAIL_MAGIC;
+        rtcTail.length = 0;
+    }
+
+    bool opened = openFile(fs, path);
+    if (opened) {
+        findWritePosition();
+    }
+
+    char marker[64];
+    snprintf(marker, sizeof(marker), "--- boot (reset reason %d%s) ---\r\n",
+             (int)reason, recovered ? ", tail recovered" : "");
+    write(marker, strlen(marker));
+
+    return opened;
+}
+
+void PersistentLog::write(const char* data, size_t length) {
+    if (_lock == nullptr) {
+        return;
+    }
+
+    xSemaphoreTake(_lock, portMAX_DELAY);
+
+    // Logger's own announcements are dropped; formats are announced per
+    // page instead, ahead of the line that uses them
+    LogBinary::RecordType type;
+    int formatId = LogBinary::formatIdOf((const uint8_t*)data, length, type);
+    if (formatId < 0 || type != LogBinary::RECORD_FORMAT) {
+        if (formatId >= 0) {
+            announce(formatId);
+        }
+        append(data, length);
+    }
+
+    xSemaphoreGive(_lock);
+}
+
+void PersistentLog::announce(int formatId) {
+    const char* format = Logger::formatString(formatId);
+    uint32_t& word = _pageFormats[formatId / 32];
+    uint32_t bit = 1u << (formatId % 32);
+    if (format == nullptr) {
+        return;
+    }
+
+    // A page written out during the frame clears the set: the announcement
+    // then started in the old page and is repeated in the new one. Frames
+    // are shorter than a page, so this ends within three rounds.
+    while (!(word & bit)) {
+        char frame[LOG_LINE_MAX];
+        size_t length = LogBinary::encodeFormat((uint8_t*)frame, sizeof(frame), formatId, format);
+        if (length == 0) {
+            return;
+        }
+        word |= bit;
+        append(frame, length);
+    }
+}
+
+void PersistentLog::append(const char* data, size_t length) {
+    while (length > 0) {
+        size_t room = PAGE_DATA_SIZE - rtcTail.length;
+        size_t chunk = (length < room) ? length : room;
+
+        memcpy(rtcTail.data + rtcTail.length, data, chunk);
+        rtcTail.length += chunk;
+        data += chunk;
+        length -= chunk;
+
+        if (rtcTail.length == PAGE_DATA_SIZE) {
+            writePage();
+        }
+    }
+}
+
+size_t PersistentLog::read(Cursor& cursor, uint8_t* buffer, size_t maxLen) {
+    if (_lock == nullptr || maxLen == 0) {
+        return 0;
+    }
+
+    xSemaphoreTake(_lock, portMAX_DELAY);
+
+    if (!cursor.started) {
+        // Oldest page is the one that will be overwritten next
+        cursor.started = true;
+        cursor.startPage = _writePage;
+    }
+
+    size_t copied = 0;
+
+    // Persisted pages, oldest first
+    while (_file && cursor.pagesRead < LOG_PERSIST_PAGES && copied == 0) {
+        uint16_t page = (cursor.startPage + cursor.pagesRead) % LOG_PERSIST_PAGES;
+        PageHeader header;
+
+        _file.seek((uint32_t)page * LOG_PERSIST_PAGE_SIZE);
+        bool valid = _file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+                     header.sequence != 0 && header.sequence != 0xFFFFFFFF &&
+                     header.length <= PAGE_DATA_SIZE;
+
+        if (valid && cursor.offset < header.length) {
+            size_t chunk = header.length - cursor.offset;
+            if (chunk > maxLen) {
+                chunk = maxLen;
+            }
+            _file.seek((uint32_t)page * LOG_PERSIST_PAGE_SIZE + sizeof(header) + cursor.offset);
+            copied = _file.read(buffer, chunk);
+            cursor.offset += copied;
+        }
+
+        if (!valid || cursor.offset >= header.length || copied == 0) {
+            cursor.pagesRead++;
+            cursor.offset = 0;
+        }
+    }
+
+    // Then the pending tail still held in RTC memory
+    if (copied == 0 && (!_file || cursor.pagesRead >= LOG_PERSIST_PAGES)) {
+        cursor.pagesRead = LOG_PERSIST_PAGES;
+        if (cursor.offset < rtcTail.length) {
+            size_t chunk = rtcTail.length - cursor.offset;
+            if (chunk > maxLen) {
+                chunk = maxLen;
+            }
+            memcpy(buffer, rtcTail.data + cursor.offset, chunk);
+            cursor.offset += chunk;
+            copied = chunk;
+        }
+    }
+
+    xSemaphoreGive(_lock);
+    return copied;
+}
+
+uint32_t PersistentLog::getPageWrites() const {
+    return _pageWrites;
+}
+
+bool PersistentLog::openFile(fs::FS& fs, const char* path) {
+    const size_t fileSize = (size_t)LOG_PERSIST_PAGES * LOG_PERSIST_PAGE_SIZE;
+
+    if (fs.exists(path)) {
+        _file = fs.open(path, "r+");
+        if (_file && _file.size() == fileSize) {
+            return true;
+        }
+        _file.close();
+    }
+
+    // Preallocate every page once so later writes never grow the file
+    File file = fs.open(path, FILE_WRITE);
+    if (!file) {
+        return false;
+    }
+
+    uint8_t empty[LOG_PERSIST_PAGE_SIZE];
+    memset(empty, 0, sizeof(empty));
+    for (size_t i = 0; i < LOG_PERSIST_PAGES; i++) {
+        file.write(empty, sizeof(empty));
+    }
+    file.close();
+
+    _file = fs.open(path, "r+");
+    return (bool)_file;
+}
+
+void PersistentLog::findWritePosition() {
+    uint32_t newest = 0;
+    uint16_t newestPage = LOG_PERSIST_PAGES - 1;
+
+    for (uint16_t page = 0; page < LOG_PERSIST_PAGES; page++) {
+        PageHeader header;
+        _file.seek((uint32_t)page * LOG_PERSIST_PAGE_SIZE);
+        if (_file.read((uint8_t*)&header, sizeof(header)) != sizeof(header)) {
+            break;
+        }
+        if (header.sequence != 0xFFFFFFFF && header.sequence > newest) {
+            newest = header.sequence;
+            newestPage = page;
+        }
+    }
+
+    _writePage = (newestPage + 1) % LOG_PERSIST_PAGES;
+    _sequence = newest + 1;
+}
+
+void PersistentLog::writePage() {
+    if (_file) {
+        // Assemble the page so it goes to flash as a single write
+        uint8_t page[LOG_PERSIST_PAGE_SIZE];
+        PageHeader header = { _sequence, (uint16_t)rtcTail.length, 0 };
+        memcpy(page, &header, sizeof(header));
+        memcpy(page + sizeof(header), rtcTail.data, PAGE_DATA_SIZE);
+
+        _file.seek((uint32_t)_writePage * LOG_PERSIST_PAGE_SIZE);
+        _file.write(page, sizeof(page));
+        _file.flush();
+
+        _writePage = (_writePage + 1) % LOG_PERSIST_PAGES;
+        _sequence++;
+        _pageWrites++;
+    }
+
+    // Without a file the oldest buffered lines are simply discarded
+    rtcTail.length = 0;
+    memset(_pageFormats, 0, sizeof(_pageFormats));
+}
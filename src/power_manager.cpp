@@ -0,0 +1,96 @@
+#include "power_manager.h"
+#include <WiFi.h>
+#include "logger.h"
+
+PowerManager::PowerManager()
+    : _enabled(false), _scaling(false), _busy(false), _lightSleep(false), _cpuLock(nullptr),
+      _sleepLock(nullptr), _idleTime(0) {
+}
+
+void PowerManager::begin() {
+    if (!POWER_SAVE_ENABLED || _enabled) {
+        return;
+    }
+
+    // Modem sleep is up to the WiFi driver alone, so it is used even where
+    // the PM is not (a core built without CONFIG_PM_ENABLE)
+    _enabled = true;
+    WiFi.setSleep(WIFI_PS_MAX_MODEM);
+
+    // The minimum stays at 80 MHz or above so the APB clock, and with it
+    // the UART baud rate, does not change
+    esp_pm_config_esp32_t config;
+    config.max_freq_mhz = POWER_CPU_MAX_MHZ;
+    config.min_freq_mhz = POWER_CPU_MIN_MHZ;
+    config.light_sleep_enable = true;
+
+    esp_err_t err = esp_pm_configure(&config);
+    if (err == ESP_ERR_NOT_SUPPORTED) {
+        // SDK without tickless idle: frequency scaling only
+        config.light_sleep_enable = false;
+        err = esp_pm_configure(&config);
+    }
+    if (err != ESP_OK) {
+        LOG_WARNF("Power: frequency scaling unavailable (%s), modem sleep only", esp_err_to_name(err));
+        return;
+    }
+    _lightSleep = config.light_sleep_enable;
+
+    if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "busy_cpu", &_cpuLock) != ESP_OK ||
+        esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "busy_sleep", &_sleepLock) != ESP_OK) {
+        Logger::error("Power: failed to create PM locks");
+        return;
+    }
+
+    _scaling = true;
+    LOG_INFOF("Power: %d-%d MHz, light sleep %s", POWER_CPU_MIN_MHZ, POWER_CPU_MAX_MHZ,
+              _lightSleep ? "on" : "unavailable");
+}
+
+void PowerManager::setBusy(bool busy) {
+    if (busy == _busy) {
+        return;
+    }
+    _busy = busy;
+    if (!_enabled) {
+        return;
+    }
+
+    if (busy) {
+        if (_scaling) {
+            esp_pm_lock_acquire(_cpuLock);
+            esp_pm_lock_acquire(_sleepLock);
+        }
+        WiFi.setSleep(WIFI_PS_NONE);
+    } else {
+        WiFi.setSleep(WIFI_PS_MAX_MODEM);
+        if (_scaling) {
+            esp_pm_lock_release(_sleepLock);
+            esp_pm_lock_release(_cpuLock);
+        }
+    }
+    LOG_DEBUGF("Power: %s", busy ? "busy" : "idle");
+}
+
+bool PowerManager::isBusy() const {
+    return _busy;
+}
+
+void PowerManager::idle(unsigned long ms) {
+    // Blocking lets the idle task run; the PM then picks light sleep or a
+    // lower clock on its own and the tick timer wakes us at the deadline
+    _idleTime += ms;
+    delay(ms);
+}
+
+float PowerManager::getDutyCycle() const {
+    unsigned long uptime = millis();
+    if (uptime == 0 || _idleTime >= uptime) {
+        return 0.0f;
+    }
+    return 1.0f - (float)_idleTime / uptime;
+}
+
+bool PowerManager::isLightSleepEnabled() const {
+    return _lightSleep;
+}
@@ -0,0 +1,55 @@
+#include "rate_limiter.h"
+
+RateLimiter::RateLimiter(uint32_t ratePerSecond, uint32_t burst)
+    : _rate(ratePerSecond > 0 ? ratePerSecond : 1), _capacity(burst * 1000) {
+    for (size_t i = 0; i < WEB_RATE_CLIENTS; i++) {
+        _buckets[i].client = 0;
+        _buckets[i].tokens = 0;
+        _buckets[i].updatedAt = 0;
+    }
+}
+
+bool RateLimiter::allow(uint32_t client, uint32_t& retryAfterMs) {
+    unsigned long now = millis();
+    Bucket& bucket = find(client, now);
+
+    // ratePerSecond requests per second is ratePerSecond thousandths per
+    // ms; long idle periods are clamped so the product cannot overflow
+    unsigned long elapsed = now - bucket.updatedAt;
+    if (elapsed >= _capacity / _rate) {
+        bucket.tokens = _capacity;
+    } else {
+        bucket.tokens += elapsed * _rate;
+        if (bucket.tokens > _capacity) {
+            bucket.tokens = _capacity;
+        }
+    }
+    bucket.updatedAt = now;
+
+    if (bucket.tokens >= 1000) {
+        bucket.tokens -= 1000;
+        return true;
+    }
+
+    retryAfterMs = (1000 - bucket.tokens + _rate - 1) / _rate;
+    return false;
+}
+
+RateLimiter::Bucket& RateLimiter::find(uint32_t client, unsigned long now) {
+    // Free slots were last updated at 0, so they are always the oldest
+    size_t oldest = 0;
+    for (size_t i = 0; i < WEB_RATE_CLIENTS; i++) {
+        if (_buckets[i].client == client) {
+            return _buckets[i];
+        }
+        if (now - _buckets[i].updatedAt > now - _buckets[oldest].updatedAt) {
+            oldest = i;
+        }
+    }
+
+    Bucket& bucket = _buckets[oldest];
+    bucket.client = client;
+    bucket.tokens = _capacity;
+    bucket.updatedAt = now;
+    return bucket;
+}
@@ -0,0 +1,185 @@
+#include "scheduler.h"
+#include "logger.h"
+
+Scheduler::Scheduler(Clock clock)
+    : _clock(clock), _heapSize(0) {
+    for (int i = 0; i < SCHEDULER_MAX_TASKS; i++) {
+        _tasks[i].callback = nullptr;
+        _tasks[i].heapIndex = -1;
+    }
+}
+
+int Scheduler::every(unsigned long interval, Callback callback, unsigned long firstDelay) {
+    if (interval == 0) {
+        return INVALID_TASK;
+    }
+    return add(firstDelay, interval, callback);
+}
+
+int Scheduler::after(unsigned long delay, Callback callback) {
+    return add(delay, 0, callback);
+}
+
+bool Scheduler::cancel(int id) {
+    if (id < 0 || id >= SCHEDULER_MAX_TASKS || _tasks[id].callback == nullptr) {
+        return false;
+    }
+
+    // A task cancelling itself from its callback is out of the heap
+    // already; clearing the callback stops run() from re-adding it
+    if (_tasks[id].heapIndex >= 0) {
+        remove(_tasks[id].heapIndex);
+    }
+    _tasks[id].callback = nullptr;
+    return true;
+}
+
+bool Scheduler::setInterval(int id, unsigned long interval) {
+    if (id < 0 || id >= SCHEDULER_MAX_TASKS || _tasks[id].callback == nullptr ||
+        _tasks[id].interval == 0 || interval == 0) {
+        return false;
+    }
+
+    Task& task = _tasks[id];
+    task.interval = interval;
+
+    unsigned long deadline = _clock() + interval;
+    if (task.heapIndex >= 0 && (long)(deadline - task.deadline) < 0) {
+        task.deadline = deadline;
+        siftUp(task.heapIndex);
+    }
+    return true;
+}
+
+unsigned long Scheduler::run() {
+    unsigned long now = _clock();
+
+    // Bounded by the tasks present on entry, so a task that is due again
+    // right away waits for the next pass instead of starving the loop
+    for (int budget = _heapSize; budget > 0 && _heapSize > 0; budget--) {
+        int slot = _heap[0];
+        Task& task = _tasks[slot];
+        if ((long)(now - task.deadline) < 0) {
+            break;
+        }
+
+        remove(0);
+        Callback callback = task.callback;
+        if (task.interval == 0) {
+            task.callback = nullptr;  // Slot is free again before the call
+        }
+        callback();
+
+        if (task.interval > 0 && task.callback != nullptr && task.heapIndex < 0) {
+            // Keep the original phase; after a stall longer than the
+            // interval, skip the missed runs instead of catching up
+            task.deadline += task.interval;
+            now = _clock();
+            if ((long)(now - task.deadline) >= 0) {
+                task.deadline = now + task.interval;
+            }
+            push(slot);
+        }
+    }
+
+    if (_heapSize == 0) {
+        return SCHEDULER_MAX_WAIT;
+    }
+
+    now = _clock();
+    long wait = (long)(_tasks[_heap[0]].deadline - now);
+    if (wait <= 0) {
+        return 0;
+    }
+    return (unsigned long)wait < SCHEDULER_MAX_WAIT ? (unsigned long)wait : SCHEDULER_MAX_WAIT;
+}
+
+int Scheduler::size() const {
+    int count = 0;
+    for (int i = 0; i < SCHEDULER_MAX_TASKS; i++) {
+        if (_tasks[i].callback != nullptr) {
+            count++;
+        }
+    }
+    return count;
+}
+
+int Scheduler::add(unsigned long delay, unsigned long interval, Callback callback) {
+    if (callback == nullptr) {
+        return INVALID_TASK;
+    }
+
+    for (int slot = 0; slot < SCHEDULER_MAX_TASKS; slot++) {
+        if (_tasks[slot].callback == nullptr && _tasks[slot].heapIndex < 0) {
+            _tasks[slot].callback = callback;
+            _tasks[slot].deadline = _clock() + delay;
+            _tasks[slot].interval = interval;
+            push(slot);
+            return slot;
+        }
+    }
+
+    Logger::error("Scheduler: task table full");
+    return INVALID_TASK;
+}
+
+void Scheduler::push(int slot) {
+    _heap[_heapSize] = slot;
+    _tasks[slot].heapIndex = _heapSize;
+    _heapSize++;
+    siftUp(_heapSize - 1);
+}
+
+void Scheduler::remove(int heapIndex) {
+    int slot = _heap[heapIndex];
+    _heapSize--;
+    if (heapIndex != _heapSize) {
+        swap(heapIndex, _heapSize);
+        siftDown(heapIndex);
+        siftUp(heapIndex);
+    }
+    _tasks[slot].heapIndex = -1;
+}
+
+void Scheduler::siftUp(int heapIndex) {
+    while (heapIndex > 0) {
+        int parent = (heapIndex - 1) / 2;
+        if (!before(heapIndex, parent)) {
+            break;
+        }
+        swap(heapIndex, parent);
+        heapIndex = parent;
+    }
+}
+
+void Scheduler::siftDown(int heapIndex) {
+    while (true) {
+        int smallest = heapIndex;
+        int left = 2 * heapIndex + 1;
+        int right = left + 1;
+        if (left < _heapSize && before(left, smallest)) {
+            smallest = left;
+        }
+        if (right < _heapSize && before(right, smallest)) {
+            smallest = right;
+        }
+        if (smallest == heapIndex) {
+            break;
+        }
+        swap(heapIndex, smallest);
+        heapIndex = smallest;
+    }
+}
+
+void Scheduler::swap(int a, int b) {
+    int slot = _heap[a];
+    _heap[a] = _heap[b];
+    _heap[b] = slot;
+    _tasks[_heap[a]].heapIndex = a;
+    _tasks[_heap[b]].heapIndex = b;
+}
+
+bool Scheduler::before(int a, int b) const {
+    // Wrap-safe comparison of millis() deadlines
+    return (long)(_tasks[_heap[a]].deadline - _tasks[_heap[b]].deadline) < 0;
+}
@@ -0,0 +1,61 @@
+#include "sensor_task.h"
+#include "logger.h"
+
+SensorTask::SensorTask()
+    : _reader(nullptr), _task(nullptr), _sampleCount(0) {
+}
+
+bool SensorTask::begin(Reader reader) {
+    if (_task != nullptr) {
+        return true;
+    }
+
+    _reader = reader;
+
+    // Single-core chips only have core 0
+    BaseType_t core = (SENSOR_TASK_CORE < portNUM_PROCESSORS) ? SENSOR_TASK_CORE : 0;
+    BaseType_t created = xTaskCreatePinnedToCore(
+        sensorTask, "sensor", SENSOR_TASK_STACK_SIZE, this,
+        SENSOR_TASK_PRIORITY, &_task, core);
+
+    if (created != pdPASS) {
+        _task = nullptr;
+        Logger::error("Sensor: failed to start task");
+        return false;
+    }
+
+    LOG_INFOF("Sensor task started on core %d", (int)core);
+    return true;
+}
+
+bool SensorTask::read(Sample& sample) {
+    return _queue.pop(sample);
+}
+
+uint32_t SensorTask::getSampleCount() const {
+    return _sampleCount;
+}
+
+uint32_t SensorTask::getDroppedCount() const {
+    return _queue.getDroppedCount();
+}
+
+void SensorTask::sensorTask(void* parameter) {
+    SensorTask* self = static_cast<SensorTask*>(parameter);
+    TickType_t wakeTime = xTaskGetTickCount();
+
+    for (;;) {
+        // Relative to the previous wake time, so sampling does not drift
+        vTaskDelayUntil(&wakeTime, pdMS_TO_TICKS(SENSOR_SAMPLE_INTERVAL));
+
+        Sample sample;
+        if (!self->_reader(sample.temperature, sample.humidity)) {
+            Logger::warn("Sensor: read failed");
+            continue;
+        }
+        sample.timestamp = millis();
+
+        self->_sampleCount++;
+        self->_queue.push(sample);
+    }
+}
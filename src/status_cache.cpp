@@ -0,0 +1,105 @@
+#include "status_cache.h"
+#include "logger.h"
+
+StatusCache::StatusCache()
+    : _lock(nullptr), _current(0), _valid(false), _invalidated(false), _fingerprint(0), _builtAt(0), _rebuilds(0) {
+    for (Snapshot& snapshot : _snapshots) {
+        snapshot.length = 0;
+        snapshot.pins = 0;
+    }
+}
+
+void StatusCache::begin(Builder builder, Fingerprint fingerprint) {
+    if (_lock == nullptr) {
+        _lock = xSemaphoreCreateMutex();
+    }
+    _builder = builder;
+    _fingerprintCallback = fingerprint;
+    _valid = false;
+}
+
+void StatusCache::invalidate() {
+    _invalidated = true;
+}
+
+const StatusCache::Snapshot* StatusCache::acquire() {
+    // Answer for a cache that was never set up; not pinned, never written
+    static const Snapshot empty = {"{}", 2, "\"0\"", 0};
+    if (_lock == nullptr) {
+        return &empty;
+    }
+
+    uint32_t fingerprint = _fingerprintCallback ? _fingerprintCallback() : 0;
+
+    xSemaphoreTake(_lock, portMAX_DELAY);
+
+    if (!_valid || _invalidated || fingerprint != _fingerprint ||
+        millis() - _builtAt >= STATUS_REFRESH_INTERVAL) {
+        rebuild(fingerprint);
+    }
+
+    Snapshot* snapshot = &_snapshots[_current];
+    snapshot->pins++;
+    xSemaphoreGive(_lock);
+
+    return snapshot;
+}
+
+void StatusCache::release(const Snapshot* snapshot) {
+    if (snapshot < _snapshots || snapshot >= _snapshots + STATUS_SNAPSHOTS) {
+        return;
+    }
+
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    _snapshots[snapshot - _snapshots].pins--;
+    xSemaphoreGive(_lock);
+}
+
+uint32_t StatusCache::getRebuildCount() const {
+    return _rebuilds;
+}
+
+void StatusCache::rebuild(uint32_t fingerprint) {
+    // Build into a buffer nobody is sending from, then switch over
+    uint8_t next = _current;
+    for (uint8_t i = 1; i < STATUS_SNAPSHOTS; i++) {
+        uint8_t candidate = (_current + i) % STATUS_SNAPSHOTS;
+        if (_snapshots[candidate].pins == 0) {
+            next = candidate;
+            break;
+        }
+    }
+    if (_valid && next == _current) {
+        // All pinned by slow clients; keep the current one for now
+        return;
+    }
+
+    _invalidated = false;
+    _fingerprint = fingerprint;
+    _builtAt = millis();
+
+    StaticJsonDocument<STATUS_BUFFER_SIZE> doc;
+    if (_builder) {
+        _builder(doc);
+    } else {
+        doc["status"] = "ok";
+    }
+
+    Snapshot& snapshot = _snapshots[next];
+    snapshot.length = serializeJson(doc, snapshot.body, sizeof(snapshot.body));
+    if (snapshot.length >= sizeof(snapshot.body) - 1) {
+        Logger::warn("Status snapshot truncated, raise STATUS_BUFFER_SIZE");
+    }
+
+    // FNV-1a over the body, so an identical rebuild keeps the same ETag
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < snapshot.length; i++) {
+        hash = (hash ^ (uint8_t)snapshot.body[i]) * 16777619u;
+    }
+
+    snprintf(snapshot.etag, sizeof(snapshot.etag), "\"%08lx\"", (unsigned long)hash);
+
+    _current = next;
+    _valid = true;
+    _rebuilds++;
+}
@@ -0,0 +1,286 @@
+#include "telemetry_queue.h"
+#include <math.h>
+#include "logger.h"
+
+TelemetryQueue::TelemetryQueue()
+    : _head(0), _count(0), _client(nullptr), _fs(nullptr), _url(nullptr),
+      _samplesSent(0), _requestsSent(0), _bytesSent(0), _samplesDropped(0),
+      _inFlight(false), _inFlightSpilled(false), _inFlightCount(0),
+      _uploadsFailed(0), _retryDelay(0), _failedAt(0) {
+    _payload[0] = '\0';
+}
+
+void TelemetryQueue::begin(AsyncHTTPClient& client, fs::FS& fs, const char* url) {
+    _client = &client;
+    _fs = &fs;
+    _url = url;
+}
+
+void TelemetryQueue::add(float temperature, float humidity) {
+    Sample sample;
+    sample.timestamp = millis();
+    sample.temperature = temperature;
+    sample.humidity = humidity;
+    add(sample);
+}
+
+void TelemetryQueue::add(const Sample& sample) {
+    // Without an endpoint telemetry is disabled
+    if (_url == nullptr || _url[0] == '\0') {
+        return;
+    }
+
+    if (_count == TELEMETRY_QUEUE_CAPACITY) {
+        // handle() normally spills before this happens; overwrite the oldest
+        // unless it belongs to the batch being uploaded
+        if (_inFlight && !_inFlightSpilled) {
+            _samplesDropped++;
+            return;
+        }
+        _head = (_head + 1) % TELEMETRY_QUEUE_CAPACITY;
+        _count--;
+        _samplesDropped++;
+    }
+
+    _samples[(_head + _count) % TELEMETRY_QUEUE_CAPACITY] = sample;
+    _count++;
+}
+
+void TelemetryQueue::handle(bool online) {
+    if (_client == nullptr || _url == nullptr || _url[0] == '\0' || _inFlight) {
+        return;
+    }
+
+    bool backingOff = _retryDelay > 0 && millis() - _failedAt < _retryDelay;
+
+    if (online && !backingOff) {
+        // Oldest data first
+        if (_fs->exists(TELEMETRY_SPILL_FILE)) {
+            uploadSpilled();
+        } else if (_count >= TELEMETRY_BATCH_SIZE ||
+                   (_count > 0 && millis() - _samples[_head].timestamp >= TELEMETRY_MAX_AGE)) {
+            uploadQueued();
+        }
+    }
+
+    if (!_inFlight && _count == TELEMETRY_QUEUE_CAPACITY) {
+        spill();
+    }
+}
+
+uint32_t TelemetryQueue::getSamplesSent() const {
+    return _samplesSent;
+}
+
+uint32_t TelemetryQueue::getRequestsSent() const {
+    return _requestsSent;
+}
+
+uint32_t TelemetryQueue::getBytesSent() const {
+    return _bytesSent;
+}
+
+uint32_t TelemetryQueue::getSamplesDropped() const {
+    return _samplesDropped;
+}
+
+uint32_t TelemetryQueue::getUploadsFailed() const {
+    return _uploadsFailed;
+}
+
+void TelemetryQueue::uploadSpilled() {
+    // File layout: uint32 count of samples already uploaded, then samples
+    File file = _fs->open(TELEMETRY_SPILL_FILE, FILE_READ);
+    if (!file) {
+        return;
+    }
+
+    uint32_t uploaded = 0;
+    file.read((uint8_t*)&uploaded, sizeof(uploaded));
+
+    size_t stored = (file.size() - sizeof(uploaded)) / sizeof(Sample);
+    if (uploaded >= stored) {
+        file.close();
+        _fs->remove(TELEMETRY_SPILL_FILE);
+        return;
+    }
+
+    Sample batch[TELEMETRY_BATCH_SIZE];
+    size_t count = stored - uploaded;
+    if (count > TELEMETRY_BATCH_SIZE) {
+        count = TELEMETRY_BATCH_SIZE;
+    }
+
+    file.seek(sizeof(uploaded) + uploaded * sizeof(Sample));
+    count = file.read((uint8_t*)batch, count * sizeof(Sample)) / sizeof(Sample);
+    file.close();
+
+    if (count > 0) {
+        upload(batch, count, true);
+    }
+}
+
+void TelemetryQueue::uploadQueued() {
+    Sample batch[TELEMETRY_BATCH_SIZE];
+    size_t count = (_count < TELEMETRY_BATCH_SIZE) ? _count : TELEMETRY_BATCH_SIZE;
+
+    for (size_t i = 0; i < count; i++) {
+        batch[i] = _samples[(_head + i) % TELEMETRY_QUEUE_CAPACITY];
+    }
+
+    upload(batch, count, false);
+}
+
+bool TelemetryQueue::upload(const Sample* samples, size_t count, bool spilled) {
+    size_t length = buildPayload(samples, count);
+    if (length == 0) {
+        Logger::error("Telemetry: payload buffer too small");
+        return false;
+    }
+
+    HTTPRequestId id = _client->post(_url, _payload, [this](int httpCode, const char* response) {
+        onUploadComplete(httpCode);
+    });
+    if (id == 0) {
+        return false;  // Request queue full, retry on a later pass
+    }
+
+    _inFlight = true;
+    _inFlightSpilled = spilled;
+    _inFlightCount = count;
+    _requestsSent++;
+    _bytesSent += length;
+    return true;
+}
+
+void TelemetryQueue::onUploadComplete(int httpCode) {
+    _inFlight = false;
+
+    if (httpCode < 200 || httpCode >= 300) {
+        _uploadsFailed++;
+        _failedAt = millis();
+        if (_retryDelay == 0) {
+            _retryDelay = TELEMETRY_RETRY_INTERVAL;
+        } else if (_retryDelay < TELEMETRY_RETRY_MAX / 2) {
+            _retryDelay *= 2;
+        } else {
+            _retryDelay = TELEMETRY_RETRY_MAX;
+        }
+        LOG_WARNF("Telemetry: upload of %u samples failed (%d), retrying in %lu s",
+                  (unsigned)_inFlightCount, httpCode, _retryDelay / 1000);
+        return;
+    }
+
+    _retryDelay = 0;
+
+    if (_inFlightSpilled) {
+        commitSpilled(_inFlightCount);
+    } else {
+        _head = (_head + _inFlightCount) % TELEMETRY_QUEUE_CAPACITY;
+        _count -= _inFlightCount;
+    }
+
+    _samplesSent += _inFlightCount;
+    LOG_DEBUGF("Telemetry: uploaded %u samples", (unsigned)_inFlightCount);
+}
+
+void TelemetryQueue::commitSpilled(size_t count) {
+    File file = _fs->open(TELEMETRY_SPILL_FILE, "r+");
+    if (!file) {
+        return;
+    }
+
+    // Record progress so a reboot resends at most one batch
+    uint32_t uploaded = 0;
+    file.read((uint8_t*)&uploaded, sizeof(uploaded));
+    size_t stored = (file.size() - sizeof(uploaded)) / sizeof(Sample);
+
+    uploaded += count;
+    file.seek(0);
+    file.write((const uint8_t*)&uploaded, sizeof(uploaded));
+    file.close();
+
+    if (uploaded >= stored) {
+        _fs->remove(TELEMETRY_SPILL_FILE);
+        Logger::info("Telemetry: spilled samples uploaded");
+    }
+}
+
+size_t TelemetryQueue::buildPayload(const Sample* samples, size_t count) {
+    size_t pos = 0;
+    uint32_t t0 = (count > 0) ? samples[0].timestamp : 0;
+    bool ok = append(pos, "{\"device\":\"%s\",\"t0\":%lu,\"dt\":[",
+                     DEFAULT_DEVICE_NAME, (unsigned long)t0);
+
+    for (size_t i = 0; ok && i < count; i++) {
+        ok = append(pos, i ? ",%lu" : "%lu", (unsigned long)(samples[i].timestamp - t0));
+    }
+
+    ok = ok && append(pos, "],\"temperature\":[");
+    for (size_t i = 0; ok && i < count; i++) {
+        ok = appendValue(pos, i, samples[i].temperature);
+    }
+
+    ok = ok && append(pos, "],\"humidity\":[");
+    for (size_t i = 0; ok && i < count; i++) {
+        ok = appendValue(pos, i, samples[i].humidity);
+    }
+
+    ok = ok && append(pos, "]}");
+    return ok ? pos : 0;
+}
+
+bool TelemetryQueue::appendValue(size_t& pos, size_t index, float value) {
+    const char* separator = index ? "," : "";
+    if (isnan(value)) {
+        return append(pos, "%snull", separator);
+    }
+    return append(pos, "%s%.2f", separator, value);
+}
+
+bool TelemetryQueue::append(size_t& pos, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(_payload + pos, sizeof(_payload) - pos, format, args);
+    va_end(args);
+
+    if (written < 0 || (size_t)written >= sizeof(_payload) - pos) {
+        return false;
+    }
+
+    pos += written;
+    return true;
+}
+
+void TelemetryQueue::spill() {
+    bool exists = _fs->exists(TELEMETRY_SPILL_FILE);
+    File file = _fs->open(TELEMETRY_SPILL_FILE, exists ? FILE_APPEND : FILE_WRITE);
+    if (!file) {
+        Logger::error("Telemetry: failed to open spill file");
+        return;
+    }
+
+    if (!exists) {
+        uint32_t uploaded = 0;
+        file.write((const uint8_t*)&uploaded, sizeof(uploaded));
+    }
+
+    if (file.size() + _count * sizeof(Sample) > TELEMETRY_SPILL_MAX_BYTES) {
+        file.close();
+        _samplesDropped += _count;
+        LOG_WARNF("Telemetry: spill file full, dropped %u samples", (unsigned)_count);
+    } else {
+        // Oldest first, in at most two writes because the queue may wrap
+        size_t first = TELEMETRY_QUEUE_CAPACITY - _head;
+        if (first > _count) {
+            first = _count;
+        }
+        file.write((const uint8_t*)&_samples[_head], first * sizeof(Sample));
+        file.write((const uint8_t*)&_samples[0], (_count - first) * sizeof(Sample));
+        file.close();
+        LOG_INFOF("Telemetry: spilled %u samples to flash", (unsigned)_count);
+    }
+
+    _head = 0;
+    _count = 0;
+}
@@ -0,0 +1,24 @@
+#include "web_assets.h"
+
+#if WEB_ASSETS_EMBEDDED
+
+// Generated from data/ by tools/build_web.py on every PlatformIO build
+#include "web_assets_data.h"
+
+const WebAsset* findWebAsset(const char* path) {
+    // The table ends with an entry whose path is nullptr
+    for (size_t i = 0; WEB_ASSETS[i].path != nullptr; i++) {
+        if (strcmp(WEB_ASSETS[i].path, path) == 0) {
+            return &WEB_ASSETS[i];
+        }
+    }
+    return nullptr;
+}
+
+#else
+
+const WebAsset* findWebAsset(const char* path) {
+    return nullptr;
+}
+
+#endif
@@ -1,12 +1,109 @@
 #include "web_server.h"
+#include <memory>
 #include "config.h"
 #include "logger.h"
+#include "web_assets.h"
+#include "metrics.h"
 
-WebServerManager::WebServerManager() {
+static Histogram handlerDuration("esp32_web_handler_duration_seconds",
+                                 "Time spent in web request handlers, by all routes");
+static Counter requestsAccepted("esp32_web_requests_accepted_total",
+                                "Web requests let through to a handler");
+static Counter rejectedBusy("esp32_web_requests_rejected_busy_total",
+                            "Web requests answered 503 with WEB_MAX_CONCURRENT in flight");
+static Counter rejectedLowHeap("esp32_web_requests_rejected_low_heap_total",
+                               "Web requests answered 503 because the heap was low");
+static Counter rejectedRateLimited("esp32_web_requests_rejected_rate_limited_total",
+                                   "Web requests answered 429, client over WEB_RATE_LIMIT");
+static Counter pushesDeferred("esp32_web_status_pushes_deferred_total",
+                             "Status pushes to an /api/events client put off because it was behind");
+
+// Only changed on the AsyncTCP task
+static volatile uint32_t activeRequests = 0;
+
+static Gauge activeRequestsGauge("esp32_web_requests_active", "Web requests let through and not closed yet",
+                                 []() { return (double)activeRequests; });
+
+// Added before every route, so it sees each request as soon as its headers
+// are in: it claims the requests to turn away and passes on the rest
+class AdmissionHandler : public AsyncWebHandler {
+public:
+    explicit AdmissionHandler(WebServerManager* server) : _server(server) {
+    }
+    
+    bool canHandle(AsyncWebServerRequest* request) override {
+        WebServerManager::Rejection rejection;
+        if (_server->admit(request, rejection)) {
+            return false;
+        }
+        
+        // A request with a body is answered only once the body is in, so
+        // the decision travels with it; the request frees _tempObject.
+        // Without the memory it is answered as busy.
+        void* decision = malloc(sizeof(rejection));
+        if (decision != nullptr) {
+            memcpy(decision, &rejection, sizeof(rejection));
+        }
+        request->_tempObject = decision;
+        return true;
+    }
+    
+    void handleRequest(AsyncWebServerRequest* request) override {
+        _server->sendRejected(request, (const WebServerManager::Rejection*)request->_tempObject);
+    }
+
+private:
+    WebServerManager* _server;
+};
+
+// Sends a pinned status snapshot. The response lives until the last byte
+// is acknowledged or the client goes away, and unpins it when deleted.
+class StatusResponse : public AsyncAbstractResponse {
+public:
+    StatusResponse(StatusCache& cache, const StatusCache::Snapshot* snapshot)
+        : _cache(cache), _snapshot(snapshot), _sent(0) {
+        _code = 200;
+        _contentType = "application/json";
+        _contentLength = snapshot->length;
+    }
+    
+    ~StatusResponse() {
+        _cache.release(_snapshot);
+    }
+    
+    bool _sourceValid() const override {
+        return true;
+    }
+    
+    size_t _fillBuffer(uint8_t* buffer, size_t maxLen) override {
+        size_t length = min(maxLen, _snapshot->length - _sent);
+        memcpy(buffer, _snapshot->body + _sent, length);
+        _sent += length;
+        return length;
+    }
+
+private:
+    StatusCache& _cache;
+    const StatusCache::Snapshot* _snapshot;
+    size_t _sent;
+};
+
+WebServerManager::WebServerManager()
+    : _eventClientsLock(nullptr), _eventId(0), _lastPushCheck(0), _persistentLog(nullptr), _configStore(nullptr),
+      _jobs(nullptr), _rateLimiter(WEB_RATE_LIMIT, WEB_RATE_BURST) {
     _server = new AsyncWebServer(WEBSERVER_PORT);
+    _events = new AsyncEventSource("/api/events");
+    _pushedEtag[0] = '\0';
+    for (EventClient& subscriber : _eventClients) {
+        subscriber.client = nullptr;
+    }
 }
 
 void WebServerManager::begin() {
+    if (_eventClientsLock == nullptr) {
+        _eventClientsLock = xSemaphoreCreateMutex();
+    }
+    
     // Initialize SPIFFS
     if (!SPIFFS.begin(FORMAT_SPIFFS_IF_FAILED)) {
         Logger::error("SPIFFS Mount Failed");
@@ -20,112 +117,492 @@ void WebServerManager::begin() {
     
     // Start server
     _server->begin();
-    Logger::info("Web Server started on port " + String(WEBSERVER_PORT));
+    LOG_INFOF("Web Server started on port %d", WEBSERVER_PORT);
 }
 
 void WebServerManager::handle() {
-    // AsyncWebServer handles requests automatically
+    // AsyncWebServer handles requests automatically; only status pushes
+    // are driven from here
+    unsigned long now = millis();
+    if (now - _lastPushCheck < STATUS_PUSH_INTERVAL || _eventClientsLock == nullptr || _events->count() == 0) {
+        return;
+    }
+    _lastPushCheck = now;
+    
+    const StatusCache::Snapshot* status = _statusCache.acquire();
+    if (strcmp(status->etag, _pushedEtag) != 0) {
+        strncpy(_pushedEtag, status->etag, sizeof(_pushedEtag));
+        _eventId++;
+    }
+    
+    // Held while sending, so a client cannot be deleted under us
+    xSemaphoreTake(_eventClientsLock, portMAX_DELAY);
+    for (EventClient& subscriber : _eventClients) {
+        if (subscriber.client == nullptr || strcmp(subscriber.etag, status->etag) == 0) {
+            continue;
+        }
+        
+        // The library queues up to 32 events per client whatever
+        // SSE_MAX_QUEUED_MESSAGES is set to, so a client that is
+        // STATUS_PUSH_MAX_QUEUED behind is skipped without holding up the
+        // rest. Every event is a full snapshot: once it catches up it is
+        // sent whatever is current.
+        if (subscriber.client->packetsWaiting() >= STATUS_PUSH_MAX_QUEUED) {
+            pushesDeferred.add();
+            continue;
+        }
+        strncpy(subscriber.etag, status->etag, sizeof(subscriber.etag));
+        subscriber.client->send(status->body, "status", _eventId);
+    }
+    xSemaphoreGive(_eventClientsLock);
+    _statusCache.release(status);
 }
 
 void WebServerManager::onConfigUpdate(std::function<void(const char*, const char*)> callback) {
     _configUpdateCallback = callback;
 }
 
-void WebServerManager::onGetStatus(std::function<String()> callback) {
-    _statusCallback = callback;
+void WebServerManager::onGetStatus(StatusCache::Builder builder, StatusCache::Fingerprint fingerprint) {
+    _statusCache.begin(builder, fingerprint);
+}
+
+void WebServerManager::invalidateStatus() {
+    _statusCache.invalidate();
+}
+
+void WebServerManager::setPersistentLog(PersistentLog* log) {
+    _persistentLog = log;
+}
+
+void WebServerManager::setConfigStore(ConfigStore* store) {
+    _configStore = store;
+}
+
+void WebServerManager::setJobQueue(JobQueue* jobs) {
+    _jobs = jobs;
 }
 
 void WebServerManager::setupRoutes() {
-    // Serve static files from SPIFFS
-    _server->serveStatic("/", SPIFFS, "/").setDefaultFile("index.html");
+    // Must stay the first handler
+    _server->addHandler(new AdmissionHandler(this));
+    
+    // Static files are served from SPIFFS by the 404 handler, so they never
+    // shadow the API routes
+    _server->on("/", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        ScopedTimer timer(handlerDuration);
+        handleRoot(request);
+    });
     
     // API endpoints
     _server->on("/api/status", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        ScopedTimer timer(handlerDuration);
         handleStatus(request);
     });
     
     _server->on("/api/config", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        ScopedTimer timer(handlerDuration);
         handleConfig(request);
     });
     
     _server->on("/api/config", HTTP_POST, [this](AsyncWebServerRequest* request) {
+        ScopedTimer timer(handlerDuration);
         handleSaveConfig(request);
     });
     
+    _server->on("/api/jobs", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        ScopedTimer timer(handlerDuration);
+        handleJob(request);
+    });
+    
+    _server->on("/api/restart", HTTP_POST, [this](AsyncWebServerRequest* request) {
+        ScopedTimer timer(handlerDuration);
+        handleRestart(request);
+    });
+    
+    _server->on("/api/logs", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        ScopedTimer timer(handlerDuration);
+        handleLogs(request);
+    });
+    
+    _server->on("/api/metrics", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        ScopedTimer timer(handlerDuration);
+        handleMetrics(request);
+    });
+    
+    // Status push channel (Server-Sent Events)
+    _events->onConnect([this](AsyncEventSourceClient* client) {
+        handleEventsConnect(client);
+    });
+    _server->addHandler(_events);
+    
     // 404 handler
     _server->onNotFound([this](AsyncWebServerRequest* request) {
+        ScopedTimer timer(handlerDuration);
         handleNotFound(request);
     });
 }
 
+bool WebServerManager::admit(AsyncWebServerRequest* request, Rejection& rejection) {
+    // AsyncWebServer has already allocated the request; a rejected one
+    // costs only a short response on top
+    if (ESP.getFreeHeap() < WEB_SHED_FREE_HEAP ||
+        ESP.getMaxAllocHeap() < WEB_SHED_LARGEST_BLOCK) {
+        rejectedLowHeap.add();
+        rejection.reason = REJECT_LOW_HEAP;
+        return false;
+    }
+    
+    // Before the concurrency check, so a client hammering the server uses
+    // up its own tokens and not the shared budget
+    if (!_rateLimiter.allow(request->client()->getRemoteAddress(), rejection.retryAfterMs)) {
+        rejectedRateLimited.add();
+        rejection.reason = REJECT_RATE_LIMITED;
+        return false;
+    }
+    
+    if (activeRequests >= WEB_MAX_CONCURRENT) {
+        rejectedBusy.add();
+        rejection.reason = REJECT_BUSY;
+        return false;
+    }
+    
+    requestsAccepted.add();
+    
+    // /api/events hands its connection to the event source and never sees
+    // the disconnect; STATUS_PUSH_MAX_CLIENTS bounds those instead
+    if (request->url() != "/api/events") {
+        activeRequests++;
+        request->onDisconnect([]() {
+            activeRequests--;
+        });
+    }
+    return true;
+}
+
+void WebServerManager::sendRejected(AsyncWebServerRequest* request, const Rejection* rejection) {
+    int code = 503;
+    const char* body = "{\"error\":\"Busy, try again\"}";
+    char retryAfter[12] = "1";
+    
+    // Without the decision (no memory to keep it) busy is the safe answer
+    RejectReason reason = (rejection != nullptr) ? rejection->reason : REJECT_BUSY;
+    if (reason == REJECT_RATE_LIMITED) {
+        code = 429;
+        body = "{\"error\":\"Too many requests\"}";
+        snprintf(retryAfter, sizeof(retryAfter), "%lu", (unsigned long)((rejection->retryAfterMs + 999) / 1000));
+    } else if (reason == REJECT_LOW_HEAP) {
+        // Heap comes back as responses in flight complete, which takes longer
+        body = "{\"error\":\"Low on memory, try again\"}";
+        strcpy(retryAfter, "5");
+    }
+    
+    AsyncWebServerResponse* response = request->beginResponse(code, "application/json", body);
+    response->addHeader("Retry-After", retryAfter);
+    request->send(response);
+}
+
 void WebServerManager::handleRoot(AsyncWebServerRequest* request) {
-    request->send(SPIFFS, "/index.html", "text/html");
+    if (!serveAsset(request)) {
+        request->send(404, "text/plain", "index.html not found, upload the filesystem image");
+    }
+}
+
+bool WebServerManager::serveAsset(AsyncWebServerRequest* request) {
+    char path[48];
+    char gzPath[52];
+    const String& url = request->url();
+    if (url.length() + strlen("index.html") >= sizeof(path)) {
+        return false;
+    }
+    snprintf(path, sizeof(path), "%s%s", url.c_str(), url.endsWith("/") ? "index.html" : "");
+    snprintf(gzPath, sizeof(gzPath), "%s.gz", path);
+    
+    // Assets compiled into the firmware take precedence over SPIFFS
+    const WebAsset* asset = findWebAsset(path);
+    char etag[24] = "";
+    File file;
+    
+    if (asset != nullptr) {
+        strncpy(etag, asset->etag, sizeof(etag) - 1);
+    } else if (SPIFFS.exists(gzPath)) {
+        // tools/build_web.py uploads assets gzipped only. The file is opened
+        // once and handed to the response, each SPIFFS lookup costs a scan.
+        file = SPIFFS.open(gzPath, FILE_READ);
+        
+        // The gzip trailer holds the CRC32 and size of the original content,
+        // which makes a content-based ETag without hashing the file
+        uint32_t trailer[2];
+        if (file && file.size() >= 18 && file.seek(file.size() - sizeof(trailer)) &&
+            file.read((uint8_t*)trailer, sizeof(trailer)) == sizeof(trailer)) {
+            snprintf(etag, sizeof(etag), "\"%08lx-%lx\"",
+                     (unsigned long)trailer[0], (unsigned long)trailer[1]);
+        }
+        if (!file || !file.seek(0)) {
+            return false;
+        }
+    } else if (SPIFFS.exists(path)) {
+        file = SPIFFS.open(path, FILE_READ);
+        if (!file) {
+            return false;
+        }
+    } else {
+        return false;
+    }
+    
+    AsyncWebServerResponse* response;
+    if (etag[0] != '\0' && request->hasHeader("If-None-Match") &&
+        request->getHeader("If-None-Match")->value() == etag) {
+        response = request->beginResponse(304);
+    } else if (asset != nullptr) {
+        // Sent straight from memory-mapped flash, no copy and no SPIFFS
+        response = request->beginResponse_P(200, asset->contentType, asset->data, asset->length);
+        if (asset->gzipped) {
+            response->addHeader("Content-Encoding", "gzip");
+        }
+    } else {
+        // Content type from path; Content-Encoding: gzip when the open
+        // file is path.gz
+        response = request->beginResponse(file, path);
+    }
+    
+    if (etag[0] != '\0') {
+        response->addHeader("ETag", etag);
+    }
+    
+    // HTML keeps its URL across firmware updates, so it is revalidated on
+    // every load (a 304 when unchanged); other assets are cached for a day
+    response->addHeader("Cache-Control", strstr(path, ".html") ? "no-cache" : WEB_ASSET_CACHE_CONTROL);
+    request->send(response);
+    return true;
 }
 
 void WebServerManager::handleConfig(AsyncWebServerRequest* request) {
-    // Read config from SPIFFS
-    File file = SPIFFS.open(CONFIG_FILE, "r");
-    if (!file) {
-        request->send(404, "application/json", "{\"error\":\"Config file not found\"}");
+    if (_configStore == nullptr) {
+        request->send(404, "application/json", "{\"error\":\"Config not available\"}");
         return;
     }
     
-    String content = file.readString();
-    file.close();
-    
-    request->send(200, "application/json", content);
+    // Served from RAM, the filesystem is not touched
+    char json[CONFIG_JSON_MAX];
+    _configStore->toJSON(json, sizeof(json));
+    request->send(200, "application/json", json);
 }
 
 void WebServerManager::handleStatus(AsyncWebServerRequest* request) {
-    if (_statusCallback) {
-        String status = _statusCallback();
-        request->send(200, "application/json", status);
+    const StatusCache::Snapshot* status = _statusCache.acquire();
+    
+    AsyncWebServerResponse* response;
+    if (request->hasHeader("If-None-Match") &&
+        request->getHeader("If-None-Match")->value() == status->etag) {
+        response = request->beginResponse(304);
+        response->addHeader("ETag", status->etag);
+        _statusCache.release(status);
     } else {
-        request->send(200, "application/json", "{\"status\":\"ok\"}");
+        // Sent straight from the snapshot buffer, without a String copy;
+        // the response holds the pin until it is done
+        response = new StatusResponse(_statusCache, status);
+        response->addHeader("ETag", status->etag);
     }
+    
+    // Browsers revalidate on every poll, so unchanged polls become 304s
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
 }
 
 void WebServerManager::handleSaveConfig(AsyncWebServerRequest* request) {
-    String ssid = "";
-    String password = "";
-    
-    // Get parameters
+    // Parameters are owned by the request; no copies until validated
+    const char* ssid = "";
+    const char* password = "";
     if (request->hasParam("ssid", true)) {
-        ssid = request->getParam("ssid", true)->value();
+        ssid = request->getParam("ssid", true)->value().c_str();
     }
     if (request->hasParam("password", true)) {
-        password = request->getParam("password", true)->value();
+        password = request->getParam("password", true)->value().c_str();
     }
     
-    if (ssid.length() == 0) {
+    if (strlen(ssid) == 0) {
         request->send(400, "application/json", "{\"error\":\"SSID is required\"}");
         return;
     }
     
-    // Save to SPIFFS
-    StaticJsonDocument<256> doc;
-    doc["ssid"] = ssid;
-    doc["password"] = password;
+    if (strlen(ssid) > WIFI_SSID_MAX_LENGTH || strlen(password) > WIFI_PASSWORD_MAX_LENGTH) {
+        request->send(400, "application/json", "{\"error\":\"SSID or password too long\"}");
+        return;
+    }
     
-    File file = SPIFFS.open(CONFIG_FILE, "w");
-    if (!file) {
+    if (_configStore == nullptr || _jobs == nullptr) {
         request->send(500, "application/json", "{\"error\":\"Failed to save config\"}");
         return;
     }
     
-    serializeJson(doc, file);
-    file.close();
+    // The job outlives the request, so the credentials go into a pooled
+    // config; the job only captures a pointer, which std::function keeps
+    // without allocating
+    DeviceConfig* pending = _pendingConfigs.acquire();
+    if (pending == nullptr) {
+        sendAccepted(request, 0);
+        return;
+    }
+    strcpy(pending->ssid, ssid);
+    strcpy(pending->password, password);
+    
+    // Saving and reconnecting happen on the main loop; this task also
+    // serves every other connection
+    JobId id = _jobs->submit("config", [this, pending]() {
+        bool saved = false;
+        if (_configStore->setWiFi(pending->ssid, pending->password)) {
+            saved = _configStore->flush();
+            Logger::info("Configuration saved");
+            
+            if (_configUpdateCallback) {
+                _configUpdateCallback(pending->ssid, pending->password);
+            }
+        }
+        _pendingConfigs.release(pending);
+        return saved;
+    });
     
-    Logger::info("Configuration saved");
+    if (id == 0) {
+        _pendingConfigs.release(pending);
+    }
+    sendAccepted(request, id);
+}
+
+void WebServerManager::handleJob(AsyncWebServerRequest* request) {
+    if (_jobs == nullptr || !request->hasParam("id")) {
+        request->send(400, "application/json", "{\"error\":\"id is required\"}");
+        return;
+    }
     
-    // Trigger callback
-    if (_configUpdateCallback) {
-        _configUpdateCallback(ssid.c_str(), password.c_str());
+    JobId id = strtoul(request->getParam("id")->value().c_str(), nullptr, 10);
+    const char* type = "";
+    JobQueue::JobState state = _jobs->getState(id, &type);
+    if (state == JobQueue::JOB_UNKNOWN) {
+        request->send(404, "application/json", "{\"error\":\"Unknown job\"}");
+        return;
     }
     
-    request->send(200, "application/json", "{\"success\":true,\"message\":\"Configuration saved. Device will reconnect.\"}");
+    char json[96];
+    snprintf(json, sizeof(json), "{\"id\":%u,\"type\":\"%s\",\"state\":\"%s\"}",
+             (unsigned)id, type, JobQueue::stateName(state));
+    request->send(200, "application/json", json);
+}
+
+void WebServerManager::handleRestart(AsyncWebServerRequest* request) {
+    if (_jobs == nullptr) {
+        request->send(500, "application/json", "{\"error\":\"Restart not available\"}");
+        return;
+    }
+    
+    // Delayed so the response still goes out
+    JobId id = _jobs->submit("restart", [this]() {
+        if (_configStore != nullptr) {
+            _configStore->flush();
+        }
+        Logger::info("Restarting on request");
+        Logger::flush();
+        ESP.restart();
+        return true;
+    }, RESTART_DELAY);
+    
+    sendAccepted(request, id);
+}
+
+void WebServerManager::sendAccepted(AsyncWebServerRequest* request, JobId id) {
+    if (id == 0) {
+        AsyncWebServerResponse* response = request->beginResponse(
+            503, "application/json", "{\"error\":\"Busy, try again\"}");
+        response->addHeader("Retry-After", "1");
+        request->send(response);
+        return;
+    }
+    
+    char location[32];
+    char json[64];
+    snprintf(location, sizeof(location), "/api/jobs?id=%u", (unsigned)id);
+    snprintf(json, sizeof(json), "{\"job\":%u,\"status\":\"%s\"}", (unsigned)id, location);
+    
+    AsyncWebServerResponse* response = request->beginResponse(202, "application/json", json);
+    response->addHeader("Location", location);
+    request->send(response);
+}
+
+void WebServerManager::handleEventsConnect(AsyncEventSourceClient* client) {
+    xSemaphoreTake(_eventClientsLock, portMAX_DELAY);
+    EventClient* slot = nullptr;
+    for (EventClient& subscriber : _eventClients) {
+        if (subscriber.client == nullptr) {
+            slot = &subscriber;
+            break;
+        }
+    }
+    
+    if (slot == nullptr) {
+        xSemaphoreGive(_eventClientsLock);
+        // Closing runs the library's disconnect handler, which takes the lock
+        Logger::warn("Too many /api/events clients, closing");
+        client->close();
+        return;
+    }
+    
+    // AsyncEventSource has no disconnect callback and deletes the client
+    // when its connection goes. Take over the connection's handler, doing
+    // what the library's own does after forgetting the client.
+    client->client()->onDisconnect([this](void* arg, AsyncClient* connection) {
+        AsyncEventSourceClient* eventClient = (AsyncEventSourceClient*)arg;
+        handleEventsDisconnect(eventClient);
+        eventClient->_onDisconnect();
+        delete connection;
+    }, client);
+    
+    // send() copies the snapshot into the client's queue
+    const StatusCache::Snapshot* status = _statusCache.acquire();
+    slot->client = client;
+    strncpy(slot->etag, status->etag, sizeof(slot->etag));
+    client->send(status->body, "status", _eventId, STATUS_PUSH_RETRY);
+    _statusCache.release(status);
+    xSemaphoreGive(_eventClientsLock);
+}
+
+void WebServerManager::handleEventsDisconnect(AsyncEventSourceClient* client) {
+    xSemaphoreTake(_eventClientsLock, portMAX_DELAY);
+    for (EventClient& subscriber : _eventClients) {
+        if (subscriber.client == client) {
+            subscriber.client = nullptr;
+        }
+    }
+    xSemaphoreGive(_eventClientsLock);
+}
+
+void WebServerManager::handleLogs(AsyncWebServerRequest* request) {
+    if (_persistentLog == nullptr) {
+        request->send(404, "application/json", "{\"error\":\"Persistent log not enabled\"}");
+        return;
+    }
+    
+    // Stream page by page with a chunked response instead of building a String
+    PersistentLog* log = _persistentLog;
+    std::shared_ptr<PersistentLog::Cursor> cursor = std::make_shared<PersistentLog::Cursor>();
+    
+    AsyncWebServerResponse* response = request->beginChunkedResponse("text/plain",
+        [log, cursor](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+            return log->read(*cursor, buffer, maxLen);
+        });
+    response->addHeader("Cache-Control", "no-store");
+    request->send(response);
+}
+
+void WebServerManager::handleMetrics(AsyncWebServerRequest* request) {
+    // Written straight into the response buffer, no intermediate string
+    AsyncResponseStream* response = request->beginResponseStream("text/plain; version=0.0.4");
+    response->addHeader("Cache-Control", "no-store");
+    Metric::writeAll(*response);
+    request->send(response);
 }
 
 void WebServerManager::handleNotFound(AsyncWebServerRequest* request) {
+    if (request->method() == HTTP_GET && serveAsset(request)) {
+        return;
+    }
     request->send(404, "text/plain", "Not found");
 }
@@ -1,73 +1,153 @@
 #include "wifi_manager.h"
+#include <esp_system.h>
 #include "config.h"
 #include "logger.h"
+#include "metrics.h"
+
+static const uint32_t WIFI_CACHE_MAGIC = 0x57494649;  // "WIFI"
+
+// Last successful connection. RTC slow memory survives soft resets and
+// deep sleep, so a wake-up can rejoin the same AP without scanning.
+struct WiFiCache {
+    uint32_t magic;
+    char ssid[WIFI_SSID_MAX_LENGTH + 1];
+    uint8_t bssid[6];
+    int32_t channel;
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;
+};
+
+RTC_NOINIT_ATTR static WiFiCache wifiCache;
+
+static Counter connectAttempts("esp32_wifi_connect_attempts_total",
+                               "WiFi connection attempts, fast and full");
+static Counter connectFailures("esp32_wifi_connect_failures_total",
+                               "WiFi connection attempts that timed out");
+static Counter fastConnects("esp32_wifi_fast_connects_total",
+                            "Connections made with the cached BSSID/channel");
+static Counter disconnects("esp32_wifi_disconnects_total",
+                           "Established WiFi connections that were lost");
+static Histogram connectDuration("esp32_wifi_connect_duration_seconds",
+                                 "Time from starting to connect to having an IP");
 
 WiFiManager::WiFiManager() 
-    : _lastReconnectAttempt(0), _retryCount(0) {
+    : _network(0), _state(STATE_IDLE), _pendingSince(0), _pendingDelay(0), _attemptStartedAt(0),
+      _connectStartedAt(0), _connectDuration(0), _offlineSince(0), _retryCount(0),
+      _networkFailures(0), _apActive(false) {
 }
 
 void WiFiManager::begin() {
     WiFi.mode(WIFI_STA);
     WiFi.setAutoReconnect(false);  // We'll handle reconnection manually
+    
+    // RTC memory holds garbage after power-on
+    if (esp_reset_reason() == ESP_RST_POWERON) {
+        wifiCache.magic = 0;
+    }
+    
     Logger::info("WiFi Manager initialized");
 }
 
-bool WiFiManager::connect(const char* ssid, const char* password) {
+bool WiFiManager::connect(const char* ssid, const char* password, unsigned long delayMs) {
     if (ssid == nullptr || strlen(ssid) == 0) {
         Logger::error("WiFi: SSID cannot be empty");
         return false;
     }
     
-    _ssid = String(ssid);
-    _password = String(password);
+    setCredentials(ssid, password);
+    _network = 0;
     _retryCount = 0;
+    _networkFailures = 0;
     
-    Logger::info("Connecting to WiFi: " + _ssid);
-    WiFi.disconnect();
-    delay(100);
-    
-    WiFi.begin(ssid, password);
-    
-    // Wait for connection
-    int attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < WIFI_MAX_RETRY) {
-        delay(500);
-        Serial.print(".");
-        attempts++;
+    LOG_INFOF("Connecting to WiFi: %s", ssid);
+    schedule(delayMs);
+    _connectStartedAt = _pendingSince + delayMs;
+    _offlineSince = _connectStartedAt;
+    return true;
+}
+
+bool WiFiManager::addNetwork(const char* ssid, const char* password) {
+    if (ssid == nullptr || strlen(ssid) == 0) {
+        return false;
     }
-    Serial.println();
     
-    if (WiFi.status() == WL_CONNECTED) {
-        logStatus();
-        return true;
-    } else {
-        Logger::error("WiFi connection failed");
-        return false;
+    for (int i = 1; i < WIFI_MAX_NETWORKS; i++) {
+        if (_networks[i].ssid.isEmpty()) {
+            _networks[i].ssid = ssid;
+            _networks[i].password = password;
+            return true;
+        }
     }
+    Logger::warn("WiFi: network list full");
+    return false;
 }
 
-void WiFiManager::handleReconnect() {
-    if (WiFi.status() == WL_CONNECTED) {
-        _retryCount = 0;
-        return;
-    }
-    
+void WiFiManager::handle() {
     unsigned long currentMillis = millis();
     
-    if (currentMillis - _lastReconnectAttempt >= WIFI_RECONNECT_INTERVAL) {
-        _lastReconnectAttempt = currentMillis;
-        _retryCount++;
+    if (WIFI_AP_FALLBACK_TIMEOUT > 0 && !_apActive &&
+        _state != STATE_IDLE && _state != STATE_CONNECTED &&
+        currentMillis - _offlineSince >= WIFI_AP_FALLBACK_TIMEOUT) {
+        Logger::warn("WiFi: offline too long, starting setup access point");
+        startAccessPoint();
+    }
+    
+    switch (_state) {
+    case STATE_IDLE:
+        break;
         
-        if (_retryCount <= WIFI_MAX_RETRY) {
-            Logger::info("Attempting to reconnect to WiFi... (Attempt " + 
-                        String(_retryCount) + "/" + String(WIFI_MAX_RETRY) + ")");
-            WiFi.disconnect();
-            delay(100);
-            WiFi.begin(_ssid.c_str(), _password.c_str());
-        } else {
-            Logger::error("WiFi reconnection failed after maximum retries");
-            _retryCount = 0;  // Reset for next cycle
+    case STATE_PENDING:
+        if (currentMillis - _pendingSince < _pendingDelay) {
+            break;
         }
+        // Joining a network on another channel moves the access point
+        // along and drops its clients, so background retries wait until
+        // nobody is using it
+        if (_apActive && _retryCount > 0 && WiFi.softAPgetStationNum() > 0) {
+            break;
+        }
+        startAttempt();
+        break;
+        
+    case STATE_FAST_CONNECTING:
+    case STATE_CONNECTING: {
+        if (WiFi.status() == WL_CONNECTED) {
+            _retryCount = 0;
+            _networkFailures = 0;
+            _connectDuration = currentMillis - _connectStartedAt;
+            // Microseconds; long outages land in the +Inf bucket
+            connectDuration.record(_connectDuration < 4000000UL ? _connectDuration * 1000 : UINT32_MAX);
+            if (_state == STATE_FAST_CONNECTING) {
+                fastConnects.add();
+            }
+            _state = STATE_CONNECTED;
+            saveCache();
+            logStatus();
+            stopAccessPoint();
+            break;
+        }
+        
+        // Only the timeout ends an attempt: right after begin() the status
+        // can still report the outcome of the previous one
+        unsigned long timeout = (_state == STATE_FAST_CONNECTING)
+            ? WIFI_FAST_CONNECT_TIMEOUT : WIFI_CONNECT_TIMEOUT;
+        if (currentMillis - _attemptStartedAt >= timeout) {
+            attemptFailed();
+        }
+        break;
+    }
+        
+    case STATE_CONNECTED:
+        if (WiFi.status() != WL_CONNECTED) {
+            Logger::warn("WiFi connection lost, reconnecting");
+            disconnects.add();
+            _connectStartedAt = currentMillis;
+            _offlineSince = currentMillis;
+            startAttempt();
+        }
+        break;
     }
 }
 
@@ -75,30 +155,182 @@ bool WiFiManager::isConnected() {
     return WiFi.status() == WL_CONNECTED;
 }
 
-String WiFiManager::getSSID() {
-    return _ssid;
+WiFiManager::State WiFiManager::getState() const {
+    return _state;
+}
+
+unsigned long WiFiManager::getConnectDuration() const {
+    return _connectDuration;
+}
+
+void WiFiManager::startAccessPoint() {
+    if (_apActive) {
+        return;
+    }
+    
+    // The station keeps running (WIFI_AP_STA) so reconnecting continues
+    WiFi.mode(WIFI_AP_STA);
+    const char* password = strlen(WIFI_AP_PASSWORD) > 0 ? WIFI_AP_PASSWORD : nullptr;
+    if (!WiFi.softAP(WIFI_AP_SSID, password)) {
+        Logger::error("WiFi: failed to start access point");
+        return;
+    }
+    
+    _apActive = true;
+    IPAddress ip = WiFi.softAPIP();
+    LOG_INFOF("WiFi: access point %s started at %u.%u.%u.%u", WIFI_AP_SSID, ip[0], ip[1], ip[2], ip[3]);
+}
+
+void WiFiManager::stopAccessPoint() {
+    if (!_apActive) {
+        return;
+    }
+    
+    WiFi.softAPdisconnect(true);
+    _apActive = false;
+    Logger::info("WiFi: access point stopped");
+}
+
+bool WiFiManager::isAccessPointActive() const {
+    return _apActive;
+}
+
+FixedString<WIFI_SSID_MAX_LENGTH> WiFiManager::getSSID() {
+    return _networks[_network].ssid;
 }
 
-String WiFiManager::getIPAddress() {
+FixedString<15> WiFiManager::getIPAddress() {
+    FixedString<15> address;
     if (isConnected()) {
-        return WiFi.localIP().toString();
+        IPAddress ip = WiFi.localIP();
+        address.appendf("%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+    } else {
+        address = "Not connected";
     }
-    return "Not connected";
+    return address;
 }
 
 void WiFiManager::disconnect() {
+    _state = STATE_IDLE;
     WiFi.disconnect();
     Logger::info("WiFi disconnected");
 }
 
 void WiFiManager::setCredentials(const char* ssid, const char* password) {
-    _ssid = String(ssid);
-    _password = String(password);
+    _networks[0].ssid = ssid;
+    _networks[0].password = password;
+}
+
+void WiFiManager::schedule(unsigned long delayMs) {
+    _state = STATE_PENDING;
+    _pendingSince = millis();
+    _pendingDelay = delayMs;
+}
+
+void WiFiManager::startAttempt() {
+    const Network& network = _networks[_network];
+    connectAttempts.add();
+    WiFi.disconnect();
+    
+    if (cacheValid()) {
+        if (WIFI_REUSE_LEASE && wifiCache.ip != 0) {
+            WiFi.config(IPAddress(wifiCache.ip), IPAddress(wifiCache.gateway),
+                        IPAddress(wifiCache.subnet), IPAddress(wifiCache.dns));
+        }
+        WiFi.begin(network.ssid.c_str(), network.password.c_str(), wifiCache.channel, wifiCache.bssid);
+        _state = STATE_FAST_CONNECTING;
+        LOG_DEBUGF("WiFi: fast connect on channel %d", (int)wifiCache.channel);
+    } else {
+        // Back to DHCP in case a cached lease was applied before
+        WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+        WiFi.begin(network.ssid.c_str(), network.password.c_str());
+        _state = STATE_CONNECTING;
+    }
+    
+    _attemptStartedAt = millis();
+}
+
+void WiFiManager::attemptFailed() {
+    connectFailures.add();
+    
+    if (_state == STATE_FAST_CONNECTING) {
+        // The AP moved, changed channel or our address is gone: forget it
+        // and do a full scan + DHCP. After a site-wide outage every device
+        // gets here at the same moment, so the scans are spread out
+        Logger::warn("WiFi fast connect failed, scanning");
+        wifiCache.magic = 0;
+        schedule(random(WIFI_FAST_CONNECT_TIMEOUT + 1));
+        return;
+    }
+    
+    _retryCount++;
+    _networkFailures++;
+    LOG_WARNF("WiFi connection to %s failed (attempt %d)", getSSID().c_str(), _retryCount);
+    
+    if (_networkFailures >= WIFI_NETWORK_ATTEMPTS && selectNextNetwork()) {
+        LOG_INFOF("WiFi: failing over to %s", getSSID().c_str());
+    }
+    
+    unsigned long delayMs = backoffDelay();
+    LOG_INFOF("WiFi: next attempt in %lu ms", delayMs);
+    schedule(delayMs);
+}
+
+bool WiFiManager::selectNextNetwork() {
+    _networkFailures = 0;
+    
+    // Wraps around to the top-ranked network after the last one
+    for (int i = 1; i < WIFI_MAX_NETWORKS; i++) {
+        int next = (_network + i) % WIFI_MAX_NETWORKS;
+        if (!_networks[next].ssid.isEmpty()) {
+            _network = next;
+            return true;
+        }
+    }
+    return false;
+}
+
+unsigned long WiFiManager::backoffDelay() {
+    // WIFI_RECONNECT_INTERVAL doubled per consecutive failure, capped
+    unsigned long delayMs = WIFI_RECONNECT_INTERVAL;
+    for (int i = 1; i < _retryCount && delayMs < WIFI_RECONNECT_MAX_INTERVAL; i++) {
+        delayMs *= 2;
+    }
+    if (delayMs > WIFI_RECONNECT_MAX_INTERVAL) {
+        delayMs = WIFI_RECONNECT_MAX_INTERVAL;
+    }
+    
+    // Equal jitter: half fixed, half random (random() uses the hardware
+    // RNG), so devices that failed together spread out over the window
+    return delayMs / 2 + random(delayMs / 2 + 1);
+}
+
+void WiFiManager::saveCache() {
+    uint8_t* bssid = WiFi.BSSID();
+    if (bssid == nullptr) {
+        return;
+    }
+    
+    memcpy(wifiCache.bssid, bssid, sizeof(wifiCache.bssid));
+    strncpy(wifiCache.ssid, getSSID().c_str(), sizeof(wifiCache.ssid) - 1);
+    wifiCache.ssid[sizeof(wifiCache.ssid) - 1] = '\0';
+    wifiCache.channel = WiFi.channel();
+    wifiCache.ip = (uint32_t)WiFi.localIP();
+    wifiCache.gateway = (uint32_t)WiFi.gatewayIP();
+    wifiCache.subnet = (uint32_t)WiFi.subnetMask();
+    wifiCache.dns = (uint32_t)WiFi.dnsIP();
+    wifiCache.magic = WIFI_CACHE_MAGIC;
+}
+
+bool WiFiManager::cacheValid() {
+    return wifiCache.magic == WIFI_CACHE_MAGIC &&
+           wifiCache.channel > 0 && wifiCache.channel <= 14 &&
+           strncmp(wifiCache.ssid, getSSID().c_str(), sizeof(wifiCache.ssid)) == 0;
 }
 
 void WiFiManager::logStatus() {
-    Logger::info("WiFi connected!");
-    Logger::info("SSID: " + String(WiFi.SSID()));
-    Logger::info("IP Address: " + WiFi.localIP().toString());
-    Logger::info("Signal Strength (RSSI): " + String(WiFi.RSSI()) + " dBm");
+    LOG_INFOF("WiFi connected in %lu ms", _connectDuration);
+    LOG_INFOF("SSID: %s", getSSID().c_str());
+    LOG_INFOF("IP Address: %s", getIPAddress().c_str());
+    LOG_INFOF("Signal Strength (RSSI): %d dBm", (int)WiFi.RSSI());
 }
@@ -0,0 +1,374 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+// Host stand-in for the parts of the Arduino-ESP32 core the firmware uses,
+// so modules can be unit tested with `pio test -e native`. Only what src/
+// needs is provided. Time is real by default; host::setFakeTime(true)
+// switches millis()/micros()/delay() to a simulated clock that only moves
+// when delay() or host::advance() is called.
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+
+using std::isnan;
+using std::max;
+using std::min;
+
+typedef uint8_t byte;
+
+#define PROGMEM
+#define IRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+#define F(string) (string)
+
+namespace host {
+
+inline std::atomic<bool> fakeTime{false};
+inline std::atomic<uint64_t> fakeMicros{0};
+
+inline uint64_t realMicros() {
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+// Simulated clock: starts at 0 and moves only through delay()/advance()
+inline void setFakeTime(bool enabled, uint64_t startMs = 0) {
+    fakeMicros = startMs * 1000;
+    fakeTime = enabled;
+}
+
+inline void advanceMicros(uint64_t us) {
+    fakeMicros += us;
+}
+
+inline void advance(uint64_t ms) {
+    fakeMicros += ms * 1000;
+}
+
+inline uint64_t nowMicros() {
+    return fakeTime ? fakeMicros.load() : realMicros();
+}
+
+inline std::mt19937& rng() {
+    static std::mt19937 generator(12345);
+    return generator;
+}
+
+// Depth of library stand-in code on this thread: what it allocates meanwhile
+// (request and response objects, their strings) is the library's, and
+// alloc_counter.h books it apart from the firmware's
+inline thread_local int libraryDepth = 0;
+
+struct LibraryScope {
+    LibraryScope() { libraryDepth++; }
+    ~LibraryScope() { libraryDepth--; }
+    LibraryScope(const LibraryScope&) = delete;
+    LibraryScope& operator=(const LibraryScope&) = delete;
+};
+
+} // namespace host
+
+inline unsigned long millis() {
+    return (unsigned long)(host::nowMicros() / 1000);
+}
+
+inline unsigned long micros() {
+    return (unsigned long)host::nowMicros();
+}
+
+inline void delay(unsigned long ms) {
+    if (host::fakeTime) {
+        host::advance(ms);
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    }
+}
+
+inline void delayMicroseconds(unsigned int us) {
+    if (host::fakeTime) {
+        host::advanceMicros(us);
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(us));
+    }
+}
+
+inline void yield() {
+    std::this_thread::yield();
+}
+
+inline uint32_t esp_random() {
+    return host::rng()();
+}
+
+inline void randomSeed(unsigned long seed) {
+    host::rng().seed(seed);
+}
+
+inline long random(long howBig) {
+    return howBig <= 0 ? 0 : (long)(esp_random() % (uint32_t)howBig);
+}
+
+inline long random(long howSmall, long howBig) {
+    return howSmall >= howBig ? howSmall : howSmall + random(howBig - howSmall);
+}
+
+inline size_t strlcpy(char* dst, const char* src, size_t size) {
+    size_t length = strlen(src);
+    if (size > 0) {
+        size_t copy = length < size - 1 ? length : size - 1;
+        memcpy(dst, src, copy);
+        dst[copy] = '\0';
+    }
+    return length;
+}
+
+class String {
+public:
+    String() {}
+    String(const char* text) : _s(text ? text : "") {}
+    String(const std::string& text) : _s(text) {}
+    String(char c) : _s(1, c) {}
+    String(int value) : _s(std::to_string(value)) {}
+    String(unsigned int value) : _s(std::to_string(value)) {}
+    String(long value) : _s(std::to_string(value)) {}
+    String(unsigned long value) : _s(std::to_string(value)) {}
+    String(float value, unsigned int decimals = 2) { format(value, decimals); }
+    String(double value, unsigned int decimals = 2) { format(value, decimals); }
+
+    const char* c_str() const { return _s.c_str(); }
+    unsigned int length() const { return _s.size(); }
+    bool isEmpty() const { return _s.empty(); }
+    bool reserve(unsigned int size) { _s.reserve(size); return true; }
+    char operator[](unsigned int index) const { return index < _s.size() ? _s[index] : 0; }
+    char charAt(unsigned int index) const { return (*this)[index]; }
+
+    bool concat(const String& other) { _s += other._s; return true; }
+    bool concat(const char* text, unsigned int length) { _s.append(text, length); return true; }
+    String& operator+=(const String& other) { _s += other._s; return *this; }
+    String& operator+=(const char* text) { _s += text; return *this; }
+    String& operator+=(char c) { _s += c; return *this; }
+
+    bool operator==(const String& other) const { return _s == other._s; }
+    bool operator==(const char* text) const { return _s == text; }
+    bool operator!=(const String& other) const { return _s != other._s; }
+    bool operator!=(const char* text) const { return _s != text; }
+    bool equals(const String& other) const { return _s == other._s; }
+    bool equalsIgnoreCase(const String& other) const {
+        return _s.size() == other._s.size() && strncasecmp(_s.c_str(), other.c_str(), _s.size()) == 0;
+    }
+
+    bool startsWith(const String& prefix) const { return _s.compare(0, prefix._s.size(), prefix._s) == 0; }
+    bool endsWith(const String& suffix) const {
+        return _s.size() >= suffix._s.size() &&
+               _s.compare(_s.size() - suffix._s.size(), suffix._s.size(), suffix._s) == 0;
+    }
+    int indexOf(char c, unsigned int from = 0) const { return found(_s.find(c, from)); }
+    int indexOf(const String& text, unsigned int from = 0) const { return found(_s.find(text._s, from)); }
+    int lastIndexOf(char c) const { return found(_s.rfind(c)); }
+    String substring(unsigned int from) const { return from < _s.size() ? String(_s.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const {
+        return from < to && from < _s.size() ? String(_s.substr(from, to - from)) : String();
+    }
+    long toInt() const { return strtol(_s.c_str(), nullptr, 10); }
+    float toFloat() const { return strtof(_s.c_str(), nullptr); }
+    void trim() {
+        size_t first = _s.find_first_not_of(" \t\r\n");
+        size_t last = _s.find_last_not_of(" \t\r\n");
+        _s = (first == std::string::npos) ? std::string() : _s.substr(first, last - first + 1);
+    }
+    void toLowerCase() { for (char& c : _s) c = tolower(c); }
+    void toUpperCase() { for (char& c : _s) c = toupper(c); }
+
+private:
+    std::string _s;
+
+    static int found(size_t position) { return position == std::string::npos ? -1 : (int)position; }
+    void format(double value, unsigned int decimals) {
+        char buffer[48];
+        snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+        _s = buffer;
+    }
+};
+
+inline String operator+(const String& a, const String& b) { String s(a); s += b; return s; }
+inline String operator+(const String& a, const char* b) { String s(a); s += b; return s; }
+inline String operator+(const char* a, const String& b) { String s(a); s += b; return s; }
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+        size_t n = 0;
+        while (size-- > 0 && write(*buffer++) == 1) {
+            n++;
+        }
+        return n;
+    }
+    size_t write(const char* text) { return text ? write((const uint8_t*)text, strlen(text)) : 0; }
+    size_t write(const char* buffer, size_t size) { return write((const uint8_t*)buffer, size); }
+    virtual void flush() {}
+
+    size_t print(const char* text) { return write(text); }
+    size_t print(const String& text) { return write(text.c_str(), text.length()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int value) { return printf("%d", value); }
+    size_t print(unsigned int value) { return printf("%u", value); }
+    size_t print(long value) { return printf("%ld", value); }
+    size_t print(unsigned long value) { return printf("%lu", value); }
+    size_t print(double value, int decimals = 2) { return printf("%.*f", decimals, value); }
+    template <typename T>
+    size_t println(const T& value) { return print(value) + println(); }
+    size_t println() { return write("\r\n"); }
+
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+        char buffer[256];
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        if (length < 0) {
+            return 0;
+        }
+        if ((size_t)length < sizeof(buffer)) {
+            return write((const uint8_t*)buffer, length);
+        }
+        std::string large(length + 1, '\0');
+        va_start(args, format);
+        vsnprintf(&large[0], large.size(), format, args);
+        va_end(args);
+        return write((const uint8_t*)large.data(), length);
+    }
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    void setTimeout(unsigned long timeout) { _timeout = timeout; }
+    unsigned long getTimeout() const { return _timeout; }
+
+    size_t readBytes(uint8_t* buffer, size_t length) {
+        size_t count = 0;
+        while (count < length) {
+            int c = timedRead();
+            if (c < 0) {
+                break;
+            }
+            buffer[count++] = (uint8_t)c;
+        }
+        return count;
+    }
+    size_t readBytes(char* buffer, size_t length) { return readBytes((uint8_t*)buffer, length); }
+
+    String readString() {
+        std::string text;
+        int c;
+        while ((c = timedRead()) >= 0) {
+            text += (char)c;
+        }
+        return String(text);
+    }
+
+protected:
+    unsigned long _timeout = 1000;
+
+    int timedRead() {
+        unsigned long start = millis();
+        do {
+            int c = read();
+            if (c >= 0) {
+                return c;
+            }
+            yield();
+        } while (millis() - start < _timeout && !host::fakeTime);
+        return -1;
+    }
+};
+
+// Serial keeps everything written to it so tests can inspect the output
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long baud) { (void)baud; }
+    void end() {}
+    explicit operator bool() const { return true; }
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        std::lock_guard<std::mutex> guard(_lock);
+        _output.append((const char*)buffer, size);
+        _writes++;
+        return size;
+    }
+    using Print::write;
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    int availableForWrite() { return 128; }
+
+    // Host side
+    std::string output() {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _output;
+    }
+    size_t writeCount() {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _writes;
+    }
+    void clearOutput() {
+        std::lock_guard<std::mutex> guard(_lock);
+        _output.clear();
+        _writes = 0;
+    }
+
+private:
+    std::mutex _lock;
+    std::string _output;
+    size_t _writes = 0;
+};
+
+inline HardwareSerial Serial;
+
+// Heap figures are whatever the test sets
+class EspClass {
+public:
+    uint32_t freeHeap = 200000;
+    uint32_t minFreeHeap = 180000;
+    uint32_t maxAllocHeap = 110000;
+    uint32_t restarts = 0;
+
+    uint32_t getFreeHeap() { return freeHeap; }
+    uint32_t getMinFreeHeap() { return minFreeHeap; }
+    uint32_t getMaxAllocHeap() { return maxAllocHeap; }
+    uint32_t getHeapSize() { return 320000; }
+    const char* getChipModel() { return "native"; }
+    uint8_t getChipCores() { return 2; }
+    const char* getSdkVersion() { return "native"; }
+    uint32_t getCpuFreqMHz() { return 240; }
+    void restart() { restarts++; }
+};
+
+inline EspClass ESP;
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#endif // NATIVE_ARDUINO_H
@@ -0,0 +1,65 @@
+#ifndef NATIVE_ARDUINO_OTA_H
+#define NATIVE_ARDUINO_OTA_H
+
+// ArduinoOTA stand-in: no network push; the callbacks are kept so a test
+// can play an update's start, progress, end or error
+
+#include <Arduino.h>
+#include <functional>
+#include <Update.h>
+
+typedef enum {
+    OTA_AUTH_ERROR,
+    OTA_BEGIN_ERROR,
+    OTA_CONNECT_ERROR,
+    OTA_RECEIVE_ERROR,
+    OTA_END_ERROR
+} ota_error_t;
+
+class ArduinoOTAClass {
+public:
+    typedef std::function<void(void)> THandlerFunction;
+    typedef std::function<void(ota_error_t)> THandlerFunction_Error;
+    typedef std::function<void(unsigned int, unsigned int)> THandlerFunction_Progress;
+
+    ArduinoOTAClass& setHostname(const char* hostname) {
+        this->hostname = hostname;
+        return *this;
+    }
+    ArduinoOTAClass& setPassword(const char* password) {
+        (void)password;
+        return *this;
+    }
+    ArduinoOTAClass& onStart(THandlerFunction fn) {
+        startHandler = fn;
+        return *this;
+    }
+    ArduinoOTAClass& onEnd(THandlerFunction fn) {
+        endHandler = fn;
+        return *this;
+    }
+    ArduinoOTAClass& onProgress(THandlerFunction_Progress fn) {
+        progressHandler = fn;
+        return *this;
+    }
+    ArduinoOTAClass& onError(THandlerFunction_Error fn) {
+        errorHandler = fn;
+        return *this;
+    }
+    void begin() { begun = true; }
+    void handle() { handleCalls++; }
+    int getCommand() { return U_FLASH; }
+
+    // Host side
+    std::string hostname;
+    bool begun = false;
+    uint32_t handleCalls = 0;
+    THandlerFunction startHandler;
+    THandlerFunction endHandler;
+    THandlerFunction_Progress progressHandler;
+    THandlerFunction_Error errorHandler;
+};
+
+inline ArduinoOTAClass ArduinoOTA;
+
+#endif // NATIVE_ARDUINO_OTA_H
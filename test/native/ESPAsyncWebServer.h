@@ -0,0 +1,865 @@
+#ifndef NATIVE_ESP_ASYNC_WEB_SERVER_H
+#define NATIVE_ESP_ASYNC_WEB_SERVER_H
+
+// ESPAsyncWebServer stand-in with the 1.2.3 API the firmware uses. There is
+// no network: host::webRequest() hands a request to the server that was
+// begun last, dispatches it like the library (handlers in order, then the
+// not-found handler), then pulls the response through in TCP-segment
+// sized pieces the way AsyncTCP acknowledgements would. The result holds
+// the status, headers and decoded body plus what went on the wire and when
+// the first and last byte were ready (micros(), so a simulated clock
+// measures server time). host::webOpen() leaves the connection open until
+// host::webClose(), for requests in flight at the same time.
+// What the library allocates for a request (the request, its headers and
+// parameters, the response objects it is handed and the Strings its API
+// takes) happens inside a host::LibraryScope, so alloc_counter.h can tell it
+// from what the handlers allocate.
+
+#include <Arduino.h>
+#include <FS.h>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+typedef enum {
+    HTTP_GET = 0b00000001,
+    HTTP_POST = 0b00000010,
+    HTTP_DELETE = 0b00000100,
+    HTTP_PUT = 0b00001000,
+    HTTP_PATCH = 0b00010000,
+    HTTP_HEAD = 0b00100000,
+    HTTP_OPTIONS = 0b01000000,
+    HTTP_ANY = 0b01111111
+} WebRequestMethod;
+
+namespace host {
+
+// A String the library takes or keeps: the conversion a call passing a
+// literal makes, and the copy the library stores, allocate inside the library
+class LibraryString : public String {
+public:
+    LibraryString() {}
+    LibraryString(const char* text) : String(inScope(text)) {}
+    LibraryString(const String& text) : String(inScope(text)) {}
+    LibraryString(const LibraryString& other) : String(inScope(other)) {}
+
+    LibraryString& operator=(const LibraryString& other) { return assign(other); }
+    LibraryString& operator=(const String& text) { return assign(text); }
+    LibraryString& operator=(const char* text) {
+        LibraryScope scope;
+        String::operator=(String(text));
+        return *this;
+    }
+
+private:
+    static String inScope(const char* text) {
+        LibraryScope scope;
+        return String(text);
+    }
+    static String inScope(const String& text) {
+        LibraryScope scope;
+        return text;
+    }
+    LibraryString& assign(const String& text) {
+        LibraryScope scope;
+        String::operator=(text);
+        return *this;
+    }
+};
+
+} // namespace host
+
+typedef uint8_t WebRequestMethodComposite;
+typedef std::function<void(void)> ArDisconnectHandler;
+
+class AsyncWebParameter {
+public:
+    AsyncWebParameter(const String& name, const String& value, bool form)
+        : _name(name), _value(value), _isForm(form) {}
+    const String& name() const { return _name; }
+    const String& value() const { return _value; }
+    bool isPost() const { return _isForm; }
+    bool isFile() const { return false; }
+
+private:
+    String _name;
+    String _value;
+    bool _isForm;
+};
+
+class AsyncWebHeader {
+public:
+    AsyncWebHeader(const String& name, const String& value) : _name(name), _value(value) {}
+    const String& name() const { return _name; }
+    const String& value() const { return _value; }
+
+private:
+    String _name;
+    String _value;
+};
+
+class AsyncClient;
+typedef std::function<void(void*, AsyncClient*)> AcConnectHandler;
+
+class AsyncClient {
+public:
+    explicit AsyncClient(uint32_t remote) : _remote(remote) {}
+    uint32_t getRemoteAddress() { return _remote; }
+    size_t space() { return 5744; }
+    bool canSend() { return true; }
+    bool connected() const { return _connected; }
+
+    void onDisconnect(AcConnectHandler handler, void* arg = nullptr) {
+        _onDisconnect = handler;
+        _onDisconnectArg = arg;
+    }
+
+    // Like AsyncTCP, the disconnect handler runs before close() returns,
+    // and may delete the client
+    void close(bool now = false) {
+        (void)now;
+        if (!_connected) {
+            return;
+        }
+        _connected = false;
+        if (_onDisconnect) {
+            _onDisconnect(_onDisconnectArg, this);
+        }
+    }
+
+private:
+    uint32_t _remote;
+    bool _connected = true;
+    AcConnectHandler _onDisconnect;
+    void* _onDisconnectArg = nullptr;
+};
+
+class AsyncWebServerRequest;
+
+class AsyncWebServerResponse {
+public:
+    AsyncWebServerResponse()
+        : _code(0), _contentLength(0), _sendContentLength(true), _chunked(false) {}
+    virtual ~AsyncWebServerResponse() {}
+
+    // The request deletes the response it is sent, so it is the library's
+    static void* operator new(size_t size) {
+        host::LibraryScope scope;
+        return ::operator new(size);
+    }
+    static void operator delete(void* p) { ::operator delete(p); }
+
+    void setCode(int code) { _code = code; }
+    void setContentLength(size_t length) { _contentLength = length; }
+    void setContentType(const host::LibraryString& type) { _contentType = type; }
+    void addHeader(const host::LibraryString& name, const host::LibraryString& value) {
+        host::LibraryScope scope;
+        _headers.emplace_back(name.c_str(), value.c_str());
+    }
+
+    virtual bool _sourceValid() const { return false; }
+
+    // Host side: status line and headers as the library assembles them
+    std::string _assembleHead() {
+        std::string head = "HTTP/1.1 " + std::to_string(_code) + " " + reason(_code) + "\r\n";
+        if (_sendContentLength) {
+            head += "Content-Length: " + std::to_string(_contentLength) + "\r\n";
+        }
+        if (_contentType.length() > 0) {
+            head += std::string("Content-Type: ") + _contentType.c_str() + "\r\n";
+        }
+        if (_chunked) {
+            head += "Transfer-Encoding: chunked\r\n";
+        }
+        head += "Accept-Ranges: none\r\n";
+        for (const auto& header : _headers) {
+            head += header.first + ": " + header.second + "\r\n";
+        }
+        return head + "\r\n";
+    }
+
+    // Host side: next part of the body, 0 when done
+    virtual size_t _nextBody(uint8_t* buffer, size_t maxLen) {
+        (void)buffer;
+        (void)maxLen;
+        return 0;
+    }
+
+    int code() const { return _code; }
+    bool chunked() const { return _chunked; }
+    const std::vector<std::pair<std::string, std::string>>& headers() const { return _headers; }
+
+protected:
+    int _code;
+    host::LibraryString _contentType;
+    size_t _contentLength;
+    bool _sendContentLength;
+    bool _chunked;
+    std::vector<std::pair<std::string, std::string>> _headers;
+
+    static const char* reason(int code) {
+        switch (code) {
+        case 200: return "OK";
+        case 202: return "Accepted";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 429: return "Too Many Requests";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        default: return "";
+        }
+    }
+};
+
+class AsyncBasicResponse : public AsyncWebServerResponse {
+public:
+    AsyncBasicResponse(int code, const host::LibraryString& contentType = host::LibraryString(),
+                       const host::LibraryString& content = host::LibraryString())
+        : _content(content.c_str()), _sent(0) {
+        _code = code;
+        _contentType = contentType;
+        _contentLength = _content.size();
+    }
+
+    bool _sourceValid() const override { return true; }
+
+    size_t _nextBody(uint8_t* buffer, size_t maxLen) override {
+        size_t length = std::min(maxLen, _content.size() - _sent);
+        memcpy(buffer, _content.data() + _sent, length);
+        _sent += length;
+        return length;
+    }
+
+private:
+    std::string _content;
+    size_t _sent;
+};
+
+// Subclasses produce the body through _fillBuffer()
+class AsyncAbstractResponse : public AsyncWebServerResponse {
+public:
+    bool _sourceValid() const override { return false; }
+    virtual size_t _fillBuffer(uint8_t* buffer, size_t maxLen) {
+        (void)buffer;
+        (void)maxLen;
+        return 0;
+    }
+
+    size_t _nextBody(uint8_t* buffer, size_t maxLen) override {
+        if (_chunked) {
+            return _fillBuffer(buffer, maxLen);
+        }
+        size_t left = _contentLength - _filled;
+        if (left == 0) {
+            return 0;
+        }
+        size_t length = _fillBuffer(buffer, std::min(maxLen, left));
+        _filled += length;
+        return length;
+    }
+
+private:
+    size_t _filled = 0;
+};
+
+class AsyncFileResponse : public AsyncAbstractResponse {
+public:
+    AsyncFileResponse(fs::FS& fs, const String& path, const String& contentType = String()) {
+        _code = 200;
+        std::string filePath = path.c_str();
+        // Like the library: an uncompressed file wins, else path.gz is sent
+        if (!fs.exists(filePath.c_str()) && fs.exists((filePath + ".gz").c_str())) {
+            filePath += ".gz";
+            addHeader("Content-Encoding", "gzip");
+        }
+        _content = fs.open(filePath.c_str(), FILE_READ);
+        _contentLength = _content.size();
+        _contentType = contentType.length() > 0 ? contentType : typeOf(path.c_str());
+    }
+
+    // An already open file; sent with Content-Encoding: gzip when it is
+    // the .gz of path
+    AsyncFileResponse(File content, const String& path, const String& contentType = String()) {
+        _code = 200;
+        std::string name = content.name();
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, ".gz") == 0 && !path.endsWith(".gz")) {
+            addHeader("Content-Encoding", "gzip");
+        }
+        _content = content;
+        _contentLength = _content.size();
+        _contentType = contentType.length() > 0 ? contentType : typeOf(path.c_str());
+    }
+
+    bool _sourceValid() const override { return (bool)_content; }
+    size_t _fillBuffer(uint8_t* buffer, size_t maxLen) override { return _content.read(buffer, maxLen); }
+
+private:
+    File _content;
+
+    static String typeOf(const std::string& path) {
+        auto endsWith = [&path](const char* suffix) {
+            size_t length = strlen(suffix);
+            return path.size() >= length && path.compare(path.size() - length, length, suffix) == 0;
+        };
+        if (endsWith(".html")) return "text/html";
+        if (endsWith(".css")) return "text/css";
+        if (endsWith(".js")) return "application/javascript";
+        if (endsWith(".json")) return "application/json";
+        if (endsWith(".png")) return "image/png";
+        if (endsWith(".ico")) return "image/x-icon";
+        return "text/plain";
+    }
+};
+
+class AsyncProgmemResponse : public AsyncAbstractResponse {
+public:
+    AsyncProgmemResponse(int code, const String& contentType, const uint8_t* content, size_t length)
+        : _content(content), _read(0) {
+        _code = code;
+        _contentType = contentType;
+        _contentLength = length;
+    }
+
+    bool _sourceValid() const override { return true; }
+    size_t _fillBuffer(uint8_t* buffer, size_t maxLen) override {
+        size_t length = std::min(maxLen, _contentLength - _read);
+        memcpy(buffer, _content + _read, length);
+        _read += length;
+        return length;
+    }
+
+private:
+    const uint8_t* _content;
+    size_t _read;
+};
+
+typedef std::function<size_t(uint8_t* buffer, size_t maxLen, size_t index)> AwsResponseFiller;
+
+class AsyncChunkedResponse : public AsyncAbstractResponse {
+public:
+    AsyncChunkedResponse(const String& contentType, AwsResponseFiller callback)
+        : _callback(callback), _index(0) {
+        _code = 200;
+        _contentType = contentType;
+        _sendContentLength = false;
+        _chunked = true;
+    }
+
+    bool _sourceValid() const override { return (bool)_callback; }
+    size_t _fillBuffer(uint8_t* buffer, size_t maxLen) override {
+        size_t length = _callback(buffer, maxLen, _index);
+        _index += length;
+        return length;
+    }
+
+private:
+    AwsResponseFiller _callback;
+    size_t _index;
+};
+
+class AsyncResponseStream : public AsyncAbstractResponse, public Print {
+public:
+    explicit AsyncResponseStream(const String& contentType) : _read(0) {
+        _code = 200;
+        _contentType = contentType;
+    }
+
+    bool _sourceValid() const override { return true; }
+    size_t _fillBuffer(uint8_t* buffer, size_t maxLen) override {
+        size_t length = std::min(maxLen, _content.size() - _read);
+        memcpy(buffer, _content.data() + _read, length);
+        _read += length;
+        return length;
+    }
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        host::LibraryScope scope;
+        _content.append((const char*)buffer, size);
+        _contentLength = _content.size();
+        return size;
+    }
+    using Print::write;
+
+private:
+    std::string _content;
+    size_t _read;
+};
+
+class AsyncWebServerRequest {
+public:
+    void* _tempObject = nullptr;
+
+    AsyncWebServerRequest(WebRequestMethodComposite method, const std::string& url, uint32_t remote)
+        : _method(method), _url(url.c_str()), _client(remote) {}
+
+    ~AsyncWebServerRequest() {
+        delete _response;
+        // The library frees it with free() too
+        free(_tempObject);
+    }
+
+    AsyncClient* client() { return &_client; }
+    const String& url() const { return _url; }
+    WebRequestMethodComposite method() const { return _method; }
+    void onDisconnect(ArDisconnectHandler handler) { _onDisconnect = handler; }
+
+    bool hasHeader(const host::LibraryString& name) const { return getHeader(name) != nullptr; }
+    AsyncWebHeader* getHeader(const host::LibraryString& name) const {
+        for (const auto& header : _headers) {
+            if (header->name().equalsIgnoreCase(name)) {
+                return header.get();
+            }
+        }
+        return nullptr;
+    }
+
+    bool hasParam(const host::LibraryString& name, bool post = false, bool file = false) const {
+        return getParam(name, post, file) != nullptr;
+    }
+    AsyncWebParameter* getParam(const host::LibraryString& name, bool post = false, bool file = false) const {
+        (void)file;
+        for (const auto& param : _params) {
+            if (param->name() == name && param->isPost() == post) {
+                return param.get();
+            }
+        }
+        return nullptr;
+    }
+
+    void send(AsyncWebServerResponse* response) {
+        delete _response;
+        _response = response;
+    }
+    void send(int code, const host::LibraryString& contentType = host::LibraryString(),
+              const host::LibraryString& content = host::LibraryString()) {
+        send(beginResponse(code, contentType, content));
+    }
+
+    AsyncWebServerResponse* beginResponse(int code, const host::LibraryString& contentType = host::LibraryString(),
+                                          const host::LibraryString& content = host::LibraryString()) {
+        host::LibraryScope scope;
+        return new AsyncBasicResponse(code, contentType, content);
+    }
+    AsyncWebServerResponse* beginResponse(fs::FS& fs, const host::LibraryString& path,
+                                          const host::LibraryString& contentType = host::LibraryString(),
+                                          bool download = false) {
+        (void)download;
+        host::LibraryScope scope;
+        return new AsyncFileResponse(fs, path, contentType);
+    }
+    AsyncWebServerResponse* beginResponse(File content, const host::LibraryString& path,
+                                          const host::LibraryString& contentType = host::LibraryString(),
+                                          bool download = false) {
+        (void)download;
+        host::LibraryScope scope;
+        return new AsyncFileResponse(content, path, contentType);
+    }
+    AsyncWebServerResponse* beginResponse_P(int code, const host::LibraryString& contentType,
+                                            const uint8_t* content, size_t length) {
+        host::LibraryScope scope;
+        return new AsyncProgmemResponse(code, contentType, content, length);
+    }
+    AsyncWebServerResponse* beginChunkedResponse(const host::LibraryString& contentType,
+                                                 AwsResponseFiller callback) {
+        host::LibraryScope scope;
+        return new AsyncChunkedResponse(contentType, callback);
+    }
+    AsyncResponseStream* beginResponseStream(const host::LibraryString& contentType, size_t bufferSize = 1460) {
+        (void)bufferSize;
+        host::LibraryScope scope;
+        return new AsyncResponseStream(contentType);
+    }
+
+    // Host side
+    void addHeader(const std::string& name, const std::string& value) {
+        _headers.emplace_back(new AsyncWebHeader(name.c_str(), value.c_str()));
+    }
+    void addParam(const std::string& name, const std::string& value, bool post) {
+        _params.emplace_back(new AsyncWebParameter(name.c_str(), value.c_str(), post));
+    }
+    AsyncWebServerResponse* response() { return _response; }
+    void disconnect() {
+        if (_onDisconnect) {
+            _onDisconnect();
+        }
+    }
+
+private:
+    WebRequestMethodComposite _method;
+    String _url;
+    AsyncClient _client;
+    ArDisconnectHandler _onDisconnect;
+    AsyncWebServerResponse* _response = nullptr;
+    std::vector<std::unique_ptr<AsyncWebHeader>> _headers;
+    std::vector<std::unique_ptr<AsyncWebParameter>> _params;
+};
+
+typedef std::function<void(AsyncWebServerRequest* request)> ArRequestHandlerFunction;
+
+class AsyncWebHandler {
+public:
+    virtual ~AsyncWebHandler() {}
+    virtual bool canHandle(AsyncWebServerRequest* request) {
+        (void)request;
+        return false;
+    }
+    virtual void handleRequest(AsyncWebServerRequest* request) { (void)request; }
+};
+
+class AsyncCallbackWebHandler : public AsyncWebHandler {
+public:
+    AsyncCallbackWebHandler(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest)
+        : _uri(uri), _method(method), _onRequest(onRequest) {}
+
+    bool canHandle(AsyncWebServerRequest* request) override {
+        return (request->method() & _method) && request->url() == _uri.c_str();
+    }
+    void handleRequest(AsyncWebServerRequest* request) override { _onRequest(request); }
+
+private:
+    std::string _uri;
+    WebRequestMethodComposite _method;
+    ArRequestHandlerFunction _onRequest;
+};
+
+class AsyncEventSource;
+
+class AsyncEventSourceClient {
+public:
+    // Takes over the connection; it is deleted with it, as in the library
+    AsyncEventSourceClient(AsyncClient* client, AsyncEventSource* server) : _client(client), _server(server) {
+        _client->onDisconnect([](void* arg, AsyncClient* connection) {
+            ((AsyncEventSourceClient*)arg)->_onDisconnect();
+            delete connection;
+        }, this);
+    }
+
+    AsyncClient* client() { return _client; }
+
+    void send(const char* message, const char* event = nullptr, uint32_t id = 0, uint32_t reconnect = 0) {
+        if (!connected()) {
+            return;
+        }
+        _messages.push_back(Message{message ? message : "", event ? event : "", id, reconnect});
+        _lastId = id;
+    }
+    void close() {
+        if (_client != nullptr) {
+            _client->close();
+        }
+    }
+    bool connected() const { return _client != nullptr && _client->connected(); }
+    uint32_t lastId() const { return _lastId; }
+    size_t packetsWaiting() const { return _messages.size() - _delivered; }
+
+    // System callback: the connection is gone, the server deletes this
+    inline void _onDisconnect();
+
+    // Host side: messages sent so far; deliver() marks them as acknowledged
+    struct Message {
+        std::string data;
+        std::string event;
+        uint32_t id;
+        uint32_t retry;
+
+        // Framed as the library sends it
+        size_t wireBytes() const {
+            size_t bytes = data.size() + strlen("data: \r\n\r\n");
+            if (retry) {
+                bytes += strlen("retry: \r\n") + std::to_string(retry).size();
+            }
+            if (id) {
+                bytes += strlen("id: \r\n") + std::to_string(id).size();
+            }
+            if (!event.empty()) {
+                bytes += strlen("event: \r\n") + event.size();
+            }
+            return bytes;
+        }
+    };
+    const std::vector<Message>& messages() const { return _messages; }
+    void deliver() { _delivered = _messages.size(); }
+
+private:
+    AsyncClient* _client;
+    AsyncEventSource* _server;
+    uint32_t _lastId = 0;
+    size_t _delivered = 0;
+    std::vector<Message> _messages;
+};
+
+namespace host {
+
+// The event stream client connected last, nullptr once it is gone
+inline AsyncEventSourceClient* lastEventClient = nullptr;
+
+} // namespace host
+
+class AsyncEventSource : public AsyncWebHandler {
+public:
+    explicit AsyncEventSource(const String& url) : _url(url.c_str()) {}
+    ~AsyncEventSource() {
+        for (AsyncEventSourceClient* client : _clients) {
+            delete client;
+        }
+    }
+
+    void onConnect(std::function<void(AsyncEventSourceClient*)> callback) { _connect = callback; }
+
+    void send(const char* message, const char* event = nullptr, uint32_t id = 0, uint32_t reconnect = 0) {
+        for (AsyncEventSourceClient* client : _clients) {
+            client->send(message, event, id, reconnect);
+        }
+    }
+
+    size_t count() const {
+        size_t connected = 0;
+        for (AsyncEventSourceClient* client : _clients) {
+            connected += client->connected() ? 1 : 0;
+        }
+        return connected;
+    }
+
+    size_t avgPacketsWaiting() const {
+        size_t waiting = 0;
+        size_t connected = 0;
+        for (AsyncEventSourceClient* client : _clients) {
+            if (client->connected()) {
+                waiting += client->packetsWaiting();
+                connected++;
+            }
+        }
+        return connected ? (waiting + connected - 1) / connected : 0;
+    }
+
+    bool canHandle(AsyncWebServerRequest* request) override {
+        return request->method() == HTTP_GET && request->url() == _url.c_str();
+    }
+
+    // The request's connection becomes an event stream client
+    void handleRequest(AsyncWebServerRequest* request) override {
+        AsyncEventSourceClient* client =
+            new AsyncEventSourceClient(new AsyncClient(request->client()->getRemoteAddress()), this);
+        _clients.push_back(client);
+        host::lastEventClient = client;
+        if (_connect) {
+            _connect(client);
+        }
+    }
+
+    // System callback
+    void _handleDisconnect(AsyncEventSourceClient* client) {
+        _clients.erase(std::remove(_clients.begin(), _clients.end(), client), _clients.end());
+        if (host::lastEventClient == client) {
+            host::lastEventClient = nullptr;
+        }
+        delete client;
+    }
+
+    // Host side: response head of the event stream
+    static size_t headBytes() {
+        return strlen("HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+                      "Connection: keep-alive\r\nAccept-Ranges: none\r\n\r\n");
+    }
+
+private:
+    std::string _url;
+    std::function<void(AsyncEventSourceClient*)> _connect;
+    std::vector<AsyncEventSourceClient*> _clients;
+};
+
+inline void AsyncEventSourceClient::_onDisconnect() {
+    _client = nullptr;
+    _server->_handleDisconnect(this);
+}
+
+class AsyncWebServer;
+
+namespace host {
+
+inline AsyncWebServer* webServer = nullptr;
+
+struct WebRequest {
+    WebRequestMethodComposite method = HTTP_GET;
+    std::string url = "/";
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::vector<std::pair<std::string, std::string>> params;      // Query string
+    std::vector<std::pair<std::string, std::string>> postParams;  // Form body
+    uint32_t remoteAddress = 0x0A000002;  // 10.0.0.2
+};
+
+struct WebResponse {
+    int code = 0;                  // 0: no response was sent
+    std::map<std::string, std::string> headers;
+    std::string body;              // Decoded, without chunk framing
+    size_t wireBytes = 0;          // Status line, headers and body as sent
+    uint64_t firstByteMicros = 0;  // From the request until headers and first segment are ready
+    uint64_t doneMicros = 0;       // Until the last byte is ready
+
+    std::string header(const char* name) const {
+        auto found = headers.find(name);
+        return found == headers.end() ? std::string() : found->second;
+    }
+};
+
+// TCP payload per segment, as AsyncTCP hands out send space
+static const size_t WEB_SEGMENT_SIZE = 1436;
+
+} // namespace host
+
+class AsyncWebServer {
+public:
+    explicit AsyncWebServer(uint16_t port) : _port(port) {}
+    ~AsyncWebServer() {
+        if (host::webServer == this) {
+            host::webServer = nullptr;
+        }
+    }
+
+    void begin() { host::webServer = this; }
+    void end() {}
+
+    AsyncWebHandler& addHandler(AsyncWebHandler* handler) {
+        _handlers.push_back(handler);
+        return *handler;
+    }
+    AsyncCallbackWebHandler& on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest) {
+        AsyncCallbackWebHandler* handler = new AsyncCallbackWebHandler(uri, method, onRequest);
+        _handlers.push_back(handler);
+        return *handler;
+    }
+    void onNotFound(ArRequestHandlerFunction handler) { _notFound = handler; }
+
+    // Host side: dispatch request and pull the whole response through
+    host::WebResponse handle(const host::WebRequest& spec) {
+        host::WebResponse result;
+        close(open(spec, result));
+        return result;
+    }
+
+    // Host side: as handle(), but the connection stays open until close(),
+    // like a client still reading the response or holding it alive
+    AsyncWebServerRequest* open(const host::WebRequest& spec, host::WebResponse& result) {
+        uint64_t start = micros();
+
+        AsyncWebServerRequest* request;
+        {
+            host::LibraryScope scope;
+            request = new AsyncWebServerRequest(spec.method, spec.url, spec.remoteAddress);
+            for (const auto& header : spec.headers) {
+                request->addHeader(header.first, header.second);
+            }
+            for (const auto& param : spec.params) {
+                request->addParam(param.first, param.second, false);
+            }
+            for (const auto& param : spec.postParams) {
+                request->addParam(param.first, param.second, true);
+            }
+        }
+
+        AsyncWebHandler* handler = nullptr;
+        for (AsyncWebHandler* candidate : _handlers) {
+            if (candidate->canHandle(request)) {
+                handler = candidate;
+                break;
+            }
+        }
+        if (handler != nullptr) {
+            handler->handleRequest(request);
+        } else if (_notFound) {
+            _notFound(request);
+        }
+
+        AsyncWebServerResponse* response = request->response();
+        if (response != nullptr) {
+            transmit(response, start, result);
+        } else {
+            result.firstByteMicros = result.doneMicros = micros() - start;
+        }
+        return request;
+    }
+
+    // Host side: the client goes away
+    void close(AsyncWebServerRequest* request) {
+        request->disconnect();
+        host::LibraryScope scope;
+        delete request;
+    }
+
+private:
+    uint16_t _port;
+    std::vector<AsyncWebHandler*> _handlers;
+    ArRequestHandlerFunction _notFound;
+
+    static void transmit(AsyncWebServerResponse* response, uint64_t start, host::WebResponse& result) {
+        host::LibraryScope scope;
+        result.code = response->code();
+        for (const auto& header : response->headers()) {
+            result.headers[header.first] = header.second;
+        }
+
+        // The head goes out with the first body segment
+        std::string head = response->_assembleHead();
+        result.wireBytes = head.size();
+        size_t room = host::WEB_SEGMENT_SIZE > head.size() ? host::WEB_SEGMENT_SIZE - head.size() : 0;
+        bool first = true;
+        uint8_t segment[host::WEB_SEGMENT_SIZE];
+        for (;;) {
+            // Chunk framing costs up to 8 bytes per segment
+            size_t maxLen = response->chunked() ? (room > 8 ? room - 8 : 0) : room;
+            size_t length = maxLen > 0 ? response->_nextBody(segment, maxLen) : 0;
+            if (first) {
+                result.firstByteMicros = micros() - start;
+                first = false;
+            }
+            if (length == 0 && maxLen > 0) {
+                break;
+            }
+            result.body.append((const char*)segment, length);
+            if (response->chunked()) {
+                char size[12];
+                result.wireBytes += snprintf(size, sizeof(size), "%zx\r\n", length) + length + 2;
+            } else {
+                result.wireBytes += length;
+            }
+            room = host::WEB_SEGMENT_SIZE;
+        }
+        if (response->chunked()) {
+            result.wireBytes += strlen("0\r\n\r\n");
+        }
+        result.doneMicros = micros() - start;
+    }
+};
+
+namespace host {
+
+// Send a request to the server begun last
+inline WebResponse webRequest(const WebRequest& request) {
+    return webServer->handle(request);
+}
+
+// Send a request and leave its connection open; webClose() ends it
+inline AsyncWebServerRequest* webOpen(const WebRequest& request, WebResponse& response) {
+    return webServer->open(request, response);
+}
+
+inline void webClose(AsyncWebServerRequest* request) {
+    webServer->close(request);
+}
+
+inline WebResponse webGet(const std::string& url,
+                          std::vector<std::pair<std::string, std::string>> headers = {}) {
+    WebRequest request;
+    request.url = url;
+    request.headers = headers;
+    return webRequest(request);
+}
+
+} // namespace host
+
+#endif // NATIVE_ESP_ASYNC_WEB_SERVER_H
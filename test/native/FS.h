@@ -0,0 +1,260 @@
+#ifndef NATIVE_FS_H
+#define NATIVE_FS_H
+
+// In-memory filesystem with the Arduino fs::FS / File interface. Writes
+// land in the file immediately, like SPIFFS. Counters let tests measure
+// flash traffic, and a write budget simulates power loss: each byte
+// written, file creation or truncation, remove and rename uses one unit,
+// and once it is used up nothing on the flash changes any more, as if
+// power had gone at that point. Access costs, when set, are
+// charged through delayMicroseconds(), so a simulated clock sees them.
+
+#include <Arduino.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+enum SeekMode {
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2
+};
+
+namespace fs {
+
+class MemoryFS;
+
+class File : public Stream {
+public:
+    File() {}
+
+    explicit operator bool() const { return _fs != nullptr; }
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+    int available() override { return _fs ? (int)(size() - _position) : 0; }
+    int read() override {
+        uint8_t c;
+        return read(&c, 1) == 1 ? c : -1;
+    }
+    int peek() override {
+        uint8_t c;
+        size_t position = _position;
+        int result = read(&c, 1) == 1 ? c : -1;
+        _position = position;
+        return result;
+    }
+    size_t read(uint8_t* buffer, size_t size);
+    void flush() override;
+    bool seek(uint32_t position, SeekMode mode = SeekSet);
+    size_t position() const { return _position; }
+    size_t size() const { return _data ? _data->size() : 0; }
+    const char* name() const { return _path.c_str(); }
+    void close() { _fs = nullptr; _data.reset(); }
+
+private:
+    friend class MemoryFS;
+    MemoryFS* _fs = nullptr;
+    std::shared_ptr<std::vector<uint8_t>> _data;
+    std::string _path;
+    size_t _position = 0;
+    bool _readable = false;
+    bool _writable = false;
+    bool _append = false;
+};
+
+class MemoryFS {
+public:
+    // Counters since the last reset()
+    size_t writeCalls = 0;
+    size_t bytesWritten = 0;
+    size_t flushes = 0;
+    size_t renames = 0;
+    size_t lookups = 0;    // open() and exists()
+    size_t readCalls = 0;
+    size_t bytesRead = 0;
+
+    // Cost of a path lookup (open, exists) and of reading 1 KB
+    unsigned long lookupMicros = 0;
+    unsigned long readMicrosPerKB = 0;
+
+    // Flash operations that may still happen; -1 for no limit
+    long writeBudget = -1;
+
+    File open(const char* path, const char* mode = FILE_READ, bool create = false) {
+        (void)create;
+        lookup();
+        File file;
+        auto entry = _files.find(path);
+        bool truncate = mode[0] == 'w';
+        if (entry == _files.end()) {
+            if (mode[0] == 'r' || take(1) == 0) {
+                return file;
+            }
+            entry = _files.emplace(path, std::make_shared<std::vector<uint8_t>>()).first;
+        } else if (truncate) {
+            if (take(1) == 0) {
+                return file;
+            }
+            entry->second = std::make_shared<std::vector<uint8_t>>();
+        }
+        file._fs = this;
+        file._data = entry->second;
+        file._path = path;
+        file._readable = mode[0] == 'r' || mode[1] == '+';
+        file._writable = mode[0] != 'r' || mode[1] == '+';
+        file._append = mode[0] == 'a';
+        file._position = file._append ? entry->second->size() : 0;
+        return file;
+    }
+    File open(const String& path, const char* mode = FILE_READ) { return open(path.c_str(), mode); }
+
+    bool exists(const char* path) {
+        lookup();
+        return _files.count(path) > 0;
+    }
+    bool exists(const String& path) { return exists(path.c_str()); }
+    bool remove(const char* path) {
+        auto entry = _files.find(path);
+        if (entry == _files.end() || take(1) == 0) {
+            return false;
+        }
+        _files.erase(entry);
+        return true;
+    }
+    bool remove(const String& path) { return remove(path.c_str()); }
+
+    bool rename(const char* from, const char* to) {
+        auto entry = _files.find(from);
+        if (entry == _files.end() || exists(to) || take(1) == 0) {
+            return false;
+        }
+        _files[to] = entry->second;
+        _files.erase(entry);
+        renames++;
+        return true;
+    }
+
+    // Host side
+    void reset() {
+        _files.clear();
+        resetCounters();
+        writeBudget = -1;
+        lookupMicros = 0;
+        readMicrosPerKB = 0;
+    }
+    void resetCounters() {
+        writeCalls = 0;
+        bytesWritten = 0;
+        flushes = 0;
+        renames = 0;
+        lookups = 0;
+        readCalls = 0;
+        bytesRead = 0;
+    }
+    std::string contents(const char* path) {
+        auto entry = _files.find(path);
+        return entry == _files.end() ? std::string()
+                                     : std::string(entry->second->begin(), entry->second->end());
+    }
+    void put(const char* path, const std::string& data) {
+        _files[path] = std::make_shared<std::vector<uint8_t>>(data.begin(), data.end());
+    }
+    size_t usedBytes() {
+        size_t used = 0;
+        for (auto& entry : _files) {
+            used += entry.second->size();
+        }
+        return used;
+    }
+
+private:
+    friend class File;
+    std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> _files;
+
+    void lookup() {
+        lookups++;
+        if (lookupMicros > 0) {
+            delayMicroseconds(lookupMicros);
+        }
+    }
+
+    void charge(size_t bytes) {
+        readCalls++;
+        bytesRead += bytes;
+        if (readMicrosPerKB > 0) {
+            delayMicroseconds((unsigned int)(bytes * readMicrosPerKB / 1024));
+        }
+    }
+
+    size_t take(size_t size) {
+        if (writeBudget < 0) {
+            return size;
+        }
+        size_t allowed = ((size_t)writeBudget < size) ? (size_t)writeBudget : size;
+        writeBudget -= allowed;
+        return allowed;
+    }
+};
+
+inline size_t File::write(const uint8_t* buffer, size_t size) {
+    if (_fs == nullptr || !_writable) {
+        return 0;
+    }
+    size = _fs->take(size);
+    if (_append) {
+        _position = _data->size();
+    }
+    if (_data->size() < _position + size) {
+        _data->resize(_position + size);
+    }
+    memcpy(_data->data() + _position, buffer, size);
+    _position += size;
+    _fs->writeCalls++;
+    _fs->bytesWritten += size;
+    return size;
+}
+
+inline size_t File::read(uint8_t* buffer, size_t size) {
+    if (_fs == nullptr || !_readable || _position >= _data->size()) {
+        return 0;
+    }
+    size_t count = (_data->size() - _position < size) ? _data->size() - _position : size;
+    memcpy(buffer, _data->data() + _position, count);
+    _position += count;
+    _fs->charge(count);
+    return count;
+}
+
+inline void File::flush() {
+    if (_fs != nullptr) {
+        _fs->flushes++;
+    }
+}
+
+inline bool File::seek(uint32_t position, SeekMode mode) {
+    if (_fs == nullptr) {
+        return false;
+    }
+    size_t base = (mode == SeekCur) ? _position : (mode == SeekEnd) ? _data->size() : 0;
+    if (base + position > _data->size()) {
+        return false;
+    }
+    _position = base + position;
+    return true;
+}
+
+typedef MemoryFS FS;
+
+} // namespace fs
+
+using fs::File;
+using fs::FS;
+
+#endif // NATIVE_FS_H
@@ -0,0 +1,246 @@
+#ifndef NATIVE_HTTP_CLIENT_H
+#define NATIVE_HTTP_CLIENT_H
+
+// HTTPClient stand-in talking to a fake server: host::setHttpHandler()
+// decides the answer to each request, and every request that reached the
+// server is logged. The response body is fed into the WiFiClient the
+// caller passed to begin(), so the caller reads it off the connection
+// like on the device. A reused connection is one that already carried a
+// request; like the ESP32 core, a client still connected() is not
+// connected again.
+
+#include <Arduino.h>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+#include "WiFiClient.h"
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_NO_STREAM (-6)
+#define HTTPC_ERROR_NO_HTTP_SERVER (-7)
+#define HTTPC_ERROR_TOO_LESS_RAM (-8)
+#define HTTPC_ERROR_ENCODING (-9)
+#define HTTPC_ERROR_STREAM_WRITE (-10)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+#define HTTPCLIENT_DEFAULT_TCP_TIMEOUT (5000)
+
+namespace host {
+
+struct HttpRequest {
+    std::string method;
+    std::string url;
+    std::string payload;
+    bool reused;
+    std::map<std::string, std::string> headers;  // Added with addHeader()
+    size_t wireBytes = 0;  // Request line, headers and payload, as the core writes them
+};
+
+struct HttpResponse {
+    int code = 200;               // <= 0: the request fails with this HTTPClient error
+    std::string body;
+    bool chunked = false;
+    int contentLength = -1;       // Declared length, if not the body's (a cut connection)
+    bool closeDelimited = false;  // No Content-Length; the server closes after the body
+    bool keepAlive = true;        // false: "Connection: close"
+    unsigned long delayMs = 0;    // Before the status line arrives
+    unsigned long bodyDelayMs = 0;  // Between the headers and the body
+};
+
+typedef std::function<HttpResponse(const HttpRequest&)> HttpHandler;
+
+inline std::mutex httpLock;
+inline HttpHandler httpHandler;
+inline std::vector<HttpRequest> httpRequests;
+
+inline void setHttpHandler(HttpHandler handler) {
+    std::lock_guard<std::mutex> guard(httpLock);
+    httpHandler = handler;
+    httpRequests.clear();
+    tcpConnectDelayMs = 0;
+    tcpConnects = 0;
+}
+
+inline std::vector<HttpRequest> httpLog() {
+    std::lock_guard<std::mutex> guard(httpLock);
+    return httpRequests;
+}
+
+} // namespace host
+
+class HTTPClient {
+public:
+    bool begin(WiFiClient& client, const char* url) {
+        _client = &client;
+        _url = url;
+        _requestHeaders.clear();
+        _responseHeaders.clear();
+        _size = -1;
+        _canReuse = true;
+        return true;
+    }
+
+    bool begin(WiFiClient& client, const String& url) { return begin(client, url.c_str()); }
+
+    void end() {
+        // Like the core: drop unread data, keep the connection if allowed
+        if (_client != nullptr) {
+            uint8_t scratch[64];
+            while (_client->available() > 0) {
+                _client->read(scratch, sizeof(scratch));
+            }
+            if (!_reuse || !_canReuse) {
+                _client->stop();
+            }
+        }
+    }
+
+    void setReuse(bool reuse) { _reuse = reuse; }
+    void setTimeout(uint16_t timeout) { _timeout = timeout; }
+    void setConnectTimeout(int32_t connectTimeout) { _connectTimeout = connectTimeout; }
+    void addHeader(const String& name, const String& value) {
+        _requestHeaders[name.c_str()] = value.c_str();
+    }
+
+    void collectHeaders(const char* headerKeys[], const size_t headerKeysCount) {
+        _collected.clear();
+        for (size_t i = 0; i < headerKeysCount; i++) {
+            _collected.push_back(headerKeys[i]);
+        }
+    }
+
+    String header(const char* name) {
+        auto found = _responseHeaders.find(name);
+        return found == _responseHeaders.end() ? String() : String(found->second);
+    }
+
+    int GET() { return sendRequest("GET", ""); }
+    int POST(const char* payload) { return sendRequest("POST", payload); }
+    int POST(const String& payload) { return sendRequest("POST", payload.c_str()); }
+
+    int getSize() { return _size; }
+
+    static String errorToString(int error) {
+        switch (error) {
+        case HTTPC_ERROR_CONNECTION_REFUSED: return "connection refused";
+        case HTTPC_ERROR_SEND_HEADER_FAILED: return "send header failed";
+        case HTTPC_ERROR_SEND_PAYLOAD_FAILED: return "send payload failed";
+        case HTTPC_ERROR_NOT_CONNECTED: return "not connected";
+        case HTTPC_ERROR_CONNECTION_LOST: return "connection lost";
+        case HTTPC_ERROR_READ_TIMEOUT: return "read Timeout";
+        default: return String();
+        }
+    }
+
+private:
+    WiFiClient* _client = nullptr;
+    std::string _url;
+    bool _reuse = true;
+    bool _canReuse = true;
+    uint16_t _timeout = HTTPCLIENT_DEFAULT_TCP_TIMEOUT;
+    int32_t _connectTimeout = HTTPCLIENT_DEFAULT_TCP_TIMEOUT;
+    int _size = -1;
+    std::map<std::string, std::string> _requestHeaders;
+    std::map<std::string, std::string> _responseHeaders;
+    std::vector<std::string> _collected;
+
+    // The head HTTPClient::sendHeader() writes, Content-Length included
+    size_t headBytes(const char* method, size_t payloadSize) const {
+        size_t schemeEnd = _url.find("://");
+        size_t hostStart = schemeEnd == std::string::npos ? 0 : schemeEnd + 3;
+        size_t pathStart = _url.find('/', hostStart);
+        std::string hostName = _url.substr(hostStart, pathStart - hostStart);
+        std::string path = pathStart == std::string::npos ? "/" : _url.substr(pathStart);
+
+        std::string head = std::string(method) + " " + path + " HTTP/1.1\r\nHost: " + hostName +
+                           "\r\nUser-Agent: ESP32HTTPClient\r\nAccept-Encoding: identity;q=1,chunked;q=0.1,*;q=0"
+                           "\r\nConnection: " + (_reuse ? "keep-alive" : "close") + "\r\n";
+        for (const auto& header : _requestHeaders) {
+            head += header.first + ": " + header.second + "\r\n";
+        }
+        if (payloadSize > 0) {
+            head += "Content-Length: " + std::to_string(payloadSize) + "\r\n";
+        }
+        return head.size() + 2;
+    }
+
+    int fail(int error) {
+        if (_client->connected()) {
+            _client->stop();
+        }
+        return error;
+    }
+
+    int sendRequest(const char* method, const char* payload) {
+        if (_client == nullptr) {
+            return HTTPC_ERROR_NOT_CONNECTED;
+        }
+
+        if (!_client->connected() && !_client->connect("server", 80, _connectTimeout)) {
+            return HTTPC_ERROR_CONNECTION_REFUSED;
+        }
+        bool reused = _client->used;
+        _client->used = true;
+
+        host::HttpRequest request{method, _url, payload ? payload : "", reused, _requestHeaders};
+        request.wireBytes = headBytes(method, request.payload.size()) + request.payload.size();
+        host::HttpResponse response;
+        {
+            std::lock_guard<std::mutex> guard(host::httpLock);
+            response = host::httpHandler ? host::httpHandler(request) : host::HttpResponse();
+        }
+
+        // Failing before the request was written: the server never saw it
+        bool unsent = response.code == HTTPC_ERROR_CONNECTION_REFUSED ||
+                      response.code == HTTPC_ERROR_SEND_HEADER_FAILED ||
+                      response.code == HTTPC_ERROR_NOT_CONNECTED;
+        if (!unsent) {
+            std::lock_guard<std::mutex> guard(host::httpLock);
+            host::httpRequests.push_back(request);
+        }
+        if (response.code <= 0) {
+            return fail(response.code);
+        }
+
+        if (response.delayMs >= _timeout) {
+            delay(_timeout);
+            return fail(HTTPC_ERROR_READ_TIMEOUT);
+        }
+        delay(response.delayMs);
+
+        _responseHeaders.clear();
+        for (const std::string& name : _collected) {
+            if (name == "Transfer-Encoding" && response.chunked) {
+                _responseHeaders[name] = "chunked";
+            }
+        }
+        _size = (response.chunked || response.closeDelimited) ? -1
+                : response.contentLength >= 0 ? response.contentLength : (int)response.body.size();
+        // Servers may end a body with the close without saying
+        // "Connection: close", so only keepAlive decides
+        _canReuse = response.keepAlive;
+
+        std::string wire = response.body;
+        if (response.chunked && !wire.empty()) {
+            char size[24];
+            snprintf(size, sizeof(size), "%zx\r\n", wire.size());
+            wire = size + wire + "\r\n0\r\n\r\n";
+        } else if (response.chunked) {
+            wire = "0\r\n\r\n";
+        }
+
+        unsigned long bodyAt = millis() + response.bodyDelayMs;
+        _client->feed(wire, bodyAt);
+        if (response.closeDelimited || !response.keepAlive) {
+            _client->closeFromPeer(bodyAt);
+        }
+        return response.code;
+    }
+};
+
+#endif // NATIVE_HTTP_CLIENT_H
@@ -0,0 +1,96 @@
+#ifndef NATIVE_PREFERENCES_H
+#define NATIVE_PREFERENCES_H
+
+// NVS stand-in: namespaces live in one process-wide map, so a value stored
+// by one Preferences instance is there for the next, as after a reboot.
+// putBytes() replaces an entry in one step, as NVS does.
+
+#include <Arduino.h>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace host {
+
+inline std::map<std::string, std::map<std::string, std::vector<uint8_t>>> nvs;
+inline size_t nvsWrites = 0;
+inline bool nvsAvailable = true;  // false: begin() fails, as with a damaged partition
+// Cost of reading 1 KB of a value; keys are found through NVS's RAM index
+inline unsigned long nvsReadMicrosPerKB = 0;
+
+inline void clearNvs() {
+    nvs.clear();
+    nvsWrites = 0;
+    nvsAvailable = true;
+    nvsReadMicrosPerKB = 0;
+}
+
+} // namespace host
+
+class Preferences {
+public:
+    bool begin(const char* name, bool readOnly = false, const char* partition = nullptr) {
+        (void)partition;
+        if (!host::nvsAvailable) {
+            return false;
+        }
+        _name = name;
+        _readOnly = readOnly;
+        _open = true;
+        return true;
+    }
+    void end() { _open = false; }
+
+    size_t putBytes(const char* key, const void* value, size_t length) {
+        if (!_open || _readOnly) {
+            return 0;
+        }
+        const uint8_t* bytes = static_cast<const uint8_t*>(value);
+        host::nvs[_name][key].assign(bytes, bytes + length);
+        host::nvsWrites++;
+        return length;
+    }
+    size_t getBytesLength(const char* key) {
+        const std::vector<uint8_t>* value = find(key);
+        return value ? value->size() : 0;
+    }
+    size_t getBytes(const char* key, void* buffer, size_t length) {
+        const std::vector<uint8_t>* value = find(key);
+        if (value == nullptr || length < value->size()) {
+            return 0;
+        }
+        memcpy(buffer, value->data(), value->size());
+        if (host::nvsReadMicrosPerKB > 0) {
+            delayMicroseconds((unsigned int)(value->size() * host::nvsReadMicrosPerKB / 1024));
+        }
+        return value->size();
+    }
+    bool isKey(const char* key) { return find(key) != nullptr; }
+    bool remove(const char* key) { return _open && !_readOnly && host::nvs[_name].erase(key) > 0; }
+    bool clear() {
+        if (!_open || _readOnly) {
+            return false;
+        }
+        host::nvs[_name].clear();
+        return true;
+    }
+
+private:
+    std::string _name;
+    bool _readOnly = false;
+    bool _open = false;
+
+    const std::vector<uint8_t>* find(const char* key) {
+        if (!_open) {
+            return nullptr;
+        }
+        auto space = host::nvs.find(_name);
+        if (space == host::nvs.end()) {
+            return nullptr;
+        }
+        auto entry = space->second.find(key);
+        return entry == space->second.end() ? nullptr : &entry->second;
+    }
+};
+
+#endif // NATIVE_PREFERENCES_H
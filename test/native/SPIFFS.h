@@ -0,0 +1,16 @@
+#ifndef NATIVE_SPIFFS_H
+#define NATIVE_SPIFFS_H
+
+#include "FS.h"
+
+class SPIFFSFS : public fs::MemoryFS {
+public:
+    bool begin(bool formatOnFail = false) { (void)formatOnFail; return true; }
+    void end() {}
+    bool format() { reset(); return true; }
+    size_t totalBytes() { return 1024 * 1024; }
+};
+
+inline SPIFFSFS SPIFFS;
+
+#endif // NATIVE_SPIFFS_H
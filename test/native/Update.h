@@ -0,0 +1,129 @@
+#ifndef NATIVE_UPDATE_H
+#define NATIVE_UPDATE_H
+
+// Update stand-in writing into an in-memory OTA partition. write() takes
+// host::flashWriteUs per 4 KB, so the flash side of a download pipeline
+// has a cost; end() marks the image bootable.
+
+#include <Arduino.h>
+#include <mutex>
+#include <vector>
+
+#define U_FLASH 0
+#define U_SPIFFS 100
+
+#define UPDATE_ERROR_OK 0
+#define UPDATE_ERROR_WRITE 1
+#define UPDATE_ERROR_SPACE 4
+#define UPDATE_ERROR_SIZE 5
+#define UPDATE_ERROR_ABORT 8
+#define UPDATE_ERROR_NO_PARTITION 11
+
+namespace host {
+
+inline std::mutex flashLock;
+inline std::vector<uint8_t> otaPartition;  // What was written since begin()
+inline size_t otaPartitionSize = 1536 * 1024;
+inline unsigned long flashWriteUs = 0;    // Per 4 KB written
+inline bool otaBootable = false;          // end() succeeded
+inline uint32_t otaBegins = 0;
+
+inline void resetUpdate() {
+    std::lock_guard<std::mutex> guard(flashLock);
+    otaPartition.clear();
+    otaPartitionSize = 1536 * 1024;
+    flashWriteUs = 0;
+    otaBootable = false;
+    otaBegins = 0;
+}
+
+inline std::vector<uint8_t> otaImage() {
+    std::lock_guard<std::mutex> guard(flashLock);
+    return otaPartition;
+}
+
+} // namespace host
+
+class UpdateClass {
+public:
+    bool begin(size_t size, int command = U_FLASH) {
+        (void)command;
+        std::lock_guard<std::mutex> guard(host::flashLock);
+        host::otaBegins++;
+        host::otaBootable = false;
+        host::otaPartition.clear();
+        _size = 0;
+        _running = false;
+        if (size == 0 || size > host::otaPartitionSize) {
+            _error = UPDATE_ERROR_SPACE;
+            return false;
+        }
+        _size = size;
+        _error = UPDATE_ERROR_OK;
+        _running = true;
+        return true;
+    }
+
+    size_t write(uint8_t* data, size_t length) {
+        if (!_running || _error != UPDATE_ERROR_OK) {
+            return 0;
+        }
+        if (host::flashWriteUs > 0) {
+            delayMicroseconds((uint64_t)host::flashWriteUs * length / 4096);
+        }
+        std::lock_guard<std::mutex> guard(host::flashLock);
+        if (host::otaPartition.size() + length > _size) {
+            _error = UPDATE_ERROR_SPACE;
+            return 0;
+        }
+        host::otaPartition.insert(host::otaPartition.end(), data, data + length);
+        return length;
+    }
+
+    // evenIfRemaining: an image shorter than begin()'s size is accepted
+    bool end(bool evenIfRemaining = false) {
+        std::lock_guard<std::mutex> guard(host::flashLock);
+        if (!_running || _error != UPDATE_ERROR_OK) {
+            return false;
+        }
+        _running = false;
+        if (!evenIfRemaining && host::otaPartition.size() != _size) {
+            _error = UPDATE_ERROR_SIZE;
+            return false;
+        }
+        host::otaBootable = true;
+        return true;
+    }
+
+    void abort() {
+        _running = false;
+        _error = UPDATE_ERROR_ABORT;
+    }
+
+    bool hasError() { return _error != UPDATE_ERROR_OK; }
+    bool isRunning() { return _running; }
+    bool isFinished() {
+        std::lock_guard<std::mutex> guard(host::flashLock);
+        return host::otaBootable;
+    }
+
+    const char* errorString() {
+        switch (_error) {
+        case UPDATE_ERROR_OK: return "No Error";
+        case UPDATE_ERROR_WRITE: return "Flash Write Failed";
+        case UPDATE_ERROR_SPACE: return "Not Enough Space";
+        case UPDATE_ERROR_SIZE: return "Bad Size Given";
+        case UPDATE_ERROR_ABORT: return "Update Aborted";
+        default: return "UNKNOWN";
+        }
+    }
+
+private:
+    size_t _size = 0;
+    bool _running = false;
+    uint8_t _error = UPDATE_ERROR_OK;
+};
+
+inline UpdateClass Update;
+
+#endif // NATIVE_UPDATE_H
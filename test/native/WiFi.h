@@ -0,0 +1,254 @@
+#ifndef NATIVE_WIFI_H
+#define NATIVE_WIFI_H
+
+// WiFi driver stand-in with simulated access points. As with the ESP32
+// driver, begin() returns at once and the connection comes up later on
+// the clock: a full connect scans every channel, associates and runs
+// DHCP; given the AP's channel and BSSID the scan is skipped, and a
+// static address skips DHCP. A connect with a stale channel or BSSID
+// never completes. Taking an AP down drops its stations, and each
+// begin() is logged, so tests can see when and how a device tried.
+
+#include <Arduino.h>
+#include <string>
+#include <vector>
+#include "WiFiClient.h"
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum { WIFI_OFF, WIFI_STA, WIFI_AP, WIFI_AP_STA } wifi_mode_t;
+typedef enum { WIFI_PS_NONE, WIFI_PS_MIN_MODEM, WIFI_PS_MAX_MODEM } wifi_ps_type_t;
+
+class IPAddress {
+public:
+    IPAddress() : _address(0) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+        : _address(a | (b << 8) | (c << 16) | ((uint32_t)d << 24)) {}
+    IPAddress(uint32_t address) : _address(address) {}
+
+    operator uint32_t() const { return _address; }
+    uint8_t operator[](int index) const { return (_address >> (8 * index)) & 0xFF; }
+    bool operator==(const IPAddress& other) const { return _address == other._address; }
+
+    String toString() const {
+        char text[16];
+        snprintf(text, sizeof(text), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+        return String(text);
+    }
+
+private:
+    uint32_t _address;
+};
+
+#define INADDR_NONE IPAddress(0, 0, 0, 0)
+
+namespace host {
+
+struct AccessPoint {
+    std::string ssid;
+    std::string password;
+    uint8_t bssid[6];
+    int32_t channel;
+    bool up = true;
+    unsigned long scanMs = 2500;      // All channels
+    unsigned long associateMs = 300;  // Authentication + association
+    unsigned long dhcpMs = 1500;
+    IPAddress lease = IPAddress(192, 168, 1, 100);
+    IPAddress gateway = IPAddress(192, 168, 1, 1);
+    uint32_t outages = 0;             // Times it went down
+};
+
+struct WiFiAttempt {
+    unsigned long at;
+    std::string ssid;
+    bool fast;      // Channel and BSSID given
+    bool staticIp;  // No DHCP
+};
+
+inline std::vector<AccessPoint> accessPoints;
+inline std::vector<WiFiAttempt> wifiAttempts;
+inline uint8_t softAPStations = 0;
+
+inline AccessPoint& addAccessPoint(const char* ssid, const char* password, int32_t channel,
+                                   uint8_t bssidTail = 1) {
+    AccessPoint ap;
+    ap.ssid = ssid;
+    ap.password = password;
+    ap.channel = channel;
+    const uint8_t bssid[6] = {0x24, 0x0a, 0xc4, 0x00, 0x00, bssidTail};
+    memcpy(ap.bssid, bssid, sizeof(ap.bssid));
+    accessPoints.push_back(ap);
+    return accessPoints.back();
+}
+
+inline AccessPoint* findAccessPoint(const std::string& ssid) {
+    for (AccessPoint& ap : accessPoints) {
+        if (ap.ssid == ssid) {
+            return &ap;
+        }
+    }
+    return nullptr;
+}
+
+// Outage: stations lose the link and have to join again once it is back
+inline void setAccessPointUp(const char* ssid, bool up) {
+    AccessPoint* ap = findAccessPoint(ssid);
+    if (ap != nullptr && ap->up && !up) {
+        ap->outages++;
+    }
+    if (ap != nullptr) {
+        ap->up = up;
+    }
+}
+
+inline void resetWiFi();
+
+} // namespace host
+
+class WiFiClass {
+public:
+    void mode(wifi_mode_t mode) { _mode = mode; }
+    wifi_mode_t getMode() { return _mode; }
+    void setAutoReconnect(bool autoReconnect) { _autoReconnect = autoReconnect; }
+    void persistent(bool persistent) { (void)persistent; }
+    bool setSleep(bool enabled) { sleep = enabled ? WIFI_PS_MIN_MODEM : WIFI_PS_NONE; return true; }
+    bool setSleep(wifi_ps_type_t type) { sleep = type; return true; }
+
+    wl_status_t begin(const char* ssid, const char* password = nullptr, int32_t channel = 0,
+                      const uint8_t* bssid = nullptr, bool connect = true) {
+        (void)connect;
+        _ssid = ssid;
+        _attempting = true;
+        _ap = nullptr;
+
+        bool fast = channel > 0 && bssid != nullptr;
+        bool staticIp = (uint32_t)_staticIp != 0;
+        host::wifiAttempts.push_back(host::WiFiAttempt{millis(), _ssid, fast, staticIp});
+
+        host::AccessPoint* ap = host::findAccessPoint(_ssid);
+        if (ap == nullptr || !ap->up || ap->password != (password ? password : "")) {
+            return WL_DISCONNECTED;
+        }
+        // The driver only listens on the given channel for the given BSSID
+        if (fast && (channel != ap->channel || memcmp(bssid, ap->bssid, 6) != 0)) {
+            return WL_DISCONNECTED;
+        }
+        // A cached address from another network gets no traffic through
+        if (staticIp && !(_gateway == ap->gateway)) {
+            return WL_DISCONNECTED;
+        }
+
+        _ap = ap;
+        _outages = ap->outages;
+        _connectedAt = millis() + (fast ? 0 : ap->scanMs) + ap->associateMs + (staticIp ? 0 : ap->dhcpMs);
+        return WL_DISCONNECTED;
+    }
+
+    bool disconnect(bool wifiOff = false, bool eraseAp = false) {
+        (void)wifiOff;
+        (void)eraseAp;
+        _attempting = false;
+        _ap = nullptr;
+        return true;
+    }
+
+    bool config(IPAddress localIp, IPAddress gateway, IPAddress subnet,
+                IPAddress dns1 = IPAddress(), IPAddress dns2 = IPAddress()) {
+        (void)dns2;
+        _staticIp = localIp;
+        _gateway = gateway;
+        _subnet = subnet;
+        _dns = dns1;
+        return true;
+    }
+
+    wl_status_t status() {
+        if (!_attempting) {
+            return WL_DISCONNECTED;
+        }
+        if (_ap == nullptr || (long)(millis() - _connectedAt) < 0) {
+            return WL_DISCONNECTED;
+        }
+        if (!_ap->up || _ap->outages != _outages) {
+            return WL_CONNECTION_LOST;
+        }
+        return WL_CONNECTED;
+    }
+
+    String SSID() { return status() == WL_CONNECTED ? String(_ssid.c_str()) : String(); }
+    int32_t RSSI() { return status() == WL_CONNECTED ? -58 : 0; }
+    uint8_t* BSSID() { return status() == WL_CONNECTED ? _ap->bssid : nullptr; }
+    int32_t channel() { return status() == WL_CONNECTED ? _ap->channel : 0; }
+
+    IPAddress localIP() {
+        if (status() != WL_CONNECTED) {
+            return IPAddress();
+        }
+        return (uint32_t)_staticIp != 0 ? _staticIp : _ap->lease;
+    }
+    IPAddress gatewayIP() { return status() == WL_CONNECTED ? _ap->gateway : IPAddress(); }
+    IPAddress subnetMask() { return status() == WL_CONNECTED ? IPAddress(255, 255, 255, 0) : IPAddress(); }
+    IPAddress dnsIP(uint8_t index = 0) {
+        (void)index;
+        return status() == WL_CONNECTED ? _ap->gateway : IPAddress();
+    }
+
+    bool softAP(const char* ssid, const char* password = nullptr) {
+        (void)password;
+        softAPSsid = ssid;
+        return true;
+    }
+    bool softAPdisconnect(bool wifiOff = false) {
+        (void)wifiOff;
+        softAPSsid.clear();
+        return true;
+    }
+    IPAddress softAPIP() { return IPAddress(192, 168, 4, 1); }
+    uint8_t softAPgetStationNum() { return host::softAPStations; }
+
+    // Host side
+    std::string softAPSsid;
+    wifi_ps_type_t sleep = WIFI_PS_MIN_MODEM;
+
+    void reset() {
+        _mode = WIFI_OFF;
+        _attempting = false;
+        _ap = nullptr;
+        _staticIp = _gateway = _subnet = _dns = IPAddress();
+        softAPSsid.clear();
+        sleep = WIFI_PS_MIN_MODEM;
+    }
+
+private:
+    wifi_mode_t _mode = WIFI_OFF;
+    bool _autoReconnect = true;
+    bool _attempting = false;
+    std::string _ssid;
+    host::AccessPoint* _ap = nullptr;
+    uint32_t _outages = 0;
+    unsigned long _connectedAt = 0;
+    IPAddress _staticIp;
+    IPAddress _gateway;
+    IPAddress _subnet;
+    IPAddress _dns;
+};
+
+inline WiFiClass WiFi;
+
+inline void host::resetWiFi() {
+    accessPoints.clear();
+    accessPoints.reserve(16);
+    wifiAttempts.clear();
+    softAPStations = 0;
+    WiFi.reset();
+}
+
+#endif // NATIVE_WIFI_H
@@ -0,0 +1,171 @@
+#ifndef NATIVE_WIFI_CLIENT_H
+#define NATIVE_WIFI_CLIENT_H
+
+// TCP connection stand-in. The test plays the server: it queues bytes for
+// the client to read, optionally not before a given millis(), and closes
+// the connection from the peer side. What the client writes is kept.
+// connected() behaves like the ESP32 core: true while unread data is left,
+// even after the peer closed.
+
+#include <Arduino.h>
+#include <deque>
+#include <mutex>
+#include <string>
+
+namespace host {
+
+inline std::atomic<uint32_t> tcpConnects{0};
+inline std::atomic<unsigned long> tcpConnectDelayMs{0};  // Time the handshake takes
+
+} // namespace host
+
+class WiFiClient : public Stream {
+public:
+    WiFiClient() {}
+    WiFiClient(const WiFiClient&) = delete;
+    WiFiClient& operator=(const WiFiClient&) = delete;
+    virtual ~WiFiClient() {}
+
+    virtual int connect(const char* host, uint16_t port) { return connect(host, port, -1); }
+
+    // Fails after timeoutMs (-1: none) when the handshake takes longer
+    virtual int connect(const char* host, uint16_t port, int32_t timeoutMs) {
+        (void)host;
+        (void)port;
+        unsigned long handshake = host::tcpConnectDelayMs;
+        if (timeoutMs >= 0 && handshake > (unsigned long)timeoutMs) {
+            delay(timeoutMs);
+            return 0;
+        }
+        if (handshake > 0) {
+            delay(handshake);
+        }
+        std::lock_guard<std::mutex> guard(_lock);
+        _open = true;
+        used = false;
+        _peerClosed = false;
+        _closeAt = NEVER;
+        _rx.clear();
+        _scheduled.clear();
+        host::tcpConnects++;
+        return 1;
+    }
+
+    virtual void stop() {
+        std::lock_guard<std::mutex> guard(_lock);
+        if (_open) {
+            _stops++;
+        }
+        _open = false;
+        _rx.clear();
+        _scheduled.clear();
+    }
+
+    uint8_t connected() {
+        std::lock_guard<std::mutex> guard(_lock);
+        deliver();
+        return _open && (!_rx.empty() || !_peerClosed);
+    }
+
+    explicit operator bool() { return connected(); }
+
+    int available() override {
+        std::lock_guard<std::mutex> guard(_lock);
+        deliver();
+        return _open ? (int)_rx.size() : 0;
+    }
+
+    int read() override {
+        uint8_t c;
+        return read(&c, 1) == 1 ? c : -1;
+    }
+
+    int read(uint8_t* buffer, size_t size) {
+        std::lock_guard<std::mutex> guard(_lock);
+        deliver();
+        if (!_open || _rx.empty()) {
+            return -1;
+        }
+        size_t count = std::min(size, _rx.size());
+        std::copy(_rx.begin(), _rx.begin() + count, buffer);
+        _rx.erase(_rx.begin(), _rx.begin() + count);
+        return (int)count;
+    }
+
+    int peek() override {
+        std::lock_guard<std::mutex> guard(_lock);
+        deliver();
+        return (_open && !_rx.empty()) ? (uint8_t)_rx.front() : -1;
+    }
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        std::lock_guard<std::mutex> guard(_lock);
+        if (!_open || _peerClosed) {
+            return 0;
+        }
+        _tx.append((const char*)buffer, size);
+        return size;
+    }
+    using Print::write;
+
+    // Host side: data arriving at atMs (now if 0), in order after earlier data
+    void feed(const std::string& data, unsigned long atMs = 0) {
+        std::lock_guard<std::mutex> guard(_lock);
+        _scheduled.push_back(Delivery{atMs, data});
+    }
+
+    // Host side: the peer closes once everything fed before is delivered
+    void closeFromPeer(unsigned long atMs = 0) {
+        std::lock_guard<std::mutex> guard(_lock);
+        _closeAt = atMs;
+    }
+
+    bool isOpen() {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _open;
+    }
+
+    uint32_t stopCount() {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _stops;
+    }
+
+    // Host side: a request went out on this connection since it opened
+    bool used = false;
+
+    std::string written() {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _tx;
+    }
+
+private:
+    static const unsigned long NEVER = ~0ul;
+
+    struct Delivery {
+        unsigned long at;
+        std::string data;
+    };
+
+    std::mutex _lock;
+    bool _open = false;
+    bool _peerClosed = false;
+    unsigned long _closeAt = NEVER;
+    std::deque<char> _rx;
+    std::deque<Delivery> _scheduled;
+    std::string _tx;
+    uint32_t _stops = 0;
+
+    void deliver() {
+        unsigned long now = millis();
+        while (!_scheduled.empty() && (long)(now - _scheduled.front().at) >= 0) {
+            _rx.insert(_rx.end(), _scheduled.front().data.begin(), _scheduled.front().data.end());
+            _scheduled.pop_front();
+        }
+        if (_scheduled.empty() && _closeAt != NEVER && (long)(now - _closeAt) >= 0) {
+            _peerClosed = true;
+        }
+    }
+};
+
+#endif // NATIVE_WIFI_CLIENT_H
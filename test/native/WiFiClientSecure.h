@@ -0,0 +1,18 @@
+#ifndef NATIVE_WIFI_CLIENT_SECURE_H
+#define NATIVE_WIFI_CLIENT_SECURE_H
+
+// TLS is not simulated; the certificate policy is only recorded
+
+#include "WiFiClient.h"
+
+class WiFiClientSecure : public WiFiClient {
+public:
+    void setCACert(const char* rootCA) { caCert = rootCA; insecure = false; }
+    void setInsecure() { insecure = true; }
+
+    // Host side
+    const char* caCert = nullptr;
+    bool insecure = false;
+};
+
+#endif // NATIVE_WIFI_CLIENT_SECURE_H
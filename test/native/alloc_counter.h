@@ -0,0 +1,68 @@
+#ifndef NATIVE_ALLOC_COUNTER_H
+#define NATIVE_ALLOC_COUNTER_H
+
+// Counts heap allocations made through operator new, which is where the
+// String and std:: containers of the shim allocate. Replaces the global
+// operator new, so include it from exactly one file of a test. Counts are
+// per thread, so background tasks do not disturb the measured code.
+// Allocations made inside a host::LibraryScope are also counted apart, so a
+// test can leave out what a library stand-in allocates for itself.
+
+#include <Arduino.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <new>
+
+namespace host {
+
+struct AllocCount {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+    uint64_t libraryAllocations = 0;  // Of allocations, those inside a LibraryScope
+
+    uint64_t firmwareAllocations() const { return allocations - libraryAllocations; }
+};
+
+inline thread_local AllocCount threadAllocs;
+
+// Allocations of the calling thread since it started
+inline AllocCount allocCount() {
+    return threadAllocs;
+}
+
+} // namespace host
+
+void* operator new(size_t size) {
+    host::threadAllocs.allocations++;
+    host::threadAllocs.bytes += size;
+    if (host::libraryDepth > 0) {
+        host::threadAllocs.libraryAllocations++;
+    }
+    void* p = malloc(size ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
+
+#endif // NATIVE_ALLOC_COUNTER_H
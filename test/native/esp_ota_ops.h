@@ -0,0 +1,11 @@
+#ifndef NATIVE_ESP_OTA_OPS_H
+#define NATIVE_ESP_OTA_OPS_H
+
+#include "esp_partition.h"
+
+inline const esp_partition_t* esp_ota_get_running_partition() {
+    host::runningPartition.size = host::runningImage.size();
+    return &host::runningPartition;
+}
+
+#endif // NATIVE_ESP_OTA_OPS_H
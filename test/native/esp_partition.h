@@ -0,0 +1,55 @@
+#ifndef NATIVE_ESP_PARTITION_H
+#define NATIVE_ESP_PARTITION_H
+
+// The running app partition is host::runningImage; mapping it hands out
+// the vector's memory, as a memory-mapped flash read would
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#ifndef ESP_OK
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#endif
+
+typedef struct {
+    uint32_t address;
+    uint32_t size;
+    char label[17];
+} esp_partition_t;
+
+typedef uint32_t spi_flash_mmap_handle_t;
+
+typedef enum {
+    SPI_FLASH_MMAP_DATA,
+    SPI_FLASH_MMAP_INST
+} spi_flash_mmap_memory_t;
+
+namespace host {
+
+inline std::vector<uint8_t> runningImage;
+inline esp_partition_t runningPartition = {0x10000, 0, "app0"};
+inline int mappedPartitions = 0;
+
+} // namespace host
+
+inline esp_err_t esp_partition_mmap(const esp_partition_t* partition, size_t offset, size_t size,
+                                    spi_flash_mmap_memory_t memory, const void** out,
+                                    spi_flash_mmap_handle_t* handle) {
+    (void)memory;
+    if (partition != &host::runningPartition || offset + size > host::runningImage.size()) {
+        return ESP_FAIL;
+    }
+    *out = host::runningImage.data() + offset;
+    *handle = ++host::mappedPartitions;
+    return ESP_OK;
+}
+
+inline void spi_flash_munmap(spi_flash_mmap_handle_t handle) {
+    (void)handle;
+    host::mappedPartitions--;
+}
+
+#endif // NATIVE_ESP_PARTITION_H
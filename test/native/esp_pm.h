@@ -0,0 +1,113 @@
+#ifndef NATIVE_ESP_PM_H
+#define NATIVE_ESP_PM_H
+
+// Power management stand-in: records the configuration and how many times
+// each lock is held, so a test can tell what the chip would be doing.
+// host::lightSleepSupported = false acts like an SDK built without
+// tickless idle, host::pmSupported = false like one without
+// CONFIG_PM_ENABLE.
+
+#include <stdint.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_NOT_SUPPORTED 0x106
+
+typedef struct {
+    int max_freq_mhz;
+    int min_freq_mhz;
+    bool light_sleep_enable;
+} esp_pm_config_esp32_t;
+
+typedef enum {
+    ESP_PM_CPU_FREQ_MAX,
+    ESP_PM_APB_FREQ_MAX,
+    ESP_PM_NO_LIGHT_SLEEP
+} esp_pm_lock_type_t;
+
+struct esp_pm_lock {
+    esp_pm_lock_type_t type;
+    int count;
+};
+
+typedef esp_pm_lock* esp_pm_lock_handle_t;
+
+namespace host {
+
+inline bool pmSupported = true;
+inline bool lightSleepSupported = true;
+inline bool pmConfigured = false;
+inline esp_pm_config_esp32_t pmConfig = {0, 0, false};
+inline int pmLocksHeld[3] = {0, 0, 0};  // By esp_pm_lock_type_t
+
+inline void resetPm() {
+    pmSupported = true;
+    lightSleepSupported = true;
+    pmConfigured = false;
+    pmConfig = esp_pm_config_esp32_t{0, 0, false};
+    pmLocksHeld[0] = pmLocksHeld[1] = pmLocksHeld[2] = 0;
+}
+
+// What the idle task would do now: light sleep or stay clocked
+inline bool lightSleepAllowed() {
+    return pmConfigured && pmConfig.light_sleep_enable && pmLocksHeld[ESP_PM_NO_LIGHT_SLEEP] == 0;
+}
+
+inline int cpuMhz() {
+    if (!pmConfigured) {
+        return 240;
+    }
+    return pmLocksHeld[ESP_PM_CPU_FREQ_MAX] > 0 ? pmConfig.max_freq_mhz : pmConfig.min_freq_mhz;
+}
+
+} // namespace host
+
+inline esp_err_t esp_pm_configure(const void* config) {
+    const esp_pm_config_esp32_t* pm = static_cast<const esp_pm_config_esp32_t*>(config);
+    if (!host::pmSupported || (pm->light_sleep_enable && !host::lightSleepSupported)) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    host::pmConfig = *pm;
+    host::pmConfigured = true;
+    return ESP_OK;
+}
+
+inline esp_err_t esp_pm_lock_create(esp_pm_lock_type_t type, int arg, const char* name,
+                                    esp_pm_lock_handle_t* handle) {
+    (void)arg;
+    (void)name;
+    *handle = new esp_pm_lock{type, 0};
+    return ESP_OK;
+}
+
+inline esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle) {
+    if (handle == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    handle->count++;
+    host::pmLocksHeld[handle->type]++;
+    return ESP_OK;
+}
+
+inline esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle) {
+    if (handle == nullptr || handle->count == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    handle->count--;
+    host::pmLocksHeld[handle->type]--;
+    return ESP_OK;
+}
+
+inline const char* esp_err_to_name(esp_err_t err) {
+    switch (err) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+    default: return "ESP_FAIL";
+    }
+}
+
+#endif // NATIVE_ESP_PM_H
@@ -0,0 +1,31 @@
+#ifndef NATIVE_ESP_SYSTEM_H
+#define NATIVE_ESP_SYSTEM_H
+
+// Reset reason is whatever the test sets, so boot paths that depend on
+// surviving RTC memory can be exercised without a reboot.
+
+typedef enum {
+    ESP_RST_UNKNOWN,
+    ESP_RST_POWERON,
+    ESP_RST_EXT,
+    ESP_RST_SW,
+    ESP_RST_PANIC,
+    ESP_RST_INT_WDT,
+    ESP_RST_TASK_WDT,
+    ESP_RST_WDT,
+    ESP_RST_DEEPSLEEP,
+    ESP_RST_BROWNOUT,
+    ESP_RST_SDIO
+} esp_reset_reason_t;
+
+namespace host {
+
+inline esp_reset_reason_t resetReason = ESP_RST_POWERON;
+
+} // namespace host
+
+inline esp_reset_reason_t esp_reset_reason() {
+    return host::resetReason;
+}
+
+#endif // NATIVE_ESP_SYSTEM_H
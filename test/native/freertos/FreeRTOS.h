@@ -0,0 +1,129 @@
+#ifndef NATIVE_FREERTOS_H
+#define NATIVE_FREERTOS_H
+
+// FreeRTOS on std::thread for host tests. A tick is one millisecond. Tasks
+// are threads; host::stopTasks() (also run at exit) makes every task
+// unwind out of its next blocking call and joins it, so tests can tear
+// down modules whose tasks loop forever.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define errQUEUE_FULL 0
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portNUM_PROCESSORS 2
+#define tskNO_AFFINITY 0x7fffffff
+#define configMAX_PRIORITIES 25
+
+namespace host {
+
+// Critical sections: a plain mutex per portMUX, nothing is masked
+struct Spinlock {
+    std::mutex lock;
+};
+
+// Thrown inside a task to unwind it when it is deleted or stopped
+struct TaskExit {};
+
+struct Task {
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable wake;
+    uint32_t notifications = 0;
+    BaseType_t core = 0;
+    bool spawned = false;
+    std::atomic<bool> deleted{false};
+};
+
+inline std::mutex tasksLock;
+inline std::vector<Task*> tasks;
+inline std::atomic<bool> stopping{false};
+inline thread_local Task* currentTask = nullptr;
+
+inline Task* selfTask() {
+    if (currentTask == nullptr) {
+        // Threads not started through xTaskCreate (e.g. the test itself)
+        // still get a handle for notifications
+        static thread_local Task adopted;
+        currentTask = &adopted;
+    }
+    return currentTask;
+}
+
+// Blocking calls check this so stopped or deleted tasks unwind
+inline void checkTaskExit() {
+    Task* task = currentTask;
+    if (task != nullptr && task->spawned && (stopping || task->deleted)) {
+        throw TaskExit();
+    }
+}
+
+// Wait on cv until ready() or timeout; waits in slices so stopTasks()
+// reaches tasks blocked forever
+template <typename Predicate>
+bool waitFor(std::unique_lock<std::mutex>& guard, std::condition_variable& cv,
+             TickType_t ticks, Predicate ready) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ticks);
+    while (!ready()) {
+        checkTaskExit();
+        auto now = std::chrono::steady_clock::now();
+        if (ticks != portMAX_DELAY && now >= deadline) {
+            return false;
+        }
+        auto slice = now + std::chrono::milliseconds(10);
+        cv.wait_until(guard, (ticks != portMAX_DELAY) ? std::min(slice, deadline) : slice);
+    }
+    return true;
+}
+
+// Unwind and join every task, then allow new ones to be created
+inline void stopTasks() {
+    std::vector<Task*> stopped;
+    {
+        std::lock_guard<std::mutex> guard(tasksLock);
+        stopped.swap(tasks);
+        stopping = true;
+    }
+    for (Task* task : stopped) {
+        task->wake.notify_all();
+        if (task->thread.joinable()) {
+            task->thread.join();
+        }
+        delete task;
+    }
+    stopping = false;
+}
+
+} // namespace host
+
+typedef host::Task* TaskHandle_t;
+typedef host::Spinlock portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {}
+
+inline void portENTER_CRITICAL(portMUX_TYPE* mux) {
+    mux->lock.lock();
+}
+
+inline void portEXIT_CRITICAL(portMUX_TYPE* mux) {
+    mux->lock.unlock();
+}
+
+#endif // NATIVE_FREERTOS_H
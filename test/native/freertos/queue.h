@@ -0,0 +1,79 @@
+#ifndef NATIVE_FREERTOS_QUEUE_H
+#define NATIVE_FREERTOS_QUEUE_H
+
+#include <string.h>
+#include <vector>
+#include "FreeRTOS.h"
+
+namespace host {
+
+// Storage for all items is allocated by xQueueCreate, as in FreeRTOS, so
+// sending and receiving never touch the heap
+struct Queue {
+    std::mutex lock;
+    std::condition_variable changed;
+    UBaseType_t length;
+    UBaseType_t itemSize;
+    std::vector<uint8_t> storage;
+    UBaseType_t head = 0;  // Oldest item
+    UBaseType_t count = 0;
+};
+
+} // namespace host
+
+typedef host::Queue* QueueHandle_t;
+
+inline QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    host::Queue* queue = new host::Queue();
+    queue->length = length;
+    queue->itemSize = itemSize;
+    queue->storage.resize((size_t)length * itemSize);
+    return queue;
+}
+
+inline BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks) {
+    std::unique_lock<std::mutex> guard(queue->lock);
+    if (!host::waitFor(guard, queue->changed, ticks,
+                       [queue] { return queue->count < queue->length; })) {
+        return errQUEUE_FULL;
+    }
+    UBaseType_t tail = (queue->head + queue->count) % queue->length;
+    memcpy(&queue->storage[(size_t)tail * queue->itemSize], item, queue->itemSize);
+    queue->count++;
+    queue->changed.notify_all();
+    return pdPASS;
+}
+
+inline BaseType_t xQueueSendToBack(QueueHandle_t queue, const void* item, TickType_t ticks) {
+    return xQueueSend(queue, item, ticks);
+}
+
+inline BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* woken) {
+    if (woken != nullptr) {
+        *woken = pdFALSE;
+    }
+    return xQueueSend(queue, item, 0);
+}
+
+inline BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks) {
+    std::unique_lock<std::mutex> guard(queue->lock);
+    if (!host::waitFor(guard, queue->changed, ticks, [queue] { return queue->count > 0; })) {
+        return pdFALSE;
+    }
+    memcpy(item, &queue->storage[(size_t)queue->head * queue->itemSize], queue->itemSize);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    queue->changed.notify_all();
+    return pdTRUE;
+}
+
+inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> guard(queue->lock);
+    return queue->count;
+}
+
+inline void vQueueDelete(QueueHandle_t queue) {
+    delete queue;
+}
+
+#endif // NATIVE_FREERTOS_QUEUE_H
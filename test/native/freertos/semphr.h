@@ -0,0 +1,61 @@
+#ifndef NATIVE_FREERTOS_SEMPHR_H
+#define NATIVE_FREERTOS_SEMPHR_H
+
+#include "FreeRTOS.h"
+
+namespace host {
+
+struct Semaphore {
+    std::mutex lock;
+    std::condition_variable available;
+    UBaseType_t count;
+    UBaseType_t max;
+};
+
+} // namespace host
+
+typedef host::Semaphore* SemaphoreHandle_t;
+
+// Mutexes are binary semaphores that start available; no priority
+// inheritance or recursion, which the firmware does not rely on
+inline SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial) {
+    host::Semaphore* semaphore = new host::Semaphore();
+    semaphore->count = initial;
+    semaphore->max = max;
+    return semaphore;
+}
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() {
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+inline SemaphoreHandle_t xSemaphoreCreateBinary() {
+    return xSemaphoreCreateCounting(1, 0);
+}
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    std::unique_lock<std::mutex> guard(semaphore->lock);
+    if (!host::waitFor(guard, semaphore->available, ticks, [semaphore] { return semaphore->count > 0; })) {
+        return pdFALSE;
+    }
+    semaphore->count--;
+    return pdTRUE;
+}
+
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    {
+        std::lock_guard<std::mutex> guard(semaphore->lock);
+        if (semaphore->count >= semaphore->max) {
+            return pdFALSE;
+        }
+        semaphore->count++;
+    }
+    semaphore->available.notify_one();
+    return pdTRUE;
+}
+
+inline void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+    delete semaphore;
+}
+
+#endif // NATIVE_FREERTOS_SEMPHR_H
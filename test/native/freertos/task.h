@@ -0,0 +1,111 @@
+#ifndef NATIVE_FREERTOS_TASK_H
+#define NATIVE_FREERTOS_TASK_H
+
+#include <Arduino.h>
+#include "FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void*);
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name,
+                                          uint32_t stackDepth, void* parameter,
+                                          UBaseType_t priority, TaskHandle_t* handle,
+                                          BaseType_t core) {
+    (void)name;
+    (void)stackDepth;
+    (void)priority;
+    static std::once_flag registered;
+    std::call_once(registered, [] { atexit(host::stopTasks); });
+
+    host::Task* task = new host::Task();
+    task->spawned = true;
+    task->core = (core == tskNO_AFFINITY) ? 0 : core;
+    if (handle != nullptr) {
+        *handle = task;
+    }
+    {
+        std::lock_guard<std::mutex> guard(host::tasksLock);
+        host::tasks.push_back(task);
+        task->thread = std::thread([task, function, parameter] {
+            host::currentTask = task;
+            try {
+                function(parameter);
+            } catch (const host::TaskExit&) {
+            }
+        });
+    }
+    return pdPASS;
+}
+
+inline BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stackDepth,
+                              void* parameter, UBaseType_t priority, TaskHandle_t* handle) {
+    return xTaskCreatePinnedToCore(function, name, stackDepth, parameter, priority, handle,
+                                   tskNO_AFFINITY);
+}
+
+// A task deleting itself unwinds now; another task unwinds at its next
+// blocking call
+inline void vTaskDelete(TaskHandle_t task) {
+    if (task == nullptr || task == host::currentTask) {
+        if (host::currentTask != nullptr && host::currentTask->spawned) {
+            throw host::TaskExit();
+        }
+        return;
+    }
+    task->deleted = true;
+    task->wake.notify_all();
+}
+
+inline TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return host::selfTask();
+}
+
+inline BaseType_t xPortGetCoreID() {
+    return host::selfTask()->core;
+}
+
+inline TickType_t xTaskGetTickCount() {
+    return (TickType_t)millis();
+}
+
+inline void vTaskDelay(TickType_t ticks) {
+    host::checkTaskExit();
+    delay(ticks);
+    host::checkTaskExit();
+}
+
+inline void vTaskDelayUntil(TickType_t* previousWake, TickType_t period) {
+    TickType_t wake = *previousWake + period;
+    TickType_t now = xTaskGetTickCount();
+    if ((int32_t)(wake - now) > 0) {
+        vTaskDelay(wake - now);
+    } else {
+        host::checkTaskExit();
+    }
+    *previousWake = wake;
+}
+
+inline UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    (void)task;
+    return 1024;
+}
+
+inline void xTaskNotifyGive(TaskHandle_t task) {
+    {
+        std::lock_guard<std::mutex> guard(task->lock);
+        task->notifications++;
+    }
+    task->wake.notify_all();
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+    host::Task* task = host::selfTask();
+    std::unique_lock<std::mutex> guard(task->lock);
+    host::waitFor(guard, task->wake, ticks, [task] { return task->notifications > 0; });
+    uint32_t value = task->notifications;
+    if (value > 0) {
+        task->notifications = clearOnExit ? 0 : value - 1;
+    }
+    return value;
+}
+
+#endif // NATIVE_FREERTOS_TASK_H
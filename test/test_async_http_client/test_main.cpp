@@ -0,0 +1,294 @@
+// AsyncHTTPClient deadlines and cancellation against a fake server that
+// injects connect, response and body delays, and the main loop's longest
+// stall with requests in flight against sending them blocking.
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <unity.h>
+#include <algorithm>
+#include <random>
+#include "async_http_client.h"
+#include "scheduler.h"
+
+static HTTPClientManager http;
+static AsyncHTTPClient asyncHttp(http);
+
+struct Result {
+    bool done = false;
+    int httpCode = 0;
+    std::string response;
+    unsigned long at = 0;
+};
+
+static HTTPRequestId start(const char* url, Result& result, unsigned long timeoutMs) {
+    return asyncHttp.get(url, [&result](int httpCode, const char* response) {
+        result.done = true;
+        result.httpCode = httpCode;
+        result.response = response;
+        result.at = millis();
+    }, timeoutMs);
+}
+
+// Deliver callbacks until nothing is pending; time only moves on the worker
+static void drain() {
+    while (asyncHttp.pending() > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        asyncHttp.handle();
+    }
+}
+
+void setUp() {
+    host::setFakeTime(true, 1000);
+    host::setHttpHandler(nullptr);
+    http.setKeepAlive(false);
+    http.setKeepAlive(true);
+}
+
+void tearDown() {
+    host::setFakeTime(false);
+}
+
+void test_slow_connect_is_bounded_by_the_deadline() {
+    host::tcpConnectDelayMs = 4000;
+
+    Result result;
+    unsigned long submitted = millis();
+    TEST_ASSERT_TRUE(start("http://slow.test/", result, 1000) != 0);
+    drain();
+
+    TEST_ASSERT_TRUE(result.done);
+    TEST_ASSERT_EQUAL_INT(HTTPC_ERROR_CONNECTION_REFUSED, result.httpCode);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(1000, result.at - submitted);
+}
+
+void test_slow_body_is_cut_at_the_deadline() {
+    host::setHttpHandler([](const host::HttpRequest& request) {
+        host::HttpResponse response;
+        response.chunked = true;
+        response.body = "late";
+        response.delayMs = 600;
+        response.bodyDelayMs = 900;  // Each under the timeout, together over it
+        return response;
+    });
+
+    Result result;
+    unsigned long submitted = millis();
+    start("http://api.test/", result, 1000);
+    drain();
+
+    TEST_ASSERT_EQUAL_INT(HTTPC_ERROR_READ_TIMEOUT, result.httpCode);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(1000 + 2, result.at - submitted);
+}
+
+void test_jitter_never_overruns_the_deadline() {
+    const unsigned long timeout = 1000;
+    static std::mt19937 jitter(7);
+    unsigned long connectDelay = 0;
+
+    host::setHttpHandler([](const host::HttpRequest& request) {
+        std::uniform_int_distribution<unsigned long> delay(0, 900);
+        host::HttpResponse response;
+        response.body = request.url;
+        response.chunked = jitter() % 2;
+        response.delayMs = delay(jitter);
+        response.bodyDelayMs = delay(jitter);
+        response.keepAlive = jitter() % 4 != 0;
+        return response;
+    });
+
+    std::vector<long> lateness;
+    int ok = 0;
+    for (int i = 0; i < 300; i++) {
+        connectDelay = std::uniform_int_distribution<unsigned long>(0, 400)(jitter);
+        host::tcpConnectDelayMs = connectDelay;
+
+        char url[48];
+        snprintf(url, sizeof(url), "http://api.test/%d", i);
+        Result result;
+        unsigned long submitted = millis();
+        start(url, result, timeout);
+        drain();
+
+        TEST_ASSERT_TRUE(result.done);
+        if (result.httpCode == 200) {
+            TEST_ASSERT_EQUAL_STRING(url, result.response.c_str());
+            ok++;
+        }
+
+        // The connect's time comes off the wait for the headers, so
+        // connect, response and body all end at the deadline
+        long late = (long)(result.at - submitted) - (long)timeout;
+        TEST_ASSERT_LESS_OR_EQUAL(2, late);
+        lateness.push_back(late);
+    }
+
+    std::sort(lateness.begin(), lateness.end());
+    printf("300 requests, %d answered in time; completion vs deadline: p50 %+ld ms, p99 %+ld ms, max %+ld ms\n",
+           ok, lateness[150], lateness[297], lateness.back());
+    TEST_ASSERT_GREATER_THAN(50, ok);
+}
+
+void test_cancel_aborts_a_running_request() {
+    // Real time: the test cancels while the worker waits for the body
+    host::setFakeTime(false);
+    host::setHttpHandler([](const host::HttpRequest& request) {
+        host::HttpResponse response;
+        response.body = request.url == "http://api.test/slow" ? "slow" : "fast";
+        response.bodyDelayMs = request.url == "http://api.test/slow" ? 3000 : 0;
+        return response;
+    });
+
+    Result slow;
+    HTTPRequestId id = start("http://api.test/slow", slow, 10000);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    auto cancelled = std::chrono::steady_clock::now();
+    TEST_ASSERT_TRUE(asyncHttp.cancel(id));
+    drain();
+    long stoppedAfter = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - cancelled).count();
+
+    TEST_ASSERT_FALSE(slow.done);
+    TEST_ASSERT_LESS_THAN(500, stoppedAfter);
+
+    // The half-read connection is not reused for the next request
+    Result fast;
+    start("http://api.test/fast", fast, 10000);
+    drain();
+    TEST_ASSERT_EQUAL_INT(200, fast.httpCode);
+    TEST_ASSERT_EQUAL_STRING("fast", fast.response.c_str());
+    TEST_ASSERT_FALSE(host::httpLog().back().reused);
+}
+
+void test_idle_connection_closed_while_queue_stays_busy() {
+    host::setHttpHandler([](const host::HttpRequest& request) {
+        host::HttpResponse response;
+        response.body = "{}";
+        response.delayMs = 500;
+        return response;
+    });
+
+    Result first;
+    start("http://a.test/", first, 5000);
+    drain();
+
+    // Back-to-back requests to another host for longer than HTTP_IDLE_TIMEOUT
+    unsigned long until = millis() + HTTP_IDLE_TIMEOUT + 5000;
+    while (millis() < until) {
+        Result other;
+        start("http://b.test/", other, 5000);
+        drain();
+    }
+
+    Result again;
+    start("http://a.test/", again, 5000);
+    drain();
+    TEST_ASSERT_EQUAL_INT(200, again.httpCode);
+    TEST_ASSERT_FALSE(host::httpLog().back().reused);
+}
+
+// Main loop: a task every LOOP_POLL_INTERVAL, asyncHttp.handle() and a
+// request every STALL_SEND_INTERVAL, either queued or sent from the loop
+static const unsigned long STALL_RUN_MS = 5000;
+static const unsigned long STALL_SEND_INTERVAL = 500;
+static HTTPClientManager blockingHttp;
+static std::mt19937 stallJitter(11);
+static bool stallBlocking;
+static unsigned long lastTick;
+static unsigned long longestGap;
+static uint32_t stallSent;
+static uint32_t stallAnswered;
+
+static void stallTick() {
+    unsigned long now = millis();
+    if (lastTick != 0) {
+        longestGap = std::max(longestGap, now - lastTick);
+    }
+    lastTick = now;
+}
+
+static void stallSend() {
+    host::tcpConnectDelayMs = std::uniform_int_distribution<unsigned long>(0, 200)(stallJitter);
+    stallSent++;
+    if (stallBlocking) {
+        String response;
+        if (blockingHttp.sendGET("http://api.test/stall", response) == 200) {
+            stallAnswered++;
+        }
+    } else {
+        asyncHttp.get("http://api.test/stall", [](int httpCode, const char* response) {
+            (void)response;
+            stallAnswered += (httpCode == 200) ? 1 : 0;
+        }, 1000);
+    }
+}
+
+struct Stall {
+    uint32_t longestPassUs;
+    unsigned long longestGapMs;
+};
+
+static Stall runLoop(bool blocking) {
+    Scheduler scheduler;
+    stallBlocking = blocking;
+    lastTick = 0;
+    longestGap = 0;
+    stallSent = 0;
+    stallAnswered = 0;
+    scheduler.every(LOOP_POLL_INTERVAL, stallTick);
+    scheduler.every(LOOP_POLL_INTERVAL, []() { asyncHttp.handle(); });
+    scheduler.every(STALL_SEND_INTERVAL, stallSend);
+
+    uint32_t longestPass = 0;
+    unsigned long end = millis() + STALL_RUN_MS;
+    while ((long)(end - millis()) > 0) {
+        uint32_t start = micros();
+        unsigned long wait = scheduler.run();
+        longestPass = std::max(longestPass, (uint32_t)(micros() - start));
+        delay(wait);
+    }
+    drain();
+    return Stall{longestPass, longestGap};
+}
+
+void test_loop_stall_with_requests_in_flight() {
+    host::setFakeTime(false);
+    host::setHttpHandler([](const host::HttpRequest& request) {
+        std::uniform_int_distribution<unsigned long> jitter(0, 150);
+        host::HttpResponse response;
+        response.body = "{}";
+        response.delayMs = 150 + jitter(stallJitter);
+        response.bodyDelayMs = jitter(stallJitter);
+        response.keepAlive = stallJitter() % 2;
+        return response;
+    });
+
+    Stall queued = runLoop(false);
+    uint32_t queuedSent = stallSent;
+    uint32_t queuedAnswered = stallAnswered;
+    Stall blocking = runLoop(true);
+
+    printf("%-10s %9s %9s %16s %20s\n", "requests", "sent", "answered", "longest loop()", "longest 20 ms gap");
+    printf("%-10s %9u %9u %13u us %17lu ms\n", "queued", queuedSent, queuedAnswered, queued.longestPassUs,
+           queued.longestGapMs);
+    printf("%-10s %9u %9u %13u us %17lu ms\n", "blocking", stallSent, stallAnswered, blocking.longestPassUs,
+           blocking.longestGapMs);
+
+    TEST_ASSERT_GREATER_THAN(0, queuedAnswered);
+    // Callbacks are all the loop runs; the network waits on the worker
+    TEST_ASSERT_LESS_THAN(5000, queued.longestPassUs);
+    TEST_ASSERT_LESS_THAN(3 * LOOP_POLL_INTERVAL, queued.longestGapMs);
+    TEST_ASSERT_GREATER_OR_EQUAL(150, blocking.longestGapMs);
+}
+
+int main() {
+    asyncHttp.begin();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_slow_connect_is_bounded_by_the_deadline);
+    RUN_TEST(test_slow_body_is_cut_at_the_deadline);
+    RUN_TEST(test_jitter_never_overruns_the_deadline);
+    RUN_TEST(test_cancel_aborts_a_running_request);
+    RUN_TEST(test_idle_connection_closed_while_queue_stays_busy);
+    RUN_TEST(test_loop_stall_with_requests_in_flight);
+    return UNITY_END();
+}
@@ -0,0 +1,384 @@
+// ConfigStore NVS backend: records survive a save/load round trip, older
+// and padded records still load, and the JSON import ends up in NVS.
+// SPIFFS backend: power lost at any point of a save leaves either the old
+// or the new config, and a damaged file is detected. A burst of updates
+// costs one flash write on either backend. Boot-time loads of the NVS
+// record and of the JSON file are timed, with the bytes each stores.
+
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <unity.h>
+#include <stddef.h>
+#include <chrono>
+#include "config_store.h"
+
+static const size_t HEADER_SIZE = 12;  // magic, version, reserved, length, reserved2, crc
+
+// Flash reads at about 1 MB/s; a SPIFFS path lookup scans object index
+// pages, as in test_web_assets
+static const unsigned long FLASH_LOOKUP_US = 3000;
+static const unsigned long FLASH_READ_US_PER_KB = 1000;
+
+static std::vector<uint8_t>& storedRecord() {
+    return host::nvs[CONFIG_NVS_NAMESPACE]["record"];
+}
+
+static uint32_t crc32(const uint8_t* data, size_t length) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+// Record as older firmware stored it: header, config, then padding bytes
+static std::vector<uint8_t> makeRecord(const char* ssid, const char* password, size_t padding) {
+    DeviceConfig config;
+    memset(&config, 0, sizeof(config));
+    strcpy(config.ssid, ssid);
+    strcpy(config.password, password);
+
+    std::vector<uint8_t> record(HEADER_SIZE + sizeof(config) + padding, 0);
+    uint16_t magic = 0xC0F1;
+    uint16_t length = sizeof(config);
+    uint32_t crc = crc32((const uint8_t*)&config, sizeof(config));
+    memcpy(&record[0], &magic, 2);
+    record[2] = CONFIG_VERSION;
+    memcpy(&record[4], &length, 2);
+    memcpy(&record[8], &crc, 4);
+    memcpy(&record[HEADER_SIZE], &config, sizeof(config));
+    return record;
+}
+
+// Config as loaded after a reboot; empty SSID when nothing loaded
+static std::string reboot() {
+    ConfigStore store;
+    return store.begin(SPIFFS, CONFIG_FILE) ? store.get().ssid : "";
+}
+
+void setUp() {
+    host::clearNvs();
+    SPIFFS.reset();
+    host::setFakeTime(true, 0);
+}
+
+void tearDown() {
+    host::setFakeTime(false);
+}
+
+void test_save_load_round_trip() {
+    ConfigStore store;
+    TEST_ASSERT_FALSE(store.begin(SPIFFS, CONFIG_FILE));
+    TEST_ASSERT_TRUE(store.setWiFi("home-network", "correct horse battery"));
+    TEST_ASSERT_TRUE(store.flush());
+    TEST_ASSERT_EQUAL_UINT32(1, store.getWriteCount());
+
+    // Exactly header + config, no struct padding
+    TEST_ASSERT_EQUAL_size_t(HEADER_SIZE + sizeof(DeviceConfig), storedRecord().size());
+
+    ConfigStore reloaded;
+    TEST_ASSERT_TRUE(reloaded.begin(SPIFFS, CONFIG_FILE));
+    DeviceConfig config = reloaded.get();
+    TEST_ASSERT_EQUAL_STRING("home-network", config.ssid);
+    TEST_ASSERT_EQUAL_STRING("correct horse battery", config.password);
+    TEST_ASSERT_TRUE(reloaded.isConfigured());
+}
+
+void test_round_trip_at_maximum_lengths() {
+    char ssid[WIFI_SSID_MAX_LENGTH + 1];
+    char password[WIFI_PASSWORD_MAX_LENGTH + 1];
+    memset(ssid, 's', WIFI_SSID_MAX_LENGTH);
+    ssid[WIFI_SSID_MAX_LENGTH] = '\0';
+    memset(password, 'p', WIFI_PASSWORD_MAX_LENGTH);
+    password[WIFI_PASSWORD_MAX_LENGTH] = '\0';
+
+    ConfigStore store;
+    store.begin(SPIFFS, CONFIG_FILE);
+    TEST_ASSERT_TRUE(store.setWiFi(ssid, password));
+    TEST_ASSERT_TRUE(store.flush());
+
+    ConfigStore reloaded;
+    TEST_ASSERT_TRUE(reloaded.begin(SPIFFS, CONFIG_FILE));
+    TEST_ASSERT_EQUAL_STRING(ssid, reloaded.get().ssid);
+    TEST_ASSERT_EQUAL_STRING(password, reloaded.get().password);
+}
+
+void test_padded_record_loads_and_is_rewritten() {
+    // What sizeof(Record) wrote: the config plus tail padding
+    storedRecord() = makeRecord("legacy", "padded", 2);
+
+    ConfigStore store;
+    TEST_ASSERT_TRUE(store.begin(SPIFFS, CONFIG_FILE));
+    TEST_ASSERT_EQUAL_STRING("legacy", store.get().ssid);
+    TEST_ASSERT_EQUAL_STRING("padded", store.get().password);
+
+    TEST_ASSERT_TRUE(store.flush());
+    TEST_ASSERT_EQUAL_size_t(HEADER_SIZE + sizeof(DeviceConfig), storedRecord().size());
+}
+
+void test_corrupt_record_is_rejected() {
+    storedRecord() = makeRecord("home", "secret", 0);
+    storedRecord()[HEADER_SIZE + 1] ^= 0x01;
+
+    ConfigStore store;
+    TEST_ASSERT_FALSE(store.begin(SPIFFS, CONFIG_FILE));
+    TEST_ASSERT_FALSE(store.isConfigured());
+}
+
+void test_truncated_record_is_rejected() {
+    std::vector<uint8_t> record = makeRecord("home", "secret", 0);
+    record.resize(record.size() - 1);
+    storedRecord() = record;
+
+    ConfigStore store;
+    TEST_ASSERT_FALSE(store.begin(SPIFFS, CONFIG_FILE));
+}
+
+void test_json_import_survives_reboot() {
+    SPIFFS.put(CONFIG_FILE, "{\"ssid\":\"office\",\"password\":\"hunter22\"}");
+
+    ConfigStore store;
+    TEST_ASSERT_TRUE(store.begin(SPIFFS, CONFIG_FILE));
+    TEST_ASSERT_FALSE(SPIFFS.exists(CONFIG_FILE));
+
+    // The import is the only copy left, so it must load back from NVS
+    ConfigStore reloaded;
+    TEST_ASSERT_TRUE(reloaded.begin(SPIFFS, CONFIG_FILE));
+    TEST_ASSERT_EQUAL_STRING("office", reloaded.get().ssid);
+    TEST_ASSERT_EQUAL_STRING("hunter22", reloaded.get().password);
+}
+
+void test_power_loss_during_import() {
+    SPIFFS.put(CONFIG_FILE, "{\"ssid\":\"office\",\"password\":\"hunter22\"}");
+
+    // Power goes after the NVS record is stored, before the file is removed
+    SPIFFS.writeBudget = 0;
+    ConfigStore store;
+    TEST_ASSERT_TRUE(store.begin(SPIFFS, CONFIG_FILE));
+    SPIFFS.writeBudget = -1;
+
+    TEST_ASSERT_EQUAL_STRING("office", reboot().c_str());
+}
+
+void test_power_loss_at_every_point_of_a_save() {
+    host::nvsAvailable = false;
+    {
+        ConfigStore store;
+        store.begin(SPIFFS, CONFIG_FILE);
+        store.setWiFi("old-network", "old-password");
+        TEST_ASSERT_TRUE(store.flush());
+    }
+    const std::string oldFile = SPIFFS.contents(CONFIG_FILE);
+
+    int oldLoaded = 0;
+    int newLoaded = 0;
+    for (long budget = 0;; budget++) {
+        SPIFFS.reset();
+        SPIFFS.put(CONFIG_FILE, oldFile);
+
+        ConfigStore store;
+        TEST_ASSERT_TRUE(store.begin(SPIFFS, CONFIG_FILE));
+        store.setWiFi("new-network", "new-password");
+        SPIFFS.writeBudget = budget;
+        store.flush();
+        bool completed = SPIFFS.writeBudget > 0;
+        SPIFFS.writeBudget = -1;
+
+        // Never the defaults or a mix: the old config or the new one
+        std::string loaded = reboot();
+        if (loaded == "old-network") {
+            oldLoaded++;
+        } else if (loaded == "new-network") {
+            newLoaded++;
+        } else {
+            TEST_FAIL_MESSAGE("config lost after power loss");
+        }
+        // And the boot after that finds the same
+        TEST_ASSERT_EQUAL_STRING(loaded.c_str(), reboot().c_str());
+        if (completed) {
+            TEST_ASSERT_EQUAL_STRING("new-network", loaded.c_str());
+            break;
+        }
+    }
+    printf("power lost at %d points: old config %d times, new config %d times\n",
+           oldLoaded + newLoaded - 1, oldLoaded, newLoaded - 1);
+    TEST_ASSERT_GREATER_THAN(0, oldLoaded);
+    TEST_ASSERT_GREATER_THAN(1, newLoaded);
+}
+
+void test_damaged_file_is_rejected() {
+    host::nvsAvailable = false;
+    {
+        ConfigStore store;
+        store.begin(SPIFFS, CONFIG_FILE);
+        store.setWiFi("home", "secret");
+        TEST_ASSERT_TRUE(store.flush());
+    }
+    TEST_ASSERT_EQUAL_STRING("home", reboot().c_str());
+
+    // Still valid JSON, but not what was written
+    std::string file = SPIFFS.contents(CONFIG_FILE);
+    file.replace(file.find("home"), 4, "hone");
+    SPIFFS.put(CONFIG_FILE, file);
+    TEST_ASSERT_EQUAL_STRING("", reboot().c_str());
+
+    // Cut short
+    file = SPIFFS.contents(CONFIG_FILE);
+    SPIFFS.put(CONFIG_FILE, file.substr(0, file.size() / 2));
+    TEST_ASSERT_EQUAL_STRING("", reboot().c_str());
+}
+
+// Flash writes for 30 changes 100 ms apart, handle() called every 10 ms
+static uint32_t burst(ConfigStore& store) {
+    char ssid[16];
+    for (int i = 0; i < 30; i++) {
+        snprintf(ssid, sizeof(ssid), "network-%d", i);
+        store.setWiFi(ssid, "password");
+        for (int tick = 0; tick < 10; tick++) {
+            host::advance(10);
+            store.handle();
+        }
+    }
+    uint32_t during = store.getWriteCount();
+    for (unsigned long waited = 0; waited <= CONFIG_SAVE_DELAY; waited += 10) {
+        host::advance(10);
+        store.handle();
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, during);
+    return store.getWriteCount();
+}
+
+void test_burst_of_updates_is_one_nvs_write() {
+    ConfigStore store;
+    store.begin(SPIFFS, CONFIG_FILE);
+    TEST_ASSERT_EQUAL_UINT32(1, burst(store));
+    TEST_ASSERT_EQUAL_size_t(1, host::nvsWrites);
+    TEST_ASSERT_EQUAL_size_t(0, SPIFFS.writeCalls);
+    TEST_ASSERT_EQUAL_STRING("network-29", reboot().c_str());
+
+    // Setting what is already stored writes nothing
+    store.setWiFi("network-29", "password");
+    host::advance(CONFIG_SAVE_DELAY + 1);
+    store.handle();
+    TEST_ASSERT_EQUAL_size_t(1, host::nvsWrites);
+    printf("NVS: 30 updates, %u record write(s)\n", (unsigned)host::nvsWrites);
+}
+
+void test_burst_of_updates_is_one_file_write() {
+    host::nvsAvailable = false;
+    ConfigStore store;
+    store.begin(SPIFFS, CONFIG_FILE);
+    SPIFFS.resetCounters();
+    TEST_ASSERT_EQUAL_UINT32(1, burst(store));
+    TEST_ASSERT_EQUAL_size_t(1, SPIFFS.renames);
+    TEST_ASSERT_EQUAL_STRING("network-29", reboot().c_str());
+    printf("SPIFFS: 30 updates, 1 save: %u write calls, %u bytes, %u rename\n",
+           (unsigned)SPIFFS.writeCalls, (unsigned)SPIFFS.bytesWritten, (unsigned)SPIFFS.renames);
+}
+
+struct Load {
+    double hostNs;           // CPU time per begin() on the build host
+    unsigned long flashUs;   // Simulated, with flash access costs
+    size_t lookups;          // SPIFFS open() and exists() per begin()
+    size_t bytesRead;
+};
+
+static const int LOADS = 20000;
+
+// What begin() costs at boot with the config already stored
+static Load timeLoad() {
+    Load load;
+    auto start = std::chrono::steady_clock::now();
+    int loaded = 0;
+    for (int i = 0; i < LOADS; i++) {
+        ConfigStore store;
+        loaded += store.begin(SPIFFS, CONFIG_FILE) ? 1 : 0;
+    }
+    load.hostNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / LOADS;
+    TEST_ASSERT_EQUAL(LOADS, loaded);
+
+    SPIFFS.resetCounters();
+    SPIFFS.lookupMicros = FLASH_LOOKUP_US;
+    SPIFFS.readMicrosPerKB = FLASH_READ_US_PER_KB;
+    host::nvsReadMicrosPerKB = FLASH_READ_US_PER_KB;
+    unsigned long before = micros();
+    {
+        ConfigStore store;
+        TEST_ASSERT_TRUE(store.begin(SPIFFS, CONFIG_FILE));
+        TEST_ASSERT_EQUAL_STRING("home-network", store.get().ssid);
+    }
+    load.flashUs = micros() - before;
+    load.lookups = SPIFFS.lookups;
+    load.bytesRead = SPIFFS.bytesRead;
+    SPIFFS.lookupMicros = 0;
+    SPIFFS.readMicrosPerKB = 0;
+    host::nvsReadMicrosPerKB = 0;
+    return load;
+}
+
+// Flash taken by a value of size bytes: NVS stores a blob as an index
+// entry and a data entry header followed by its data, in 32-byte entries;
+// a SPIFFS file is an object index page plus data pages of 256 bytes
+static size_t nvsFlashBytes(size_t size) {
+    return (2 + (size + 31) / 32) * 32;
+}
+
+static size_t spiffsFlashBytes(size_t size) {
+    return (1 + (size + 255) / 256) * 256;
+}
+
+void test_boot_load_nvs_against_json() {
+    {
+        ConfigStore store;
+        store.begin(SPIFFS, CONFIG_FILE);
+        store.setWiFi("home-network", "correct horse battery");
+        TEST_ASSERT_TRUE(store.flush());
+    }
+    size_t recordBytes = storedRecord().size();
+    Load nvs = timeLoad();
+
+    host::clearNvs();
+    host::nvsAvailable = false;
+    {
+        ConfigStore store;
+        store.begin(SPIFFS, CONFIG_FILE);
+        store.setWiFi("home-network", "correct horse battery");
+        TEST_ASSERT_TRUE(store.flush());
+    }
+    size_t fileBytes = SPIFFS.contents(CONFIG_FILE).size();
+    Load json = timeLoad();
+
+    printf("%-18s %8s %8s %10s %10s %8s %8s\n", "boot-time load", "stored", "flash", "host ns", "flash us",
+           "lookups", "read");
+    printf("%-18s %8zu %8zu %10.0f %10lu %8zu %8zu\n", "NVS record", recordBytes, nvsFlashBytes(recordBytes),
+           nvs.hostNs, nvs.flashUs, nvs.lookups, (size_t)recordBytes);
+    printf("%-18s %8zu %8zu %10.0f %10lu %8zu %8zu\n", "JSON on SPIFFS", fileBytes, spiffsFlashBytes(fileBytes),
+           json.hostNs, json.flashUs, json.lookups, json.bytesRead);
+
+    TEST_ASSERT_EQUAL_size_t(HEADER_SIZE + sizeof(DeviceConfig), recordBytes);
+    // No file is touched when the record loads
+    TEST_ASSERT_EQUAL_size_t(0, nvs.lookups);
+    TEST_ASSERT_EQUAL_size_t(fileBytes, json.bytesRead);
+    TEST_ASSERT_TRUE(nvs.flashUs * 10 < json.flashUs);
+    TEST_ASSERT_TRUE(nvs.hostNs < json.hostNs);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_save_load_round_trip);
+    RUN_TEST(test_round_trip_at_maximum_lengths);
+    RUN_TEST(test_padded_record_loads_and_is_rewritten);
+    RUN_TEST(test_corrupt_record_is_rejected);
+    RUN_TEST(test_truncated_record_is_rejected);
+    RUN_TEST(test_json_import_survives_reboot);
+    RUN_TEST(test_power_loss_during_import);
+    RUN_TEST(test_power_loss_at_every_point_of_a_save);
+    RUN_TEST(test_damaged_file_is_rejected);
+    RUN_TEST(test_burst_of_updates_is_one_nvs_write);
+    RUN_TEST(test_burst_of_updates_is_one_file_write);
+    RUN_TEST(test_boot_load_nvs_against_json);
+    return UNITY_END();
+}
@@ -0,0 +1,405 @@
+// DeltaPatch against a fake flash partition: patches made by
+// tools/ota_delta.py and by hand rebuild the new image byte for byte, in
+// any chunk size, from a stream that runs dry or breaks and resumes.
+
+#include <Arduino.h>
+#include <unity.h>
+#include <mbedtls/sha256.h>
+#include <vector>
+#include "config.h"
+#include "delta_patch.h"
+
+// Flash partition: erased to 0xFF, and bytes can only be written once
+class FakePartition {
+public:
+    explicit FakePartition(size_t size) : _flash(size, 0xFF), _written(0), _rewrites(0) {}
+
+    const uint8_t* map() const { return _flash.data(); }
+    size_t size() const { return _flash.size(); }
+
+    void load(const std::vector<uint8_t>& image) {
+        std::copy(image.begin(), image.end(), _flash.begin());
+    }
+
+    // Sequential writes, as Update.write() does them
+    void append(const uint8_t* data, size_t length) {
+        for (size_t i = 0; i < length; i++) {
+            if (_flash[_written + i] != 0xFF) {
+                _rewrites++;
+            }
+            _flash[_written + i] = data[i];
+        }
+        _written += length;
+    }
+
+    size_t written() const { return _written; }
+    size_t rewrites() const { return _rewrites; }
+    bool holds(const std::vector<uint8_t>& image) const {
+        return _written == image.size() && memcmp(_flash.data(), image.data(), image.size()) == 0;
+    }
+
+private:
+    std::vector<uint8_t> _flash;
+    size_t _written;
+    size_t _rewrites;
+};
+
+// Patch download: can stop after cutAt bytes (broken connection) and
+// run dry every dryEvery bytes (data not arrived yet)
+class PatchStream : public Stream {
+public:
+    PatchStream(const std::vector<uint8_t>& data, size_t start = 0, size_t cutAt = SIZE_MAX,
+                size_t dryEvery = 0)
+        : _data(data), _pos(start), _end(std::min(cutAt, data.size())), _dryEvery(dryEvery), _sinceDry(0) {}
+
+    int available() override { return _pos < _end ? 1 : 0; }
+    int read() override {
+        if (_pos >= _end) {
+            return -1;
+        }
+        if (_dryEvery > 0 && ++_sinceDry > _dryEvery) {
+            _sinceDry = 0;
+            return -1;
+        }
+        return _data[_pos++];
+    }
+    int peek() override { return _pos < _end ? _data[_pos] : -1; }
+    size_t write(uint8_t) override { return 0; }
+    bool exhausted() const { return _pos >= _end; }
+
+private:
+    const std::vector<uint8_t>& _data;
+    size_t _pos;
+    size_t _end;
+    size_t _dryEvery;
+    size_t _sinceDry;
+};
+
+static uint32_t rngState;
+
+static uint8_t nextRandom() {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState & 0xFF;
+}
+
+static std::vector<uint8_t> randomBytes(size_t length) {
+    std::vector<uint8_t> bytes(length);
+    for (uint8_t& b : bytes) {
+        b = nextRandom();
+    }
+    return bytes;
+}
+
+static void appendRange(std::vector<uint8_t>& out, const std::vector<uint8_t>& from, size_t start, size_t end) {
+    out.insert(out.end(), from.begin() + start, from.begin() + end);
+}
+
+static void sha256(const uint8_t* data, size_t length, uint8_t digest[32]) {
+    mbedtls_sha256_context hash;
+    mbedtls_sha256_init(&hash);
+    mbedtls_sha256_starts(&hash, 0);
+    mbedtls_sha256_update(&hash, data, length);
+    mbedtls_sha256_finish(&hash, digest);
+    mbedtls_sha256_free(&hash);
+}
+
+// Made with tools/ota_delta.py from the images in makeToolImages()
+static const uint8_t TOOL_PATCH[] = {
+    0x45, 0x53, 0x50, 0x44, 0x01, 0x00, 0x00, 0x00, 0x00, 0x18, 0x00, 0x00, 0x80, 0x18, 0x00, 0x00,
+    0x8d, 0x18, 0x0c, 0x5f, 0xa7, 0x2c, 0xb8, 0xc1, 0x57, 0xcf, 0x4b, 0xc8, 0x12, 0xb5, 0x03, 0x4c,
+    0xb5, 0x6d, 0xe7, 0x53, 0x55, 0x4e, 0xc2, 0x94, 0xe1, 0xaa, 0x4e, 0xe0, 0x46, 0x0b, 0x8c, 0x90,
+    0x01, 0x00, 0x80, 0x18, 0x80, 0x08, 0x01, 0x01, 0x3f, 0x01, 0x01, 0x3f, 0x01, 0x01, 0x3f, 0x01,
+    0x01, 0x3f, 0x01, 0x01, 0x3f, 0x01, 0x01, 0x3f, 0x01, 0x01, 0x3f, 0x01, 0x01, 0x3f, 0x01, 0x01,
+    0x3f, 0x01, 0x01, 0x3f, 0x01, 0x01, 0x3f, 0x01, 0x01, 0x3f, 0x01, 0x01, 0x3f, 0x01, 0x01, 0x3f,
+    0x01, 0x01, 0x3f, 0x01, 0x01, 0x3f, 0x01, 0x01, 0x3f, 0x01, 0x01, 0x3f, 0x01, 0x01, 0x3f, 0x01,
+    0x01, 0x3f, 0x01, 0x01, 0x3f, 0x01, 0x01, 0x3f, 0x01, 0x01, 0x3f, 0x01, 0x01, 0x3f, 0x01, 0x01,
+    0x3f, 0x01, 0x01, 0x3f, 0x01, 0x01, 0x3f, 0x01, 0x01, 0x3f, 0x01, 0x01, 0x3f, 0x01, 0x01, 0x3f,
+    0x01, 0x01, 0x3f, 0x01, 0x01, 0x3f, 0x00, 0x02, 0x80, 0x01, 0x8f, 0xe8, 0xdd, 0xb0, 0xaa, 0x88,
+    0x0f, 0x82, 0x54, 0x40, 0xfd, 0xe7, 0xdf, 0x65, 0xeb, 0x17, 0xb1, 0xd4, 0xf3, 0x09, 0x4d, 0x37,
+    0x1f, 0xac, 0xc4, 0x66, 0x0c, 0xd4, 0xa2, 0xd9, 0x87, 0x76, 0x68, 0xae, 0xcb, 0x05, 0xee, 0xdd,
+    0x6b, 0xa6, 0x1d, 0xe8, 0xb9, 0xf6, 0x2d, 0xf9, 0x0f, 0x5c, 0x6a, 0xfc, 0xde, 0x4b, 0xb3, 0x0e,
+    0xe4, 0x3c, 0x53, 0xf4, 0xe5, 0x28, 0xc7, 0x77, 0x44, 0xf0, 0x6c, 0x4b, 0x98, 0xd4, 0x4a, 0x46,
+    0xf1, 0x72, 0xbf, 0x3c, 0x13, 0xc0, 0xd4, 0xb2, 0xab, 0x13, 0xc5, 0x08, 0xd9, 0x9b, 0x2b, 0xef,
+    0xfd, 0x14, 0x56, 0x4f, 0xc0, 0x1d, 0x0d, 0xea, 0x86, 0xb4, 0x97, 0x87, 0x9c, 0x96, 0xb6, 0xad,
+    0x22, 0xde, 0x80, 0x08, 0x9c, 0x2e, 0xf7, 0x7a, 0xdd, 0x6a, 0xd3, 0xcc, 0xf3, 0xa5, 0xd2, 0xbc,
+    0xbb, 0x2b, 0x9c, 0xdb, 0x5d, 0x51, 0x5c, 0xdc, 0x40, 0xa5, 0x01, 0x80, 0x10, 0x80, 0x10, 0x80,
+    0x10, 0x00, 0x01, 0xff, 0x2f, 0x80, 0x08, 0x80, 0x08, 0x00, 0x00,
+};
+
+static void makeToolImages(std::vector<uint8_t>& oldImage, std::vector<uint8_t>& newImage) {
+    rngState = 0x12345678;
+    oldImage = randomBytes(6144);
+
+    // Code with changed addresses, new code, and two blocks swapped
+    newImage.clear();
+    appendRange(newImage, oldImage, 0, 1024);
+    for (size_t i = 1024; i < 3072; i++) {
+        newImage.push_back(oldImage[i] + (i % 64 == 0 ? 1 : 0));
+    }
+    std::vector<uint8_t> inserted = randomBytes(128);
+    appendRange(newImage, inserted, 0, inserted.size());
+    appendRange(newImage, oldImage, 4096, 6144);
+    appendRange(newImage, oldImage, 3072, 4096);
+}
+
+// Hand-written patches
+static void putVarint(std::vector<uint8_t>& out, uint32_t value) {
+    do {
+        uint8_t b = value & 0x7F;
+        value >>= 7;
+        out.push_back(value ? (b | 0x80) : b);
+    } while (value);
+}
+
+static void putHeader(std::vector<uint8_t>& out, const std::vector<uint8_t>& source, size_t targetSize) {
+    const uint8_t magic[8] = {'E', 'S', 'P', 'D', DeltaPatch::VERSION, 0, 0, 0};
+    out.insert(out.end(), magic, magic + 8);
+    for (uint32_t value : {(uint32_t)source.size(), (uint32_t)targetSize}) {
+        for (int i = 0; i < 4; i++) {
+            out.push_back((value >> (i * 8)) & 0xFF);
+        }
+    }
+    uint8_t digest[32];
+    sha256(source.data(), source.size(), digest);
+    out.insert(out.end(), digest, digest + 32);
+}
+
+// ADD of target[t, t + length) against source[s, ...) as same/count runs
+static void putAdd(std::vector<uint8_t>& out, int32_t seek, const std::vector<uint8_t>& source, size_t s,
+                   const std::vector<uint8_t>& target, size_t t, size_t length) {
+    out.push_back(0x01);
+    putVarint(out, ((uint32_t)seek << 1) ^ (uint32_t)(seek >> 31));
+    putVarint(out, length);
+    size_t pos = 0;
+    while (pos < length) {
+        size_t same = 0;
+        while (pos + same < length && source[s + pos + same] == target[t + pos + same]) {
+            same++;
+        }
+        size_t count = 0;
+        while (pos + same + count < length && source[s + pos + same + count] != target[t + pos + same + count]) {
+            count++;
+        }
+        putVarint(out, same);
+        putVarint(out, count);
+        for (size_t i = 0; i < count; i++) {
+            size_t at = pos + same + i;
+            out.push_back((uint8_t)(target[t + at] - source[s + at]));
+        }
+        pos += same + count;
+    }
+}
+
+static void putInsert(std::vector<uint8_t>& out, const std::vector<uint8_t>& bytes) {
+    out.push_back(0x02);
+    putVarint(out, bytes.size());
+    out.insert(out.end(), bytes.begin(), bytes.end());
+}
+
+// Run the decoder the way OTAManager::download() does, flashing each
+// chunk as it comes out
+static void apply(DeltaPatch& patch, PatchStream& in, FakePartition& target, size_t chunk) {
+    std::vector<uint8_t> buffer(chunk);
+    while (!patch.finished() && !patch.failed()) {
+        size_t length = patch.decode(in, buffer.data(), chunk);
+        target.append(buffer.data(), length);
+        if (length == 0 && in.exhausted()) {
+            break;
+        }
+    }
+}
+
+static std::vector<uint8_t> toolPatch() {
+    return std::vector<uint8_t>(TOOL_PATCH, TOOL_PATCH + sizeof(TOOL_PATCH));
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_tool_patch_rebuilds_image() {
+    std::vector<uint8_t> oldImage, newImage;
+    makeToolImages(oldImage, newImage);
+    std::vector<uint8_t> bytes = toolPatch();
+
+    // The running partition is larger than the image it holds
+    FakePartition running(64 * 1024);
+    running.load(oldImage);
+    FakePartition target(64 * 1024);
+
+    DeltaPatch patch;
+    patch.begin(running.map(), running.size());
+    PatchStream in(bytes);
+    apply(patch, in, target, OTA_CHUNK_SIZE);
+
+    TEST_ASSERT_TRUE(patch.finished());
+    TEST_ASSERT_EQUAL_size_t(newImage.size(), patch.getTargetSize());
+    TEST_ASSERT_EQUAL_size_t(bytes.size(), patch.getConsumed());
+    TEST_ASSERT_TRUE(target.holds(newImage));
+    TEST_ASSERT_EQUAL_size_t(0, target.rewrites());
+
+    // Same digest the tool put in the manifest
+    static const uint8_t expected[32] = {
+        0x86, 0x36, 0x00, 0x6d, 0xeb, 0x1d, 0xca, 0xfb, 0xc5, 0xd4, 0xab, 0xf5, 0xb2, 0xfe, 0x11, 0xa0,
+        0x93, 0xd7, 0xac, 0xf3, 0x2e, 0x51, 0x41, 0x12, 0x59, 0xbb, 0xf5, 0x2e, 0x33, 0xa8, 0x96, 0x2e};
+    uint8_t digest[32];
+    sha256(target.map(), target.written(), digest);
+    TEST_ASSERT_EQUAL_MEMORY(expected, digest, 32);
+}
+
+void test_tiny_chunks_from_a_dry_stream() {
+    std::vector<uint8_t> oldImage, newImage;
+    makeToolImages(oldImage, newImage);
+    std::vector<uint8_t> bytes = toolPatch();
+    FakePartition running(64 * 1024);
+    running.load(oldImage);
+
+    const size_t chunks[] = {1, 7, 64, 1000};
+    for (size_t chunk : chunks) {
+        FakePartition target(64 * 1024);
+        DeltaPatch patch;
+        patch.begin(running.map(), running.size());
+        PatchStream in(bytes, 0, SIZE_MAX, 5);
+        apply(patch, in, target, chunk);
+        TEST_ASSERT_TRUE(patch.finished());
+        TEST_ASSERT_TRUE(target.holds(newImage));
+    }
+}
+
+void test_resume_after_broken_download() {
+    std::vector<uint8_t> oldImage, newImage;
+    makeToolImages(oldImage, newImage);
+    std::vector<uint8_t> bytes = toolPatch();
+    FakePartition running(64 * 1024);
+    running.load(oldImage);
+
+    // Break inside the header, inside an ADD run and inside the INSERT
+    const size_t cuts[] = {20, 100, 180, 250};
+    for (size_t cut : cuts) {
+        FakePartition target(64 * 1024);
+        DeltaPatch patch;
+        patch.begin(running.map(), running.size());
+
+        PatchStream first(bytes, 0, cut);
+        apply(patch, first, target, OTA_CHUNK_SIZE);
+        TEST_ASSERT_FALSE(patch.finished());
+        TEST_ASSERT_EQUAL_size_t(cut, patch.getConsumed());
+
+        // Range request from the bytes consumed
+        PatchStream resumed(bytes, patch.getConsumed());
+        apply(patch, resumed, target, OTA_CHUNK_SIZE);
+        TEST_ASSERT_TRUE(patch.finished());
+        TEST_ASSERT_TRUE(target.holds(newImage));
+    }
+}
+
+void test_large_image_with_moved_blocks() {
+    rngState = 0xC0FFEE;
+    std::vector<uint8_t> oldImage = randomBytes(256 * 1024);
+
+    std::vector<uint8_t> newImage;
+    for (size_t i = 0; i < 100 * 1024; i++) {
+        newImage.push_back(oldImage[i] + (i % 97 == 0 ? 4 : 0));
+    }
+    std::vector<uint8_t> inserted = randomBytes(3000);
+    appendRange(newImage, inserted, 0, inserted.size());
+    appendRange(newImage, oldImage, 150 * 1024, 256 * 1024);
+    appendRange(newImage, oldImage, 100 * 1024, 150 * 1024);
+
+    std::vector<uint8_t> bytes;
+    putHeader(bytes, oldImage, newImage.size());
+    putAdd(bytes, 0, oldImage, 0, newImage, 0, 100 * 1024);
+    putInsert(bytes, inserted);
+    size_t t = 100 * 1024 + inserted.size();
+    putAdd(bytes, 50 * 1024, oldImage, 150 * 1024, newImage, t, 106 * 1024);
+    t += 106 * 1024;
+    putAdd(bytes, -156 * 1024, oldImage, 100 * 1024, newImage, t, 50 * 1024);
+    bytes.push_back(0x00);
+
+    FakePartition running(1024 * 1024);
+    running.load(oldImage);
+    FakePartition target(1024 * 1024);
+    DeltaPatch patch;
+    patch.begin(running.map(), running.size());
+    PatchStream in(bytes, 0, SIZE_MAX, 1500);
+    apply(patch, in, target, OTA_CHUNK_SIZE);
+
+    TEST_ASSERT_TRUE(patch.finished());
+    TEST_ASSERT_TRUE(target.holds(newImage));
+    TEST_ASSERT_LESS_THAN(newImage.size() / 10, bytes.size());
+}
+
+void test_wrong_source_image_fails() {
+    std::vector<uint8_t> oldImage, newImage;
+    makeToolImages(oldImage, newImage);
+    std::vector<uint8_t> bytes = toolPatch();
+    oldImage[3000] ^= 0x01;
+
+    FakePartition running(64 * 1024);
+    running.load(oldImage);
+    FakePartition target(64 * 1024);
+    DeltaPatch patch;
+    patch.begin(running.map(), running.size());
+    PatchStream in(bytes);
+    apply(patch, in, target, OTA_CHUNK_SIZE);
+
+    TEST_ASSERT_TRUE(patch.failed());
+    TEST_ASSERT_EQUAL_size_t(0, target.written());
+}
+
+void test_out_of_range_add_fails() {
+    rngState = 1;
+    std::vector<uint8_t> oldImage = randomBytes(4096);
+    std::vector<uint8_t> bytes;
+    putHeader(bytes, oldImage, 8192);
+    bytes.push_back(0x01);
+    putVarint(bytes, 0);
+    putVarint(bytes, 5000);  // Longer than the source
+
+    FakePartition running(8192);
+    running.load(oldImage);
+    FakePartition target(8192);
+    DeltaPatch patch;
+    patch.begin(running.map(), running.size());
+    PatchStream in(bytes);
+    apply(patch, in, target, OTA_CHUNK_SIZE);
+
+    TEST_ASSERT_TRUE(patch.failed());
+    TEST_ASSERT_EQUAL_size_t(0, target.written());
+}
+
+void test_patch_ending_early_fails() {
+    std::vector<uint8_t> oldImage, newImage;
+    makeToolImages(oldImage, newImage);
+    std::vector<uint8_t> bytes = toolPatch();
+    // END right after the header
+    bytes.resize(DeltaPatch::HEADER_SIZE);
+    bytes.push_back(0x00);
+
+    FakePartition running(64 * 1024);
+    running.load(oldImage);
+    FakePartition target(64 * 1024);
+    DeltaPatch patch;
+    patch.begin(running.map(), running.size());
+    PatchStream in(bytes);
+    apply(patch, in, target, OTA_CHUNK_SIZE);
+
+    TEST_ASSERT_TRUE(patch.failed());
+    TEST_ASSERT_FALSE(patch.finished());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_tool_patch_rebuilds_image);
+    RUN_TEST(test_tiny_chunks_from_a_dry_stream);
+    RUN_TEST(test_resume_after_broken_download);
+    RUN_TEST(test_large_image_with_moved_blocks);
+    RUN_TEST(test_wrong_source_image_fails);
+    RUN_TEST(test_out_of_range_add_fails);
+    RUN_TEST(test_patch_ending_early_fails);
+    return UNITY_END();
+}
@@ -0,0 +1,168 @@
+// HTTPBodyStream framing and end-of-body detection, and how
+// HTTPClientManager treats the connection afterwards: a close-delimited
+// body that stalls is a timeout, not a short body, and such a connection
+// is never reused.
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <unity.h>
+#include "http_body_stream.h"
+#include "http_client.h"
+
+static const unsigned long TIMEOUT = 1000;
+
+static std::string readAll(HTTPBodyStream& body) {
+    std::string text;
+    uint8_t buffer[7];  // Odd size, so reads straddle chunk boundaries
+    size_t length;
+    while ((length = body.readChunk(buffer, sizeof(buffer))) > 0) {
+        text.append((const char*)buffer, length);
+    }
+    return text;
+}
+
+void setUp() {
+    host::setFakeTime(true, 1000);
+    host::setHttpHandler(nullptr);
+}
+
+void tearDown() {
+    host::setFakeTime(false);
+}
+
+void test_content_length_body() {
+    WiFiClient client;
+    client.connect("server", 80);
+    client.feed("hello world, and the next response");
+
+    HTTPBodyStream body(client, 11, false, TIMEOUT);
+    TEST_ASSERT_EQUAL_STRING("hello world", readAll(body).c_str());
+    TEST_ASSERT_TRUE(body.finished());
+    TEST_ASSERT_FALSE(body.failed());
+    TEST_ASSERT_EQUAL_INT(23, client.available());
+}
+
+void test_chunked_body_in_pieces() {
+    WiFiClient client;
+    client.connect("server", 80);
+    client.feed("5;ext=1\r\nhello\r\n");
+    client.feed("7\r\n, world\r\n0\r\n", millis() + 100);
+    client.feed("Trailer: x\r\n\r\n", millis() + 200);
+
+    HTTPBodyStream body(client, -1, true, TIMEOUT);
+    TEST_ASSERT_EQUAL_STRING("hello, world", readAll(body).c_str());
+    TEST_ASSERT_TRUE(body.finished());
+    TEST_ASSERT_FALSE(body.failed());
+}
+
+void test_close_delimited_body_ends_at_close() {
+    WiFiClient client;
+    client.connect("server", 80);
+    client.feed("all of it");
+    client.feed(" and more", millis() + 300);
+    client.closeFromPeer(millis() + 300);
+
+    HTTPBodyStream body(client, -1, false, TIMEOUT);
+    TEST_ASSERT_EQUAL_STRING("all of it and more", readAll(body).c_str());
+    TEST_ASSERT_TRUE(body.finished());
+    TEST_ASSERT_FALSE(body.failed());
+}
+
+void test_close_delimited_stall_is_a_timeout() {
+    WiFiClient client;
+    client.connect("server", 80);
+    client.feed("first part");
+    client.feed(" arrives too late", millis() + 5 * TIMEOUT);
+
+    HTTPBodyStream body(client, -1, false, TIMEOUT);
+    TEST_ASSERT_EQUAL_STRING("first part", readAll(body).c_str());
+    TEST_ASSERT_TRUE(body.failed());
+    TEST_ASSERT_FALSE(body.finished());
+}
+
+void test_content_length_cut_short_fails() {
+    WiFiClient client;
+    client.connect("server", 80);
+    client.feed("short");
+    client.closeFromPeer();
+
+    HTTPBodyStream body(client, 20, false, TIMEOUT);
+    TEST_ASSERT_EQUAL_STRING("short", readAll(body).c_str());
+    TEST_ASSERT_TRUE(body.failed());
+    TEST_ASSERT_FALSE(body.finished());
+}
+
+void test_stalled_close_delimited_response_is_an_error_and_not_reused() {
+    int served = 0;
+    host::setHttpHandler([&served](const host::HttpRequest& request) {
+        host::HttpResponse response;
+        response.closeDelimited = true;
+        if (served++ == 0) {
+            // Headers, then nothing until long after the timeout
+            response.body = "{\"stale\":true}";
+            response.bodyDelayMs = 3 * TIMEOUT;
+        } else {
+            response.body = "{\"fresh\":true}";
+        }
+        return response;
+    });
+
+    HTTPClientManager http;
+    http.setTimeout(TIMEOUT);
+    String first;
+    TEST_ASSERT_EQUAL_INT(HTTPC_ERROR_READ_TIMEOUT, http.sendGET("http://api.test/a", first));
+
+    delay(5 * TIMEOUT);
+    String second;
+    TEST_ASSERT_EQUAL_INT(200, http.sendGET("http://api.test/b", second));
+    TEST_ASSERT_EQUAL_STRING("{\"fresh\":true}", second.c_str());
+    TEST_ASSERT_EQUAL_UINT32(2, host::tcpConnects.load());
+}
+
+void test_close_delimited_connection_is_not_reused() {
+    host::setHttpHandler([](const host::HttpRequest& request) {
+        host::HttpResponse response;
+        response.closeDelimited = true;
+        response.body = request.url;
+        return response;
+    });
+
+    HTTPClientManager http;
+    for (int i = 0; i < 3; i++) {
+        String body;
+        TEST_ASSERT_EQUAL_INT(200, http.sendGET("http://api.test/x", body));
+        TEST_ASSERT_EQUAL_STRING("http://api.test/x", body.c_str());
+    }
+    TEST_ASSERT_EQUAL_UINT32(3, host::tcpConnects.load());
+    for (const host::HttpRequest& request : host::httpLog()) {
+        TEST_ASSERT_FALSE(request.reused);
+    }
+}
+
+void test_content_length_connection_is_reused() {
+    host::setHttpHandler([](const host::HttpRequest& request) {
+        host::HttpResponse response;
+        response.body = "ok";
+        return response;
+    });
+
+    HTTPClientManager http;
+    for (int i = 0; i < 3; i++) {
+        String body;
+        TEST_ASSERT_EQUAL_INT(200, http.sendGET("http://api.test/x", body));
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, host::tcpConnects.load());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_content_length_body);
+    RUN_TEST(test_chunked_body_in_pieces);
+    RUN_TEST(test_close_delimited_body_ends_at_close);
+    RUN_TEST(test_close_delimited_stall_is_a_timeout);
+    RUN_TEST(test_content_length_cut_short_fails);
+    RUN_TEST(test_stalled_close_delimited_response_is_an_error_and_not_reused);
+    RUN_TEST(test_close_delimited_connection_is_not_reused);
+    RUN_TEST(test_content_length_connection_is_reused);
+    return UNITY_END();
+}
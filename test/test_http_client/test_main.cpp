@@ -0,0 +1,111 @@
+// HTTPClientManager keep-alive retries: a request that fails on a reused
+// connection is resent on a new one only when that cannot deliver it twice.
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <unity.h>
+#include "http_client.h"
+
+static const char* URL = "http://api.test/data";
+
+// The first request that arrives on a reused connection fails with
+// staleError; everything else succeeds
+static int staleError = 0;
+static bool staleUsed = false;
+
+static HTTPClientManager http;
+
+static int post(const char* payload) {
+    String response;
+    return http.sendPOST(URL, payload, response);
+}
+
+static int get() {
+    String response;
+    return http.sendGET(URL, response);
+}
+
+static void failFirstReusedWith(int error) {
+    staleError = error;
+    staleUsed = false;
+    host::setHttpHandler([](const host::HttpRequest& request) {
+        host::HttpResponse response;
+        if (request.reused && !staleUsed) {
+            staleUsed = true;
+            response.code = staleError;
+        } else {
+            response.body = "{}";
+        }
+        return response;
+    });
+}
+
+void setUp() {
+    host::setFakeTime(true, 1000);
+    http.setKeepAlive(false);
+    http.setKeepAlive(true);
+}
+
+void tearDown() {
+    host::setFakeTime(false);
+}
+
+void test_get_is_retried_after_the_request_went_out() {
+    failFirstReusedWith(HTTPC_ERROR_CONNECTION_LOST);
+    TEST_ASSERT_EQUAL_INT(200, get());
+    TEST_ASSERT_EQUAL_INT(200, get());
+
+    std::vector<host::HttpRequest> log = host::httpLog();
+    TEST_ASSERT_EQUAL_size_t(3, log.size());
+    TEST_ASSERT_TRUE(log[1].reused);
+    TEST_ASSERT_FALSE(log[2].reused);
+}
+
+void test_post_is_not_resent_once_it_went_out() {
+    failFirstReusedWith(HTTPC_ERROR_CONNECTION_LOST);
+    TEST_ASSERT_EQUAL_INT(200, post("{\"n\":1}"));
+    TEST_ASSERT_EQUAL_INT(HTTPC_ERROR_CONNECTION_LOST, post("{\"n\":2}"));
+
+    // The server may have acted on the second one; it must see it once
+    std::vector<host::HttpRequest> log = host::httpLog();
+    TEST_ASSERT_EQUAL_size_t(2, log.size());
+    TEST_ASSERT_EQUAL_STRING("{\"n\":2}", log[1].payload.c_str());
+}
+
+void test_post_is_not_resent_after_a_read_timeout() {
+    failFirstReusedWith(HTTPC_ERROR_READ_TIMEOUT);
+    TEST_ASSERT_EQUAL_INT(200, post("{\"n\":1}"));
+    TEST_ASSERT_EQUAL_INT(HTTPC_ERROR_READ_TIMEOUT, post("{\"n\":2}"));
+    TEST_ASSERT_EQUAL_size_t(2, host::httpLog().size());
+}
+
+void test_post_is_resent_when_it_never_went_out() {
+    failFirstReusedWith(HTTPC_ERROR_SEND_HEADER_FAILED);
+    TEST_ASSERT_EQUAL_INT(200, post("{\"n\":1}"));
+    TEST_ASSERT_EQUAL_INT(200, post("{\"n\":2}"));
+
+    std::vector<host::HttpRequest> log = host::httpLog();
+    TEST_ASSERT_EQUAL_size_t(2, log.size());
+    TEST_ASSERT_EQUAL_STRING("{\"n\":2}", log[1].payload.c_str());
+    TEST_ASSERT_FALSE(log[1].reused);
+}
+
+void test_fresh_connection_failure_is_not_retried() {
+    host::setHttpHandler([](const host::HttpRequest& request) {
+        host::HttpResponse response;
+        response.code = HTTPC_ERROR_CONNECTION_LOST;
+        return response;
+    });
+    TEST_ASSERT_EQUAL_INT(HTTPC_ERROR_CONNECTION_LOST, get());
+    TEST_ASSERT_EQUAL_size_t(1, host::httpLog().size());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_get_is_retried_after_the_request_went_out);
+    RUN_TEST(test_post_is_not_resent_once_it_went_out);
+    RUN_TEST(test_post_is_not_resent_after_a_read_timeout);
+    RUN_TEST(test_post_is_resent_when_it_never_went_out);
+    RUN_TEST(test_fresh_connection_failure_is_not_retried);
+    return UNITY_END();
+}
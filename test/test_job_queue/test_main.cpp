@@ -0,0 +1,259 @@
+// Deferred jobs: JobQueue ordering, delays and slot reuse, then the web
+// server handing slow work to the main loop. A single thread plays the
+// AsyncTCP task and serves a burst of requests while a slow config job
+// (a stand-in for the old delay(1000) + blocking connect) is pending;
+// handler latency and throughput are compared with running the same job
+// on the AsyncTCP task, as the old handler did.
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <Preferences.h>
+#include <SPIFFS.h>
+#include <unity.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "config_store.h"
+#include "job_queue.h"
+#include "web_server.h"
+
+static const unsigned long SLOW_JOB_MS = 300;
+static const int BURST = 200;  // Requests arriving while the job runs
+
+static JobQueue jobs;
+static ConfigStore configStore;
+static WebServerManager* server;
+static std::atomic<int> slowJobsRun{0};
+
+static double nowUs() {
+    return std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Every request from its own address, so the per-client rate limit
+// stays out of the measurement
+static uint32_t nextAddress = 0x0A010001;
+
+static host::WebResponse post(const char* ssid) {
+    host::WebRequest request;
+    request.method = HTTP_POST;
+    request.url = "/api/config";
+    request.postParams = {{"ssid", ssid}, {"password", "hunter22"}};
+    request.remoteAddress = nextAddress++;
+    return host::webRequest(request);
+}
+
+static host::WebResponse poll(JobId id) {
+    host::WebRequest request;
+    request.url = "/api/jobs";
+    request.params = {{"id", std::to_string(id)}};
+    request.remoteAddress = nextAddress++;
+    return host::webRequest(request);
+}
+
+static JobId jobId(const host::WebResponse& accepted) {
+    std::string location = accepted.header("Location");
+    return strtoul(location.substr(location.find('=') + 1).c_str(), nullptr, 10);
+}
+
+// The main loop: runs jobs until stopped
+struct MainLoop {
+    std::atomic<bool> running{true};
+    std::thread thread{[this]() {
+        while (running) {
+            jobs.handle();
+            delay(1);
+        }
+    }};
+
+    ~MainLoop() {
+        running = false;
+        thread.join();
+    }
+};
+
+struct Burst {
+    double postUs;         // POST /api/config, arrival to response
+    double p50Us;          // Polls arriving with it
+    double p99Us;
+    double maxUs;
+    double requestsPerSec;
+};
+
+// A POST and BURST polls arrive at once; the AsyncTCP task serves them in
+// order. inlineJobs runs due jobs on that task after each request
+static Burst serveBurst(bool inlineJobs) {
+    double arrival = nowUs();
+    host::WebResponse accepted = post("office");
+    if (inlineJobs) {
+        jobs.handle();
+    }
+    double postUs = nowUs() - arrival;
+    TEST_ASSERT_EQUAL_INT(202, accepted.code);
+    JobId id = jobId(accepted);
+    TEST_ASSERT_TRUE(id != 0);
+
+    std::vector<double> latencies;
+    for (int i = 0; i < BURST; i++) {
+        host::WebResponse response = poll(id);
+        TEST_ASSERT_EQUAL_INT(200, response.code);
+        latencies.push_back(nowUs() - arrival);
+    }
+    double elapsedUs = nowUs() - arrival;
+
+    std::sort(latencies.begin(), latencies.end());
+    return Burst{postUs, latencies[BURST / 2], latencies[BURST * 99 / 100], latencies.back(),
+                 (BURST + 1) / (elapsedUs / 1e6)};
+}
+
+static void waitForJobs() {
+    while (jobs.pending() > 0) {
+        delay(1);
+    }
+}
+
+void setUp() {
+    host::clearNvs();
+    slowJobsRun = 0;
+}
+
+void tearDown() {
+}
+
+void test_jobs_run_in_order_after_their_delay() {
+    host::setFakeTime(true, 0);
+    JobQueue queue;
+    queue.begin();
+    std::vector<int> order;
+    JobId later = queue.submit("later", [&]() { order.push_back(1); return true; }, 500);
+    JobId first = queue.submit("first", [&]() { order.push_back(2); return true; });
+    JobId failing = queue.submit("failing", [&]() { order.push_back(3); return false; });
+
+    queue.handle();
+    TEST_ASSERT_EQUAL_size_t(2, order.size());
+    TEST_ASSERT_EQUAL_INT(2, order[0]);
+    TEST_ASSERT_EQUAL_INT(3, order[1]);
+    TEST_ASSERT_EQUAL_INT(JobQueue::JOB_QUEUED, queue.getState(later));
+    TEST_ASSERT_EQUAL_INT(JobQueue::JOB_DONE, queue.getState(first));
+    TEST_ASSERT_EQUAL_INT(JobQueue::JOB_FAILED, queue.getState(failing));
+    TEST_ASSERT_EQUAL_size_t(1, queue.pending());
+
+    host::advance(500);
+    queue.handle();
+    TEST_ASSERT_EQUAL_INT(1, order[2]);
+    TEST_ASSERT_EQUAL_INT(JobQueue::JOB_DONE, queue.getState(later));
+    host::setFakeTime(false);
+}
+
+void test_finished_slots_are_reused_oldest_first() {
+    JobQueue queue;
+    queue.begin();
+    for (size_t i = 0; i < JOB_QUEUE_SIZE; i++) {
+        TEST_ASSERT_TRUE(queue.submit("work", []() { return true; }) != 0);
+    }
+    // Every slot holds a job that has not run yet
+    TEST_ASSERT_EQUAL_UINT32(0, queue.submit("extra", []() { return true; }));
+
+    queue.handle();
+    JobId next = queue.submit("extra", []() { return true; });
+    TEST_ASSERT_EQUAL_UINT32(JOB_QUEUE_SIZE + 1, next);
+    TEST_ASSERT_EQUAL_INT(JobQueue::JOB_UNKNOWN, queue.getState(1));
+    TEST_ASSERT_EQUAL_INT(JobQueue::JOB_DONE, queue.getState(2));
+}
+
+void test_save_config_answers_202_and_runs_on_main_loop() {
+    MainLoop loop;
+    host::WebResponse accepted = post("office");
+    TEST_ASSERT_EQUAL_INT(202, accepted.code);
+    JobId id = jobId(accepted);
+    TEST_ASSERT_EQUAL_STRING(("/api/jobs?id=" + std::to_string(id)).c_str(), accepted.header("Location").c_str());
+
+    // Still running when the handler has long returned
+    std::string state = poll(id).body;
+    TEST_ASSERT_TRUE(state.find("\"running\"") != std::string::npos ||
+                     state.find("\"queued\"") != std::string::npos);
+    waitForJobs();
+    host::WebResponse done = poll(id);
+    TEST_ASSERT_TRUE(done.body.find("\"type\":\"config\"") != std::string::npos);
+    TEST_ASSERT_TRUE(done.body.find("\"state\":\"done\"") != std::string::npos);
+    TEST_ASSERT_EQUAL_STRING("office", configStore.get().ssid);
+    TEST_ASSERT_EQUAL_INT(1, slowJobsRun);
+
+    TEST_ASSERT_EQUAL_INT(404, poll(id + 1000).code);
+}
+
+void test_full_queue_is_rejected_without_blocking() {
+    MainLoop loop;
+    double start = nowUs();
+    int accepted = 0;
+    int busy = 0;
+    for (size_t i = 0; i < JOB_QUEUE_SIZE + 4; i++) {
+        host::WebResponse response = post("office");
+        if (response.code == 202) {
+            accepted++;
+        } else {
+            TEST_ASSERT_EQUAL_INT(503, response.code);
+            TEST_ASSERT_EQUAL_STRING("1", response.header("Retry-After").c_str());
+            busy++;
+        }
+    }
+    double elapsedMs = (nowUs() - start) / 1000;
+    printf("%zu saves while a slow job runs: %d accepted, %d told to retry, %.2f ms\n",
+           JOB_QUEUE_SIZE + 4, accepted, busy, elapsedMs);
+
+    TEST_ASSERT_GREATER_OR_EQUAL((int)JOB_QUEUE_SIZE, accepted);
+    TEST_ASSERT_TRUE(busy > 0);
+    TEST_ASSERT_TRUE(elapsedMs < SLOW_JOB_MS / 2);
+    waitForJobs();
+}
+
+void test_latency_and_throughput_while_a_slow_job_is_pending() {
+    Burst onLoop;
+    {
+        MainLoop loop;
+        onLoop = serveBurst(false);
+        TEST_ASSERT_TRUE(jobs.pending() > 0);  // The burst was served meanwhile
+        waitForJobs();
+    }
+    Burst onAsyncTcp = serveBurst(true);
+
+    printf("POST /api/config, then %d job polls, %lu ms job\n", BURST, SLOW_JOB_MS);
+    printf("%-28s %10s %10s %10s %10s %12s\n", "job runs on", "POST us", "p50 us", "p99 us", "max us", "requests/s");
+    printf("%-28s %10.0f %10.0f %10.0f %10.0f %12.0f\n", "AsyncTCP task (old)", onAsyncTcp.postUs,
+           onAsyncTcp.p50Us, onAsyncTcp.p99Us, onAsyncTcp.maxUs, onAsyncTcp.requestsPerSec);
+    printf("%-28s %10.0f %10.0f %10.0f %10.0f %12.0f\n", "main loop (JobQueue)", onLoop.postUs,
+           onLoop.p50Us, onLoop.p99Us, onLoop.maxUs, onLoop.requestsPerSec);
+
+    // The handler returns long before the job is done, and the requests
+    // behind it do not wait for the job either
+    TEST_ASSERT_TRUE(onLoop.postUs < SLOW_JOB_MS * 1000 / 10);
+    TEST_ASSERT_TRUE(onLoop.maxUs < SLOW_JOB_MS * 1000 / 2);
+    TEST_ASSERT_TRUE(onAsyncTcp.p50Us >= SLOW_JOB_MS * 1000);
+    TEST_ASSERT_TRUE(onLoop.requestsPerSec > 10 * onAsyncTcp.requestsPerSec);
+}
+
+int main() {
+    SPIFFS.begin();
+    jobs.begin();
+    configStore.begin(SPIFFS, CONFIG_FILE);
+    server = new WebServerManager();
+    server->setConfigStore(&configStore);
+    server->setJobQueue(&jobs);
+    server->onConfigUpdate([](const char* ssid, const char* password) {
+        (void)ssid;
+        (void)password;
+        delay(SLOW_JOB_MS);
+        slowJobsRun++;
+    });
+    server->begin();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_jobs_run_in_order_after_their_delay);
+    RUN_TEST(test_finished_slots_are_reused_oldest_first);
+    RUN_TEST(test_save_config_answers_202_and_runs_on_main_loop);
+    RUN_TEST(test_full_queue_is_rejected_without_blocking);
+    RUN_TEST(test_latency_and_throughput_while_a_slow_job_is_pending);
+    return UNITY_END();
+}
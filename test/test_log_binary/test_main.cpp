@@ -0,0 +1,135 @@
+// Binary log format round trip: the same log traffic is written as text and
+// as binary records, the binary capture is decoded with tools/log_decode.py,
+// and the result must equal the text output while being at least 3x smaller.
+
+#include <Arduino.h>
+#include <unity.h>
+#include <string>
+#include "logger.h"
+
+// Typical traffic of a running device, taken from the firmware's call sites
+static void logTypicalTraffic(int rounds) {
+    for (int round = 0; round < rounds; round++) {
+        LOG_INFOF("HTTP %s Response: %d%s", "POST", 200, round % 3 ? " (reused)" : "");
+        host::advance(17);
+        LOG_DEBUGF("Telemetry: uploaded %u samples", (unsigned)(10 + round % 5));
+        host::advance(1203);
+        LOG_INFOF("Signal Strength (RSSI): %d dBm", -60 - round % 20);
+        host::advance(5);
+        LOG_WARNF("Telemetry: upload of %u samples failed (%d), retrying in %lu s",
+                  (unsigned)(20 + round), -11, (unsigned long)(5 << (round % 6)));
+        host::advance(30000);
+        LOG_INFOF("WiFi connected in %lu ms", (unsigned long)(1800 + round * 7));
+        LOG_INFOF("IP Address: %s", "192.168.1.42");
+        host::advance(250);
+        LOG_DEBUGF("Sensor: %.2f C, %.1f %%", 21.5 + (round % 10) * 0.25, 40.0 + round % 30);
+        LOG_ERRORF("OTA: download failed at %u of %u bytes", (unsigned)(4096 * round), 1048576u);
+        host::advance(60000);
+    }
+}
+
+static std::string capture(LogFormat format, int rounds) {
+    host::setFakeTime(true, 12345);
+    Logger::setFormat(format);
+    Serial.clearOutput();
+    logTypicalTraffic(rounds);
+    std::string output = Serial.output();
+    Serial.clearOutput();
+    Logger::setFormat(LOG_FORMAT_TEXT);
+    host::setFakeTime(false);
+    return output;
+}
+
+// Runs the host decoder on data; the path is relative to the project, where
+// `pio test` runs the test program
+static std::string decode(const std::string& data) {
+    std::string root = __FILE__;
+    root = root.substr(0, root.rfind("test/test_log_binary/"));
+    std::string capturePath = "log_binary_capture.bin";
+    FILE* file = fopen(capturePath.c_str(), "wb");
+    TEST_ASSERT_NOT_NULL(file);
+    fwrite(data.data(), 1, data.size(), file);
+    fclose(file);
+
+    std::string command = "python3 " + root + "tools/log_decode.py " + capturePath;
+    FILE* pipe = popen(command.c_str(), "r");
+    TEST_ASSERT_NOT_NULL(pipe);
+    std::string decoded;
+    char buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+        decoded.append(buffer, count);
+    }
+    TEST_ASSERT_EQUAL_INT(0, pclose(pipe));
+    remove(capturePath.c_str());
+    return decoded;
+}
+
+static std::string withoutCarriageReturns(std::string text) {
+    text.erase(std::remove(text.begin(), text.end(), '\r'), text.end());
+    return text;
+}
+
+void setUp() {
+    Logger::setLogLevel(LOG_DEBUG);
+}
+
+void tearDown() {
+}
+
+void test_decoded_binary_equals_text_output() {
+    std::string text = capture(LOG_FORMAT_TEXT, 20);
+    std::string binary = capture(LOG_FORMAT_BINARY, 20);
+
+    std::string decoded = decode(binary);
+    TEST_ASSERT_EQUAL_STRING(withoutCarriageReturns(text).c_str(), decoded.c_str());
+}
+
+void test_long_lines_fall_back_to_text_records() {
+    // Arguments too long for a frame are sent as already formatted text;
+    // each encoding cuts the line to fit LOG_LINE_MAX bytes on the wire
+    std::string longValue(300, 'x');
+    host::setFakeTime(true, 1000);
+    Logger::setFormat(LOG_FORMAT_TEXT);
+    Serial.clearOutput();
+    LOG_INFOF("Payload: %s", longValue.c_str());
+    std::string text = withoutCarriageReturns(Serial.output());
+
+    // Announce the format first so only the line itself is captured
+    Logger::setFormat(LOG_FORMAT_BINARY);
+    Serial.clearOutput();
+    LOG_INFOF("Payload: %s", "");
+    std::string announced = Serial.output();
+    Serial.clearOutput();
+    LOG_INFOF("Payload: %s", longValue.c_str());
+    std::string binary = Serial.output();
+    Logger::setFormat(LOG_FORMAT_TEXT);
+    host::setFakeTime(false);
+
+    TEST_ASSERT_LESS_OR_EQUAL(LOG_LINE_MAX, (int)binary.size());
+    std::string decoded = decode(announced + binary);
+    decoded = decoded.substr(decoded.find('\n') + 1);
+    text.pop_back();
+    TEST_ASSERT_EQUAL_STRING(text.c_str(), decoded.substr(0, text.size()).c_str());
+    TEST_ASSERT_EQUAL_size_t(decoded.find_first_not_of('x', text.size()), decoded.size() - 1);
+}
+
+void test_binary_is_at_least_three_times_smaller() {
+    const int rounds = 500;
+    std::string text = capture(LOG_FORMAT_TEXT, rounds);
+    std::string binary = capture(LOG_FORMAT_BINARY, rounds);
+
+    double lines = rounds * 8.0;
+    double ratio = (double)text.size() / binary.size();
+    printf("%.0f lines: text %zu bytes (%.1f/line), binary %zu bytes (%.1f/line), %.2fx smaller\n",
+           lines, text.size(), text.size() / lines, binary.size(), binary.size() / lines, ratio);
+    TEST_ASSERT_GREATER_OR_EQUAL(3.0, ratio);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_decoded_binary_equals_text_output);
+    RUN_TEST(test_long_lines_fall_back_to_text_records);
+    RUN_TEST(test_binary_is_at_least_three_times_smaller);
+    return UNITY_END();
+}
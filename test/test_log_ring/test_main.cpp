@@ -0,0 +1,190 @@
+// LogRing and async Logger under concurrent producers: every line comes
+// out whole, exactly once and in per-producer order, and drops are counted.
+
+#include <Arduino.h>
+#include <unity.h>
+#include <thread>
+#include <vector>
+#include "log_ring.h"
+#include "logger.h"
+
+static const int PRODUCERS = 4;
+static const int LINES_PER_PRODUCER = 20000;
+
+// Line body depends on producer and sequence, so a torn or mixed line
+// fails the check
+static size_t makeLine(char* buffer, size_t size, int producer, int sequence) {
+    char fill = 'a' + (sequence + producer) % 26;
+    int padding = 10 + (sequence * 7 + producer) % 60;
+    int length = snprintf(buffer, size, "P%d #%d ", producer, sequence);
+    for (int i = 0; i < padding && (size_t)length < size - 1; i++) {
+        buffer[length++] = fill;
+    }
+    buffer[length] = '\0';
+    return length;
+}
+
+static bool parseLine(const char* line, size_t length, int& producer, int& sequence) {
+    if (sscanf(line, "P%d #%d ", &producer, &sequence) != 2) {
+        return false;
+    }
+    char expected[LOG_LINE_MAX];
+    size_t expectedLength = makeLine(expected, sizeof(expected), producer, sequence);
+    return length == expectedLength && memcmp(line, expected, length) == 0;
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_ring_mpsc_no_lost_or_torn_lines() {
+    LogRing ring;
+    TEST_ASSERT_TRUE(ring.begin(16));
+
+    std::atomic<uint32_t> fullClaims{0};
+    std::vector<std::thread> producers;
+    for (int p = 0; p < PRODUCERS; p++) {
+        producers.emplace_back([&ring, &fullClaims, p] {
+            for (int sequence = 0; sequence < LINES_PER_PRODUCER; sequence++) {
+                uint32_t ticket;
+                char* slot;
+                // Retry on a full ring so every line must arrive
+                while ((slot = ring.claim(ticket)) == nullptr) {
+                    fullClaims++;
+                    std::this_thread::yield();
+                }
+                size_t length = makeLine(slot, LOG_LINE_MAX, p, sequence);
+                ring.publish(ticket, length);
+            }
+        });
+    }
+
+    int next[PRODUCERS] = {};
+    int received = 0;
+    int bad = 0;
+    while (received < PRODUCERS * LINES_PER_PRODUCER && bad == 0) {
+        size_t length;
+        const char* line = ring.peek(length);
+        if (line == nullptr) {
+            std::this_thread::yield();
+            continue;
+        }
+        int producer, sequence;
+        if (!parseLine(line, length, producer, sequence) || producer < 0 || producer >= PRODUCERS ||
+            sequence != next[producer]) {
+            bad++;
+        } else {
+            next[producer]++;
+        }
+        ring.release();
+        received++;
+    }
+
+    for (std::thread& producer : producers) {
+        producer.join();
+    }
+
+    TEST_ASSERT_EQUAL_INT(0, bad);
+    TEST_ASSERT_EQUAL_INT(PRODUCERS * LINES_PER_PRODUCER, received);
+    for (int p = 0; p < PRODUCERS; p++) {
+        TEST_ASSERT_EQUAL_INT(LINES_PER_PRODUCER, next[p]);
+    }
+    TEST_ASSERT_TRUE(ring.isEmpty());
+    TEST_ASSERT_EQUAL_UINT32(fullClaims.load(), ring.getDroppedCount());
+}
+
+void test_ring_drops_and_counts_when_full() {
+    LogRing ring;
+    TEST_ASSERT_TRUE(ring.begin(8));
+
+    uint32_t ticket;
+    for (int i = 0; i < 8; i++) {
+        char* slot = ring.claim(ticket);
+        TEST_ASSERT_NOT_NULL(slot);
+        ring.publish(ticket, makeLine(slot, LOG_LINE_MAX, 0, i));
+    }
+    TEST_ASSERT_NULL(ring.claim(ticket));
+    TEST_ASSERT_NULL(ring.claim(ticket));
+    TEST_ASSERT_EQUAL_UINT32(2, ring.getDroppedCount());
+
+    // Releasing one line frees exactly one slot
+    size_t length;
+    TEST_ASSERT_NOT_NULL(ring.peek(length));
+    ring.release();
+    TEST_ASSERT_NOT_NULL(ring.claim(ticket));
+    TEST_ASSERT_NULL(ring.claim(ticket));
+}
+
+void test_async_logger_lines_whole_and_accounted() {
+    Serial.clearOutput();
+    TEST_ASSERT_TRUE(Logger::beginAsync(LOG_RING_SLOTS));
+
+    const int lines = 5000;
+    std::vector<std::thread> producers;
+    for (int p = 0; p < PRODUCERS; p++) {
+        producers.emplace_back([p] {
+            char body[LOG_LINE_MAX];
+            for (int sequence = 0; sequence < lines; sequence++) {
+                makeLine(body, 100, p, sequence);
+                LOG_INFOF("%s", body);
+            }
+        });
+    }
+    for (std::thread& producer : producers) {
+        producer.join();
+    }
+    Logger::flush(5000);
+    // The drop notice is written after the ring empties
+    delay(2 * LOG_DRAIN_IDLE_MS);
+
+    std::string output = Serial.output();
+    int last[PRODUCERS];
+    for (int p = 0; p < PRODUCERS; p++) {
+        last[p] = -1;
+    }
+    int received = 0;
+    unsigned long reportedDrops = 0;
+    int bad = 0;
+
+    size_t start = 0;
+    while (start < output.size()) {
+        size_t end = output.find("\r\n", start);
+        TEST_ASSERT_TRUE_MESSAGE(end != std::string::npos, "unterminated line");
+        std::string line = output.substr(start, end - start);
+        start = end + 2;
+
+        unsigned long timestamp, dropped;
+        if (sscanf(line.c_str(), "[%lu] [WARN ] Logger dropped %lu lines", &timestamp, &dropped) == 2) {
+            reportedDrops += dropped;
+            continue;
+        }
+
+        const char* prefix = "] [INFO ] ";
+        size_t body = line.find(prefix);
+        int producer, sequence;
+        if (line[0] != '[' || body == std::string::npos ||
+            !parseLine(line.c_str() + body + strlen(prefix), line.size() - body - strlen(prefix),
+                       producer, sequence) ||
+            sequence <= last[producer]) {
+            bad++;
+            continue;
+        }
+        last[producer] = sequence;
+        received++;
+    }
+
+    TEST_ASSERT_EQUAL_INT(0, bad);
+    TEST_ASSERT_GREATER_THAN(0, received);
+    TEST_ASSERT_EQUAL_UINT32(Logger::getDroppedCount(), reportedDrops);
+    TEST_ASSERT_EQUAL_INT(PRODUCERS * lines, received + (int)reportedDrops);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_ring_mpsc_no_lost_or_torn_lines);
+    RUN_TEST(test_ring_drops_and_counts_when_full);
+    RUN_TEST(test_async_logger_lines_whole_and_accounted);
+    return UNITY_END();
+}
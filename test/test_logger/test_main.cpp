@@ -0,0 +1,122 @@
+// Logger call cost: printf-style calls format without allocating, disabled
+// levels cost a level check and nothing else, and calls above
+// LOG_COMPILE_LEVEL are not compiled in at all. The benchmark compares
+// allocations and ns per call with the String overloads.
+
+// Build this file as a LOG_COMPILE_LEVEL=2 firmware would; logger.cpp
+// itself does not depend on it
+#define LOG_COMPILE_LEVEL 2
+
+#include <Arduino.h>
+#include <alloc_counter.h>
+#include <unity.h>
+#include <chrono>
+#include <functional>
+#include "logger.h"
+
+static const int CALLS = 200000;
+
+struct CallCost {
+    double allocationsPerCall;
+    double nsPerCall;
+};
+
+// Runs body once to size Serial's buffer, then measures it
+static CallCost measure(const std::function<void(int)>& body) {
+    for (int i = 0; i < CALLS; i++) {
+        body(i);
+    }
+    Serial.clearOutput();
+
+    host::AllocCount before = host::allocCount();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < CALLS; i++) {
+        body(i);
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    host::AllocCount after = host::allocCount();
+    Serial.clearOutput();
+    return CallCost{(double)(after.allocations - before.allocations) / CALLS, ns / CALLS};
+}
+
+static int evaluated = 0;
+
+static int sideEffect(int value) {
+    evaluated++;
+    return value;
+}
+
+void setUp() {
+    Logger::setLogLevel(LOG_INFO);
+    Serial.clearOutput();
+}
+
+void tearDown() {
+}
+
+void test_printf_line_matches_string_line() {
+    int httpCode = 404;
+    LOG_INFOF("HTTP GET Response: %d", httpCode);
+    Logger::info("HTTP GET Response: " + String(httpCode));
+
+    std::string output = Serial.output();
+    size_t first = output.find("\r\n");
+    TEST_ASSERT_TRUE(first != std::string::npos);
+    std::string printfLine = output.substr(0, first);
+    std::string stringLine = output.substr(first + 2, output.size() - first - 4);
+    TEST_ASSERT_EQUAL_STRING(printfLine.substr(13).c_str(), stringLine.substr(13).c_str());
+    TEST_ASSERT_TRUE(printfLine.find("[INFO ] HTTP GET Response: 404") != std::string::npos);
+}
+
+void test_disabled_levels_do_not_evaluate_arguments() {
+    evaluated = 0;
+
+    // Disabled at runtime
+    LOG_AT_LEVEL(LOG_DEBUG, debugf, "value %d", sideEffect(1));
+    TEST_ASSERT_EQUAL_INT(0, evaluated);
+
+    // Compiled out: not even enabling the level brings it back
+    Logger::setLogLevel(LOG_DEBUG);
+    LOG_DEBUGF("value %d", sideEffect(2));
+    TEST_ASSERT_EQUAL_INT(0, evaluated);
+    TEST_ASSERT_EQUAL_size_t(0, Serial.output().size());
+
+    LOG_AT_LEVEL(LOG_DEBUG, debugf, "value %d", sideEffect(3));
+    TEST_ASSERT_EQUAL_INT(1, evaluated);
+}
+
+void test_printf_calls_do_not_allocate() {
+    CallCost enabled = measure([](int i) { LOG_INFOF("HTTP GET Response: %d (%s)", i, "ok"); });
+    CallCost disabled = measure([](int i) { LOG_AT_LEVEL(LOG_DEBUG, debugf, "HTTP GET Response: %d", i); });
+    CallCost compiledOut = measure([](int i) { LOG_DEBUGF("HTTP GET Response: %d", i); });
+    CallCost stringEnabled = measure([](int i) {
+        Logger::info("HTTP GET Response: " + String(i) + " (" + "ok" + ")");
+    });
+    CallCost stringDisabled = measure([](int i) { Logger::debug("HTTP GET Response: " + String(i)); });
+
+    printf("%-28s %10s %10s\n", "call", "allocs", "ns");
+    printf("%-28s %10.2f %10.1f\n", "LOG_INFOF, enabled", enabled.allocationsPerCall, enabled.nsPerCall);
+    printf("%-28s %10.2f %10.1f\n", "debugf, disabled", disabled.allocationsPerCall, disabled.nsPerCall);
+    printf("%-28s %10.2f %10.1f\n", "LOG_DEBUGF, compiled out", compiledOut.allocationsPerCall,
+           compiledOut.nsPerCall);
+    printf("%-28s %10.2f %10.1f\n", "info(String), enabled", stringEnabled.allocationsPerCall,
+           stringEnabled.nsPerCall);
+    printf("%-28s %10.2f %10.1f\n", "debug(String), disabled", stringDisabled.allocationsPerCall,
+           stringDisabled.nsPerCall);
+
+    TEST_ASSERT_EQUAL_INT(0, (int)(enabled.allocationsPerCall * CALLS));
+    TEST_ASSERT_EQUAL_INT(0, (int)(disabled.allocationsPerCall * CALLS));
+    TEST_ASSERT_EQUAL_INT(0, (int)(compiledOut.allocationsPerCall * CALLS));
+    // The String overloads build the message whether or not it is logged
+    TEST_ASSERT_TRUE(stringEnabled.allocationsPerCall >= 1.0);
+    TEST_ASSERT_TRUE(stringDisabled.allocationsPerCall >= 1.0);
+    TEST_ASSERT_TRUE(disabled.nsPerCall < stringDisabled.nsPerCall);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_printf_line_matches_string_line);
+    RUN_TEST(test_disabled_levels_do_not_evaluate_arguments);
+    RUN_TEST(test_printf_calls_do_not_allocate);
+    return UNITY_END();
+}
@@ -0,0 +1,131 @@
+// Metrics export: histogram sums keep counting past 2^32 microseconds and
+// stay exact with several tasks recording at once. Also ns per update for
+// Counter::add, Histogram::record alone and contended, and ScopedTimer.
+
+#include <Arduino.h>
+#include <unity.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "metrics.h"
+
+class Capture : public Print {
+public:
+    std::string text;
+    size_t write(uint8_t c) override { text += (char)c; return 1; }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        text.append((const char*)buffer, size);
+        return size;
+    }
+};
+
+// Value of one exported sample, e.g. "test_wrap_seconds_sum"
+static double sample(const char* name) {
+    Capture out;
+    Metric::writeAll(out);
+    std::string prefix = std::string(name) + " ";
+    size_t at = out.text.find("\n" + prefix);
+    TEST_ASSERT_TRUE_MESSAGE(at != std::string::npos, name);
+    return strtod(out.text.c_str() + at + 1 + prefix.size(), nullptr);
+}
+
+static Histogram wrapHistogram("test_wrap_seconds", "Records past the 32-bit sum");
+static Histogram sharedHistogram("test_shared_seconds", "Recorded from several threads");
+static Counter benchCounter("test_bench_total", "Added to by the benchmark");
+static Histogram benchHistogram("test_bench_seconds", "Recorded by the benchmark");
+
+static const int BENCH_OPS = 1000000;
+static const int BENCH_THREADS = 4;
+
+// ns per call of op, run BENCH_OPS times on each of threads threads at once
+template <typename Op>
+static double nsPerOp(int threads, Op op) {
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&op] {
+            for (int i = 0; i < BENCH_OPS; i++) {
+                op(i);
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BENCH_OPS;
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_sum_does_not_wrap() {
+    // 100 x 60 s = 6000 s, well past the 4295 s a 32-bit sum holds
+    for (int i = 0; i < 100; i++) {
+        wrapHistogram.record(60000000);
+    }
+
+    TEST_ASSERT_DOUBLE_WITHIN(0.001, 6000.0, sample("test_wrap_seconds_sum"));
+    TEST_ASSERT_EQUAL_UINT32(100, (uint32_t)sample("test_wrap_seconds_count"));
+    TEST_ASSERT_EQUAL_UINT32(100, (uint32_t)sample("test_wrap_seconds_bucket{le=\"+Inf\"}"));
+}
+
+void test_concurrent_records_are_exact() {
+    const int threads = 4;
+    const int records = 100000;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([t] {
+            for (int i = 0; i < records; i++) {
+                sharedHistogram.record(10000 + t);
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    double expected = 0;
+    for (int t = 0; t < threads; t++) {
+        expected += (double)(10000 + t) * records;
+    }
+    TEST_ASSERT_DOUBLE_WITHIN(0.001, expected / 1e6, sample("test_shared_seconds_sum"));
+    TEST_ASSERT_EQUAL_UINT32(threads * records, (uint32_t)sample("test_shared_seconds_count"));
+}
+
+void test_update_cost() {
+    double add = nsPerOp(1, [](int i) { benchCounter.add(); (void)i; });
+    double addContended = nsPerOp(BENCH_THREADS, [](int i) { benchCounter.add(); (void)i; });
+    double record = nsPerOp(1, [](int i) { benchHistogram.record(i & 0xFFFF); });
+    double recordContended = nsPerOp(BENCH_THREADS, [](int i) { benchHistogram.record(i & 0xFFFF); });
+    double timer = nsPerOp(1, [](int i) {
+        ScopedTimer scoped(benchHistogram);
+        (void)i;
+    });
+
+    // Contended: wall time over the calls of one thread, i.e. what each
+    // caller waits while the others hammer the same metric
+    printf("%-34s %8s\n", "update", "ns/op");
+    printf("%-34s %8.1f\n", "Counter::add", add);
+    printf("%-34s %8.1f\n", "Counter::add, 4 threads", addContended);
+    printf("%-34s %8.1f\n", "Histogram::record", record);
+    printf("%-34s %8.1f\n", "Histogram::record, 4 threads", recordContended);
+    printf("%-34s %8.1f\n", "ScopedTimer (2 x micros + record)", timer);
+
+    TEST_ASSERT_EQUAL_UINT32(BENCH_OPS * (1 + BENCH_THREADS), benchCounter.get());
+    TEST_ASSERT_EQUAL_UINT32(BENCH_OPS * (2 + BENCH_THREADS), (uint32_t)sample("test_bench_seconds_count"));
+    // Generous bounds for a loaded build host; typical values are far lower
+    TEST_ASSERT_TRUE(add < 50);
+    TEST_ASSERT_TRUE(record < 200);
+    TEST_ASSERT_TRUE(timer < 500);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_sum_does_not_wrap);
+    RUN_TEST(test_concurrent_records_are_exact);
+    RUN_TEST(test_update_cost);
+    return UNITY_END();
+}
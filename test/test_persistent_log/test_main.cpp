@@ -0,0 +1,262 @@
+// PersistentLog against the in-memory filesystem: the circular file keeps
+// the newest LOG_PERSIST_PAGES pages across wraparound, flash sees one
+// write per full page, and the RTC tail survives a soft reset. A binary
+// log that wrapped still decodes with tools/log_decode.py.
+
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <esp_system.h>
+#include <unity.h>
+#include <string>
+#include "log_binary.h"
+#include "persistent_log.h"
+
+static const size_t PAGE_DATA_SIZE = LOG_PERSIST_PAGE_SIZE - 8;
+
+// Appends n log lines of varying length to the log and to expected
+static void writeLines(PersistentLog& log, std::string& expected, int first, int n) {
+    char line[LOG_LINE_MAX];
+    for (int i = first; i < first + n; i++) {
+        int length = snprintf(line, sizeof(line), "[%10d] [INFO ] line %d %.*s\r\n", i * 10, i,
+                              i % 50, "..................................................");
+        log.write(line, length);
+        expected.append(line, length);
+    }
+}
+
+static std::string readAll(PersistentLog& log, size_t chunk) {
+    std::string result;
+    PersistentLog::Cursor cursor;
+    uint8_t buffer[512];
+    size_t count;
+    while ((count = log.read(cursor, buffer, chunk)) > 0) {
+        result.append((const char*)buffer, count);
+    }
+    return result;
+}
+
+// What the log must hold after writing stream: the newest full pages that
+// fit in the file, then the partial page still in RTC memory
+static std::string retained(const std::string& stream) {
+    size_t pages = stream.size() / PAGE_DATA_SIZE;
+    size_t firstPage = pages > LOG_PERSIST_PAGES ? pages - LOG_PERSIST_PAGES : 0;
+    return stream.substr(firstPage * PAGE_DATA_SIZE);
+}
+
+static std::string bootMarker(PersistentLog& log) {
+    // The marker begin() wrote is the start of everything it logged
+    std::string all = readAll(log, 512);
+    return all.substr(all.rfind("--- boot"));
+}
+
+// Runs the host decoder on data, as in test_log_binary
+static std::string decode(const std::string& data) {
+    std::string root = __FILE__;
+    root = root.substr(0, root.rfind("test/test_persistent_log/"));
+    std::string capturePath = "persistent_log_capture.bin";
+    FILE* file = fopen(capturePath.c_str(), "wb");
+    TEST_ASSERT_NOT_NULL(file);
+    fwrite(data.data(), 1, data.size(), file);
+    fclose(file);
+
+    std::string command = "python3 " + root + "tools/log_decode.py " + capturePath;
+    FILE* pipe = popen(command.c_str(), "r");
+    TEST_ASSERT_NOT_NULL(pipe);
+    std::string decoded;
+    char buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+        decoded.append(buffer, count);
+    }
+    TEST_ASSERT_EQUAL_INT(0, pclose(pipe));
+    remove(capturePath.c_str());
+    return decoded;
+}
+
+// Bytes of FORMAT frames in a raw binary log
+static size_t announcementBytes(const std::string& raw) {
+    size_t bytes = 0;
+    for (size_t i = 0; i + LogBinary::FRAME_OVERHEAD < raw.size(); i++) {
+        size_t length = (uint8_t)raw[i + 1] + LogBinary::FRAME_OVERHEAD;
+        LogBinary::RecordType type;
+        if (i + length <= raw.size() &&
+            LogBinary::formatIdOf((const uint8_t*)raw.data() + i, length, type) >= 0) {
+            bytes += (type == LogBinary::RECORD_FORMAT) ? length : 0;
+            i += length - 1;
+        }
+    }
+    return bytes;
+}
+
+void setUp() {
+    SPIFFS.reset();
+    host::resetReason = ESP_RST_POWERON;
+}
+
+void tearDown() {
+}
+
+void test_partial_pages_stay_in_memory() {
+    PersistentLog log;
+    TEST_ASSERT_TRUE(log.begin(SPIFFS, LOG_PERSIST_FILE));
+    std::string expected = bootMarker(log);
+    SPIFFS.resetCounters();
+
+    // Less than a page: nothing reaches flash yet, but it can be read
+    writeLines(log, expected, 0, 3);
+    TEST_ASSERT_LESS_THAN((int)PAGE_DATA_SIZE, (int)expected.size());
+    TEST_ASSERT_EQUAL_size_t(0, SPIFFS.writeCalls);
+    TEST_ASSERT_EQUAL_STRING(expected.c_str(), readAll(log, 512).c_str());
+}
+
+void test_wraparound_keeps_newest_pages_in_order() {
+    PersistentLog log;
+    TEST_ASSERT_TRUE(log.begin(SPIFFS, LOG_PERSIST_FILE));
+    std::string expected = bootMarker(log);
+    size_t fileSize = SPIFFS.contents(LOG_PERSIST_FILE).size();
+    SPIFFS.resetCounters();
+
+    // Enough for the file to wrap around about two and a half times
+    int lines = 0;
+    while (expected.size() < PAGE_DATA_SIZE * LOG_PERSIST_PAGES * 5 / 2) {
+        writeLines(log, expected, lines, 100);
+        lines += 100;
+    }
+
+    // Read with an odd chunk size so reads straddle page boundaries
+    TEST_ASSERT_EQUAL_STRING(retained(expected).c_str(), readAll(log, 37).c_str());
+    TEST_ASSERT_EQUAL_STRING(retained(expected).c_str(), readAll(log, 512).c_str());
+
+    // The file never grows
+    TEST_ASSERT_EQUAL_size_t(fileSize, SPIFFS.contents(LOG_PERSIST_FILE).size());
+}
+
+void test_one_flash_write_per_full_page() {
+    PersistentLog log;
+    TEST_ASSERT_TRUE(log.begin(SPIFFS, LOG_PERSIST_FILE));
+    std::string expected = bootMarker(log);
+    SPIFFS.resetCounters();
+    uint32_t pageWritesBefore = log.getPageWrites();
+
+    const int lines = 5000;
+    writeLines(log, expected, 0, lines);
+
+    size_t pages = expected.size() / PAGE_DATA_SIZE - pageWritesBefore;
+    TEST_ASSERT_EQUAL_UINT32(pages, log.getPageWrites() - pageWritesBefore);
+    TEST_ASSERT_EQUAL_size_t(pages, SPIFFS.writeCalls);
+    TEST_ASSERT_EQUAL_size_t(pages, SPIFFS.flushes);
+    TEST_ASSERT_EQUAL_size_t(pages * LOG_PERSIST_PAGE_SIZE, SPIFFS.bytesWritten);
+    printf("%d lines, %zu bytes: %zu page writes (%.1f lines per flash write)\n",
+           lines, expected.size(), pages, (double)lines / pages);
+}
+
+void test_soft_reset_recovers_tail_and_continues() {
+    std::string expected;
+    {
+        PersistentLog log;
+        TEST_ASSERT_TRUE(log.begin(SPIFFS, LOG_PERSIST_FILE));
+        expected = bootMarker(log);
+        writeLines(log, expected, 0, 400);
+    }
+    // The partial page exists only in RTC memory at this point
+    TEST_ASSERT_TRUE(expected.size() % PAGE_DATA_SIZE != 0);
+
+    host::resetReason = ESP_RST_PANIC;
+    PersistentLog rebooted;
+    TEST_ASSERT_TRUE(rebooted.begin(SPIFFS, LOG_PERSIST_FILE));
+    std::string marker = bootMarker(rebooted);
+    TEST_ASSERT_TRUE(marker.find("tail recovered") != std::string::npos);
+    expected += marker;
+    writeLines(rebooted, expected, 400, 50);
+
+    TEST_ASSERT_EQUAL_STRING(retained(expected).c_str(), readAll(rebooted, 512).c_str());
+}
+
+void test_power_on_discards_stale_tail() {
+    std::string before;
+    {
+        PersistentLog log;
+        TEST_ASSERT_TRUE(log.begin(SPIFFS, LOG_PERSIST_FILE));
+        before = bootMarker(log);
+        writeLines(log, before, 0, 400);
+    }
+    size_t persisted = before.size() / PAGE_DATA_SIZE * PAGE_DATA_SIZE;
+
+    // RTC memory holds garbage after power-on, so only full pages remain
+    host::resetReason = ESP_RST_POWERON;
+    PersistentLog rebooted;
+    TEST_ASSERT_TRUE(rebooted.begin(SPIFFS, LOG_PERSIST_FILE));
+    std::string marker = bootMarker(rebooted);
+    TEST_ASSERT_TRUE(marker.find("tail recovered") == std::string::npos);
+
+    std::string expected = before.substr(0, persisted) + marker;
+    TEST_ASSERT_EQUAL_STRING(retained(expected).c_str(), readAll(rebooted, 512).c_str());
+}
+
+void test_wrapped_binary_log_decodes() {
+    // Logger keeps its sinks for the rest of the run
+    static PersistentLog log;
+    TEST_ASSERT_TRUE(log.begin(SPIFFS, LOG_PERSIST_FILE));
+    TEST_ASSERT_TRUE(Logger::addSink(&log));
+    host::setFakeTime(true, 1000);
+    Logger::setLogLevel(LOG_INFO);
+    Logger::setFormat(LOG_FORMAT_BINARY);
+
+    // Formats of boot, announced by Logger once
+    LOG_INFOF("WiFi connected in %lu ms", 1834ul);
+    LOG_INFOF("IP Address: %s", "192.168.1.42");
+
+    // Then enough for the file to wrap around twice
+    int samples = 0;
+    while (log.getPageWrites() < 2 * LOG_PERSIST_PAGES) {
+        LOG_INFOF("Sample %d: %.2f C", samples, 21.5 + samples % 10 * 0.25);
+        if (samples % 40 == 39) {
+            LOG_WARNF("Telemetry: upload of %u samples failed (%d)", 10u, -11);
+        }
+        samples++;
+        host::advance(1000);
+        Serial.clearOutput();
+    }
+    // A boot format again, long after its announcement was overwritten
+    LOG_INFOF("WiFi connected in %lu ms", 2210ul);
+    Serial.clearOutput();
+    Logger::setFormat(LOG_FORMAT_TEXT);
+    host::setFakeTime(false);
+
+    std::string raw = readAll(log, 512);
+    std::string decoded = decode(raw);
+    TEST_ASSERT_TRUE(decoded.find("<unknown format") == std::string::npos);
+    TEST_ASSERT_TRUE(decoded.find("Telemetry: upload of 10 samples failed (-11)") != std::string::npos);
+    TEST_ASSERT_TRUE(decoded.find("WiFi connected in 2210 ms") != std::string::npos);
+
+    // The newest samples, every one of them, up to the last
+    int first = -1;
+    int expected = -1;
+    for (size_t at = decoded.find("] Sample "); at != std::string::npos; at = decoded.find("] Sample ", at + 1)) {
+        int sample = atoi(decoded.c_str() + at + strlen("] Sample "));
+        if (first < 0) {
+            first = expected = sample;
+        }
+        TEST_ASSERT_EQUAL_INT(expected, sample);
+        expected++;
+    }
+    TEST_ASSERT_EQUAL_INT(samples, expected);
+
+    size_t announced = announcementBytes(raw);
+    printf("binary log after wrapping: %d of %d samples kept, %zu bytes decode to %zu bytes of text, "
+           "%zu bytes (%.0f%%) are per-page format announcements\n",
+           samples - first, samples, raw.size(), decoded.size(), announced, 100.0 * announced / raw.size());
+    // Still holds more than the same log as text would
+    TEST_ASSERT_TRUE(decoded.size() > raw.size());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_partial_pages_stay_in_memory);
+    RUN_TEST(test_wraparound_keeps_newest_pages_in_order);
+    RUN_TEST(test_one_flash_write_per_full_page);
+    RUN_TEST(test_soft_reset_recovers_tail_and_continues);
+    RUN_TEST(test_power_on_discards_stale_tail);
+    RUN_TEST(test_wrapped_binary_log_decodes);
+    return UNITY_END();
+}
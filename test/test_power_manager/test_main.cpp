@@ -0,0 +1,276 @@
+// PowerManager policy and a one-hour power simulation. The main loop is
+// rebuilt on the Scheduler with the firmware's task periods and per-task
+// CPU cost, on the simulated clock; telemetry uploads and OTA checks make
+// it busy for a while. Each stretch of time is charged at the current of
+// the state the chip is in (CPU clock or light sleep, WiFi power save),
+// giving duty cycle and current per hour against the old delay(10) loop.
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <esp_pm.h>
+#include <unity.h>
+#include "power_manager.h"
+#include "scheduler.h"
+
+// Average supply current per state, mA. CPU figures are for the core
+// running (or idling without light sleep); radio figures are the WiFi
+// average on top of it in each power save mode
+struct PowerModel {
+    double cpu240 = 40;
+    double cpu80 = 20;
+    double lightSleep = 1.5;     // Chip asleep, WiFi associated (DTIM wake-ups included)
+    double radioAwake = 95;      // WIFI_PS_NONE: receiver always on
+    double radioMinModem = 20;   // WIFI_PS_MIN_MODEM: wakes for every DTIM beacon
+    double radioMaxModem = 6;    // WIFI_PS_MAX_MODEM: wakes per listen interval
+};
+
+// CPU time per run of each loop task, us
+static const unsigned long NETWORK_POLL_US = 300;
+static const unsigned long HTTP_POLL_US = 50;
+static const unsigned long HOUSEKEEPING_US = 100;  // Each of the six 100 ms tasks
+static const unsigned long LOOP_OVERHEAD_US = 20;  // One loop() pass
+
+// Work that keeps the device busy: a telemetry upload every 60 s takes
+// 400 ms, the OTA manifest check (OTA_PULL_FIRST_DELAY after boot) 1.5 s
+static const unsigned long TELEMETRY_INTERVAL_MS = 60000;
+static const unsigned long TELEMETRY_BUSY_MS = 400;
+static const unsigned long OTA_CHECK_BUSY_MS = 1500;
+
+static const unsigned long HOUR_MS = 3600000;
+
+static PowerManager* power;
+static Scheduler* scheduler;
+static int networkTask;
+static int httpTask;
+static unsigned long busyUntil;
+static bool otaUpdating;
+
+static unsigned long pollInterval() {
+    return (POWER_SAVE_ENABLED && !power->isBusy()) ? POWER_IDLE_POLL_INTERVAL : LOOP_POLL_INTERVAL;
+}
+
+// As in main.cpp
+static void updatePowerState() {
+    delayMicroseconds(HOUSEKEEPING_US);
+    bool busy = otaUpdating || (long)(busyUntil - millis()) > 0;
+    if (busy == power->isBusy()) {
+        return;
+    }
+    power->setBusy(busy);
+    scheduler->setInterval(networkTask, pollInterval());
+    scheduler->setInterval(httpTask, pollInterval());
+}
+
+static void networkPoll() { delayMicroseconds(NETWORK_POLL_US); }
+static void httpPoll() { delayMicroseconds(HTTP_POLL_US); }
+static void housekeeping() { delayMicroseconds(HOUSEKEEPING_US); }
+static void upload() { busyUntil = std::max(busyUntil, millis() + TELEMETRY_BUSY_MS); }
+static void otaCheck() { busyUntil = std::max(busyUntil, millis() + OTA_CHECK_BUSY_MS); }
+
+struct Energy {
+    double runningMs = 0;     // loop() executing
+    double idleMs = 0;        // loop() sleeping, chip clocked
+    double lightSleepMs = 0;  // loop() sleeping, chip in light sleep
+    double mAms = 0;          // Charge, mA x ms
+
+    double totalMs() const { return runningMs + idleMs + lightSleepMs; }
+    double dutyCycle() const { return runningMs / totalMs(); }
+    double lightSleepShare() const { return lightSleepMs / totalMs(); }
+    double averageMa() const { return mAms / totalMs(); }
+};
+
+static double radioMa(const PowerModel& model) {
+    switch (WiFi.sleep) {
+    case WIFI_PS_NONE: return model.radioAwake;
+    case WIFI_PS_MIN_MODEM: return model.radioMinModem;
+    default: return model.radioMaxModem;
+    }
+}
+
+// Charge ms of time in the state the chip is in right now
+static void charge(Energy& energy, const PowerModel& model, double ms, bool running) {
+    if (!running && host::lightSleepAllowed()) {
+        energy.lightSleepMs += ms;
+        energy.mAms += ms * model.lightSleep;
+        return;
+    }
+    (running ? energy.runningMs : energy.idleMs) += ms;
+    double cpu = host::cpuMhz() > 80 ? model.cpu240 : model.cpu80;
+    energy.mAms += ms * (cpu + radioMa(model));
+}
+
+// One loop() pass: due tasks, then the sleep until the next deadline
+// (oldLoop: the fixed delay(10) of the old super-loop instead)
+static void loopOnce(Energy& energy, const PowerModel& model, bool oldLoop) {
+    unsigned long start = micros();
+    delayMicroseconds(LOOP_OVERHEAD_US);
+    unsigned long wait = scheduler->run();
+    charge(energy, model, (micros() - start) / 1000.0, true);
+
+    if (oldLoop) {
+        wait = 10;
+        delay(wait);
+    } else {
+        power->idle(wait);
+    }
+    charge(energy, model, wait, false);
+}
+
+static void setUpLoop() {
+    scheduler = new Scheduler();
+    networkTask = scheduler->every(pollInterval(), networkPoll);
+    httpTask = scheduler->every(pollInterval(), httpPoll);
+    scheduler->every(LOOP_HOUSEKEEPING_INTERVAL, updatePowerState);
+    for (int i = 0; i < 5; i++) {
+        scheduler->every(LOOP_HOUSEKEEPING_INTERVAL, housekeeping);
+    }
+    scheduler->every(TELEMETRY_INTERVAL_MS, upload);
+    scheduler->every(OTA_PULL_INTERVAL, otaCheck, OTA_PULL_FIRST_DELAY);
+}
+
+static Energy simulateHour(const PowerModel& model, bool powerSave, bool oldLoop) {
+    host::setFakeTime(true, 0);
+    power = new PowerManager();
+    if (powerSave) {
+        power->begin();
+    }
+    setUpLoop();
+
+    Energy energy;
+    while (millis() < HOUR_MS) {
+        loopOnce(energy, model, oldLoop);
+    }
+    return energy;
+}
+
+void setUp() {
+    host::resetPm();
+    host::resetWiFi();
+    busyUntil = 0;
+    otaUpdating = false;
+}
+
+void tearDown() {
+    delete scheduler;
+    scheduler = nullptr;
+    delete power;
+    power = nullptr;
+    host::setFakeTime(false);
+}
+
+void test_begin_enables_light_sleep_and_modem_sleep() {
+    power = new PowerManager();
+    power->begin();
+    TEST_ASSERT_TRUE(power->isLightSleepEnabled());
+    TEST_ASSERT_TRUE(host::lightSleepAllowed());
+    TEST_ASSERT_EQUAL_INT(POWER_CPU_MIN_MHZ, host::cpuMhz());
+    TEST_ASSERT_EQUAL_INT(WIFI_PS_MAX_MODEM, WiFi.sleep);
+}
+
+void test_without_tickless_idle_only_scales_frequency() {
+    host::lightSleepSupported = false;
+    power = new PowerManager();
+    power->begin();
+    TEST_ASSERT_FALSE(power->isLightSleepEnabled());
+    TEST_ASSERT_FALSE(host::lightSleepAllowed());
+    TEST_ASSERT_EQUAL_INT(POWER_CPU_MIN_MHZ, host::cpuMhz());
+}
+
+void test_without_power_management_still_uses_modem_sleep() {
+    // esp_pm_configure() fails with and without light sleep
+    host::pmSupported = false;
+    power = new PowerManager();
+    power->begin();
+    TEST_ASSERT_FALSE(host::pmConfigured);
+    TEST_ASSERT_FALSE(power->isLightSleepEnabled());
+    TEST_ASSERT_EQUAL_INT(240, host::cpuMhz());
+    TEST_ASSERT_EQUAL_INT(WIFI_PS_MAX_MODEM, WiFi.sleep);
+
+    // Power save still goes off for throughput while busy
+    power->setBusy(true);
+    TEST_ASSERT_EQUAL_INT(WIFI_PS_NONE, WiFi.sleep);
+    TEST_ASSERT_EQUAL_INT(0, host::pmLocksHeld[ESP_PM_CPU_FREQ_MAX]);
+    power->setBusy(false);
+    TEST_ASSERT_EQUAL_INT(WIFI_PS_MAX_MODEM, WiFi.sleep);
+}
+
+void test_ota_update_keeps_the_device_awake() {
+    host::setFakeTime(true, 0);
+    power = new PowerManager();
+    power->begin();
+    setUpLoop();
+    PowerModel model;
+    Energy energy;
+
+    otaUpdating = true;
+    for (int i = 0; i < 50; i++) {
+        loopOnce(energy, model, false);
+        if (millis() > LOOP_HOUSEKEEPING_INTERVAL) {
+            TEST_ASSERT_TRUE(power->isBusy());
+            TEST_ASSERT_FALSE(host::lightSleepAllowed());
+            TEST_ASSERT_EQUAL_INT(POWER_CPU_MAX_MHZ, host::cpuMhz());
+            TEST_ASSERT_EQUAL_INT(WIFI_PS_NONE, WiFi.sleep);
+        }
+    }
+    // Polled fast while busy
+    TEST_ASSERT_LESS_OR_EQUAL(LOOP_POLL_INTERVAL, scheduler->run());
+
+    otaUpdating = false;
+    for (int i = 0; i < 50; i++) {
+        loopOnce(energy, model, false);
+    }
+    TEST_ASSERT_FALSE(power->isBusy());
+    TEST_ASSERT_TRUE(host::lightSleepAllowed());
+    TEST_ASSERT_EQUAL_INT(WIFI_PS_MAX_MODEM, WiFi.sleep);
+}
+
+void test_duty_cycle_and_current_per_hour() {
+    PowerModel model;
+    Energy old = simulateHour(model, false, true);
+    tearDown();
+    setUp();
+
+    host::pmSupported = false;
+    Energy noPm = simulateHour(model, true, false);
+    tearDown();
+    setUp();
+
+    host::lightSleepSupported = false;
+    Energy noSleep = simulateHour(model, true, false);
+    tearDown();
+    setUp();
+
+    Energy saving = simulateHour(model, true, false);
+    float reported = power->getDutyCycle();
+
+    // Average mA over the hour is also mAh per hour
+    printf("%-42s %10s %14s %10s\n", "one hour", "running %", "light sleep %", "mAh");
+    printf("%-42s %10.2f %14.2f %10.1f\n", "old: delay(10) loop, 240 MHz, PS_MIN_MODEM",
+           100 * old.dutyCycle(), 100 * old.lightSleepShare(), old.averageMa());
+    printf("%-42s %10.2f %14.2f %10.1f\n", "no PM in the SDK: 240 MHz + PS_MAX_MODEM",
+           100 * noPm.dutyCycle(), 100 * noPm.lightSleepShare(), noPm.averageMa());
+    printf("%-42s %10.2f %14.2f %10.1f\n", "no tickless idle: DFS + PS_MAX_MODEM",
+           100 * noSleep.dutyCycle(), 100 * noSleep.lightSleepShare(), noSleep.averageMa());
+    printf("%-42s %10.2f %14.2f %10.1f\n", "power save: light sleep + PS_MAX_MODEM",
+           100 * saving.dutyCycle(), 100 * saving.lightSleepShare(), saving.averageMa());
+    printf("duty cycle reported by PowerManager: %.2f %%\n", 100 * reported);
+
+    // A reading every minute is mostly sleep
+    TEST_ASSERT_TRUE(saving.dutyCycle() < 0.05);
+    TEST_ASSERT_TRUE(saving.averageMa() * 10 < old.averageMa());
+    TEST_ASSERT_TRUE(saving.averageMa() < noSleep.averageMa());
+    TEST_ASSERT_TRUE(noSleep.averageMa() < noPm.averageMa());
+    // Modem sleep alone still beats the radio of the old loop
+    TEST_ASSERT_TRUE(noPm.averageMa() < old.averageMa());
+    TEST_ASSERT_FLOAT_WITHIN(0.01, saving.dutyCycle(), reported);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_begin_enables_light_sleep_and_modem_sleep);
+    RUN_TEST(test_without_tickless_idle_only_scales_frequency);
+    RUN_TEST(test_without_power_management_still_uses_modem_sleep);
+    RUN_TEST(test_ota_update_keeps_the_device_awake);
+    RUN_TEST(test_duty_cycle_and_current_per_hour);
+    return UNITY_END();
+}
@@ -0,0 +1,114 @@
+// RateLimiter token buckets on a simulated clock: burst, sustained rate,
+// Retry-After hints, per-client isolation and eviction.
+
+#include <Arduino.h>
+#include <unity.h>
+#include "rate_limiter.h"
+
+static const uint32_t RATE = 5;
+static const uint32_t BURST = 10;
+
+static uint32_t ip(int n) {
+    return 0x0A000000u + n;  // 10.0.0.n
+}
+
+void setUp() {
+    host::setFakeTime(true, 100000);
+}
+
+void tearDown() {
+    host::setFakeTime(false);
+}
+
+void test_burst_then_rejected_with_retry_after() {
+    RateLimiter limiter(RATE, BURST);
+    uint32_t retryAfterMs = 0;
+
+    for (uint32_t i = 0; i < BURST; i++) {
+        TEST_ASSERT_TRUE(limiter.allow(ip(1), retryAfterMs));
+    }
+    TEST_ASSERT_FALSE(limiter.allow(ip(1), retryAfterMs));
+    TEST_ASSERT_EQUAL_UINT32(1000 / RATE, retryAfterMs);
+
+    // Half a token later the hint is half as long
+    delay(100);
+    TEST_ASSERT_FALSE(limiter.allow(ip(1), retryAfterMs));
+    TEST_ASSERT_EQUAL_UINT32(100, retryAfterMs);
+
+    delay(retryAfterMs);
+    TEST_ASSERT_TRUE(limiter.allow(ip(1), retryAfterMs));
+}
+
+void test_sustained_rate_is_enforced() {
+    RateLimiter limiter(RATE, BURST);
+    uint32_t retryAfterMs;
+
+    // A client asking every 10 ms for 60 s gets the burst plus RATE/s
+    int allowed = 0;
+    for (int t = 0; t < 6000; t++) {
+        if (limiter.allow(ip(1), retryAfterMs)) {
+            allowed++;
+        }
+        delay(10);
+    }
+    TEST_ASSERT_INT_WITHIN(1, BURST + RATE * 60, allowed);
+}
+
+void test_clients_do_not_share_a_bucket() {
+    RateLimiter limiter(RATE, BURST);
+    uint32_t retryAfterMs;
+
+    for (uint32_t i = 0; i < BURST; i++) {
+        limiter.allow(ip(1), retryAfterMs);
+    }
+    TEST_ASSERT_FALSE(limiter.allow(ip(1), retryAfterMs));
+    TEST_ASSERT_TRUE(limiter.allow(ip(2), retryAfterMs));
+}
+
+void test_least_recently_seen_client_is_evicted() {
+    RateLimiter limiter(RATE, BURST);
+    uint32_t retryAfterMs;
+
+    // Client 1 empties its bucket, then WEB_RATE_CLIENTS others show up
+    for (uint32_t i = 0; i < BURST; i++) {
+        limiter.allow(ip(1), retryAfterMs);
+    }
+    for (int n = 2; n < 2 + WEB_RATE_CLIENTS; n++) {
+        delay(1);
+        TEST_ASSERT_TRUE(limiter.allow(ip(n), retryAfterMs));
+    }
+
+    // Evicted, so it starts over with a full bucket
+    TEST_ASSERT_TRUE(limiter.allow(ip(1), retryAfterMs));
+
+    // That took client 2's slot; client 3 kept its bucket, one token spent
+    for (uint32_t i = 0; i < BURST - 1; i++) {
+        TEST_ASSERT_TRUE(limiter.allow(ip(3), retryAfterMs));
+    }
+    TEST_ASSERT_FALSE(limiter.allow(ip(3), retryAfterMs));
+}
+
+void test_long_idle_refills_without_overflow() {
+    RateLimiter limiter(1000, BURST);
+    uint32_t retryAfterMs;
+
+    for (uint32_t i = 0; i < BURST; i++) {
+        limiter.allow(ip(1), retryAfterMs);
+    }
+    // Days idle: elapsed * rate would overflow 32 bits if not clamped
+    delay(5UL * 24 * 3600 * 1000);
+    for (uint32_t i = 0; i < BURST; i++) {
+        TEST_ASSERT_TRUE(limiter.allow(ip(1), retryAfterMs));
+    }
+    TEST_ASSERT_FALSE(limiter.allow(ip(1), retryAfterMs));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_burst_then_rejected_with_retry_after);
+    RUN_TEST(test_sustained_rate_is_enforced);
+    RUN_TEST(test_clients_do_not_share_a_bucket);
+    RUN_TEST(test_least_recently_seen_client_is_evicted);
+    RUN_TEST(test_long_idle_refills_without_overflow);
+    return UNITY_END();
+}
@@ -0,0 +1,252 @@
+// Scheduler on a mock clock: periodic and one-shot tasks run at their
+// deadlines, run() returns the exact time to the next one, and cancel,
+// setInterval, stalls and millis() wraparound behave. The benchmark fills
+// the table with 100+ tasks and measures the cost of run() per pass and
+// per task dispatched, and checks nothing is allocated.
+
+#include <Arduino.h>
+#include <alloc_counter.h>
+#include <unity.h>
+#include <chrono>
+#include <climits>
+#include <utility>
+#include <vector>
+#include "scheduler.h"
+
+static unsigned long now;
+static unsigned long mockClock() {
+    return now;
+}
+
+static std::vector<unsigned long> calls;
+static void record() {
+    calls.push_back(now);
+}
+
+static Scheduler* current;
+static int selfId;
+static void cancelSelf() {
+    calls.push_back(now);
+    current->cancel(selfId);
+}
+
+static void busy() {
+    calls.push_back(now);
+    now += 250;  // Runs longer than its interval
+}
+
+// Advance the clock the way the loop sleeps: straight to the next deadline
+static void runFor(Scheduler& scheduler, unsigned long ms) {
+    unsigned long end = now + ms;
+    while ((long)(end - now) > 0) {
+        unsigned long wait = scheduler.run();
+        now += std::min(wait, end - now);
+    }
+}
+
+void setUp() {
+    now = 5000;
+    calls.clear();
+}
+
+void tearDown() {
+}
+
+void test_periodic_task_keeps_its_phase() {
+    Scheduler scheduler(mockClock);
+    TEST_ASSERT_TRUE(scheduler.every(100, record, 30) >= 0);
+    runFor(scheduler, 1000);
+
+    TEST_ASSERT_EQUAL_size_t(10, calls.size());
+    for (size_t i = 0; i < calls.size(); i++) {
+        TEST_ASSERT_EQUAL_UINT32(5030 + 100 * i, calls[i]);
+    }
+}
+
+void test_run_returns_time_to_next_deadline() {
+    Scheduler scheduler(mockClock);
+    TEST_ASSERT_EQUAL_UINT32(SCHEDULER_MAX_WAIT, scheduler.run());
+
+    scheduler.every(250, record, 70);
+    scheduler.after(40, record);
+    TEST_ASSERT_EQUAL_UINT32(40, scheduler.run());
+    now += 40;
+    TEST_ASSERT_EQUAL_UINT32(30, scheduler.run());
+    TEST_ASSERT_EQUAL_size_t(1, calls.size());
+
+    now += 30;
+    TEST_ASSERT_EQUAL_UINT32(250, scheduler.run());
+
+    // A deadline further out than SCHEDULER_MAX_WAIT
+    Scheduler idle(mockClock);
+    idle.after(5 * SCHEDULER_MAX_WAIT, record);
+    TEST_ASSERT_EQUAL_UINT32(SCHEDULER_MAX_WAIT, idle.run());
+}
+
+void test_one_shot_runs_once_and_frees_its_slot() {
+    Scheduler scheduler(mockClock);
+    scheduler.after(10, record);
+    TEST_ASSERT_EQUAL_INT(1, scheduler.size());
+    runFor(scheduler, 100);
+    TEST_ASSERT_EQUAL_size_t(1, calls.size());
+    TEST_ASSERT_EQUAL_UINT32(5010, calls[0]);
+    TEST_ASSERT_EQUAL_INT(0, scheduler.size());
+}
+
+void test_cancel_including_from_own_callback() {
+    Scheduler scheduler(mockClock);
+    current = &scheduler;
+    int other = scheduler.every(10, record);
+    selfId = scheduler.every(20, cancelSelf, 20);
+    TEST_ASSERT_TRUE(scheduler.cancel(other));
+    TEST_ASSERT_FALSE(scheduler.cancel(other));
+
+    runFor(scheduler, 200);
+    TEST_ASSERT_EQUAL_size_t(1, calls.size());
+    TEST_ASSERT_EQUAL_INT(0, scheduler.size());
+    TEST_ASSERT_FALSE(scheduler.cancel(selfId));
+}
+
+void test_set_interval() {
+    Scheduler scheduler(mockClock);
+    int id = scheduler.every(1000, record, 1000);
+
+    // Shorter: from now on
+    now += 100;
+    TEST_ASSERT_TRUE(scheduler.setInterval(id, 50));
+    TEST_ASSERT_EQUAL_UINT32(50, scheduler.run());
+    runFor(scheduler, 200);
+    TEST_ASSERT_EQUAL_size_t(3, calls.size());
+    TEST_ASSERT_EQUAL_UINT32(5150, calls[0]);
+
+    // Longer: after the run already due
+    TEST_ASSERT_TRUE(scheduler.setInterval(id, 500));
+    calls.clear();
+    runFor(scheduler, 1000);
+    TEST_ASSERT_EQUAL_UINT32(5300, calls[0]);
+    TEST_ASSERT_EQUAL_UINT32(5800, calls[1]);
+
+    TEST_ASSERT_FALSE(scheduler.setInterval(scheduler.after(10, record), 20));
+}
+
+void test_stall_skips_missed_runs() {
+    Scheduler scheduler(mockClock);
+    scheduler.every(100, busy, 100);
+    runFor(scheduler, 1000);
+
+    // 250 ms per call: every other deadline is missed, not made up for
+    TEST_ASSERT_TRUE(calls.size() >= 3);
+    for (size_t i = 1; i < calls.size(); i++) {
+        TEST_ASSERT_EQUAL_UINT32(350, calls[i] - calls[i - 1]);
+    }
+}
+
+void test_task_due_again_does_not_starve_the_loop() {
+    Scheduler scheduler(mockClock);
+    scheduler.every(1, record);
+    now += 10;
+    scheduler.run();
+    TEST_ASSERT_EQUAL_size_t(1, calls.size());
+}
+
+void test_millis_wraparound() {
+    now = ULONG_MAX - 150;
+    Scheduler scheduler(mockClock);
+    scheduler.every(100, record, 100);
+    scheduler.after(120, record);
+    runFor(scheduler, 400);
+
+    TEST_ASSERT_EQUAL_size_t(4, calls.size());
+    TEST_ASSERT_TRUE(calls[0] == ULONG_MAX - 50);
+    TEST_ASSERT_TRUE(calls[1] == ULONG_MAX - 30);
+    TEST_ASSERT_TRUE(calls[2] == 49);
+    TEST_ASSERT_TRUE(calls[3] == 149);
+}
+
+void test_table_full() {
+    Scheduler scheduler(mockClock);
+    for (int i = 0; i < SCHEDULER_MAX_TASKS; i++) {
+        TEST_ASSERT_EQUAL_INT(i, scheduler.every(100 + i, record));
+    }
+    TEST_ASSERT_EQUAL_INT(Scheduler::INVALID_TASK, scheduler.after(10, record));
+    TEST_ASSERT_TRUE(scheduler.cancel(7));
+    TEST_ASSERT_EQUAL_INT(7, scheduler.after(10, record));
+}
+
+// One callback per task, each counting its own runs and lateness
+static uint32_t runs[SCHEDULER_MAX_TASKS];
+static unsigned long deadlines[SCHEDULER_MAX_TASKS];
+static unsigned long intervals[SCHEDULER_MAX_TASKS];
+static unsigned long maxLateness;
+
+template <int N>
+static void tick() {
+    runs[N]++;
+    maxLateness = std::max(maxLateness, now - deadlines[N]);
+    deadlines[N] += intervals[N];
+}
+
+template <int... N>
+static const Scheduler::Callback* makeTicks(std::integer_sequence<int, N...>) {
+    static const Scheduler::Callback ticks[] = {tick<N>...};
+    return ticks;
+}
+
+void test_benchmark_many_tasks() {
+    TEST_ASSERT_GREATER_OR_EQUAL(100, SCHEDULER_MAX_TASKS);
+    const Scheduler::Callback* ticks = makeTicks(std::make_integer_sequence<int, SCHEDULER_MAX_TASKS>());
+    const unsigned long simulatedMs = 600000;
+
+    Scheduler scheduler(mockClock);
+    randomSeed(17);
+    maxLateness = 0;
+    for (int i = 0; i < SCHEDULER_MAX_TASKS; i++) {
+        runs[i] = 0;
+        intervals[i] = 10 + random(5000);
+        unsigned long firstDelay = random(intervals[i]);
+        deadlines[i] = now + firstDelay;
+        TEST_ASSERT_EQUAL_INT(i, scheduler.every(intervals[i], ticks[i], firstDelay));
+    }
+
+    host::AllocCount before = host::allocCount();
+    uint64_t passes = 0;
+    unsigned long start = now;
+    auto began = std::chrono::steady_clock::now();
+    while (now - start < simulatedMs) {
+        now += scheduler.run();
+        passes++;
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - began).count();
+    host::AllocCount after = host::allocCount();
+
+    uint64_t dispatched = 0;
+    for (int i = 0; i < SCHEDULER_MAX_TASKS; i++) {
+        dispatched += runs[i];
+        // Every deadline in the simulated time was met
+        TEST_ASSERT_UINT32_WITHIN(1, (simulatedMs - (deadlines[i] - intervals[i] * runs[i] - start)) / intervals[i],
+                                  runs[i]);
+    }
+
+    printf("%d tasks, %lu s simulated: %llu run() passes, %llu tasks dispatched\n", SCHEDULER_MAX_TASKS,
+           simulatedMs / 1000, (unsigned long long)passes, (unsigned long long)dispatched);
+    printf("%.0f ns per run() pass, %.0f ns per task dispatched, max lateness %lu ms, %llu allocations\n",
+           ns / passes, ns / dispatched, maxLateness, (unsigned long long)(after.allocations - before.allocations));
+
+    TEST_ASSERT_EQUAL_UINT32(0, maxLateness);
+    TEST_ASSERT_TRUE(after.allocations == before.allocations);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_periodic_task_keeps_its_phase);
+    RUN_TEST(test_run_returns_time_to_next_deadline);
+    RUN_TEST(test_one_shot_runs_once_and_frees_its_slot);
+    RUN_TEST(test_cancel_including_from_own_callback);
+    RUN_TEST(test_set_interval);
+    RUN_TEST(test_stall_skips_missed_runs);
+    RUN_TEST(test_task_due_again_does_not_starve_the_loop);
+    RUN_TEST(test_millis_wraparound);
+    RUN_TEST(test_table_full);
+    RUN_TEST(test_benchmark_many_tasks);
+    return UNITY_END();
+}
@@ -0,0 +1,322 @@
+// Soak test: a simulated week of the main loop on the fake clock, with the
+// firmware's scheduled work (WiFi and HTTP polls, telemetry uploads, jobs,
+// heap reports) plus browsers polling /api/status, a scraper on
+// /api/metrics and a daily WiFi outage and config save through /api/config,
+// all served by WebServerManager with main's status builder. After a
+// warm-up hour no hot path may allocate; allocations are counted per
+// simulated day on the loop's thread, leaving out only what the web server
+// library allocates for each request (host::LibraryScope). The HTTP worker's
+// client runs on its own thread.
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <ESPAsyncWebServer.h>
+#include <HTTPClient.h>
+#include <SPIFFS.h>
+#include <WiFi.h>
+#include <alloc_counter.h>
+#include <unity.h>
+#include <chrono>
+#include <thread>
+#include "async_http_client.h"
+#include "config_store.h"
+#include "job_queue.h"
+#include "logger.h"
+#include "metrics.h"
+#include "scheduler.h"
+#include "telemetry_queue.h"
+#include "web_server.h"
+#include "wifi_manager.h"
+
+static const unsigned long HOUR_MS = 3600000UL;
+static const unsigned long DAY_MS = 24 * HOUR_MS;
+static const int DAYS = 7;
+static const unsigned long OUTAGE_MS = 30000;       // AP down once a day
+static const unsigned long DASHBOARD_INTERVAL = 5000;  // Open browser tab polling /api/status
+static const unsigned long SCRAPE_INTERVAL = 15000;    // Prometheus scraping /metrics
+static const uint32_t DASHBOARD_CLIENTS = 3;
+static const char* URL = "http://telemetry.test/api/data";
+
+static HTTPClientManager http;
+static AsyncHTTPClient asyncHttp(http);
+static WiFiManager wifiManager;
+static TelemetryQueue telemetry;
+static JobQueue jobs;
+static ConfigStore configStore;
+static WebServerManager webServer;
+static Scheduler scheduler;
+static Histogram loopDuration("soak_loop_duration_us", "loop() run time");
+
+// What the browsers and the scraper send; built once and reused, so only
+// the device's side of each request is measured
+static host::WebRequest statusPolls[DASHBOARD_CLIENTS];
+static host::WebRequest scrape;
+static host::WebRequest configSave;
+
+static uint32_t passes;
+static uint32_t reconnects;
+static uint32_t configsApplied;
+static uint32_t statusSent;
+static uint32_t statusNotModified;
+static size_t statusBytes;
+static size_t scrapedBytes;
+
+static bool wasConnected;
+
+static void handleNetwork() {
+    wifiManager.handle();
+    bool connected = wifiManager.isConnected();
+    if (connected && !wasConnected) {
+        reconnects++;
+    }
+    wasConnected = connected;
+}
+
+static void forwardSample() {
+    float temperature = 22.5f + random(-50, 50) / 10.0f;
+    float humidity = 55.0f + random(-100, 100) / 10.0f;
+    telemetry.add(temperature, humidity);
+    LOG_DEBUGF("Temperature: %.2f°C, Humidity: %.2f%%", temperature, humidity);
+}
+
+// As main.cpp's; there is no OTA manager here, so no progress
+static void buildStatus(JsonDocument& doc) {
+    doc["device_name"] = DEFAULT_DEVICE_NAME;
+    doc["firmware_version"] = FIRMWARE_VERSION;
+    doc["uptime"] = millis();
+    doc["wifi_connected"] = wifiManager.isConnected();
+    if (wifiManager.isConnected()) {
+        doc["ssid"] = wifiManager.getSSID();
+        doc["ip_address"] = wifiManager.getIPAddress();
+        doc["signal_strength"] = WiFi.RSSI();
+        doc["wifi_connect_time"] = wifiManager.getConnectDuration();
+    } else {
+        doc["ssid"] = "Not connected";
+        doc["ip_address"] = "N/A";
+        doc["signal_strength"] = 0;
+    }
+    doc["free_heap"] = ESP.getFreeHeap();
+    doc["largest_free_block"] = ESP.getMaxAllocHeap();
+    doc["chip_model"] = ESP.getChipModel();
+    doc["chip_cores"] = ESP.getChipCores();
+    doc["sdk_version"] = ESP.getSdkVersion();
+}
+
+static uint32_t statusFingerprint() {
+    uint32_t hash = 2166136261u;
+    auto mix = [&hash](uint32_t value) {
+        hash = (hash ^ value) * 16777619u;
+    };
+    bool connected = wifiManager.isConnected();
+    mix(connected);
+    if (connected) {
+        mix((uint32_t)WiFi.localIP());
+        mix((uint32_t)wifiManager.getConnectDuration());
+    }
+    mix((uint32_t)-1);
+    return hash;
+}
+
+// Each open tab revalidates with the ETag it last got, as browsers do
+static void dashboardPoll() {
+    for (host::WebRequest& poll : statusPolls) {
+        host::WebResponse response = host::webRequest(poll);
+        if (response.code == 304) {
+            statusNotModified++;
+            continue;
+        }
+        TEST_ASSERT_EQUAL(200, response.code);
+        statusSent++;
+        statusBytes += response.body.size();
+        std::string etag = response.header("ETag");
+        if (poll.headers.empty()) {
+            poll.headers.push_back({"If-None-Match", etag});
+        } else {
+            poll.headers[0].second = etag;
+        }
+    }
+}
+
+static void scrapeMetrics() {
+    host::WebResponse response = host::webRequest(scrape);
+    TEST_ASSERT_EQUAL(200, response.code);
+    scrapedBytes += response.body.size();
+}
+
+static void reportHeap() {
+    uint32_t free = ESP.getFreeHeap();
+    uint32_t largest = ESP.getMaxAllocHeap();
+    LOG_INFOF("Heap: %u free, %u largest block (%d%% fragmented), %u min free", (unsigned)free,
+              (unsigned)largest, (int)((1.0f - (float)largest / free) * 100), (unsigned)ESP.getMinFreeHeap());
+}
+
+static void restoreAccessPoint() {
+    host::setAccessPointUp("office", true);
+}
+
+static void dailyOutage() {
+    host::setAccessPointUp("office", false);
+    scheduler.after(OUTAGE_MS, restoreAccessPoint);
+}
+
+// The web UI's save; the job stores it and main's callback reconnects
+static void dailyConfigSave() {
+    host::WebResponse response = host::webRequest(configSave);
+    TEST_ASSERT_EQUAL(202, response.code);
+}
+
+// One loop(): due tasks, then uploads finish on the worker (real time)
+// while the loop sleeps until the next deadline
+static void loopOnce() {
+    uint32_t start = micros();
+    unsigned long wait = scheduler.run();
+    loopDuration.record(micros() - start);
+    while (asyncHttp.pending() > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        asyncHttp.handle();
+    }
+    Serial.clearOutput();
+    passes++;
+    host::advance(wait);
+}
+
+static void runUntil(unsigned long endMs) {
+    while ((long)(endMs - millis()) > 0) {
+        loopOnce();
+    }
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_a_week_without_hot_path_allocations() {
+    host::setFakeTime(true, 0);
+    SPIFFS.begin();
+    host::resetWiFi();
+    host::addAccessPoint("office", "hunter22", 6);
+    host::setHttpHandler([](const host::HttpRequest& request) {
+        (void)request;
+        host::HttpResponse response;
+        response.code = 200;
+        response.body = "{}";
+        return response;
+    });
+    Logger::setLogLevel(LOG_INFO);
+
+    // A provisioned device: credentials stored, loaded at boot as in main
+    wifiManager.begin();
+    configStore.begin(SPIFFS, CONFIG_FILE);  // Nothing stored yet
+    TEST_ASSERT_TRUE(configStore.setWiFi("office", "hunter22"));
+    TEST_ASSERT_TRUE(configStore.flush());
+    DeviceConfig config = configStore.get();
+    wifiManager.connect(config.ssid, config.password);
+    asyncHttp.begin();
+    telemetry.begin(asyncHttp, SPIFFS, URL);
+    jobs.begin();
+    webServer.setConfigStore(&configStore);
+    webServer.setJobQueue(&jobs);
+    webServer.begin();
+    webServer.onConfigUpdate([](const char* ssid, const char* password) {
+        configsApplied++;
+        wifiManager.connect(ssid, password, 1000);
+        webServer.invalidateStatus();
+    });
+    webServer.onGetStatus(buildStatus, statusFingerprint);
+
+    for (uint32_t i = 0; i < DASHBOARD_CLIENTS; i++) {
+        statusPolls[i].url = "/api/status";
+        statusPolls[i].remoteAddress = 0xC0A80101 + i;  // 192.168.1.1..
+    }
+    scrape.url = "/api/metrics";
+    scrape.remoteAddress = 0xC0A80164;  // 192.168.1.100
+    configSave.method = HTTP_POST;
+    configSave.url = "/api/config";
+    configSave.remoteAddress = 0xC0A80101;
+    configSave.postParams = {{"ssid", "office"}, {"password", "hunter22"}};
+
+    scheduler.every(LOOP_POLL_INTERVAL, handleNetwork);
+    scheduler.every(LOOP_POLL_INTERVAL, []() { asyncHttp.handle(); });
+    scheduler.every(LOOP_HOUSEKEEPING_INTERVAL, []() { webServer.handle(); });
+    scheduler.every(LOOP_HOUSEKEEPING_INTERVAL, []() { telemetry.handle(wifiManager.isConnected()); });
+    scheduler.every(LOOP_HOUSEKEEPING_INTERVAL, []() { configStore.handle(); });
+    scheduler.every(LOOP_HOUSEKEEPING_INTERVAL, []() { jobs.handle(); });
+    scheduler.every(SENSOR_SAMPLE_INTERVAL, forwardSample);
+    scheduler.every(DASHBOARD_INTERVAL, dashboardPoll);
+    scheduler.every(SCRAPE_INTERVAL, scrapeMetrics);
+    scheduler.every(HEAP_REPORT_INTERVAL, reportHeap);
+    // Both after the warm-up hour, so their first run is measured
+    scheduler.every(DAY_MS, dailyOutage, 2 * HOUR_MS);
+    scheduler.every(DAY_MS, dailyConfigSave, 14 * HOUR_MS);
+
+    // Warm-up: first connect, Serial's buffer, first uploads, first status
+    runUntil(HOUR_MS);
+    TEST_ASSERT_TRUE(wifiManager.isConnected());
+    reconnects = 0;
+    statusSent = 0;
+    statusNotModified = 0;
+    host::wifiAttempts.reserve(host::wifiAttempts.size() + 8 * DAYS);  // The shim's own log
+    uint32_t samplesBefore = telemetry.getSamplesSent();
+
+    printf("%-5s %10s %11s %8s %11s %8s %12s\n", "day", "loop runs", "samples up", "uploads", "reconnects",
+           "configs", "allocations");
+    host::AllocCount weekBefore = host::allocCount();
+    uint32_t uploadsBefore = telemetry.getRequestsSent();
+    for (int day = 1; day <= DAYS; day++) {
+        uint32_t dayPasses = passes;
+        uint32_t daySamples = telemetry.getSamplesSent();
+        uint32_t dayUploads = telemetry.getRequestsSent();
+        uint32_t dayReconnects = reconnects;
+        uint32_t dayConfigs = configsApplied;
+        host::AllocCount dayBefore = host::allocCount();
+
+        runUntil(HOUR_MS + day * DAY_MS);
+
+        host::AllocCount dayAfter = host::allocCount();
+        printf("%-5d %10u %11u %8u %11u %8u %12llu\n", day, passes - dayPasses,
+               telemetry.getSamplesSent() - daySamples, telemetry.getRequestsSent() - dayUploads,
+               reconnects - dayReconnects, configsApplied - dayConfigs,
+               (unsigned long long)(dayAfter.firmwareAllocations() - dayBefore.firmwareAllocations()));
+    }
+    host::AllocCount weekAfter = host::allocCount();
+    printf("/api/status: %u sent (%zu bytes), %u not modified; %zu bytes scraped; "
+           "web server library allocations: %llu\n",
+           statusSent, statusBytes, statusNotModified, scrapedBytes,
+           (unsigned long long)(weekAfter.libraryAllocations - weekBefore.libraryAllocations));
+
+    // The week's work was done
+    uint32_t samples = DAYS * DAY_MS / SENSOR_SAMPLE_INTERVAL;
+    TEST_ASSERT_UINT32_WITHIN(TELEMETRY_BATCH_SIZE, samples, telemetry.getSamplesSent() - samplesBefore);
+    TEST_ASSERT_GREATER_OR_EQUAL(samples / TELEMETRY_BATCH_SIZE, telemetry.getRequestsSent() - uploadsBefore);
+    TEST_ASSERT_EQUAL_UINT32(0, telemetry.getSamplesDropped());
+    // Once after the outage, once after each config save
+    TEST_ASSERT_EQUAL_UINT32(2 * DAYS, reconnects);
+    TEST_ASSERT_EQUAL_UINT32(DAYS, configsApplied);
+    TEST_ASSERT_TRUE(wifiManager.isConnected());
+    TEST_ASSERT_EQUAL_UINT32(DAYS * DAY_MS / DASHBOARD_INTERVAL * DASHBOARD_CLIENTS,
+                             statusSent + statusNotModified);
+    TEST_ASSERT_TRUE(statusNotModified > statusSent);
+
+    TEST_ASSERT_EQUAL_UINT32(0, (uint32_t)(weekAfter.firmwareAllocations() - weekBefore.firmwareAllocations()));
+    host::setFakeTime(false);
+}
+
+// The same status text built with String, as before, for comparison
+void test_string_status_allocates() {
+    host::AllocCount before = host::allocCount();
+    String status = String("{\"ssid\":\"") + WiFi.SSID() + "\",\"ip_address\":\"" + WiFi.localIP().toString() +
+                    "\",\"free_heap\":" + String(ESP.getFreeHeap()) + "}";
+    host::AllocCount after = host::allocCount();
+    printf("String status, %u bytes: %llu allocations\n", (unsigned)status.length(),
+           (unsigned long long)(after.allocations - before.allocations));
+    TEST_ASSERT_TRUE(after.allocations - before.allocations >= 1);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_a_week_without_hot_path_allocations);
+    RUN_TEST(test_string_status_allocates);
+    return UNITY_END();
+}
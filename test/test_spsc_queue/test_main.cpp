@@ -0,0 +1,254 @@
+// SpscQueue and the sensor task hand-off with std::thread producers and
+// consumers: values arrive whole, exactly once and in order, drops are
+// counted, and the hand-off throughput is compared with a mutex queue and
+// the log ring.
+
+#include <Arduino.h>
+#include <unity.h>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "log_ring.h"
+#include "sensor_task.h"
+#include "spsc_queue.h"
+
+static const uint32_t ITEMS = 2000000;
+
+struct Item {
+    uint32_t sequence;
+    uint32_t check;  // Derived from sequence, so a torn copy fails
+};
+
+static Item makeItem(uint32_t sequence) {
+    return Item{sequence, sequence * 2654435761u ^ 0x5bd1e995u};
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_spsc_no_lost_torn_or_reordered_items() {
+    static SpscQueue<Item, 64> queue;
+
+    uint32_t fullPushes = 0;
+    std::thread producer([&fullPushes] {
+        for (uint32_t sequence = 0; sequence < ITEMS; sequence++) {
+            // Retry on a full queue so every item must arrive
+            while (!queue.push(makeItem(sequence))) {
+                fullPushes++;
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    uint32_t next = 0;
+    int bad = 0;
+    while (next < ITEMS && bad == 0) {
+        Item item;
+        if (!queue.pop(item)) {
+            std::this_thread::yield();
+            continue;
+        }
+        Item expected = makeItem(next);
+        if (item.sequence != expected.sequence || item.check != expected.check) {
+            bad++;
+        }
+        next++;
+    }
+    producer.join();
+
+    TEST_ASSERT_EQUAL_INT(0, bad);
+    TEST_ASSERT_EQUAL_UINT32(ITEMS, next);
+    TEST_ASSERT_EQUAL_size_t(0, queue.size());
+    TEST_ASSERT_EQUAL_UINT32(fullPushes, queue.getDroppedCount());
+}
+
+void test_spsc_drops_and_counts_when_full() {
+    SpscQueue<Item, 4> queue;
+    for (uint32_t i = 0; i < 6; i++) {
+        TEST_ASSERT_EQUAL(i < 4, queue.push(makeItem(i)));
+    }
+    TEST_ASSERT_EQUAL_UINT32(2, queue.getDroppedCount());
+    TEST_ASSERT_EQUAL_size_t(4, queue.size());
+
+    // The oldest items are kept; popping one frees exactly one slot
+    Item item;
+    TEST_ASSERT_TRUE(queue.pop(item));
+    TEST_ASSERT_EQUAL_UINT32(0, item.sequence);
+    TEST_ASSERT_TRUE(queue.push(makeItem(6)));
+    TEST_ASSERT_FALSE(queue.push(makeItem(7)));
+    for (uint32_t expected : {1u, 2u, 3u, 6u}) {
+        TEST_ASSERT_TRUE(queue.pop(item));
+        TEST_ASSERT_EQUAL_UINT32(expected, item.sequence);
+    }
+    TEST_ASSERT_FALSE(queue.pop(item));
+}
+
+static const uint32_t READINGS = 50000;
+static std::atomic<uint32_t> readings{0};
+static std::atomic<bool> sensorDone{false};
+
+static bool countingSensor(float& temperature, float& humidity) {
+    uint32_t reading = readings++;
+    if (reading >= READINGS) {
+        // Park until the test stops the task
+        while (!sensorDone) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return false;
+    }
+    temperature = (float)reading;
+    humidity = 50.0f;
+    return true;
+}
+
+void test_sensor_task_hand_off_on_the_tick_grid() {
+    // On the simulated clock the sensor task samples as fast as it can;
+    // the loop side stalls now and then, so samples get dropped
+    host::setFakeTime(true, 0);
+    SensorTask sensors;
+    TEST_ASSERT_TRUE(sensors.begin(countingSensor));
+
+    std::vector<SensorTask::Sample> received;
+    SensorTask::Sample sample;
+    while (sensors.getSampleCount() < READINGS) {
+        if (sensors.read(sample)) {
+            received.push_back(sample);
+            if (received.size() % 500 == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    sensorDone = true;
+    host::stopTasks();
+    while (sensors.read(sample)) {
+        received.push_back(sample);
+    }
+    host::setFakeTime(false);
+
+    // Readings only skip where samples were dropped, and the timestamps
+    // stay on the SENSOR_SAMPLE_INTERVAL grid
+    int bad = 0;
+    for (size_t i = 1; i < received.size(); i++) {
+        uint32_t skipped = (uint32_t)received[i].temperature - (uint32_t)received[i - 1].temperature;
+        if (skipped == 0 || skipped > READINGS ||
+            received[i].timestamp - received[i - 1].timestamp != skipped * SENSOR_SAMPLE_INTERVAL) {
+            bad++;
+        }
+    }
+    TEST_ASSERT_EQUAL_INT(0, bad);
+    TEST_ASSERT_GREATER_THAN(0, (int)received.size());
+    TEST_ASSERT_GREATER_THAN(0, (int)sensors.getDroppedCount());
+    TEST_ASSERT_EQUAL_UINT32(READINGS, received.size() + sensors.getDroppedCount());
+    printf("sensor hand-off: %u samples, %zu received, %u dropped\n",
+           (unsigned)READINGS, received.size(), (unsigned)sensors.getDroppedCount());
+}
+
+// What the SPSC queue replaces: a locked deque between the two tasks
+template <typename T, size_t Capacity>
+class MutexQueue {
+public:
+    bool push(const T& value) {
+        std::lock_guard<std::mutex> guard(_lock);
+        if (_items.size() == Capacity) {
+            return false;
+        }
+        _items.push_back(value);
+        return true;
+    }
+
+    bool pop(T& value) {
+        std::lock_guard<std::mutex> guard(_lock);
+        if (_items.empty()) {
+            return false;
+        }
+        value = _items.front();
+        _items.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex _lock;
+    std::deque<T> _items;
+};
+
+template <typename Queue>
+static double handOffRate(Queue& queue) {
+    auto start = std::chrono::steady_clock::now();
+    std::thread producer([&queue] {
+        for (uint32_t sequence = 0; sequence < ITEMS; sequence++) {
+            while (!queue.push(makeItem(sequence))) {
+                std::this_thread::yield();
+            }
+        }
+    });
+    uint32_t next = 0;
+    while (next < ITEMS) {
+        Item item;
+        if (queue.pop(item)) {
+            TEST_ASSERT_EQUAL_UINT32(next, item.sequence);
+            next++;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    return ITEMS / secondsSince(start);
+}
+
+void test_hand_off_throughput() {
+    static SpscQueue<Item, 64> spsc;
+    static MutexQueue<Item, 64> locked;
+    double spscRate = handOffRate(spsc);
+    double lockedRate = handOffRate(locked);
+
+    // Log ring: one producer and the drain, whole lines per hand-off
+    LogRing ring;
+    TEST_ASSERT_TRUE(ring.begin(LOG_RING_SLOTS));
+    const uint32_t lines = ITEMS / 4;
+    auto start = std::chrono::steady_clock::now();
+    std::thread producer([&ring, lines] {
+        for (uint32_t sequence = 0; sequence < lines; sequence++) {
+            uint32_t ticket;
+            char* slot;
+            while ((slot = ring.claim(ticket)) == nullptr) {
+                std::this_thread::yield();
+            }
+            ring.publish(ticket, snprintf(slot, LOG_LINE_MAX, "[%u] [INFO ] line %u", sequence, sequence));
+        }
+    });
+    uint32_t drained = 0;
+    while (drained < lines) {
+        size_t length;
+        if (ring.peek(length) != nullptr) {
+            ring.release();
+            drained++;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    double ringRate = lines / secondsSince(start);
+
+    printf("hand-off, 1 producer / 1 consumer: SpscQueue %.1f M/s, mutex deque %.1f M/s, "
+           "LogRing %.1f M lines/s\n", spscRate / 1e6, lockedRate / 1e6, ringRate / 1e6);
+    TEST_ASSERT_EQUAL_UINT32(lines, drained);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_spsc_no_lost_torn_or_reordered_items);
+    RUN_TEST(test_spsc_drops_and_counts_when_full);
+    RUN_TEST(test_sensor_task_hand_off_on_the_tick_grid);
+    RUN_TEST(test_hand_off_throughput);
+    return UNITY_END();
+}
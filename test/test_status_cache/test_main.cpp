@@ -0,0 +1,244 @@
+// StatusCache: a pinned snapshot stays byte-identical while rebuilds go on
+// around it, and fingerprint changes show up on the next read. Also
+// /api/status served three ways, with requests per second and allocations
+// per request: the String built per request as before, the cached snapshot
+// through WebServerManager, and a 304 to a client that has it.
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <SPIFFS.h>
+#include <alloc_counter.h>
+#include <unity.h>
+#include <chrono>
+#include "status_cache.h"
+#include "web_server.h"
+
+static int generation = 0;
+static uint32_t fingerprint = 0;
+
+static void buildStatus(JsonDocument& doc) {
+    doc["generation"] = generation;
+    doc["padding"] = "abcdefghijklmnopqrstuvwxyz";
+}
+
+static std::string bodyOf(const StatusCache::Snapshot* snapshot) {
+    return std::string(snapshot->body, snapshot->length);
+}
+
+void setUp() {
+    generation = 0;
+    fingerprint = 0;
+    host::setFakeTime(true, 1000);
+}
+
+void tearDown() {
+    host::setFakeTime(false);
+}
+
+void test_unchanged_reads_share_a_snapshot() {
+    StatusCache cache;
+    cache.begin(buildStatus, []() { return fingerprint; });
+
+    const StatusCache::Snapshot* first = cache.acquire();
+    cache.release(first);
+    generation++;
+    const StatusCache::Snapshot* second = cache.acquire();
+    cache.release(second);
+
+    TEST_ASSERT_EQUAL_UINT32(1, cache.getRebuildCount());
+    TEST_ASSERT_EQUAL_STRING(first->etag, second->etag);
+}
+
+void test_fingerprint_change_rebuilds_at_once() {
+    StatusCache cache;
+    cache.begin(buildStatus, []() { return fingerprint; });
+
+    const StatusCache::Snapshot* before = cache.acquire();
+    std::string etag = before->etag;
+    cache.release(before);
+
+    generation++;
+    fingerprint = 42;
+    const StatusCache::Snapshot* after = cache.acquire();
+    TEST_ASSERT_TRUE(strcmp(etag.c_str(), after->etag) != 0);
+    TEST_ASSERT_TRUE(bodyOf(after).find("\"generation\":1") != std::string::npos);
+    cache.release(after);
+}
+
+void test_pinned_snapshot_survives_rebuilds() {
+    StatusCache cache;
+    cache.begin(buildStatus, []() { return fingerprint; });
+
+    // A slow client still sending the first snapshot
+    const StatusCache::Snapshot* slow = cache.acquire();
+    std::string body = bodyOf(slow);
+    std::string etag = slow->etag;
+
+    for (int i = 0; i < 20; i++) {
+        generation++;
+        cache.invalidate();
+        const StatusCache::Snapshot* other = cache.acquire();
+        TEST_ASSERT_TRUE(other != slow);
+        cache.release(other);
+    }
+
+    TEST_ASSERT_EQUAL_STRING(body.c_str(), bodyOf(slow).c_str());
+    TEST_ASSERT_EQUAL_STRING(etag.c_str(), slow->etag);
+    cache.release(slow);
+}
+
+void test_all_pinned_keeps_serving_current() {
+    StatusCache cache;
+    cache.begin(buildStatus, []() { return fingerprint; });
+
+    const StatusCache::Snapshot* pinned[STATUS_SNAPSHOTS];
+    for (int i = 0; i < STATUS_SNAPSHOTS; i++) {
+        generation++;
+        cache.invalidate();
+        pinned[i] = cache.acquire();
+    }
+    std::string bodies[STATUS_SNAPSHOTS];
+    for (int i = 0; i < STATUS_SNAPSHOTS; i++) {
+        bodies[i] = bodyOf(pinned[i]);
+    }
+
+    // No free buffer: the current snapshot is served again, untouched
+    generation++;
+    cache.invalidate();
+    const StatusCache::Snapshot* current = cache.acquire();
+    TEST_ASSERT_TRUE(current == pinned[STATUS_SNAPSHOTS - 1]);
+    cache.release(current);
+    for (int i = 0; i < STATUS_SNAPSHOTS; i++) {
+        TEST_ASSERT_EQUAL_STRING(bodies[i].c_str(), bodyOf(pinned[i]).c_str());
+    }
+
+    // Once one is released the pending rebuild goes through
+    cache.release(pinned[0]);
+    current = cache.acquire();
+    TEST_ASSERT_TRUE(current == pinned[0]);
+    TEST_ASSERT_TRUE(bodyOf(current).find("\"generation\":" + std::to_string(generation)) != std::string::npos);
+    cache.release(current);
+    for (int i = 1; i < STATUS_SNAPSHOTS; i++) {
+        cache.release(pinned[i]);
+    }
+}
+
+void test_unstarted_cache_answers_empty_object() {
+    StatusCache cache;
+    const StatusCache::Snapshot* snapshot = cache.acquire();
+    TEST_ASSERT_EQUAL_STRING("{}", bodyOf(snapshot).c_str());
+    cache.release(snapshot);
+}
+
+// The fields of main's buildStatus(), with fixed values
+static void buildDeviceStatus(JsonDocument& doc) {
+    doc["device_name"] = "ESP32-Device";
+    doc["firmware_version"] = "1.0.0";
+    doc["uptime"] = millis();
+    doc["wifi_connected"] = true;
+    doc["ssid"] = "office";
+    doc["ip_address"] = "192.168.1.2";
+    doc["signal_strength"] = -61;
+    doc["wifi_connect_time"] = 412;
+    doc["free_heap"] = ESP.getFreeHeap();
+    doc["chip_model"] = ESP.getChipModel();
+    doc["chip_cores"] = ESP.getChipCores();
+    doc["sdk_version"] = ESP.getSdkVersion();
+}
+
+// /api/status before the cache: a String per request
+static String getStatusJSON() {
+    StaticJsonDocument<512> doc;
+    buildDeviceStatus(doc);
+    String output;
+    serializeJson(doc, output);
+    return output;
+}
+
+struct Served {
+    double perSecond;
+    double allocations;  // Per request, the stand-in's request and response included
+    host::WebResponse last;
+};
+
+static const int STATUS_REQUESTS = 20000;
+
+static Served serveStatus(AsyncWebServer* server, const std::string& etag) {
+    host::webServer = server;
+    host::WebRequest request;
+    request.url = "/api/status";
+    if (!etag.empty()) {
+        request.headers.push_back({"If-None-Match", etag});
+    }
+
+    Served served;
+    served.last = host::webRequest(request);  // Warm-up
+    host::AllocCount before = host::allocCount();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < STATUS_REQUESTS; i++) {
+        // A client of its own each time, so the rate limit never applies
+        request.remoteAddress = 0x0A000000u + 2 + i;
+        host::webRequest(request);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    host::AllocCount after = host::allocCount();
+    served.perSecond = STATUS_REQUESTS / seconds;
+    served.allocations = (double)(after.allocations - before.allocations) / STATUS_REQUESTS;
+    return served;
+}
+
+void test_status_served_three_ways() {
+    SPIFFS.begin();
+    WebServerManager* manager = new WebServerManager();
+    static uint32_t builds = 0;
+    manager->onGetStatus(
+        [](JsonDocument& doc) {
+            builds++;
+            buildDeviceStatus(doc);
+        },
+        []() { return fingerprint; });
+    manager->begin();
+    AsyncWebServer* managed = host::webServer;
+
+    // The handler as it was, on a server of its own (no admission checks)
+    AsyncWebServer legacy(80);
+    legacy.on("/api/status", HTTP_GET, [](AsyncWebServerRequest* request) {
+        String status = getStatusJSON();
+        request->send(200, "application/json", status);
+    });
+
+    // The clock stands still, so the snapshot is never refreshed
+    Served string = serveStatus(&legacy, "");
+    Served cached = serveStatus(managed, "");
+    Served notModified = serveStatus(managed, cached.last.header("ETag"));
+    host::webServer = managed;
+
+    printf("%-28s %6s %10s %12s %10s\n", "/api/status", "code", "req/s", "allocs/req", "wire bytes");
+    printf("%-28s %6d %10.0f %12.1f %10zu\n", "String per request (before)", string.last.code, string.perSecond,
+           string.allocations, string.last.wireBytes);
+    printf("%-28s %6d %10.0f %12.1f %10zu\n", "cached snapshot", cached.last.code, cached.perSecond,
+           cached.allocations, cached.last.wireBytes);
+    printf("%-28s %6d %10.0f %12.1f %10zu\n", "cached, If-None-Match", notModified.last.code,
+           notModified.perSecond, notModified.allocations, notModified.last.wireBytes);
+
+    TEST_ASSERT_EQUAL(200, string.last.code);
+    TEST_ASSERT_EQUAL(200, cached.last.code);
+    TEST_ASSERT_EQUAL(304, notModified.last.code);
+    TEST_ASSERT_EQUAL_STRING(string.last.body.c_str(), cached.last.body.c_str());
+    TEST_ASSERT_EQUAL_size_t(0, notModified.last.body.size());
+    TEST_ASSERT_EQUAL_UINT32(1, builds);
+    // The String and its copy into the response are gone
+    TEST_ASSERT_TRUE(cached.allocations + 2 <= string.allocations);
+    TEST_ASSERT_TRUE(notModified.allocations <= cached.allocations);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_unchanged_reads_share_a_snapshot);
+    RUN_TEST(test_fingerprint_change_rebuilds_at_once);
+    RUN_TEST(test_pinned_snapshot_survives_rebuilds);
+    RUN_TEST(test_all_pinned_keeps_serving_current);
+    RUN_TEST(test_unstarted_cache_answers_empty_object);
+    RUN_TEST(test_status_served_three_ways);
+    return UNITY_END();
+}
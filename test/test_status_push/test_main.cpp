@@ -0,0 +1,284 @@
+// Status push over /api/events against polling /api/status, on the
+// simulated clock: ten dashboards for ten minutes either polling every
+// 10 s (revalidating with If-None-Match, as the browser does) or
+// subscribed to Server-Sent Events. Requests, bytes the device sends and
+// how late a status change reaches a dashboard are compared. Also a
+// subscriber that stops reading while the others keep up, and subscribers
+// coming and going.
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <SPIFFS.h>
+#include <unity.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "web_server.h"
+
+static const uint32_t DASHBOARDS = 10;
+static const unsigned long POLL_INTERVAL = 10000;   // data/index.html without EventSource
+static const unsigned long CHANGE_INTERVAL = 60000; // WiFi, IP or OTA progress changing
+static const unsigned long CHANGE_OFFSET = 3700;    // Off the poll and push grid
+static const unsigned long RUN_MS = 600000;
+
+static WebServerManager* server;
+static uint32_t state;               // Fields that show up at once (the fingerprint)
+static unsigned long stateChangedAt;
+
+struct Traffic {
+    uint32_t requests = 0;
+    size_t bytes = 0;          // Sent by the device
+    uint32_t updates = 0;      // New snapshots a dashboard received
+    double lateMsTotal = 0;    // From a state change until a dashboard had it
+    uint32_t lateCount = 0;
+
+    double lateMs() const { return lateCount ? lateMsTotal / lateCount : 0; }
+};
+
+static uint32_t ip(int n) {
+    return 0xC0A80100u + 10 + n;  // 192.168.1.(10 + n)
+}
+
+// The "state" field of a snapshot
+static uint32_t stateOf(const std::string& body) {
+    size_t at = body.find("\"state\":");
+    TEST_ASSERT_TRUE(at != std::string::npos);
+    return strtoul(body.c_str() + at + strlen("\"state\":"), nullptr, 10);
+}
+
+static void changeStateWhenDue(unsigned long start) {
+    unsigned long elapsed = millis() - start;
+    if (elapsed >= CHANGE_OFFSET && (elapsed - CHANGE_OFFSET) % CHANGE_INTERVAL == 0) {
+        state++;
+        stateChangedAt = millis();
+    }
+}
+
+static void noteUpdate(Traffic& traffic, uint32_t& seenState, const std::string& body) {
+    traffic.updates++;
+    uint32_t now = stateOf(body);
+    if (now != seenState) {
+        seenState = now;
+        traffic.lateMsTotal += millis() - stateChangedAt;
+        traffic.lateCount++;
+    }
+}
+
+static AsyncEventSourceClient* subscribe(uint32_t remote) {
+    host::WebRequest request;
+    request.url = "/api/events";
+    request.remoteAddress = remote;
+    host::webRequest(request);
+    return host::lastEventClient;
+}
+
+// Reads what arrived since the last call and acknowledges it
+static void drain(AsyncEventSourceClient* client, size_t& read, Traffic& traffic, uint32_t& seenState) {
+    const std::vector<AsyncEventSourceClient::Message>& messages = client->messages();
+    for (; read < messages.size(); read++) {
+        traffic.bytes += messages[read].wireBytes();
+        noteUpdate(traffic, seenState, messages[read].data);
+    }
+    client->deliver();
+}
+
+void setUp() {
+    host::advance(10000);
+    state = 0;
+    stateChangedAt = millis();
+}
+
+void tearDown() {
+}
+
+static Traffic poll() {
+    Traffic traffic;
+    std::vector<std::string> etags(DASHBOARDS);
+    std::vector<uint32_t> seen(DASHBOARDS, state);
+    unsigned long start = millis();
+    while (millis() - start < RUN_MS) {
+        changeStateWhenDue(start);
+        unsigned long elapsed = millis() - start;
+        for (uint32_t i = 0; i < DASHBOARDS; i++) {
+            if (elapsed % POLL_INTERVAL != POLL_INTERVAL * i / DASHBOARDS) {
+                continue;
+            }
+            host::WebRequest request;
+            request.url = "/api/status";
+            request.remoteAddress = ip(i);
+            if (!etags[i].empty()) {
+                request.headers.push_back({"If-None-Match", etags[i]});
+            }
+            host::WebResponse response = host::webRequest(request);
+            traffic.requests++;
+            traffic.bytes += response.wireBytes;
+            if (response.code == 200) {
+                etags[i] = response.header("ETag");
+                noteUpdate(traffic, seen[i], response.body);
+            } else {
+                TEST_ASSERT_EQUAL(304, response.code);
+            }
+        }
+        host::advance(1);
+    }
+    return traffic;
+}
+
+static Traffic push() {
+    Traffic traffic;
+    std::vector<AsyncEventSourceClient*> clients;
+    std::vector<size_t> read(DASHBOARDS, 0);
+    std::vector<uint32_t> seen(DASHBOARDS, state);
+    for (uint32_t i = 0; i < DASHBOARDS; i++) {
+        clients.push_back(subscribe(ip(i)));
+        TEST_ASSERT_NOT_NULL(clients.back());
+        traffic.requests++;
+        traffic.bytes += AsyncEventSource::headBytes();
+    }
+
+    unsigned long start = millis();
+    while (millis() - start < RUN_MS) {
+        changeStateWhenDue(start);
+        if ((millis() - start) % LOOP_HOUSEKEEPING_INTERVAL == 0) {
+            server->handle();
+            for (uint32_t i = 0; i < DASHBOARDS; i++) {
+                drain(clients[i], read[i], traffic, seen[i]);
+            }
+        }
+        host::advance(1);
+    }
+
+    for (AsyncEventSourceClient* client : clients) {
+        client->close();
+    }
+    return traffic;
+}
+
+void test_push_against_polling_for_ten_dashboards() {
+    Traffic polled = poll();
+    Traffic pushed = push();
+
+    printf("%-22s %9s %12s %9s %15s\n", "10 dashboards, 10 min", "requests", "bytes sent", "updates",
+           "change seen in");
+    printf("%-22s %9u %12zu %9u %12.0f ms\n", "polling every 10 s", polled.requests, polled.bytes, polled.updates,
+           polled.lateMs());
+    printf("%-22s %9u %12zu %9u %12.0f ms\n", "/api/events", pushed.requests, pushed.bytes, pushed.updates,
+           pushed.lateMs());
+
+    TEST_ASSERT_EQUAL_UINT32(DASHBOARDS * RUN_MS / POLL_INTERVAL, polled.requests);
+    TEST_ASSERT_EQUAL_UINT32(DASHBOARDS, pushed.requests);
+    // Every change reaches every dashboard either way
+    TEST_ASSERT_EQUAL_UINT32(DASHBOARDS * (RUN_MS / CHANGE_INTERVAL), polled.lateCount);
+    TEST_ASSERT_EQUAL_UINT32(polled.lateCount, pushed.lateCount);
+    TEST_ASSERT_TRUE(pushed.bytes * 2 < polled.bytes);
+    // Within a push check, instead of half a poll interval on average
+    TEST_ASSERT_TRUE(pushed.lateMs() <= STATUS_PUSH_INTERVAL);
+    TEST_ASSERT_TRUE(polled.lateMs() > POLL_INTERVAL / 4);
+}
+
+void test_slow_subscriber_does_not_hold_up_the_rest() {
+    Traffic fast;
+    Traffic slow;
+    std::vector<AsyncEventSourceClient*> clients;
+    std::vector<size_t> read(DASHBOARDS, 0);
+    std::vector<uint32_t> seen(DASHBOARDS, state);
+    for (uint32_t i = 0; i < DASHBOARDS; i++) {
+        clients.push_back(subscribe(ip(i)));
+    }
+    AsyncEventSourceClient* stalled = clients[0];
+
+    unsigned long start = millis();
+    size_t mostWaiting = 0;
+    while (millis() - start < RUN_MS) {
+        changeStateWhenDue(start);
+        if ((millis() - start) % LOOP_HOUSEKEEPING_INTERVAL == 0) {
+            server->handle();
+            // The first client's reads stall: nothing of it is acknowledged
+            mostWaiting = std::max(mostWaiting, stalled->packetsWaiting());
+            for (uint32_t i = 1; i < DASHBOARDS; i++) {
+                drain(clients[i], read[i], fast, seen[i]);
+            }
+        }
+        host::advance(1);
+    }
+    printf("stalled subscriber: %zu events queued at most, %zu sent; the other %u got %u changes each\n",
+           mostWaiting, stalled->messages().size(), DASHBOARDS - 1, fast.lateCount / (DASHBOARDS - 1));
+
+    TEST_ASSERT_EQUAL_size_t(STATUS_PUSH_MAX_QUEUED, mostWaiting);
+    TEST_ASSERT_EQUAL_UINT32((DASHBOARDS - 1) * (RUN_MS / CHANGE_INTERVAL), fast.lateCount);
+    TEST_ASSERT_TRUE(fast.lateMs() <= STATUS_PUSH_INTERVAL);
+
+    // Once it catches up it is sent what is current, and nothing between
+    drain(stalled, read[0], slow, seen[0]);
+    host::advance(STATUS_PUSH_INTERVAL);
+    server->handle();
+    TEST_ASSERT_EQUAL_size_t(1, stalled->packetsWaiting());
+    TEST_ASSERT_EQUAL_UINT32(state, stateOf(stalled->messages().back().data));
+
+    for (AsyncEventSourceClient* client : clients) {
+        client->close();
+    }
+}
+
+void test_subscribers_coming_and_going() {
+    std::vector<AsyncEventSourceClient*> clients;
+    for (uint32_t i = 0; i < DASHBOARDS; i++) {
+        clients.push_back(subscribe(ip(i)));
+        TEST_ASSERT_EQUAL_size_t(1, clients.back()->messages().size());
+    }
+
+    // One too many: closed, and gone with its connection
+    TEST_ASSERT_NULL(subscribe(ip(DASHBOARDS)));
+
+    // Three leave; what is left still gets changes
+    for (uint32_t i = 0; i < 3; i++) {
+        clients[i]->client()->close();
+    }
+    state++;
+    host::advance(STATUS_PUSH_INTERVAL);
+    server->handle();
+    for (uint32_t i = 3; i < DASHBOARDS; i++) {
+        TEST_ASSERT_EQUAL_size_t(2, clients[i]->messages().size());
+        TEST_ASSERT_EQUAL_UINT32(state, stateOf(clients[i]->messages().back().data));
+    }
+
+    // Their slots are free again
+    for (uint32_t i = 0; i < 3; i++) {
+        clients[i] = subscribe(ip(DASHBOARDS + i));
+        TEST_ASSERT_NOT_NULL(clients[i]);
+        TEST_ASSERT_EQUAL_UINT32(state, stateOf(clients[i]->messages().back().data));
+    }
+    TEST_ASSERT_NULL(subscribe(ip(2 * DASHBOARDS)));
+
+    for (AsyncEventSourceClient* client : clients) {
+        client->close();
+    }
+    state++;
+    host::advance(STATUS_PUSH_INTERVAL);
+    server->handle();
+}
+
+int main() {
+    host::setFakeTime(true, 0);
+    SPIFFS.begin();
+    server = new WebServerManager();
+    server->onGetStatus(
+        [](JsonDocument& doc) {
+            doc["device_name"] = "ESP32-Device";
+            doc["uptime"] = millis();
+            doc["wifi_connected"] = true;
+            doc["ip_address"] = "192.168.1.2";
+            doc["free_heap"] = ESP.getFreeHeap();
+            doc["state"] = state;
+        },
+        []() { return state; });
+    server->begin();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_push_against_polling_for_ten_dashboards);
+    RUN_TEST(test_slow_subscriber_does_not_hold_up_the_rest);
+    RUN_TEST(test_subscribers_coming_and_going);
+    int result = UNITY_END();
+    host::setFakeTime(false);
+    return result;
+}
@@ -0,0 +1,206 @@
+// TelemetryQueue uplink: batches reach the fake server, and a failing
+// server sees retries spaced out exponentially up to the cap, back to
+// normal after the first success. Also requests and bytes on the wire for
+// the same samples batched and posted one by one.
+
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <HTTPClient.h>
+#include <unity.h>
+#include "telemetry_queue.h"
+
+static const char* URL = "http://telemetry.test/api/data";
+
+static HTTPClientManager http;
+static AsyncHTTPClient asyncHttp(http);
+
+static bool serverUp = true;
+static std::vector<unsigned long> postTimes;
+
+// Head of the fake server's answer
+static const char* RESPONSE_HEAD = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: 2\r\n\r\n";
+
+static host::HttpResponse serve(const host::HttpRequest& request) {
+    postTimes.push_back(millis());
+    host::HttpResponse response;
+    response.code = serverUp ? 200 : 503;
+    response.body = serverUp ? "{}" : "{\"error\":\"unavailable\"}";
+    return response;
+}
+
+// One main-loop pass: queue work, wait for the worker, deliver callbacks
+static void pass(TelemetryQueue& telemetry) {
+    telemetry.handle(true);
+    while (asyncHttp.pending() > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        asyncHttp.handle();
+    }
+}
+
+static void fillBatch(TelemetryQueue& telemetry) {
+    for (int i = 0; i < TELEMETRY_BATCH_SIZE; i++) {
+        telemetry.add(20.0f + i, 50.0f);
+    }
+}
+
+void setUp() {
+    SPIFFS.reset();
+    serverUp = true;
+    postTimes.clear();
+    host::setHttpHandler(serve);
+}
+
+void tearDown() {
+}
+
+void test_full_batch_is_uploaded_once() {
+    TelemetryQueue telemetry;
+    telemetry.begin(asyncHttp, SPIFFS, URL);
+    fillBatch(telemetry);
+
+    for (int i = 0; i < 20; i++) {
+        pass(telemetry);
+        delay(100);
+    }
+
+    std::vector<host::HttpRequest> log = host::httpLog();
+    TEST_ASSERT_EQUAL_size_t(1, log.size());
+    TEST_ASSERT_EQUAL_STRING("POST", log[0].method.c_str());
+    TEST_ASSERT_TRUE(log[0].payload.find("\"temperature\":[20.00,21.00") != std::string::npos);
+    TEST_ASSERT_EQUAL_UINT32(TELEMETRY_BATCH_SIZE, telemetry.getSamplesSent());
+}
+
+void test_failures_back_off_exponentially_up_to_the_cap() {
+    TelemetryQueue telemetry;
+    telemetry.begin(asyncHttp, SPIFFS, URL);
+    fillBatch(telemetry);
+    serverUp = false;
+
+    // The loop passes every 100 ms, like the network task
+    unsigned long end = millis() + 30 * 60000UL;
+    while (millis() < end) {
+        pass(telemetry);
+        delay(100);
+    }
+
+    TEST_ASSERT_GREATER_THAN(8, (int)postTimes.size());
+    unsigned long expected = TELEMETRY_RETRY_INTERVAL;
+    for (size_t i = 1; i < postTimes.size(); i++) {
+        unsigned long gap = postTimes[i] - postTimes[i - 1];
+        // Retries start on the first pass after the wait
+        TEST_ASSERT_GREATER_OR_EQUAL_UINT32(expected, gap);
+        TEST_ASSERT_LESS_OR_EQUAL_UINT32(expected + 200, gap);
+        expected = std::min<unsigned long>(expected * 2, TELEMETRY_RETRY_MAX);
+    }
+    TEST_ASSERT_EQUAL_UINT32(TELEMETRY_RETRY_MAX, expected);
+    TEST_ASSERT_EQUAL_UINT32(postTimes.size(), telemetry.getUploadsFailed());
+    TEST_ASSERT_EQUAL_UINT32(0, telemetry.getSamplesSent());
+
+    printf("30 min of failures: %u uploads (without backoff: ~18000)\n", (unsigned)postTimes.size());
+}
+
+void test_success_resets_the_backoff() {
+    TelemetryQueue telemetry;
+    telemetry.begin(asyncHttp, SPIFFS, URL);
+    fillBatch(telemetry);
+    serverUp = false;
+
+    // Four failures: the next wait would be 16 x the interval
+    while (postTimes.size() < 4) {
+        pass(telemetry);
+        delay(100);
+    }
+    serverUp = true;
+    unsigned long until = millis() + 16 * TELEMETRY_RETRY_INTERVAL;
+    while (millis() < until) {
+        pass(telemetry);
+        delay(100);
+    }
+    TEST_ASSERT_EQUAL_UINT32(TELEMETRY_BATCH_SIZE, telemetry.getSamplesSent());
+
+    // The next failure waits the base interval again
+    fillBatch(telemetry);
+    serverUp = false;
+    size_t before = postTimes.size();
+    while (postTimes.size() < before + 2) {
+        pass(telemetry);
+        delay(100);
+    }
+    unsigned long gap = postTimes[before + 1] - postTimes[before];
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(TELEMETRY_RETRY_INTERVAL, gap);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(TELEMETRY_RETRY_INTERVAL + 200, gap);
+}
+
+struct Uplink {
+    uint32_t requests = 0;
+    uint32_t connects = 0;
+    size_t payloadBytes = 0;
+    size_t sentBytes = 0;      // Request heads and payloads
+    size_t receivedBytes = 0;  // Responses
+};
+
+// What reached the server since the handler was set
+static Uplink uplink() {
+    Uplink result;
+    for (const host::HttpRequest& request : host::httpLog()) {
+        result.requests++;
+        result.payloadBytes += request.payload.size();
+        result.sentBytes += request.wireBytes;
+        result.receivedBytes += strlen(RESPONSE_HEAD) + strlen("{}");
+    }
+    result.connects = host::tcpConnects;
+    return result;
+}
+
+void test_batched_against_per_sample_posts() {
+    const int samples = 10 * TELEMETRY_BATCH_SIZE;
+
+    TelemetryQueue telemetry;
+    telemetry.begin(asyncHttp, SPIFFS, URL);
+    for (int i = 0; i < samples; i++) {
+        telemetry.add(22.5f + i % 7 * 0.01f, 55.0f - i % 5 * 0.1f);
+        pass(telemetry);
+        delay(SENSOR_SAMPLE_INTERVAL);
+    }
+    Uplink batched = uplink();
+
+    // The same samples through the single-sample POST
+    host::setHttpHandler(serve);
+    for (int i = 0; i < samples; i++) {
+        TEST_ASSERT_TRUE(http.sendSensorData(URL, 22.5f + i % 7 * 0.01f, 55.0f - i % 5 * 0.1f));
+        delay(SENSOR_SAMPLE_INTERVAL);
+    }
+    Uplink single = uplink();
+
+    printf("%-22s %9s %9s %9s %11s %9s %9s\n", "samples", "requests", "connects", "payload", "sent", "received",
+           "total");
+    printf("%-3d batched by %-8d %9u %9u %9zu %11zu %9zu %9zu\n", samples, TELEMETRY_BATCH_SIZE, batched.requests,
+           batched.connects, batched.payloadBytes, batched.sentBytes, batched.receivedBytes,
+           batched.sentBytes + batched.receivedBytes);
+    printf("%-3d one per POST     %9u %9u %9zu %11zu %9zu %9zu\n", samples, single.requests, single.connects,
+           single.payloadBytes, single.sentBytes, single.receivedBytes, single.sentBytes + single.receivedBytes);
+
+    TEST_ASSERT_EQUAL_UINT32(samples / TELEMETRY_BATCH_SIZE, batched.requests);
+    TEST_ASSERT_EQUAL_UINT32(samples, single.requests);
+    TEST_ASSERT_EQUAL_UINT32(samples, telemetry.getSamplesSent());
+    TEST_ASSERT_EQUAL_UINT32(batched.requests, telemetry.getRequestsSent());
+    TEST_ASSERT_EQUAL_UINT32(batched.payloadBytes, telemetry.getBytesSent());
+    // Both keep the connection from earlier tests alive
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(1, batched.connects);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(1, single.connects);
+    // Fewer payload bytes, and nine request heads and responses saved per batch
+    TEST_ASSERT_TRUE(batched.payloadBytes * 2 < single.payloadBytes);
+    TEST_ASSERT_TRUE((batched.sentBytes + batched.receivedBytes) * 4 < single.sentBytes + single.receivedBytes);
+}
+
+int main() {
+    host::setFakeTime(true, 1000);
+    asyncHttp.begin();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_full_batch_is_uploaded_once);
+    RUN_TEST(test_failures_back_off_exponentially_up_to_the_cap);
+    RUN_TEST(test_success_resets_the_backoff);
+    RUN_TEST(test_batched_against_per_sample_posts);
+    return UNITY_END();
+}
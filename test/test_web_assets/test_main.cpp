@@ -0,0 +1,202 @@
+// Web UI delivery: the dashboard as it used to be served (plain index.html
+// from SPIFFS) against the minified, gzipped asset with ETag and
+// Cache-Control, and SPIFFS against assets embedded in the firmware. Time
+// to first byte and bytes on the wire are measured on the simulated clock,
+// with SPIFFS access costs and a slow WiFi link.
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <Preferences.h>
+#include <SPIFFS.h>
+#include <unity.h>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include "config_store.h"
+#include "web_assets.h"
+#include "web_server.h"
+
+// SPIFFS on SPI flash: a path lookup scans object index pages, reads run
+// at about 1 MB/s
+static const unsigned long FLASH_LOOKUP_US = 3000;
+static const unsigned long FLASH_READ_US_PER_KB = 1000;
+// Effective throughput of a busy 2.4 GHz link, 1 Mbit/s
+static const double LINK_BYTES_PER_US = 0.125;
+
+static WebServerManager* server;
+static ConfigStore configStore;
+
+struct Delivery {
+    double ttfbMs;
+    double totalMs;
+    size_t wireBytes;
+};
+
+static Delivery delivery(const host::WebResponse& response) {
+    size_t firstSegment = std::min(response.wireBytes, host::WEB_SEGMENT_SIZE);
+    return Delivery{(response.firstByteMicros + firstSegment / LINK_BYTES_PER_US) / 1000.0,
+                    (response.doneMicros + response.wireBytes / LINK_BYTES_PER_US) / 1000.0,
+                    response.wireBytes};
+}
+
+static std::string readProjectFile(const char* path) {
+    std::string root = __FILE__;
+    root = root.substr(0, root.rfind("test/test_web_assets/"));
+    std::ifstream file(root + path, std::ios::binary);
+    std::stringstream content;
+    content << file.rdbuf();
+    return content.str();
+}
+
+static host::WebResponse get(const std::string& url, const std::string& ifNoneMatch = "") {
+    // Stay clear of the per-client rate limit
+    host::advance(1000);
+    std::vector<std::pair<std::string, std::string>> headers;
+    if (!ifNoneMatch.empty()) {
+        headers.push_back({"If-None-Match", ifNoneMatch});
+    }
+    return host::webGet(url, headers);
+}
+
+static std::string embeddedIndex() {
+    const WebAsset* asset = findWebAsset("/index.html");
+    TEST_ASSERT_NOT_NULL(asset);
+    return std::string((const char*)asset->data, asset->length);
+}
+
+void setUp() {
+    host::setFakeTime(true, 0);
+    SPIFFS.reset();
+    // What the old serveStatic() route sent, and the build_web.py output
+    // as uploaded to SPIFFS; /spiffs/ is not embedded, so it comes from flash
+    SPIFFS.put("/old/index.html", readProjectFile("data/index.html"));
+    SPIFFS.put("/spiffs/index.html.gz", embeddedIndex());
+    SPIFFS.lookupMicros = FLASH_LOOKUP_US;
+    SPIFFS.readMicrosPerKB = FLASH_READ_US_PER_KB;
+}
+
+void tearDown() {
+    host::setFakeTime(false);
+}
+
+void test_gzipped_asset_headers() {
+    host::WebResponse response = get("/spiffs/");
+    TEST_ASSERT_EQUAL_INT(200, response.code);
+    TEST_ASSERT_EQUAL_STRING("gzip", response.header("Content-Encoding").c_str());
+    TEST_ASSERT_EQUAL_STRING("no-cache", response.header("Cache-Control").c_str());
+    TEST_ASSERT_TRUE(response.header("ETag").size() > 2);
+    TEST_ASSERT_TRUE(response.body == embeddedIndex());
+
+    // The ETag is the gzip trailer: CRC32 and size of the minified page
+    uint32_t trailer[2];
+    memcpy(trailer, response.body.data() + response.body.size() - 8, 8);
+    char etag[24];
+    snprintf(etag, sizeof(etag), "\"%08lx-%lx\"", (unsigned long)trailer[0], (unsigned long)trailer[1]);
+    TEST_ASSERT_EQUAL_STRING(etag, response.header("ETag").c_str());
+}
+
+void test_unchanged_asset_revalidates_with_304() {
+    std::string etag = get("/spiffs/").header("ETag");
+
+    host::WebResponse response = get("/spiffs/", etag);
+    TEST_ASSERT_EQUAL_INT(304, response.code);
+    TEST_ASSERT_EQUAL_size_t(0, response.body.size());
+    TEST_ASSERT_EQUAL_STRING(etag.c_str(), response.header("ETag").c_str());
+
+    // A stale ETag gets the page
+    TEST_ASSERT_EQUAL_INT(200, get("/spiffs/", "\"00000000-0\"").code);
+}
+
+void test_ttfb_and_bytes_before_and_after() {
+    Delivery before = delivery(get("/old/"));
+    Delivery first = delivery(get("/spiffs/"));
+    Delivery reload = delivery(get("/spiffs/", get("/spiffs/").header("ETag")));
+
+    printf("%-34s %9s %9s %9s\n", "index.html", "TTFB ms", "total ms", "bytes");
+    printf("%-34s %9.1f %9.1f %9zu\n", "before: plain file", before.ttfbMs, before.totalMs, before.wireBytes);
+    printf("%-34s %9.1f %9.1f %9zu\n", "after: minified + gzip", first.ttfbMs, first.totalMs, first.wireBytes);
+    printf("%-34s %9.1f %9.1f %9zu\n", "after: reload, 304", reload.ttfbMs, reload.totalMs, reload.wireBytes);
+
+    TEST_ASSERT_LESS_THAN(before.wireBytes / 3, first.wireBytes);
+    TEST_ASSERT_LESS_THAN(before.totalMs / 3, first.totalMs);
+    TEST_ASSERT_LESS_OR_EQUAL(before.ttfbMs, first.ttfbMs);
+    TEST_ASSERT_LESS_THAN(400, (int)reload.wireBytes);
+}
+
+struct Latency {
+    double simulatedMs;   // Server time on the simulated clock, flash costs included
+    double hostUs;        // Real time per request on this machine
+    double lookups;       // SPIFFS lookups per request
+    double bytesRead;     // SPIFFS bytes read per request
+};
+
+static Latency latency(const std::string& url, int requests) {
+    SPIFFS.resetCounters();
+    uint64_t simulated = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < requests; i++) {
+        host::WebResponse response = get(url);
+        TEST_ASSERT_EQUAL_INT(200, response.code);
+        simulated += response.doneMicros;
+    }
+    double hostUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    return Latency{simulated / 1000.0 / requests, hostUs / requests, (double)SPIFFS.lookups / requests,
+                   (double)SPIFFS.bytesRead / requests};
+}
+
+void test_embedded_asset_does_not_touch_spiffs() {
+    SPIFFS.resetCounters();
+    host::WebResponse response = get("/");
+    TEST_ASSERT_EQUAL_INT(200, response.code);
+    TEST_ASSERT_TRUE(response.body == embeddedIndex());
+    TEST_ASSERT_EQUAL_STRING("gzip", response.header("Content-Encoding").c_str());
+    TEST_ASSERT_EQUAL_size_t(0, SPIFFS.lookups);
+    TEST_ASSERT_EQUAL_size_t(0, SPIFFS.readCalls);
+
+    // Same content and validator as the SPIFFS copy
+    TEST_ASSERT_EQUAL_STRING(get("/spiffs/").header("ETag").c_str(), response.header("ETag").c_str());
+}
+
+void test_config_served_from_ram() {
+    host::clearNvs();
+    configStore.begin(SPIFFS, CONFIG_FILE);
+    configStore.setWiFi("office", "hunter22");
+    server->setConfigStore(&configStore);
+
+    SPIFFS.resetCounters();
+    host::WebResponse response = get("/api/config");
+    TEST_ASSERT_EQUAL_INT(200, response.code);
+    TEST_ASSERT_TRUE(response.body.find("\"office\"") != std::string::npos);
+    TEST_ASSERT_EQUAL_size_t(0, SPIFFS.lookups);
+    TEST_ASSERT_EQUAL_size_t(0, SPIFFS.readCalls);
+}
+
+void test_spiffs_vs_embedded_latency() {
+    const int requests = 200;
+    Latency spiffs = latency("/spiffs/", requests);
+    Latency embedded = latency("/", requests);
+
+    printf("%-22s %14s %10s %10s %12s\n", "GET index.html", "simulated ms", "host us", "lookups", "bytes read");
+    printf("%-22s %14.2f %10.2f %10.1f %12.0f\n", "SPIFFS (.gz)", spiffs.simulatedMs, spiffs.hostUs,
+           spiffs.lookups, spiffs.bytesRead);
+    printf("%-22s %14.2f %10.2f %10.1f %12.0f\n", "embedded in flash", embedded.simulatedMs, embedded.hostUs,
+           embedded.lookups, embedded.bytesRead);
+
+    TEST_ASSERT_TRUE(embedded.lookups == 0 && embedded.bytesRead == 0);
+    // Memory-mapped flash costs no file system time at all
+    TEST_ASSERT_TRUE(embedded.simulatedMs * 10 < spiffs.simulatedMs);
+}
+
+int main() {
+    server = new WebServerManager();
+    server->begin();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_gzipped_asset_headers);
+    RUN_TEST(test_unchanged_asset_revalidates_with_304);
+    RUN_TEST(test_ttfb_and_bytes_before_and_after);
+    RUN_TEST(test_embedded_asset_does_not_touch_spiffs);
+    RUN_TEST(test_config_served_from_ram);
+    RUN_TEST(test_spiffs_vs_embedded_latency);
+    return UNITY_END();
+}
@@ -0,0 +1,308 @@
+// Admission control under load: WebServerManager on the simulated clock,
+// polled at ten times the dashboard's rate (/api/status every second
+// instead of every 10 s) from several client IPs, with a client hammering
+// the API and with connections held open by a slow link. Counts 200, 429
+// and 503 with their Retry-After, the most requests in flight, the growth
+// of the process heap, and the host time accepted requests took.
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <SPIFFS.h>
+#include <malloc.h>
+#include <unity.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+#include "metrics.h"
+#include "web_server.h"
+
+static const unsigned long DASHBOARD_INTERVAL = 10000;  // data/index.html without EventSource
+static const unsigned long LOAD_INTERVAL = DASHBOARD_INTERVAL / 10;
+static const unsigned long HAMMER_INTERVAL = 50;        // A broken integration, 20 requests/s
+static const unsigned long RUN_MS = 60000;
+static const uint32_t DASHBOARDS = 6;
+
+static WebServerManager* server;
+
+struct Client {
+    uint32_t ip;
+    unsigned long intervalMs;
+    unsigned long holdMs;  // Connection kept open after the response is ready
+};
+
+struct Load {
+    uint32_t sent = 0;
+    std::map<std::string, uint32_t> answers;   // "200", "429 1", "503 5", ...
+    std::map<uint32_t, uint32_t> acceptedBy;   // Client IP -> 200s
+    size_t maxInFlight = 0;
+    size_t heapGrowth = 0;                     // Peak bytes in use above the start
+    std::vector<double> acceptedUs;            // Host time to the last byte of a 200
+
+    uint32_t count(const char* answer) const {
+        auto found = answers.find(answer);
+        return found == answers.end() ? 0 : found->second;
+    }
+
+    double percentile(double p) {
+        if (acceptedUs.empty()) {
+            return 0;
+        }
+        std::sort(acceptedUs.begin(), acceptedUs.end());
+        return acceptedUs[(size_t)(p * (acceptedUs.size() - 1))];
+    }
+};
+
+// Scraped like /api/metrics
+class MetricsText : public Print {
+public:
+    std::string text;
+    size_t write(uint8_t c) override {
+        text += (char)c;
+        return 1;
+    }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        text.append((const char*)buffer, size);
+        return size;
+    }
+};
+
+static double metric(const char* name) {
+    MetricsText scrape;
+    Metric::writeAll(scrape);
+    std::string line = std::string("\n") + name + " ";
+    size_t at = scrape.text.find(line);
+    TEST_ASSERT_TRUE(at != std::string::npos);
+    return strtod(scrape.text.c_str() + at + line.size(), nullptr);
+}
+
+static size_t heapInUse() {
+    return mallinfo2().uordblks;
+}
+
+static uint32_t ip(int n) {
+    return 0xC0A80100u + n;  // 192.168.1.n
+}
+
+static std::vector<Client> dashboards(unsigned long intervalMs, unsigned long holdMs, uint32_t count = DASHBOARDS) {
+    std::vector<Client> clients;
+    for (uint32_t i = 0; i < count; i++) {
+        clients.push_back(Client{ip(10 + i), intervalMs, holdMs});
+    }
+    return clients;
+}
+
+// Every client polls /api/status on its interval, spread out over the
+// first one, and closes its connection holdMs after the response is ready
+static Load run(const std::vector<Client>& clients, unsigned long durationMs) {
+    struct Open {
+        AsyncWebServerRequest* request;
+        unsigned long closeAt;
+    };
+    std::vector<Open> open;
+    std::vector<unsigned long> next;
+    unsigned long start = millis();
+    for (size_t i = 0; i < clients.size(); i++) {
+        next.push_back(start + clients[i].intervalMs * i / clients.size());
+    }
+
+    // The bookkeeping up front, so heap growth is the server's
+    Load load;
+    size_t expected = 0;
+    for (const Client& client : clients) {
+        expected += durationMs / client.intervalMs + 1;
+    }
+    load.acceptedUs.reserve(expected);
+    open.reserve(clients.size() * 2 + WEB_MAX_CONCURRENT);
+    size_t heapBefore = heapInUse();
+    while (millis() - start < durationMs) {
+        unsigned long now = millis();
+        for (size_t i = 0; i < open.size();) {
+            if ((long)(now - open[i].closeAt) >= 0) {
+                host::webClose(open[i].request);
+                open[i] = open.back();
+                open.pop_back();
+            } else {
+                i++;
+            }
+        }
+
+        for (size_t i = 0; i < clients.size(); i++) {
+            if ((long)(now - next[i]) < 0) {
+                continue;
+            }
+            next[i] += clients[i].intervalMs;
+
+            host::WebRequest spec;
+            spec.url = "/api/status";
+            spec.remoteAddress = clients[i].ip;
+            host::WebResponse response;
+            auto started = std::chrono::steady_clock::now();
+            AsyncWebServerRequest* request = host::webOpen(spec, response);
+            double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - started).count();
+            load.sent++;
+
+            std::string answer = std::to_string(response.code);
+            if (response.code != 200) {
+                answer += " " + response.header("Retry-After");
+                // A short answer; the client reads it and goes
+                host::webClose(request);
+            } else {
+                load.acceptedBy[clients[i].ip]++;
+                load.acceptedUs.push_back(us);
+                open.push_back(Open{request, now + clients[i].holdMs});
+            }
+            load.answers[answer]++;
+
+            if (open.size() > load.maxInFlight) {
+                load.maxInFlight = open.size();
+                TEST_ASSERT_EQUAL_UINT32(open.size(), (uint32_t)metric("esp32_web_requests_active"));
+            }
+            size_t heap = heapInUse();
+            if (heap > heapBefore) {
+                load.heapGrowth = std::max(load.heapGrowth, heap - heapBefore);
+            }
+        }
+        host::advance(1);
+    }
+
+    for (const Open& connection : open) {
+        host::webClose(connection.request);
+    }
+    // Every connection closed, nothing left counted in flight
+    TEST_ASSERT_EQUAL_UINT32(0, (uint32_t)metric("esp32_web_requests_active"));
+    return load;
+}
+
+static void print(const char* name, Load& load) {
+    std::string answers;
+    for (const auto& answer : load.answers) {
+        answers += " " + answer.first + ":" + std::to_string(answer.second);
+    }
+    printf("%-24s %6u sent,%s; %zu in flight, heap +%zu B; 200 in %.1f/%.1f/%.1f us (p50/p99/max)\n", name,
+           load.sent, answers.c_str(), load.maxInFlight, load.heapGrowth, load.percentile(0.5),
+           load.percentile(0.99), load.percentile(1.0));
+}
+
+void setUp() {
+    // Every bucket full again
+    host::advance(10000);
+    ESP.freeHeap = 200000;
+    ESP.maxAllocHeap = 110000;
+}
+
+void tearDown() {
+}
+
+void test_dashboard_rate_is_all_accepted() {
+    Load load = run(dashboards(DASHBOARD_INTERVAL, 20), RUN_MS);
+    print("dashboards, 1x", load);
+
+    TEST_ASSERT_EQUAL_UINT32(DASHBOARDS * RUN_MS / DASHBOARD_INTERVAL, load.sent);
+    TEST_ASSERT_EQUAL_UINT32(load.sent, load.count("200"));
+}
+
+void test_ten_times_dashboard_rate_is_all_accepted() {
+    Load load = run(dashboards(LOAD_INTERVAL, 20), RUN_MS);
+    print("dashboards, 10x", load);
+
+    TEST_ASSERT_EQUAL_UINT32(DASHBOARDS * RUN_MS / LOAD_INTERVAL, load.sent);
+    TEST_ASSERT_EQUAL_UINT32(load.sent, load.count("200"));
+    TEST_ASSERT_TRUE(load.maxInFlight <= DASHBOARDS);
+    TEST_ASSERT_TRUE(load.percentile(0.99) < 2000);
+}
+
+void test_hammering_client_is_rate_limited_alone() {
+    std::vector<Client> clients = dashboards(LOAD_INTERVAL, 20);
+    uint32_t hammer = ip(200);
+    clients.push_back(Client{hammer, HAMMER_INTERVAL, 20});
+    uint32_t limitedBefore = (uint32_t)metric("esp32_web_requests_rejected_rate_limited_total");
+    Load load = run(clients, RUN_MS);
+    print("10x + 20/s from one IP", load);
+
+    // The hammering client gets its burst, then WEB_RATE_LIMIT a second;
+    // every rejection says to come back within the next token, 1 s rounded up
+    uint32_t hammerSent = RUN_MS / HAMMER_INTERVAL;
+    uint32_t hammerAllowed = WEB_RATE_BURST + WEB_RATE_LIMIT * RUN_MS / 1000;
+    TEST_ASSERT_UINT32_WITHIN(WEB_RATE_LIMIT, hammerAllowed, load.acceptedBy[hammer]);
+    TEST_ASSERT_EQUAL_UINT32(hammerSent - load.acceptedBy[hammer], load.count("429 1"));
+    TEST_ASSERT_EQUAL_UINT32(load.count("429 1"),
+                             (uint32_t)metric("esp32_web_requests_rejected_rate_limited_total") - limitedBefore);
+
+    // Nobody else noticed
+    for (uint32_t i = 0; i < DASHBOARDS; i++) {
+        TEST_ASSERT_EQUAL_UINT32(RUN_MS / LOAD_INTERVAL, load.acceptedBy[ip(10 + i)]);
+    }
+    TEST_ASSERT_EQUAL_UINT32(load.sent, load.count("200") + load.count("429 1"));
+    TEST_ASSERT_TRUE(load.maxInFlight <= WEB_MAX_CONCURRENT);
+    TEST_ASSERT_TRUE(load.percentile(0.99) < 2000);
+}
+
+void test_slow_connections_are_held_to_the_concurrency_budget() {
+    // Twice the budget's worth of dashboards on a link so slow each poll
+    // takes 1.5 s: they would need 18 connections at once
+    const uint32_t clients = 2 * WEB_MAX_CONCURRENT - 4;
+    const unsigned long holdMs = 1500;
+    uint32_t busyBefore = (uint32_t)metric("esp32_web_requests_rejected_busy_total");
+    uint32_t acceptedBefore = (uint32_t)metric("esp32_web_requests_accepted_total");
+    Load load = run(dashboards(LOAD_INTERVAL, holdMs, clients), RUN_MS);
+    print("10x on a slow link", load);
+
+    TEST_ASSERT_EQUAL_UINT32(WEB_MAX_CONCURRENT, load.maxInFlight);
+    TEST_ASSERT_TRUE(load.count("503 1") > 0);
+    TEST_ASSERT_EQUAL_UINT32(load.sent, load.count("200") + load.count("503 1"));
+    TEST_ASSERT_EQUAL_UINT32(load.count("503 1"),
+                             (uint32_t)metric("esp32_web_requests_rejected_busy_total") - busyBefore);
+    TEST_ASSERT_EQUAL_UINT32(load.count("200"),
+                             (uint32_t)metric("esp32_web_requests_accepted_total") - acceptedBefore);
+    // The budget is used fully: WEB_MAX_CONCURRENT connections turned over
+    // every holdMs, less the gaps before the next poll comes in
+    uint32_t capacity = WEB_MAX_CONCURRENT * RUN_MS / holdMs;
+    TEST_ASSERT_TRUE(load.count("200") <= capacity);
+    TEST_ASSERT_TRUE(load.count("200") >= capacity * 3 / 4);
+    // In-flight requests are bounded, and so is what they hold
+    TEST_ASSERT_TRUE(load.heapGrowth < WEB_MAX_CONCURRENT * 2048);
+}
+
+void test_low_heap_is_shed_until_it_recovers() {
+    ESP.freeHeap = WEB_SHED_FREE_HEAP - 1;
+    Load shed = run(dashboards(LOAD_INTERVAL, 20), 10000);
+    print("10x, heap low", shed);
+    TEST_ASSERT_EQUAL_UINT32(shed.sent, shed.count("503 5"));
+    TEST_ASSERT_EQUAL_UINT32(0, shed.maxInFlight);
+
+    ESP.freeHeap = 200000;
+    ESP.maxAllocHeap = WEB_SHED_LARGEST_BLOCK - 1;
+    Load fragmented = run(dashboards(LOAD_INTERVAL, 20), 10000);
+    TEST_ASSERT_EQUAL_UINT32(fragmented.sent, fragmented.count("503 5"));
+
+    ESP.maxAllocHeap = 110000;
+    Load recovered = run(dashboards(LOAD_INTERVAL, 20), 10000);
+    TEST_ASSERT_EQUAL_UINT32(recovered.sent, recovered.count("200"));
+}
+
+int main() {
+    host::setFakeTime(true, 0);
+    SPIFFS.begin();
+    server = new WebServerManager();
+    server->onGetStatus(
+        [](JsonDocument& doc) {
+            doc["ssid"] = "office";
+            doc["ip_address"] = "192.168.1.2";
+            doc["uptime"] = millis() / 1000;
+            doc["free_heap"] = ESP.getFreeHeap();
+        },
+        []() { return (uint32_t)1; });
+    server->begin();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_dashboard_rate_is_all_accepted);
+    RUN_TEST(test_ten_times_dashboard_rate_is_all_accepted);
+    RUN_TEST(test_hammering_client_is_rate_limited_alone);
+    RUN_TEST(test_slow_connections_are_held_to_the_concurrency_budget);
+    RUN_TEST(test_low_heap_is_shed_until_it_recovers);
+    int result = UNITY_END();
+    host::setFakeTime(false);
+    return result;
+}
@@ -0,0 +1,334 @@
+// WiFiManager connection state machine against the simulated WiFi driver:
+// time to connected for a cold start (scan + DHCP), a reconnect with the
+// cached BSSID/channel and lease, and a stale cache that falls back to a
+// scan, together with how long each handle() call holds up the main loop.
+// Reconnect scheduling: 500 devices losing the same AP, failover to a
+// backup network and the setup access point fallback.
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <esp_system.h>
+#include <unity.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "wifi_manager.h"
+
+static const unsigned long LOOP_MS = 10;  // Main loop period
+
+struct Run {
+    unsigned long connectedAfterMs;  // Since the run started; 0 if never
+    unsigned long maxStallMs;        // Simulated time spent inside one handle()
+    double maxHandleUs;              // Real time of the slowest handle()
+};
+
+// Loop until connected or limitMs passed, as loop() would
+static Run run(WiFiManager& wifi, unsigned long limitMs = 30000) {
+    Run result{0, 0, 0};
+    unsigned long start = millis();
+    while (millis() - start < limitMs) {
+        host::advance(LOOP_MS);
+        unsigned long before = millis();
+        auto begin = std::chrono::steady_clock::now();
+        wifi.handle();
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+        result.maxStallMs = std::max(result.maxStallMs, millis() - before);
+        result.maxHandleUs = std::max(result.maxHandleUs, us);
+        if (wifi.getState() == WiFiManager::STATE_CONNECTED) {
+            result.connectedAfterMs = millis() - start;
+            break;
+        }
+    }
+    return result;
+}
+
+// Short AP outage: the link is gone, the AP is back when the device notices
+static void outage(WiFiManager& wifi) {
+    host::setAccessPointUp("office", false);
+    host::setAccessPointUp("office", true);
+    TEST_ASSERT_FALSE(wifi.isConnected());
+}
+
+static unsigned long fullConnectMs() {
+    const host::AccessPoint& ap = *host::findAccessPoint("office");
+    return ap.scanMs + ap.associateMs + ap.dhcpMs;
+}
+
+void setUp() {
+    host::setFakeTime(true, 1000);
+    host::resetWiFi();
+    host::addAccessPoint("office", "hunter22", 6);
+    host::resetReason = ESP_RST_POWERON;
+}
+
+void tearDown() {
+    host::setFakeTime(false);
+}
+
+void test_connect_returns_at_once() {
+    WiFiManager wifi;
+    wifi.begin();
+    unsigned long before = millis();
+    TEST_ASSERT_TRUE(wifi.connect("office", "hunter22"));
+    TEST_ASSERT_EQUAL_UINT32(0, millis() - before);
+    TEST_ASSERT_EQUAL_INT(WiFiManager::STATE_PENDING, wifi.getState());
+}
+
+void test_cold_start_scans() {
+    WiFiManager wifi;
+    wifi.begin();
+    wifi.connect("office", "hunter22");
+    Run cold = run(wifi);
+
+    TEST_ASSERT_TRUE(wifi.isConnected());
+    TEST_ASSERT_EQUAL_size_t(1, host::wifiAttempts.size());
+    TEST_ASSERT_FALSE(host::wifiAttempts[0].fast);
+    TEST_ASSERT_FALSE(host::wifiAttempts[0].staticIp);
+    TEST_ASSERT_GREATER_OR_EQUAL(fullConnectMs(), cold.connectedAfterMs);
+    TEST_ASSERT_LESS_OR_EQUAL(fullConnectMs() + LOOP_MS, cold.connectedAfterMs);
+    TEST_ASSERT_EQUAL_UINT32(0, cold.maxStallMs);
+    TEST_ASSERT_EQUAL_STRING("192.168.1.100", wifi.getIPAddress().c_str());
+}
+
+void test_reconnect_uses_cached_ap_and_lease() {
+    WiFiManager wifi;
+    wifi.begin();
+    wifi.connect("office", "hunter22");
+    run(wifi);
+
+    outage(wifi);
+    Run fast = run(wifi);
+    TEST_ASSERT_TRUE(wifi.isConnected());
+    TEST_ASSERT_EQUAL_size_t(2, host::wifiAttempts.size());
+    TEST_ASSERT_TRUE(host::wifiAttempts[1].fast);
+    TEST_ASSERT_TRUE(host::wifiAttempts[1].staticIp);
+    TEST_ASSERT_LESS_OR_EQUAL(host::findAccessPoint("office")->associateMs + LOOP_MS, fast.connectedAfterMs);
+    TEST_ASSERT_EQUAL_UINT32(0, fast.maxStallMs);
+    TEST_ASSERT_EQUAL_STRING("192.168.1.100", wifi.getIPAddress().c_str());
+}
+
+void test_cache_survives_soft_reset_only() {
+    {
+        WiFiManager wifi;
+        wifi.begin();
+        wifi.connect("office", "hunter22");
+        run(wifi);
+    }
+
+    // Soft reset: RTC memory kept
+    host::resetReason = ESP_RST_SW;
+    WiFi.reset();
+    {
+        WiFiManager wifi;
+        wifi.begin();
+        wifi.connect("office", "hunter22");
+        run(wifi);
+        TEST_ASSERT_TRUE(wifi.isConnected());
+        TEST_ASSERT_TRUE(host::wifiAttempts.back().fast);
+    }
+
+    // Power cycle: RTC memory is garbage and must not be trusted
+    host::resetReason = ESP_RST_POWERON;
+    WiFi.reset();
+    {
+        WiFiManager wifi;
+        wifi.begin();
+        wifi.connect("office", "hunter22");
+        run(wifi);
+        TEST_ASSERT_TRUE(wifi.isConnected());
+        TEST_ASSERT_FALSE(host::wifiAttempts.back().fast);
+    }
+}
+
+void test_stale_cache_falls_back_to_scan() {
+    WiFiManager wifi;
+    wifi.begin();
+    wifi.connect("office", "hunter22");
+    run(wifi);
+
+    // The AP comes back on another channel
+    host::findAccessPoint("office")->channel = 11;
+    outage(wifi);
+    Run fallback = run(wifi);
+
+    TEST_ASSERT_TRUE(wifi.isConnected());
+    TEST_ASSERT_EQUAL_size_t(3, host::wifiAttempts.size());
+    TEST_ASSERT_TRUE(host::wifiAttempts[1].fast);
+    TEST_ASSERT_FALSE(host::wifiAttempts[2].fast);
+    TEST_ASSERT_FALSE(host::wifiAttempts[2].staticIp);
+    // The scan starts up to WIFI_FAST_CONNECT_TIMEOUT later again
+    TEST_ASSERT_LESS_OR_EQUAL(2 * WIFI_FAST_CONNECT_TIMEOUT + fullConnectMs() + 2 * LOOP_MS,
+                              fallback.connectedAfterMs);
+    TEST_ASSERT_EQUAL_UINT32(0, fallback.maxStallMs);
+
+    // The new channel is cached for next time
+    outage(wifi);
+    TEST_ASSERT_TRUE(run(wifi).connectedAfterMs <= host::findAccessPoint("office")->associateMs + LOOP_MS);
+    TEST_ASSERT_TRUE(host::wifiAttempts.back().fast);
+}
+
+void test_time_to_connected() {
+    WiFiManager wifi;
+    wifi.begin();
+    wifi.connect("office", "hunter22");
+    Run cold = run(wifi);
+    outage(wifi);
+    Run fast = run(wifi);
+    host::findAccessPoint("office")->channel = 1;
+    outage(wifi);
+    Run fallback = run(wifi);
+
+    // The old connect() polled in a delay(500) loop up to WIFI_MAX_RETRY
+    // (20) times: the whole connect stalled setup(), up to 10 s
+    printf("%-28s %12s %16s %14s\n", "", "connected ms", "max stall ms", "max handle us");
+    printf("%-28s %12lu %16lu %14s\n", "old blocking connect", cold.connectedAfterMs,
+           std::min(cold.connectedAfterMs, 10000ul), "-");
+    printf("%-28s %12lu %16lu %14.2f\n", "cold start (scan + DHCP)", cold.connectedAfterMs,
+           cold.maxStallMs, cold.maxHandleUs);
+    printf("%-28s %12lu %16lu %14.2f\n", "reconnect (cached AP+lease)", fast.connectedAfterMs,
+           fast.maxStallMs, fast.maxHandleUs);
+    printf("%-28s %12lu %16lu %14.2f\n", "stale cache, then scan", fallback.connectedAfterMs,
+           fallback.maxStallMs, fallback.maxHandleUs);
+
+    TEST_ASSERT_TRUE(fast.connectedAfterMs * 10 < cold.connectedAfterMs);
+    TEST_ASSERT_EQUAL_UINT32(0, cold.maxStallMs + fast.maxStallMs + fallback.maxStallMs);
+}
+
+// One device through a site-wide outage of outageMs starting at 0: times
+// of its attempts to join, relative to the start of the outage
+static std::vector<long> reconnectAttempts(unsigned long seed, unsigned long outageMs) {
+    host::setFakeTime(true, 1000);
+    host::resetWiFi();
+    host::addAccessPoint("office", "hunter22", 6);
+    Serial.clearOutput();
+    randomSeed(seed);
+
+    WiFiManager wifi;
+    wifi.begin();
+    wifi.connect("office", "hunter22");
+    run(wifi);
+    TEST_ASSERT_TRUE(wifi.isConnected());
+
+    // Devices run their loops out of phase
+    host::advance(random(LOOP_MS));
+    unsigned long outageAt = millis();
+    size_t before = host::wifiAttempts.size();
+    host::setAccessPointUp("office", false);
+    while (millis() - outageAt < outageMs) {
+        host::advance(LOOP_MS);
+        wifi.handle();
+    }
+    host::setAccessPointUp("office", true);
+    run(wifi, WIFI_RECONNECT_MAX_INTERVAL + WIFI_CONNECT_TIMEOUT);
+    TEST_ASSERT_TRUE(wifi.isConnected());
+
+    std::vector<long> attempts;
+    for (size_t i = before; i < host::wifiAttempts.size(); i++) {
+        attempts.push_back((long)(host::wifiAttempts[i].at - outageAt));
+    }
+    return attempts;
+}
+
+void test_500_devices_spread_their_retries() {
+    const int devices = 500;
+    const unsigned long outageMs = 60000;
+
+    std::vector<long> attempts;
+    std::vector<long> reconnected;
+    for (int device = 0; device < devices; device++) {
+        std::vector<long> mine = reconnectAttempts(device + 1, outageMs);
+        attempts.insert(attempts.end(), mine.begin(), mine.end());
+        reconnected.push_back(mine.back());
+    }
+    host::setFakeTime(true, 0);
+
+    // Attempts per second; every device tries once right when the link drops
+    long last = *std::max_element(attempts.begin(), attempts.end());
+    std::vector<int> perSecond(last / 1000 + 1, 0);
+    for (long at : attempts) {
+        perSecond[at / 1000]++;
+    }
+    int peakAfterFirst = *std::max_element(perSecond.begin() + 1, perSecond.end());
+    std::sort(reconnected.begin(), reconnected.end());
+
+    printf("%d devices, %lu s outage: %zu attempts\n", devices, outageMs / 1000, attempts.size());
+    printf("second  attempts\n");
+    for (size_t second = 0; second < perSecond.size(); second++) {
+        if (perSecond[second] > 0) {
+            printf("%6zu  %8d %s\n", second, perSecond[second],
+                   std::string(std::min(perSecond[second] / 5, 100), '#').c_str());
+        }
+    }
+    printf("last join attempt: first device %.1f s, median %.1f s, last %.1f s after the outage began\n",
+           reconnected.front() / 1000.0, reconnected[devices / 2] / 1000.0, reconnected.back() / 1000.0);
+    printf("peak after the first second: %d attempts/s (fixed 5 s retries: %d every 5 s)\n",
+           peakAfterFirst, devices);
+
+    // Retries after the first are spread out: no second sees half the
+    // fleet, where fixed intervals bring all of it at once
+    TEST_ASSERT_EQUAL_INT(devices, perSecond[0]);
+    TEST_ASSERT_LESS_THAN(devices / 2, peakAfterFirst);
+    TEST_ASSERT_TRUE(reconnected.back() - reconnected.front() > 10000);
+}
+
+void test_backoff_is_capped() {
+    std::vector<long> attempts = reconnectAttempts(7, 3600000);
+    long longest = 0;
+    for (size_t i = 1; i < attempts.size(); i++) {
+        longest = std::max(longest, attempts[i] - attempts[i - 1]);
+    }
+    // A gap is a failed attempt's timeout plus the backoff delay
+    TEST_ASSERT_LESS_OR_EQUAL(WIFI_RECONNECT_MAX_INTERVAL + WIFI_CONNECT_TIMEOUT + LOOP_MS, longest);
+    TEST_ASSERT_GREATER_OR_EQUAL(WIFI_RECONNECT_MAX_INTERVAL / 2, longest);
+}
+
+void test_fails_over_to_backup_network() {
+    host::addAccessPoint("backup", "backup-pass", 11, 2);
+    host::setAccessPointUp("office", false);
+
+    WiFiManager wifi;
+    wifi.begin();
+    wifi.addNetwork("backup", "backup-pass");
+    wifi.connect("office", "hunter22");
+    run(wifi, 60000);
+
+    TEST_ASSERT_TRUE(wifi.isConnected());
+    TEST_ASSERT_EQUAL_STRING("backup", wifi.getSSID().c_str());
+    TEST_ASSERT_EQUAL_size_t(WIFI_NETWORK_ATTEMPTS + 1, host::wifiAttempts.size());
+    TEST_ASSERT_EQUAL_STRING("backup", host::wifiAttempts.back().ssid.c_str());
+}
+
+void test_setup_access_point_while_offline() {
+    host::setAccessPointUp("office", false);
+
+    WiFiManager wifi;
+    wifi.begin();
+    wifi.connect("office", "hunter22");
+    run(wifi, WIFI_AP_FALLBACK_TIMEOUT - LOOP_MS);
+    TEST_ASSERT_FALSE(wifi.isAccessPointActive());
+    run(wifi, 2 * LOOP_MS);
+    TEST_ASSERT_TRUE(wifi.isAccessPointActive());
+    TEST_ASSERT_EQUAL_STRING(WIFI_AP_SSID, WiFi.softAPSsid.c_str());
+
+    // Stopped again once the station is back
+    host::setAccessPointUp("office", true);
+    run(wifi, WIFI_RECONNECT_MAX_INTERVAL + WIFI_CONNECT_TIMEOUT);
+    TEST_ASSERT_TRUE(wifi.isConnected());
+    TEST_ASSERT_FALSE(wifi.isAccessPointActive());
+    TEST_ASSERT_TRUE(WiFi.softAPSsid.empty());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_connect_returns_at_once);
+    RUN_TEST(test_cold_start_scans);
+    RUN_TEST(test_reconnect_uses_cached_ap_and_lease);
+    RUN_TEST(test_cache_survives_soft_reset_only);
+    RUN_TEST(test_stale_cache_falls_back_to_scan);
+    RUN_TEST(test_time_to_connected);
+    RUN_TEST(test_500_devices_spread_their_retries);
+    RUN_TEST(test_backoff_is_capped);
+    RUN_TEST(test_fails_over_to_backup_network);
+    RUN_TEST(test_setup_access_point_while_offline);
+    return UNITY_END();
+}
@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+"""Minify and gzip the web UI in data/ into the SPIFFS image directory.
+
+Runs automatically before every PlatformIO build/uploadfs (extra_scripts in
+platformio.ini), or by hand. HTML, CSS and JS files are minified and stored
+as <name>.gz only; the web server sends them with Content-Encoding: gzip and
+uses the gzip trailer (CRC32 + size) as ETag. Other files are copied as-is.
+
+The same files are also written as const arrays to web_assets_data.h, which
+src/web_assets.cpp compiles into the firmware when WEB_ASSETS_EMBEDDED is set.
+
+Usage:
+    python tools/build_web.py [source_dir] [output_dir] [header_dir]
+"""
+
+import gzip
+import mimetypes
+import os
+import re
+import shutil
+import struct
+import sys
+import zlib
+
+MINIFY = {".html", ".htm", ".css", ".js", ".json", ".svg"}
+
+BLOCK_COMMENT = re.compile(r"/\*.*?\*/|<!--.*?-->", re.S)
+
+
+def minify(text):
+    """Conservative minifier: drops comments, indentation and blank lines.
+
+    Works line by line, so it never joins statements and stays safe for
+    inline JavaScript without semicolon-insertion surprises.
+    """
+    text = BLOCK_COMMENT.sub("", text)
+    lines = []
+    for line in text.splitlines():
+        line = line.strip()
+        if not line or line.startswith("//"):
+            continue
+        lines.append(line)
+    return "\n".join(lines) + "\n"
+
+
+def etag(packed, original, gzipped):
+    """Same ETag the firmware derives from a SPIFFS file's gzip trailer."""
+    if gzipped:
+        crc, size = struct.unpack("<II", packed[-8:])
+    else:
+        crc, size = zlib.crc32(original), len(original)
+    return '"%08x-%x"' % (crc, size)
+
+
+def write_header(assets, header_dir):
+    os.makedirs(header_dir, exist_ok=True)
+    lines = [
+        "// Generated by tools/build_web.py from data/ - do not edit",
+        "#pragma once",
+        "",
+    ]
+    for index, (path, ctype, packed, tag, gzipped) in enumerate(assets):
+        lines.append("static const uint8_t WEB_ASSET_%d[] = {" % index)
+        for start in range(0, len(packed), 16):
+            lines.append("    " + ", ".join("0x%02x" % b for b in packed[start:start + 16]) + ",")
+        lines.append("};")
+        lines.append("")
+
+    lines.append("static const WebAsset WEB_ASSETS[] = {")
+    for index, (path, ctype, packed, tag, gzipped) in enumerate(assets):
+        lines.append('    { "%s", "%s", WEB_ASSET_%d, sizeof(WEB_ASSET_%d), "%s", %s },' % (
+            path, ctype, index, index, tag.replace('"', '\\"'), "true" if gzipped else "false"))
+    lines.append("    { nullptr, nullptr, nullptr, 0, nullptr, false },")
+    lines.append("};")
+
+    header = os.path.join(header_dir, "web_assets_data.h")
+    content = "\n".join(lines) + "\n"
+    # Leave the file untouched when nothing changed to avoid rebuilds
+    if os.path.exists(header):
+        with open(header) as f:
+            if f.read() == content:
+                return
+    with open(header, "w") as f:
+        f.write(content)
+
+
+def build(source, output, header_dir):
+    if os.path.abspath(source) == os.path.abspath(output):
+        sys.exit("web: output directory must differ from %s (set data_dir)" % source)
+
+    if os.path.isdir(output):
+        shutil.rmtree(output)
+    os.makedirs(output)
+
+    assets = []
+    total_in = total_out = 0
+    for root, _dirs, files in os.walk(source):
+        for name in sorted(files):
+            src = os.path.join(root, name)
+            rel = os.path.relpath(src, source)
+            dst = os.path.join(output, rel)
+            os.makedirs(os.path.dirname(dst), exist_ok=True)
+
+            with open(src, "rb") as f:
+                data = f.read()
+
+            gzipped = os.path.splitext(name)[1].lower() in MINIFY
+            if gzipped:
+                original = minify(data.decode("utf-8")).encode("utf-8")
+                # mtime=0 keeps the output (and its ETag) reproducible
+                packed = gzip.compress(original, 9, mtime=0)
+                dst += ".gz"
+            else:
+                original = packed = data
+
+            url = "/" + rel.replace(os.sep, "/")
+            ctype = mimetypes.guess_type(name)[0] or "application/octet-stream"
+            assets.append((url, ctype, packed, etag(packed, original, gzipped), gzipped))
+
+            with open(dst, "wb") as f:
+                f.write(packed)
+
+            total_in += len(data)
+            total_out += len(packed)
+            print("web: %-24s %6d -> %6d bytes" % (rel, len(data), len(packed)))
+
+    print("web: %d -> %d bytes total" % (total_in, total_out))
+    write_header(assets, header_dir)
+
+
+def main():
+    root = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    source = sys.argv[1] if len(sys.argv) > 1 else os.path.join(root, "data")
+    output = sys.argv[2] if len(sys.argv) > 2 else os.path.join(root, ".pio", "data")
+    header_dir = sys.argv[3] if len(sys.argv) > 3 else os.path.join(root, ".pio", "generated")
+    build(source, output, header_dir)
+
+
+try:
+    Import("env")  # noqa: F821 - defined when run by PlatformIO
+except NameError:
+    if __name__ == "__main__":
+        main()
+else:
+    generated = os.path.join(env.subst("$PROJECT_WORKSPACE_DIR"), "generated")  # noqa: F821
+    build(os.path.join(env["PROJECT_DIR"], "data"), env.subst("$PROJECT_DATA_DIR"), generated)  # noqa: F821
+    env.Append(CPPPATH=[generated])  # noqa: F821
@@ -0,0 +1,209 @@
+#!/usr/bin/env python3
+"""Decode binary Logger output (LOG_FORMAT_BINARY) into readable log lines.
+
+Frames are [0xA5][payload length][payload][checksum]; see include/log_binary.h.
+Bytes outside valid frames (boot messages, plain text) are passed through.
+
+Usage:
+    python tools/log_decode.py capture.bin
+    python tools/log_decode.py --port /dev/ttyUSB0 --baud 115200
+    cat capture.bin | python tools/log_decode.py
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+FRAME_SYNC = 0xA5
+RECORD_LINE = 1
+RECORD_TEXT = 2
+RECORD_FORMAT = 3
+
+LEVELS = {0: "ERROR", 1: "WARN ", 2: "INFO ", 3: "DEBUG"}
+
+SPEC = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?([hljztL]*)([diuxXocpfFeEgGaAsn%])")
+
+
+class Reader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def varint(self):
+        value = 0
+        shift = 0
+        while True:
+            byte = self.data[self.pos]
+            self.pos += 1
+            value |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                return value
+
+    def zigzag(self):
+        value = self.varint()
+        return (value >> 1) ^ -(value & 1)
+
+    def bytes(self, length):
+        chunk = self.data[self.pos:self.pos + length]
+        if len(chunk) != length:
+            raise IndexError("truncated record")
+        self.pos += length
+        return chunk
+
+    def rest(self):
+        return self.data[self.pos:]
+
+
+def format_line(fmt, reader):
+    """Rebuild the printf output by consuming packed arguments in order."""
+    out = []
+    last = 0
+    for match in SPEC.finditer(fmt):
+        out.append(fmt[last:match.start()])
+        last = match.end()
+        flags, width, precision, _length, conv = match.groups()
+
+        if conv == "%":
+            out.append("%")
+            continue
+        if conv == "n":
+            continue
+
+        if width == "*":
+            width = str(reader.zigzag())
+        if precision == "*":
+            precision = str(reader.zigzag())
+
+        spec = "%" + flags + (width or "") + ("." + precision if precision is not None else "")
+        if conv in "di":
+            out.append((spec + "d") % reader.zigzag())
+        elif conv in "uxXo":
+            out.append((spec + ("d" if conv == "u" else conv)) % reader.varint())
+        elif conv == "c":
+            out.append((spec + "c") % chr(reader.varint()))
+        elif conv == "p":
+            out.append("0x%x" % reader.varint())
+        elif conv in "fFeEgGaA":
+            value = struct.unpack("<f", reader.bytes(4))[0]
+            out.append((spec + ("f" if conv in "aA" else conv)) % value)
+        elif conv == "s":
+            text = reader.bytes(reader.varint()).decode("utf-8", "replace")
+            out.append((spec + "s") % text)
+    out.append(fmt[last:])
+    return "".join(out)
+
+
+class Decoder:
+    def __init__(self, output):
+        self.output = output
+        self.formats = {}
+        self.buffer = bytearray()
+        self.bytes_in = 0
+        self.bytes_out = 0
+
+    def feed(self, data):
+        self.bytes_in += len(data)
+        self.buffer.extend(data)
+        self._process()
+
+    def _emit(self, text):
+        self.bytes_out += len(text)
+        self.output.write(text)
+
+    def _process(self):
+        buf = self.buffer
+        while buf:
+            sync = buf.find(bytes([FRAME_SYNC]))
+            if sync < 0:
+                self._emit(buf.decode("utf-8", "replace"))
+                del buf[:]
+                return
+            if sync > 0:
+                self._emit(buf[:sync].decode("utf-8", "replace"))
+                del buf[:sync]
+
+            if len(buf) < 2:
+                return
+            length = buf[1]
+            if len(buf) < length + 3:
+                return
+
+            payload = bytes(buf[2:2 + length])
+            if length == 0 or (sum(payload) & 0xFF) != buf[2 + length]:
+                # Not a frame after all: pass the sync byte through and rescan
+                self._emit(chr(FRAME_SYNC))
+                del buf[:1]
+                continue
+
+            del buf[:length + 3]
+            self._record(payload)
+
+    def _record(self, payload):
+        kind = payload[0] >> 4
+        level = LEVELS.get(payload[0] & 0x0F, "UNKN ")
+        reader = Reader(payload)
+        reader.pos = 1
+        timestamp = 0
+
+        try:
+            if kind == RECORD_FORMAT:
+                fmt_id = reader.varint()
+                self.formats[fmt_id] = reader.rest().decode("utf-8", "replace")
+                return
+            timestamp = reader.varint()
+            if kind == RECORD_LINE:
+                fmt_id = reader.varint()
+                fmt = self.formats.get(fmt_id)
+                if fmt is None:
+                    message = "<unknown format #%d: %s>" % (fmt_id, reader.rest().hex())
+                else:
+                    message = format_line(fmt, reader)
+            elif kind == RECORD_TEXT:
+                message = reader.rest().decode("utf-8", "replace")
+            else:
+                return
+        except (IndexError, TypeError, ValueError) as error:
+            message = "<corrupt record: %s>" % error
+
+        self._emit("[%10u] [%s] %s\n" % (timestamp, level, message))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("input", nargs="?", help="binary capture file (default: stdin)")
+    parser.add_argument("--port", help="read from a serial port instead (needs pyserial)")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--stats", action="store_true",
+                        help="print encoded vs decoded byte counts at the end")
+    args = parser.parse_args()
+
+    decoder = Decoder(sys.stdout)
+    try:
+        if args.port:
+            import serial
+            with serial.Serial(args.port, args.baud, timeout=0.1) as port:
+                while True:
+                    data = port.read(256)
+                    if data:
+                        decoder.feed(data)
+                        sys.stdout.flush()
+        else:
+            stream = open(args.input, "rb") if args.input else sys.stdin.buffer
+            with stream:
+                while True:
+                    data = stream.read(4096)
+                    if not data:
+                        break
+                    decoder.feed(data)
+    except KeyboardInterrupt:
+        pass
+
+    if args.stats and decoder.bytes_in:
+        sys.stderr.write("%d bytes in, %d bytes decoded (%.2fx)\n" % (
+            decoder.bytes_in, decoder.bytes_out, decoder.bytes_out / decoder.bytes_in))
+
+
+if __name__ == "__main__":
+    main()
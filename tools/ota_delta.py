@@ -0,0 +1,281 @@
+#!/usr/bin/env python3
+"""Make and apply delta patches for pull OTA updates (see include/delta_patch.h).
+
+A patch rebuilds a new firmware image from the one running on the device.
+Matches are found through an index of 8-byte windows of the old image and
+extended bsdiff-style: a match keeps going across differing bytes as long
+as most bytes still agree, so code that moved and only had its addresses
+changed costs a few bytes per difference instead of being sent again.
+Everything without a match is sent as-is.
+
+"make" checks the patch by applying it before writing it out, and prints
+its size next to the image size and the manifest entry to publish.
+
+Usage:
+    python tools/ota_delta.py make old.bin new.bin out.patch [--from 1.0.0 --url URL]
+    python tools/ota_delta.py apply old.bin in.patch out.bin
+"""
+
+import argparse
+import hashlib
+import json
+import struct
+import sys
+
+MAGIC = b"ESPD"
+VERSION = 1
+HEADER = struct.Struct("<4sB3xII32s")
+
+OP_END = 0x00
+OP_ADD = 0x01
+OP_INSERT = 0x02
+
+WINDOW = 8        # Bytes hashed per index entry
+STEP = 4          # Index every 4th source offset; any 11-byte match is found
+SLACK = 32        # Bytes an approximate match may run on without improving
+MIN_GAP = 3       # Shorter equal stretches inside an ADD stay in the diff run
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def zigzag(value):
+    return (value << 1) ^ (value >> 63)
+
+
+class Reader:
+    def __init__(self, data, pos=0):
+        self.data = data
+        self.pos = pos
+
+    def byte(self):
+        value = self.data[self.pos]
+        self.pos += 1
+        return value
+
+    def varint(self):
+        value = 0
+        shift = 0
+        while True:
+            byte = self.byte()
+            value |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                return value
+
+    def zigzag(self):
+        value = self.varint()
+        return (value >> 1) ^ -(value & 1)
+
+    def bytes(self, length):
+        chunk = self.data[self.pos:self.pos + length]
+        if len(chunk) != length:
+            raise ValueError("truncated patch")
+        self.pos += length
+        return chunk
+
+
+def build_index(source):
+    index = {}
+    for pos in range(0, len(source) - WINDOW + 1, STEP):
+        index.setdefault(source[pos:pos + WINDOW], pos)
+    return index
+
+
+def extend(source, target, s, t):
+    """Length of the approximate match at source[s:], target[t:]: the
+    point where matches * 2 - length peaks, i.e. where more than half of
+    the bytes still agree."""
+    limit = min(len(source) - s, len(target) - t)
+    best_len = 0
+    best_score = 0
+    matches = 0
+    length = 0
+    while length < limit and length - best_len <= SLACK:
+        if source[s + length] == target[t + length]:
+            matches += 1
+        length += 1
+        score = matches * 2 - length
+        if score > best_score:
+            best_score = score
+            best_len = length
+    return best_len
+
+
+def add_runs(source, target, s, t, length):
+    """Encode target[t:t+length] against source[s:] as same/count runs."""
+    out = bytearray()
+    pos = 0
+    while pos < length:
+        same = 0
+        while pos + same < length and source[s + pos + same] == target[t + pos + same]:
+            same += 1
+        pos += same
+        diff = bytearray()
+        while pos < length:
+            gap = 0
+            while (pos + gap < length and gap < MIN_GAP and
+                   source[s + pos + gap] == target[t + pos + gap]):
+                gap += 1
+            if gap >= MIN_GAP or (gap > 0 and pos + gap == length):
+                break
+            for i in range(gap + 1):
+                if pos + i < length:
+                    diff.append((target[t + pos + i] - source[s + pos + i]) & 0xFF)
+            pos += gap + 1
+        out += varint(same) + varint(len(diff)) + diff
+    return bytes(out)
+
+
+def make_patch(source, target):
+    index = build_index(source)
+    ops = bytearray()
+    stats = {"add": 0, "insert": 0, "copied": 0, "inserted": 0}
+    cursor = 0       # Source position the decoder is at
+    literal = 0      # Start of target bytes not covered yet
+    t = 0
+
+    def flush_literal(end):
+        if end > literal:
+            ops.extend(bytes([OP_INSERT]) + varint(end - literal) + target[literal:end])
+            stats["insert"] += 1
+            stats["inserted"] += end - literal
+
+    while t + WINDOW <= len(target):
+        window = target[t:t + WINDOW]
+        # Prefer carrying on where the last match left off, so runs of
+        # identical windows do not make the patch jump around
+        expected = cursor + (t - literal)
+        if source[expected:expected + WINDOW] == window:
+            s = expected
+        else:
+            s = index.get(window)
+            if s is None:
+                t += 1
+                continue
+
+        # Grow the exact match backwards into the pending literal
+        while t > literal and s > 0 and source[s - 1] == target[t - 1]:
+            s -= 1
+            t -= 1
+
+        length = extend(source, target, s, t)
+        flush_literal(t)
+        ops.extend(bytes([OP_ADD]) + varint(zigzag(s - cursor)) + varint(length))
+        ops.extend(add_runs(source, target, s, t, length))
+        stats["add"] += 1
+        stats["copied"] += length
+        cursor = s + length
+        t += length
+        literal = t
+
+    flush_literal(len(target))
+    ops.append(OP_END)
+
+    header = HEADER.pack(MAGIC, VERSION, len(source), len(target),
+                         hashlib.sha256(source).digest())
+    return header + bytes(ops), stats
+
+
+def apply_patch(source, patch):
+    magic, version, source_size, target_size, digest = HEADER.unpack_from(patch)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("not a version %d delta patch" % VERSION)
+    if source_size > len(source) or hashlib.sha256(source[:source_size]).digest() != digest:
+        raise ValueError("patch is for a different image")
+
+    reader = Reader(patch, HEADER.size)
+    out = bytearray()
+    cursor = 0
+    while True:
+        op = reader.byte()
+        if op == OP_END:
+            break
+        if op == OP_ADD:
+            cursor += reader.zigzag()
+            remaining = reader.varint()
+            if cursor < 0 or cursor + remaining > source_size:
+                raise ValueError("ADD out of range")
+            while remaining:
+                same = reader.varint()
+                out += source[cursor:cursor + same]
+                cursor += same
+                count = reader.varint()
+                for byte in reader.bytes(count):
+                    out.append((source[cursor] + byte) & 0xFF)
+                    cursor += 1
+                remaining -= same + count
+        elif op == OP_INSERT:
+            out += reader.bytes(reader.varint())
+        else:
+            raise ValueError("unknown op 0x%02x" % op)
+
+    if len(out) != target_size:
+        raise ValueError("patch produced %d of %d bytes" % (len(out), target_size))
+    return bytes(out)
+
+
+def read(path):
+    with open(path, "rb") as f:
+        return f.read()
+
+
+def write(path, data):
+    with open(path, "wb") as f:
+        f.write(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    make = commands.add_parser("make", help="create a patch from old.bin to new.bin")
+    make.add_argument("old")
+    make.add_argument("new")
+    make.add_argument("patch")
+    make.add_argument("--from", dest="from_version", help="version of old.bin, for the manifest entry")
+    make.add_argument("--url", help="where the patch will be published, for the manifest entry")
+
+    apply = commands.add_parser("apply", help="rebuild new.bin from old.bin and a patch")
+    apply.add_argument("old")
+    apply.add_argument("patch")
+    apply.add_argument("new")
+
+    args = parser.parse_args()
+
+    try:
+        if args.command == "make":
+            source = read(args.old)
+            target = read(args.new)
+            patch, stats = make_patch(source, target)
+            if apply_patch(source, patch) != target:
+                raise ValueError("patch does not reproduce %s" % args.new)
+            write(args.patch, patch)
+
+            print("%s: %d bytes, %.1f%% of the %d byte image" % (
+                args.patch, len(patch), len(patch) * 100.0 / max(len(target), 1), len(target)))
+            print("%d ADD ops (%d bytes from the old image), %d INSERT ops (%d new bytes)" % (
+                stats["add"], stats["copied"], stats["insert"], stats["inserted"]))
+            print("manifest:")
+            print("  \"sha256\": %s," % json.dumps(hashlib.sha256(target).hexdigest()))
+            print("  \"patches\": [%s]" % json.dumps({
+                "from": args.from_version or "<old version>",
+                "url": args.url or "<patch url>",
+                "size": len(patch)}))
+        else:
+            write(args.new, apply_patch(read(args.old), read(args.patch)))
+    except (OSError, ValueError, IndexError, struct.error) as error:
+        sys.exit("ota_delta: %s" % error)
+
+
+if __name__ == "__main__":
+    main()
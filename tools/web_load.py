@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""Load the device's web server and check it stays up with bounded memory.
+
+Requests go out open-loop at a fixed rate (a slow answer does not slow the
+sender down) from a pool of connections, the way a crowd of dashboards or
+a broken integration would. The device answers what it can and turns the
+rest away with 503/429 and Retry-After (WEB_MAX_CONCURRENT, WEB_RATE_LIMIT,
+WEB_SHED_FREE_HEAP in include/config.h).
+
+/api/metrics is read before and after the run: the lowest free heap since
+boot shows how far memory dropped under load, and uptime shows whether the
+device restarted. The after-read waits for the rate limit to refill first.
+
+A dashboard without EventSource polls every 10 s, so --rate 10 is ten
+dashboards at ten times that rate (test/test_web_load does this on the host).
+
+Usage:
+    python tools/web_load.py 192.168.1.50 [--rate 10] [--duration 60]
+        [--path /api/status] [--connections 16]
+"""
+
+import argparse
+import http.client
+import sys
+import threading
+import time
+from collections import Counter
+
+METRICS = (
+    "esp32_uptime_seconds",
+    "esp32_heap_free_bytes",
+    "esp32_heap_min_free_bytes",
+    "esp32_heap_min_largest_free_block_bytes",
+    "esp32_web_requests_accepted_total",
+    "esp32_web_requests_rejected_busy_total",
+    "esp32_web_requests_rejected_low_heap_total",
+    "esp32_web_requests_rejected_rate_limited_total",
+)
+
+
+def request(host, port, path, timeout):
+    """Status (or an error name), seconds taken and the Retry-After header."""
+    start = time.monotonic()
+    connection = http.client.HTTPConnection(host, port, timeout=timeout)
+    try:
+        connection.request("GET", path)
+        response = connection.getresponse()
+        response.read()
+        return response.status, time.monotonic() - start, response.getheader("Retry-After")
+    except (OSError, http.client.HTTPException) as error:
+        return type(error).__name__, time.monotonic() - start, None
+    finally:
+        connection.close()
+
+
+def read_metrics(host, port, timeout):
+    status = None
+    for _ in range(10):
+        connection = http.client.HTTPConnection(host, port, timeout=timeout)
+        try:
+            connection.request("GET", "/api/metrics")
+            response = connection.getresponse()
+            text = response.read().decode()
+            status = response.status
+            if status == 200:
+                break
+            time.sleep(float(response.getheader("Retry-After") or 1))
+        finally:
+            connection.close()
+    if status != 200:
+        raise OSError("/api/metrics answered %s" % status)
+
+    values = {}
+    for line in text.splitlines():
+        if line and not line.startswith("#"):
+            name, _, value = line.rpartition(" ")
+            values[name] = float(value)
+    return values
+
+
+def percentile(values, fraction):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * fraction))]
+
+
+def run(args):
+    results = []
+    lock = threading.Lock()
+    next_slot = [0]
+    total = int(args.rate * args.duration)
+    start = time.monotonic() + 0.5
+
+    def worker():
+        while True:
+            with lock:
+                slot = next_slot[0]
+                next_slot[0] += 1
+            if slot >= total:
+                return
+            delay = start + slot / args.rate - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+            result = request(args.host, args.port, args.path, args.timeout)
+            with lock:
+                results.append(result)
+
+    threads = [threading.Thread(target=worker, daemon=True) for _ in range(args.connections)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    return results, time.monotonic() - start
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--path", default="/api/status")
+    parser.add_argument("--rate", type=float, default=10, help="requests per second")
+    parser.add_argument("--duration", type=float, default=60, help="seconds")
+    parser.add_argument("--connections", type=int, default=16, help="requests in flight at most")
+    parser.add_argument("--timeout", type=float, default=5, help="seconds per request")
+    parser.add_argument("--settle", type=float, default=3,
+                        help="seconds to wait before the final metrics read")
+    args = parser.parse_args()
+
+    try:
+        before = read_metrics(args.host, args.port, args.timeout)
+    except (OSError, http.client.HTTPException) as error:
+        sys.exit("web_load: cannot read metrics: %s" % error)
+
+    print("%.0f req/s to %s for %.0f s over %d connections" % (
+        args.rate, args.path, args.duration, args.connections))
+    results, elapsed = run(args)
+
+    statuses = Counter(status for status, _, _ in results)
+    print("\n%d requests in %.1f s (%.1f req/s)" % (len(results), elapsed, len(results) / elapsed))
+    for status, count in sorted(statuses.items(), key=lambda item: str(item[0])):
+        latencies = [latency for s, latency, _ in results if s == status]
+        retry = Counter(r for s, _, r in results if s == status and r is not None)
+        print("  %-16s %6d  p50 %6.0f ms  p99 %6.0f ms  max %6.0f ms%s" % (
+            status, count,
+            percentile(latencies, 0.5) * 1000, percentile(latencies, 0.99) * 1000,
+            max(latencies) * 1000,
+            "  Retry-After %s" % ",".join(sorted(retry)) if retry else ""))
+
+    time.sleep(args.settle)
+    try:
+        after = read_metrics(args.host, args.port, args.timeout)
+    except (OSError, http.client.HTTPException) as error:
+        sys.exit("web_load: device did not answer after the run: %s" % error)
+
+    print("\n  %-50s %10s %10s" % ("device", "before", "after"))
+    for name in METRICS:
+        print("  %-50s %10.0f %10.0f" % (name, before.get(name, 0), after.get(name, 0)))
+
+    restarted = after.get("esp32_uptime_seconds", 0) < before.get("esp32_uptime_seconds", 0)
+    errors = sum(count for status, count in statuses.items() if not isinstance(status, int))
+    print("\n%s, %d connection errors, lowest free heap %.0f bytes" % (
+        "RESTARTED" if restarted else "no restart", errors,
+        after.get("esp32_heap_min_free_bytes", 0)))
+    if restarted:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()